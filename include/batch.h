@@ -0,0 +1,67 @@
+/**
+ * batch.h - Batch render class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines batched rendering of many small images into one
+ * contiguous output arena, by a pool of threads kept between batches.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "scene.h"
+
+/* Render job */
+typedef struct {
+   scene_t *scene;    /* Scene to render */
+   int      width;    /* Width of rendered image */
+   int      height;   /* Height of rendered image */
+   size_t   offset;   /* Offset of the image in the output arena */
+} batch_job_t;
+
+/* Most threads of the worker pool rendering batches */
+#define BATCH_MAX_THREADS 64
+
+/* Batch of render jobs */
+typedef struct {
+   batch_job_t *job;      /* Jobs */
+   int          num;      /* Number of jobs */
+   int          max;      /* Number of allocated jobs */
+   size_t       size;     /* Size of all images, i.e. of the arena */
+   uint32_t     next;     /* Next job to claim, atomic counter */
+   int          failed;   /* Non-zero if a job failed to render */
+   uint8_t     *arena;    /* Rendered images, in job order */
+} batch_t;
+
+void batch_init (batch_t *batch);
+int batch_add (batch_t *batch, scene_t *scene, int width, int height);
+int batch_render (batch_t *batch, int num_threads);
+uint8_t* batch_get_image (batch_t *batch, int job);
+void batch_free (batch_t *batch);
+
+#endif /* __BATCH_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
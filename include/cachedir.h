@@ -0,0 +1,38 @@
+/**
+ * cachedir.h - Cache directory class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines the private cache directories, where files reused by
+ * later srt processes of the same user are kept.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __CACHEDIR_H__
+#define __CACHEDIR_H__
+
+#include <stdlib.h>
+
+int cachedir_get (const char *env, const char *name, char *dir, size_t dir_sz);
+
+#endif /* __CACHEDIR_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,50 @@
+/**
+ * composite.h - Depth compositing class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines sort-last rendering, where the spheres of a scene are
+ * split between processes and the rendered images are merged by depth.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __COMPOSITE_H__
+#define __COMPOSITE_H__
+
+#include <stdint.h>
+
+#include "scene.h"
+
+void composite_merge (uint8_t* dst,
+                      float* dst_depth,
+                      const uint8_t* src,
+                      const float* src_depth,
+                      size_t num_pixels);
+int composite_render (int num_parts,
+                      uint8_t* image,
+                      size_t image_sz,
+                      int screen_width,
+                      int screen_height,
+                      scene_t *scene);
+
+#endif /* __COMPOSITE_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,83 @@
+/**
+ * delta.h - Delta class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines scene deltas, a compact binary encoding of scene edits
+ * that is sent to a render server to update its scene incrementally.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __DELTA_H__
+#define __DELTA_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "edit.h"
+
+/* First bytes of a delta, "SRTD" */
+#define DELTA_MAGIC 0x53545244
+
+/* Largest delta accepted by a server, in bytes */
+#define DELTA_MAX_SIZE (16 << 20)
+
+/* Record operations
+ *
+ * A delta is the magic followed by records, each an operation byte and its
+ * arguments. Sphere records start with a 32-bit sphere ID. Positions are
+ * doubles, radius and field of view floats and colors one byte for each
+ * component. Values are stored in host format, like scene_pack() does.
+ */
+typedef enum {
+   DELTA_CAMERA_POS = 1,   /* x, y, z */
+   DELTA_CAMERA_FOV,       /* Field of view in radians */
+   DELTA_SPHERE_ADD,       /* ID, x, y, z, radius, r, g, b */
+   DELTA_SPHERE_CENTER,    /* ID, x, y, z */
+   DELTA_SPHERE_RADIUS,    /* ID, radius */
+   DELTA_SPHERE_COLOR,     /* ID, r, g, b */
+   DELTA_SPHERE_REMOVE     /* ID, the last sphere takes it over */
+} delta_op_t;
+
+/* Delta being encoded */
+typedef struct {
+   uint8_t *buf;   /* Encoded delta */
+   size_t   len;   /* Number of bytes in @buf */
+   size_t   max;   /* Number of allocated bytes */
+} delta_t;
+
+void delta_init (delta_t *delta);
+void delta_free (delta_t *delta);
+int delta_camera_pos (delta_t *delta, double x, double y, double z);
+int delta_camera_fov (delta_t *delta, double fov);
+int delta_sphere_add (delta_t *delta, int id, double x, double y, double z,
+                      double radius, int r, int g, int b);
+int delta_sphere_center (delta_t *delta, int id, double x, double y, double z);
+int delta_sphere_radius (delta_t *delta, int id, double radius);
+int delta_sphere_color (delta_t *delta, int id, int r, int g, int b);
+int delta_sphere_remove (delta_t *delta, int id);
+int delta_encode (delta_t *delta, edit_txn_t *txn);
+int delta_apply (const uint8_t *buf, size_t len, edit_txn_t *txn);
+int delta_send (const char *addr, delta_t *delta, unsigned long *version);
+
+#endif /* __DELTA_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,50 @@
+/**
+ * dist.h - Distributed render class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines distributed rendering, where a master process hands
+ * out tiles of the screen to worker processes over sockets.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __DIST_H__
+#define __DIST_H__
+
+#include <stdint.h>
+
+#include "scene.h"
+
+/* Width and height of a tile handed out to a worker */
+#define DIST_TILE_SIZE 32
+
+int dist_master (const char *addr,
+                 int num_workers,
+                 uint8_t* image,
+                 size_t image_sz,
+                 int screen_width,
+                 int screen_height,
+                 scene_t *scene);
+int dist_worker (const char *addr);
+
+#endif /* __DIST_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
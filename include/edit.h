@@ -0,0 +1,85 @@
+/**
+ * edit.h - Edit class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines scene edit transactions. Edits are recorded in a log
+ * and applied to the scene all at once when the transaction is committed.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifndef __EDIT_H__
+#define __EDIT_H__
+
+#include <stdint.h>
+
+#include "scene.h"
+
+/* Edit operations */
+typedef enum {
+   EDIT_CAMERA_POS,      /* Camera world position, v[0..2] */
+   EDIT_CAMERA_FOV,      /* Camera field of view in radians, v[0] */
+   EDIT_SPHERE_CENTER,   /* Sphere world position, v[0..2] */
+   EDIT_SPHERE_RADIUS,   /* Sphere radius, v[0] */
+   EDIT_SPHERE_COLOR,    /* Sphere color, v[0..2] */
+   EDIT_SPHERE_REMOVE    /* Sphere removal, the last sphere takes its ID */
+} edit_op_t;
+
+/* Logged edit */
+typedef struct {
+   edit_op_t op;     /* Operation */
+   int       id;     /* Sphere ID, -1 for camera edits */
+   double    v[3];   /* Values, see edit_op_t */
+} edit_t;
+
+/* Edit transaction */
+typedef struct {
+   scene_t  *scene;        /* Edited scene, NULL when not begun */
+   edit_t   *log;          /* Logged edits, in order */
+   int       num;          /* Number of logged edits */
+   int       max;          /* Number of allocated edits */
+   int       max_added;    /* Most spheres the commit may add, negative
+                            * for any number */
+   int       cam_dirty;    /* Non-zero if the last commit moved the camera
+                            * or changed the field of view */
+   int      *dirty;        /* IDs of the spheres changed by the last commit,
+                            * in increasing order */
+   int       num_dirty;    /* Number of IDs in @dirty */
+} edit_txn_t;
+
+void edit_init (edit_txn_t *txn);
+int edit_begin (edit_txn_t *txn, scene_t *scene);
+int edit_active (edit_txn_t *txn);
+int edit_check (edit_op_t op, double a, double b, double c);
+int edit_camera_pos (edit_txn_t *txn, double x, double y, double z);
+int edit_camera_fov (edit_txn_t *txn, double fov);
+int edit_sphere_center (edit_txn_t *txn, int id, double x, double y, double z);
+int edit_sphere_radius (edit_txn_t *txn, int id, double radius);
+int edit_sphere_color (edit_txn_t *txn, int id, int r, int g, int b);
+int edit_sphere_remove (edit_txn_t *txn, int id);
+int edit_commit (edit_txn_t *txn);
+void edit_abort (edit_txn_t *txn);
+void edit_free (edit_txn_t *txn);
+
+#endif /* __EDIT_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,80 @@
+/**
+ * fixed.h - Fixed point class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines a fixed point rendering backend, for targets where
+ * floating point is slow or emulated.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __FIXED_H__
+#define __FIXED_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "scene.h"
+#include "precision.h"
+
+/*
+ * Coordinates are stored as signed 32-bit Qm.n numbers, relative to the
+ * camera, and products are kept in 64 bits. The number of fractional bits n
+ * is picked for each frame by fixed_range(), as many as the scene bounds
+ * allow within FIXED_MIN_FRAC and FIXED_MAX_FRAC. Define FIXED_FRAC to use a
+ * fixed Q format instead.
+ */
+#ifndef FIXED_MIN_FRAC
+#define FIXED_MIN_FRAC 8
+#endif
+#ifndef FIXED_MAX_FRAC
+#define FIXED_MAX_FRAC 24
+#endif
+
+/* Fractional bits of the normalized ray direction, whose components are at
+ * most one. The direction is generated with two bits less, and the sum of
+ * its squares must fit in 63 bits, so fixed_render() only supports a field
+ * of view where tan² x + tan² y + 1 is below FIXED_MAX_TAN2, e.g. up to
+ * about 82 degrees for a square image */
+#define FIXED_DIR_FRAC 30
+#define FIXED_MAX_TAN2 ((double)((int64_t)1 << (63 - 2 * (FIXED_DIR_FRAC - 2))))
+
+/* Coordinates must stay below 2^FIXED_RANGE_BITS in fixed point, leaving
+ * room for sums of three squares in 64 bits */
+#define FIXED_RANGE_BITS 30
+
+/* Largest error of a pixel, in pixels, allowed for fixed_check() to pass,
+ * see precision_compare() */
+#define FIXED_MAX_SHIFT 1
+
+typedef int32_t fixed_t;
+
+int fixed_range (scene_t *scene);
+int fixed_render (uint8_t* image,
+                  size_t image_sz,
+                  int screen_width,
+                  int screen_height,
+                  scene_t *scene);
+int fixed_check (int width, int height, scene_t *scene, precision_err_t *err);
+
+#endif /* __FIXED_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,64 @@
+/**
+ * http.h - HTTP class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines a minimal HTTP/1.1 server side, enough to serve
+ * rendered images to a local viewer.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __HTTP_H__
+#define __HTTP_H__
+
+#include <stdlib.h>
+
+/* Size of the connection receive buffer, also the longest request head */
+#define HTTP_BUF_SIZE 4096
+
+/* Connection */
+typedef struct {
+   int    fd;                    /* Socket */
+   char   buf[HTTP_BUF_SIZE];    /* Received data not yet consumed */
+   size_t len;                   /* Number of bytes in @buf */
+} http_conn_t;
+
+/* Request */
+typedef struct {
+   char   method[8];        /* Request method, e.g. "GET" */
+   char   path[256];        /* Request path */
+   size_t content_length;   /* Length of the request body */
+   int    keep_alive;       /* Non-zero if the connection should be kept */
+} http_req_t;
+
+void http_init (http_conn_t *conn, int fd);
+int http_read_request (http_conn_t *conn, http_req_t *req);
+int http_read_body (http_conn_t *conn, void *buf, size_t len);
+int http_respond (http_conn_t *conn,
+                  int status,
+                  const char *type,
+                  const void *body,
+                  size_t len,
+                  int keep_alive);
+
+#endif /* __HTTP_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
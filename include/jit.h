@@ -0,0 +1,56 @@
+/**
+ * jit.h - JIT class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines rendering with a kernel specialised for the scene,
+ * compiled at runtime by the system C compiler.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "scene.h"
+
+/* Compiler used when CC isn't set in the environment */
+#define JIT_CC "cc"
+
+/* Environment variable selecting the kernel cache directory, the default
+ * is /tmp/srt-jit-<UID>, see cachedir_get() */
+#define JIT_DIR_ENV "SRT_JIT_DIR"
+
+/* Largest scene rendered by a generated kernel, which tests every sphere
+ * for every pixel, above it the culling of render_scene() is faster */
+#define JIT_MAX_SPHERES 8
+
+int jit_render (uint8_t* image,
+                size_t image_sz,
+                int screen_width,
+                int screen_height,
+                scene_t *scene);
+
+#endif /* __JIT_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,86 @@
+/**
+ * jobsched.h - Job scheduler class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines a pool of render threads shared by render jobs of
+ * different priority classes, which are scheduled one tile at a time.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __JOBSCHED_H__
+#define __JOBSCHED_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "scene.h"
+
+/* Width and height of a scheduled tile, a job can only be preempted
+ * between its tiles */
+#define JOBSCHED_TILE 64
+
+/* Most render threads */
+#define JOBSCHED_MAX_THREADS 256
+
+/* Priority classes, in order of priority */
+typedef enum {
+   JOBSCHED_INTERACTIVE,   /* E.g. previews, a user is waiting */
+   JOBSCHED_NORMAL,        /* Default */
+   JOBSCHED_BATCH,         /* E.g. posters, nobody is waiting */
+   JOBSCHED_CLASSES        /* Number of classes */
+} jobsched_class_t;
+
+/* Default share weight of each class */
+#define JOBSCHED_WEIGHTS { 16, 4, 1 }
+
+/* Statistics of a class */
+typedef struct {
+   unsigned long jobs;     /* Finished jobs */
+   unsigned long tiles;    /* Rendered tiles */
+   unsigned long missed;   /* Jobs finished after their deadline */
+   double        wait;     /* Sum of the times from submit to first tile */
+   double        time;     /* Sum of the times from submit to finish */
+   int           queued;   /* Jobs not finished */
+   int           weight;   /* Share weight */
+} jobsched_stats_t;
+
+int jobsched_start (int num_threads);
+int jobsched_get_threads (void);
+jobsched_class_t jobsched_class (const char *name);
+const char* jobsched_class_name (jobsched_class_t cls);
+int jobsched_set_weight (jobsched_class_t cls, int weight);
+int jobsched_render (uint8_t* image,
+                     size_t image_sz,
+                     int screen_width,
+                     int screen_height,
+                     int x0,
+                     int y0,
+                     int x1,
+                     int y1,
+                     scene_t *scene,
+                     jobsched_class_t cls,
+                     double deadline);
+void jobsched_get_stats (jobsched_class_t cls, jobsched_stats_t *stats);
+
+#endif /* __JOBSCHED_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,182 @@
+/**
+ * kernel.h - Kernel class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines the render kernels. A kernel is compiled for each
+ * combination of pixel format, SIMD width, accelerator and statistics, and
+ * for each small sphere count, and is picked once per render.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __KERNEL_H__
+#define __KERNEL_H__
+
+#include <stdint.h>
+
+#include "scene.h"
+#include "precision.h"
+#include "span.h"
+
+/* Largest number of spheres with a kernel specialised for the count */
+#define KERNEL_MAX_SPHERES 16
+
+/* Extra pixels around the screen bounds of a sphere, covering rounding */
+#define KERNEL_CULL_MARGIN 2
+
+/* Largest number of spheres in a leaf of the sphere tree used to splat
+ * clusters of spheres, see kernel_init_splats() */
+#define KERNEL_LEAF_SPHERES 4
+
+/* Output pixel formats */
+typedef enum {
+   KERNEL_FMT_RGB24,    /* Red, green and blue bytes, as the rendered image */
+   KERNEL_FMT_RGBA32,   /* As RGB24 followed by alpha, zero where no sphere
+                         * was hit */
+   KERNEL_FMT_NUM
+} kernel_fmt_t;
+
+/* SIMD widths, i.e. number of pixels traced together */
+typedef enum {
+   KERNEL_SIMD_1,
+   KERNEL_SIMD_4,
+   KERNEL_SIMD_NUM
+} kernel_simd_t;
+
+/* Accelerators */
+typedef enum {
+   KERNEL_ACCEL_NONE,   /* Test every sphere for every pixel */
+   KERNEL_ACCEL_CULL,   /* Test only the spheres whose screen bounds overlap
+                         * the rendered rectangle */
+   KERNEL_ACCEL_NUM
+} kernel_accel_t;
+
+/* Render statistics */
+typedef struct {
+   uint64_t rays;    /* Number of traced rays */
+   uint64_t tests;   /* Number of ray-sphere intersection tests */
+   uint64_t hits;    /* Number of rays hitting a sphere */
+} kernel_stats_t;
+
+/* Constants of a sphere, the parts of sphere_intersect() which don't depend
+ * on the ray */
+typedef struct {
+   float ox, oy, oz;   /* O-E vector */
+   float k;            /* r² - c² */
+} kernel_sphere_t;
+
+/* Sphere, or cluster of spheres, splatted instead of traced, see
+ * kernel_init_splats() */
+typedef struct {
+   int     x, y;       /* Pixel at or left of and below the center */
+   float   fx, fy;     /* Offset of the center from that pixel, 0 to 1 */
+   float   dist;       /* Distance from the camera to the sphere */
+   float   cov;        /* Coverage of a pixel by the projected sphere */
+   uint8_t color[3];   /* Red, green and blue component */
+} kernel_splat_t;
+
+typedef struct kernel_ctx kernel_ctx_t;
+
+/* Render kernel, renders pixels (@x0, @y0) up to (@x1, @y1) to @tile and,
+ * if not NULL, @depth, which have @stride pixels per row */
+typedef void (*kernel_t)(kernel_ctx_t *ctx,
+                         uint8_t* tile,
+                         float* depth,
+                         int stride,
+                         int x0,
+                         int y0,
+                         int x1,
+                         int y1);
+
+/* Render context, setup once per render by kernel_init() */
+struct kernel_ctx {
+   scene_t         *scene;           /* Rendered scene */
+   int              screen_width;    /* Width of the whole rendered screen */
+   int              screen_height;   /* Height of the whole rendered screen */
+   kernel_fmt_t     fmt;             /* Pixel format */
+   precision_t      prec;            /* Precision tier */
+   double           tan_x;           /* Tangent of field of view, x-plane */
+   double           tan_y;           /* Tangent of field of view, y-plane */
+   float           *dir_x;           /* Ray direction x of each column, and
+                                      * of 3 more for the last SIMD lanes */
+   float           *dir_y;           /* Ray direction y of each row */
+   float           *row;             /* Part of v which is the same for the
+                                      * whole row, of each tested sphere, in
+                                      * the fast tiers, see kernel_v() */
+   kernel_sphere_t *sphere;          /* Constants of each sphere */
+   int             *bounds;          /* Screen bounds of each sphere, x0, y0,
+                                      * x1, y1, for KERNEL_ACCEL_CULL */
+   int             *list;            /* Spheres to test in the rectangle */
+   kernel_splat_t  *splat;           /* Splatted spheres, by row and column */
+   int             *splat_row;       /* Index of the first splat of each row
+                                      * from -1, and the end of the last */
+   int              num_splat;       /* Number of splats */
+   int             *trace;           /* Traced spheres if some are splatted,
+                                      * in increasing order */
+   int              num_trace;       /* Number of traced spheres */
+   kernel_stats_t   stats;           /* Statistics of this render */
+   kernel_t         kernel;          /* Selected kernel */
+};
+
+int kernel_bpp (kernel_fmt_t fmt);
+int kernel_init (kernel_ctx_t *ctx,
+                 scene_t *scene,
+                 int screen_width,
+                 int screen_height,
+                 kernel_fmt_t fmt);
+void kernel_done (kernel_ctx_t *ctx);
+int kernel_init_bounds (kernel_ctx_t *ctx);
+int kernel_init_splats (kernel_ctx_t *ctx);
+int kernel_splat (kernel_ctx_t *ctx,
+                  uint8_t* tile,
+                  const float* depth,
+                  int stride,
+                  int x0,
+                  int y0,
+                  int x1,
+                  int y1);
+int kernel_select (kernel_ctx_t *ctx, int x0, int y0, int x1, int y1,
+                   const int *from, int num, int *ids);
+int kernel_trace (kernel_ctx_t *ctx, int x, int y, const int *ids, int num,
+                  float *dist);
+void kernel_trace_row (kernel_ctx_t *ctx, const int *x, int n, int y,
+                       const int *ids, int num, int *id, float *dist);
+int kernel_spans (kernel_ctx_t *ctx,
+                  int y,
+                  int x0,
+                  int x1,
+                  const int *ids,
+                  int num,
+                  span_t *span,
+                  int n);
+
+int kernel_set_simd (int width);
+int kernel_get_simd (void);
+int kernel_set_accel (const char *name);
+const char* kernel_get_accel (void);
+int kernel_set_lod (float pixels);
+float kernel_get_lod (void);
+void kernel_set_stats (int on);
+int kernel_get_stats (kernel_stats_t *stats);
+
+#endif /* __KERNEL_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,83 @@
+/**
+ * library.h - Library class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines the scene library of the render server, which keeps
+ * the most recently used scenes of a directory loaded within a budget.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __LIBRARY_H__
+#define __LIBRARY_H__
+
+#include <stdlib.h>
+
+#include "scene.h"
+
+/* Longest scene name, including the terminating zero */
+#define LIBRARY_NAME_SIZE 64
+
+/* Default budget of the loaded scenes in bytes */
+#define LIBRARY_SIZE (256 << 20)
+
+/* Environment variable selecting the binary scene cache directory, the
+ * default is /tmp/srt-library-<UID>, see cachedir_get() */
+#define LIBRARY_DIR_ENV "SRT_LIBRARY_DIR"
+
+/* First bytes of a binary copy of a scene in the cache, "SRTL" */
+#define LIBRARY_CACHE_MAGIC 0x5354524c
+
+/* Loaded scene */
+typedef struct library_entry {
+   char          name[LIBRARY_NAME_SIZE];   /* Scene name */
+   unsigned long version;                   /* Unique for each load */
+   scene_t      *scene;                     /* Scene, NULL if failed */
+   size_t        size;                      /* Bytes used by @scene */
+   int           pending;                   /* Non-zero while being loaded */
+   int           cached;                    /* Non-zero while in the library */
+   int           refs;                      /* Number of users */
+   struct library_entry *prev;              /* LRU list, more recently used */
+   struct library_entry *next;              /* LRU list, less recently used */
+} library_entry_t;
+
+/* Library statistics */
+typedef struct {
+   unsigned long hits;          /* Requests for a loaded scene */
+   unsigned long misses;        /* Requests which had to load the scene */
+   unsigned long coalesced;     /* Requests which waited for another load */
+   unsigned long evictions;     /* Scenes dropped to stay within the budget */
+   unsigned long xml_loads;     /* Misses loaded from XML */
+   unsigned long cache_loads;   /* Misses loaded from the binary cache */
+   size_t bytes;                /* Bytes used by loaded scenes */
+   size_t max_bytes;            /* Library budget */
+   int entries;                 /* Number of loaded scenes */
+} library_stats_t;
+
+int library_init (const char *dir, size_t max_bytes);
+int library_enabled (void);
+library_entry_t* library_get (const char *name);
+void library_release (library_entry_t *entry);
+void library_get_stats (library_stats_t *stats);
+
+#endif /* __LIBRARY_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,60 @@
+/**
+ * loadgen.h - Load generator class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines a load generator, which requests tiles from a render
+ * server over many connections at a fixed rate and reports the latency.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __LOADGEN_H__
+#define __LOADGEN_H__
+
+/* Defaults */
+#define LOADGEN_CONNECTIONS 16      /* Number of client connections */
+#define LOADGEN_RATE        100.0   /* Requests per second, all connections */
+#define LOADGEN_DURATION    10.0    /* Seconds */
+
+/* Histogram precision, each power of two of microseconds is split into
+ * 2^LOADGEN_SUB_BITS buckets, i.e. values are kept within 1% */
+#define LOADGEN_SUB_BITS    7
+
+/* Number of powers of two covered by the histogram, up to about 19 hours */
+#define LOADGEN_MAGS        30
+
+/* Load generator setup */
+typedef struct {
+   const char *addr;        /* Server address, see net_connect() */
+   int         conns;       /* Number of client connections */
+   double      rate;        /* Requests per second, all connections */
+   double      duration;    /* Seconds to generate load */
+   const char *mix;         /* Request mix file, NULL for one full HD tile
+                             * of the main scene at a time */
+   const char *hdr;         /* File to dump the histogram to, NULL for none */
+} loadgen_conf_t;
+
+void loadgen_init (loadgen_conf_t *conf, const char *addr);
+int loadgen_run (loadgen_conf_t *conf);
+
+#endif /* __LOADGEN_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
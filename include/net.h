@@ -0,0 +1,52 @@
+/**
+ * net.h - Network class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines socket helpers and the message framing used when
+ * processes talk to each other over TCP or Unix sockets.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __NET_H__
+#define __NET_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Message header, sent in front of every message payload */
+typedef struct {
+   uint32_t type;   /* Message type, see the users of this class */
+   uint32_t len;    /* Length of the payload following the header */
+} net_msg_t;
+
+int net_listen (const char *addr);
+int net_accept (int fd);
+int net_connect (const char *addr);
+void net_close (int fd, const char *addr);
+int net_write (int fd, const void *buf, size_t len);
+int net_read (int fd, void *buf, size_t len);
+int net_send_msg (int fd, uint32_t type, const void *buf, size_t len);
+int net_recv_msg (int fd, net_msg_t *msg, void **buf, size_t *len, size_t max);
+
+#endif /* __NET_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -28,6 +28,7 @@
 
 int output_render_setup (int (*cb)());
 int output_render (void);
+int output_render_image (uint8_t* img, int width, int height);
 uint8_t* output_get_image (void);
 size_t output_get_image_size (void);
 int output_get_image_width (void);
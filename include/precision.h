@@ -0,0 +1,145 @@
+/**
+ * precision.h - Precision class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines the numeric precision tiers of the ray kernels.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __PRECISION_H__
+#define __PRECISION_H__
+
+#include <stdint.h>
+#include <math.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+/* Precision tiers */
+typedef enum {
+   PRECISION_EXACT,     /* IEEE float, correctly rounded sqrt and divides */
+   PRECISION_FAST,      /* Reciprocal square root with one Newton step */
+   PRECISION_FASTEST,   /* Reciprocal square root estimate only */
+   PRECISION_NUM
+} precision_t;
+
+/* Largest error of a pixel, in pixels, for a tier to pass
+ * render_check_precision(), see precision_compare(). The tiers only differ
+ * from the exact one by rounding, which may move an edge by a pixel. */
+#define PRECISION_FAST_MAX_SHIFT    1
+#define PRECISION_FASTEST_MAX_SHIFT 1
+
+/* Farthest distance, in pixels, searched by precision_compare() */
+#define PRECISION_SEARCH 8
+
+/* Result of precision_compare() */
+typedef struct {
+   long  num_diff;    /* Number of pixels differing from the reference */
+   float pct_diff;    /* Part of the pixels differing, in percent */
+   int   max_err;     /* Largest difference of a color component */
+   int   max_shift;   /* Largest error of a pixel, in pixels, or
+                       * PRECISION_SEARCH + 1 if larger than searched */
+   float max_depth;   /* Largest relative depth error where both images hit
+                       * the same sphere */
+} precision_err_t;
+
+/*
+ * Building with e.g. -D PRECISION=PRECISION_FAST fixes the tier at compile
+ * time, the compiler can then drop the code of the other tiers.
+ */
+#ifdef PRECISION
+#define precision_get() (PRECISION)
+#else
+precision_t precision_get (void);
+#endif
+int precision_set (precision_t p);
+const char* precision_name (precision_t p);
+int precision_parse (const char *name, precision_t *p);
+void precision_compare (const uint8_t *ref,
+                        const uint8_t *image,
+                        const float *ref_depth,
+                        const float *depth,
+                        int width,
+                        int height,
+                        precision_err_t *err);
+
+/**
+ * precision_rsqrt - Calculate a reciprocal square root.
+ * @x: Value, greater than zero.
+ * @p: Precision tier.
+ *
+ * The fast tiers start from the reciprocal square root estimate of the CPU,
+ * with a relative error below 0.04%, which one Newton step brings down to
+ * about float precision. Without SSE the estimate is taken from the float
+ * bit pattern instead, and is refined by one more Newton step in each tier
+ * to keep the error at the same level.
+ *
+ * Returns:
+ * 1 / sqrt(@x).
+ */
+static inline __attribute__ ((always_inline))
+float precision_rsqrt (float x, precision_t p)
+{
+   float y;
+
+   if (p == PRECISION_EXACT)
+      return 1.0f / sqrtf (x);
+
+#ifdef __SSE__
+   y = _mm_cvtss_f32 (_mm_rsqrt_ss (_mm_set_ss (x)));
+#else
+   {
+      union { float f; uint32_t i; } u;
+
+      u.f = x;
+      u.i = 0x5f3759df - (u.i >> 1);
+      y   = u.f;
+      y   = y * (1.5f - 0.5f * x * y * y);
+   }
+#endif
+
+   if (p == PRECISION_FAST)
+      y = y * (1.5f - 0.5f * x * y * y);
+
+   return y;
+}
+
+/**
+ * precision_sqrt - Calculate a square root.
+ * @x: Value, zero or greater.
+ * @p: Precision tier.
+ *
+ * Returns:
+ * sqrt(@x).
+ */
+static inline __attribute__ ((always_inline))
+float precision_sqrt (float x, precision_t p)
+{
+   if (p == PRECISION_EXACT)
+      return sqrtf (x);
+
+   return x * precision_rsqrt (x, p);
+}
+
+#endif /* __PRECISION_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
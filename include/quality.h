@@ -0,0 +1,72 @@
+/**
+ * quality.h - Image quality class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines image quality metrics, comparing a rendered image with
+ * a reference, and a benchmark of the render modes reporting their quality
+ * next to their speed.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __QUALITY_H__
+#define __QUALITY_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "scene.h"
+
+/* SSIM is computed on the luma of windows of QUALITY_SSIM_WINDOW x
+ * QUALITY_SSIM_WINDOW pixels, QUALITY_SSIM_STEP pixels apart */
+#define QUALITY_SSIM_WINDOW 8
+#define QUALITY_SSIM_STEP   4
+
+/* Most threads comparing an image */
+#define QUALITY_MAX_THREADS 64
+
+/* Number of times each mode is rendered by quality_bench(), the fastest
+ * time is reported */
+#define QUALITY_RUNS 3
+
+/* Image quality, compared with a reference */
+typedef struct {
+   double mse;        /* Mean squared error of the color components */
+   double psnr;       /* Peak signal to noise ratio in dB, INFINITY if equal */
+   double ssim;       /* Mean structural similarity of the luma, 1 if equal */
+   long   num_diff;   /* Number of differing pixels */
+   int    max_err;    /* Largest color component error */
+} quality_t;
+
+int quality_compare (const uint8_t* ref,
+                     const uint8_t* image,
+                     int width,
+                     int height,
+                     uint8_t* map,
+                     quality_t* q);
+int quality_compare_files (const char* ref, const char* image, const char* map,
+                           quality_t* q);
+int quality_bench (int width, int height, scene_t* scene, int runs,
+                   const char* map_prefix);
+
+#endif /* __QUALITY_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
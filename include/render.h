@@ -26,12 +26,72 @@
 #include <stdint.h>
 
 #include "scene.h"
+#include "precision.h"
+#include "kernel.h"
 
 int render_scene (uint8_t* image,
                   size_t image_sz,
                   int screen_width,
                   int screen_height,
                   scene_t *scene);
+int render_region (uint8_t* image,
+                   size_t image_sz,
+                   int screen_width,
+                   int screen_height,
+                   int x0,
+                   int y0,
+                   int x1,
+                   int y1,
+                   scene_t *scene);
+int render_vrs (uint8_t* image,
+                size_t image_sz,
+                int screen_width,
+                int screen_height,
+                const uint8_t* rate,
+                scene_t *scene,
+                long* rays);
+int render_depth (uint8_t* image,
+                  size_t image_sz,
+                  float* depth,
+                  int screen_width,
+                  int screen_height,
+                  scene_t *scene);
+int render_tile (uint8_t* tile,
+                 size_t tile_sz,
+                 int screen_width,
+                 int screen_height,
+                 int x0,
+                 int y0,
+                 int x1,
+                 int y1,
+                 scene_t *scene);
+int render_tile_fmt (uint8_t* tile,
+                     size_t tile_sz,
+                     kernel_fmt_t fmt,
+                     int screen_width,
+                     int screen_height,
+                     int x0,
+                     int y0,
+                     int x1,
+                     int y1,
+                     scene_t *scene);
+int render_init (kernel_ctx_t *ctx,
+                 scene_t *scene,
+                 int screen_width,
+                 int screen_height,
+                 kernel_fmt_t fmt);
+int render_tile_ctx (kernel_ctx_t *ctx,
+                     uint8_t* tile,
+                     size_t tile_sz,
+                     int x0,
+                     int y0,
+                     int x1,
+                     int y1);
+int render_check_precision (precision_t p,
+                            int width,
+                            int height,
+                            scene_t *scene,
+                            precision_err_t* err);
 
 #endif /* __RENDER_H__ */
 
@@ -23,23 +23,59 @@
 #ifndef __SCENE_H__
 #define __SCENE_H__
 
+#include <stdint.h>
+#include <stdlib.h>
+
 #include "camera.h"
 #include "sphere.h"
 
-/* Number of spheres in scene */
+/* First bytes of a binary scene file, "SRTS" */
+#define SCENE_FILE_MAGIC 0x53545253
+
+/* Format of a binary scene file, bumped when scene_pack() changes */
+#define SCENE_FILE_VERSION 2
+
+/* Default number of spheres in scene */
 #define NUM_SPHERES 3
 
-/* Scene object */
+/* Scene object
+ *
+ * Positions are stored in double precision world coordinates. The camera
+ * and sphere objects used when rendering hold float coordinates relative to
+ * the camera, i.e. the camera is always at the origin, which keeps them
+ * accurate far away from the world origin. Positions must therefore be set
+ * with scene_set_camera_pos() and scene_set_sphere_center().
+ */
 typedef struct {
-   camera_t cam;                  /* Camera object */
-   sphere_t sphere[NUM_SPHERES];  /* Sphere objects */
+   camera_t   cam;           /* Camera object */
+   int        num_spheres;   /* Number of sphere objects */
+   int        max_spheres;   /* Number of allocated sphere objects */
+   sphere_t  *sphere;        /* Sphere objects */
+   dvector_t  origin;        /* World position of the camera */
+   dvector_t *center;        /* World position of each sphere */
+   unsigned long version;    /* Bumped by each committed edit transaction */
 }  scene_t;
 
 void scene_init (void);
+scene_t* scene_new (void);
+void scene_free (scene_t* scene);
 scene_t* scene_get_scene (void);
 camera_t* scene_get_camera (scene_t* scene);
 sphere_t* scene_get_sphere (scene_t* scene);
-int scene_get_num_spheres (void);
+int scene_get_num_spheres (scene_t* scene);
+int scene_set_num_spheres (scene_t* scene, int num);
+void scene_remove_sphere (scene_t* scene, int id);
+void scene_get_camera_pos (scene_t* scene, dvector_t* pos);
+void scene_set_camera_pos (scene_t* scene, double x, double y, double z);
+void scene_get_sphere_center (scene_t* scene, int id, dvector_t* center);
+void scene_set_sphere_center (scene_t* scene, int id, double x, double y, double z);
+unsigned long scene_get_version (scene_t* scene);
+void scene_touch (scene_t* scene);
+size_t scene_pack_size (scene_t* scene);
+int scene_pack (scene_t* scene, uint8_t* buf, size_t len);
+int scene_unpack (scene_t* scene, const uint8_t* buf, size_t len);
+int scene_save (scene_t* scene, const char* file);
+int scene_load (scene_t* scene, const char* file);
 
 #endif /* __SCENE_H__ */
 
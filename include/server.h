@@ -0,0 +1,52 @@
+/**
+ * server.h - Render server class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines the render server, which renders and serves image
+ * tiles on request over HTTP.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include <stdlib.h>
+
+/* Width and height of a served tile */
+#define SERVER_TILE_SIZE  256
+
+/* Largest full resolution width or height of a tiled image */
+#define SERVER_MAX_SIZE   (1 << 20)
+
+/* Largest width or height of an image rendered as a whole */
+#define SERVER_MAX_IMAGE  8192
+
+/* Default tile cache budget in bytes */
+#define SERVER_CACHE_SIZE (64 << 20)
+
+void server_set_updates (int on);
+int server_start (const char *addr, size_t cache_size);
+int server_wait (void);
+
+#endif /* __SERVER_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
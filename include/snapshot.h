@@ -0,0 +1,81 @@
+/**
+ * snapshot.h - Snapshot class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines immutable, versioned snapshots of the scene, which
+ * are rendered while the scene is edited.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <pthread.h>
+
+#include "scene.h"
+#include "edit.h"
+
+/* Number of spheres in a chunk, the unit shared between snapshots */
+#define SNAPSHOT_CHUNK 256
+
+/* Chunk of spheres, shared by all snapshots where they are unchanged */
+typedef struct {
+   int       refs;                      /* Number of snapshots using it */
+   sphere_t  sphere[SNAPSHOT_CHUNK];    /* Sphere objects, their centers are
+                                         * rebased by snapshot_get_scene() */
+   dvector_t center[SNAPSHOT_CHUNK];    /* World position of each sphere */
+} snapshot_chunk_t;
+
+/* Scene snapshot */
+typedef struct {
+   unsigned long      version;       /* Scene version, see scene_get_version() */
+   int                refs;          /* Number of pins, plus one while current */
+   camera_t           cam;           /* Camera object */
+   dvector_t          origin;        /* World position of the camera */
+   int                num_spheres;   /* Number of sphere objects */
+   int                num_chunks;    /* Number of chunks */
+   snapshot_chunk_t **chunk;         /* Chunks holding the spheres */
+   pthread_mutex_t    lock;          /* Protects @scene */
+   scene_t           *scene;         /* The snapshot as a scene, built on
+                                      * first use */
+} snapshot_t;
+
+/* Snapshot statistics */
+typedef struct {
+   unsigned long version;   /* Version of the current snapshot */
+   int snapshots;           /* Number of live snapshots */
+   int chunks;              /* Number of live chunks */
+   long copied;             /* Number of chunks copied by publishes */
+   long shared;             /* Number of chunks shared by publishes */
+} snapshot_stats_t;
+
+int snapshot_publish (scene_t *scene, const int *dirty, int num_dirty);
+int snapshot_commit (edit_txn_t *txn);
+snapshot_t* snapshot_pin (void);
+scene_t* snapshot_get_scene (snapshot_t *snap);
+void snapshot_unpin (snapshot_t *snap);
+void snapshot_get_stats (snapshot_stats_t *stats);
+
+#endif /* __SNAPSHOT_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
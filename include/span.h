@@ -0,0 +1,94 @@
+/**
+ * span.h - Span class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines the span pipeline, which renders each row of the
+ * screen as runs of a single color and hands them to a sink, without ever
+ * holding the pixels of the image.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __SPAN_H__
+#define __SPAN_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "scene.h"
+
+/* Default number of spans of a span buffer for each row of the screen */
+#define SPAN_BUF_PER_ROW 64
+
+/* Run of pixels of a single color in a row */
+typedef struct {
+   int     x0;         /* First column */
+   int     x1;         /* Column after the last column */
+   uint8_t color[3];   /* Red, green and blue component */
+} span_t;
+
+/* Consumer of the rendered rows */
+typedef struct {
+   int   top_down;     /* Non-zero to get the top row first, else the bottom
+                        * row first as in the rendered image */
+   int (*row) (void *data, int y, const span_t *span, int num);
+                       /* Called with the @num spans covering row @y, in
+                        * order of column, returns non-zero on error */
+   void *data;         /* Passed to @row */
+} span_sink_t;
+
+/* Spans of a whole screen, in shared memory */
+typedef struct {
+   int       width;    /* Width of the screen */
+   int       height;   /* Height of the screen */
+   uint64_t  num;      /* Number of spans used, atomic counter */
+   uint64_t  max;      /* Number of spans allocated */
+   uint64_t *first;    /* Index of the first span of each row */
+   int      *count;    /* Number of spans of each row */
+   span_t   *span;     /* Spans */
+   size_t    map_sz;   /* Size of the shared mapping */
+} span_buf_t;
+
+/* Statistics of a span render */
+typedef struct {
+   uint64_t spans;     /* Number of spans */
+   uint64_t traced;    /* Number of traced pixels */
+   uint64_t bytes;     /* Number of bytes written by the sink */
+} span_stats_t;
+
+int span_render (int screen_width,
+                 int screen_height,
+                 scene_t *scene,
+                 span_sink_t *sink,
+                 span_stats_t *stats);
+int span_write (const char *fname,
+                int screen_width,
+                int screen_height,
+                scene_t *scene,
+                span_stats_t *stats);
+int span_buf_init (span_buf_t *buf, int width, int height, uint64_t max);
+void span_buf_free (span_buf_t *buf);
+void span_buf_sink (span_buf_t *buf, span_sink_t *sink);
+int span_buf_fill (span_buf_t *buf, uint8_t *image, size_t image_sz);
+
+#endif /* __SPAN_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
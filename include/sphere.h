@@ -35,6 +35,7 @@ typedef struct {
 } sphere_t;
 
 float sphere_intersect (sphere_t *sphere, ray_t *ray);
+float sphere_intersect_tier (sphere_t *sphere, ray_t *ray, precision_t p);
 
 #endif /* __SPHERE_H__ */
 
@@ -0,0 +1,63 @@
+/**
+ * png.h - PNG image class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * PNG image class.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __PNG_H__
+#define __PNG_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Size of the IDAT chunks written by png_stream_run() */
+#define PNG_STREAM_BUF 65536
+
+/* PNG image written to a file a run of pixels at a time */
+typedef struct {
+   FILE    *fp;                   /* File written to */
+   int      width;                /* Image width */
+   int      height;               /* Image height */
+   int      x;                    /* Column of the next pixel */
+   int      y;                    /* Number of finished rows */
+   uint8_t  prev[3];              /* Previous pixel of the row */
+   uint32_t adler;                /* Adler-32 of the raw image data */
+   uint32_t bits;                 /* Deflate bits not yet in @buf */
+   int      num_bits;             /* Number of bits in @bits */
+   size_t   len;                  /* Bytes in @buf */
+   size_t   size;                 /* Bytes written to @fp */
+   int      err;                  /* Non-zero if a write failed */
+   uint8_t  buf[PNG_STREAM_BUF];  /* Data of the next IDAT chunk */
+} png_stream_t;
+
+size_t png_size (int width, int height);
+int png_encode (uint8_t *buf, size_t len, int width, int height, const uint8_t *image);
+int png_stream_begin (png_stream_t *s, FILE *fp, int width, int height);
+int png_stream_run (png_stream_t *s, const uint8_t *rgb, int count);
+int png_stream_end (png_stream_t *s);
+
+#endif /* __PNG_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -23,7 +23,13 @@
 #ifndef __TGA_H__
 #define __TGA_H__
 
+#include <stdio.h>
+#include <stdint.h>
+
 int tga_write (const char *fname, int width, int height, uint8_t *image);
+int tga_read (const char *fname, int *width, int *height, uint8_t **image);
+int tga_rle_begin (FILE *fp, int width, int height);
+size_t tga_rle_run (FILE *fp, const uint8_t *rgb, int count);
 
 #endif /* __TGA_H__ */
 
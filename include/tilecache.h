@@ -0,0 +1,73 @@
+/**
+ * tilecache.h - Tile cache class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines a size bounded LRU cache of encoded images, shared by
+ * the server threads.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __TILECACHE_H__
+#define __TILECACHE_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Longest key, including the terminating zero */
+#define TILECACHE_KEY_SIZE 128
+
+/* Cached image */
+typedef struct tilecache_entry {
+   char      key[TILECACHE_KEY_SIZE];   /* Key */
+   uint32_t  hash;                      /* Hash of @key */
+   uint8_t  *data;                      /* Encoded image, NULL if failed */
+   size_t    len;                       /* Length of @data */
+   int       pending;                   /* Non-zero while being rendered */
+   int       cached;                    /* Non-zero while in the cache */
+   int       stale;                     /* Non-zero if flushed while pending */
+   int       refs;                      /* Number of users */
+   struct tilecache_entry *prev;        /* LRU list, more recently used */
+   struct tilecache_entry *next;        /* LRU list, less recently used */
+   struct tilecache_entry *chain;       /* Next entry in hash bucket */
+} tilecache_entry_t;
+
+/* Cache statistics */
+typedef struct {
+   unsigned long hits;        /* Requests served from the cache */
+   unsigned long misses;      /* Requests which had to be rendered */
+   unsigned long coalesced;   /* Requests which waited for another request */
+   unsigned long evictions;   /* Entries dropped to stay within the budget */
+   size_t bytes;              /* Bytes used by cached entries */
+   size_t max_bytes;          /* Cache budget */
+   int entries;               /* Number of cached entries */
+} tilecache_stats_t;
+
+void tilecache_init (size_t max_bytes);
+tilecache_entry_t* tilecache_get (const char *key, int *owner);
+void tilecache_fill (tilecache_entry_t *entry, uint8_t *data, size_t len);
+void tilecache_release (tilecache_entry_t *entry);
+void tilecache_flush (void);
+void tilecache_get_stats (tilecache_stats_t *stats);
+
+#endif /* __TILECACHE_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,62 @@
+/**
+ * tilesched.h - Tile scheduler class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines the tile scheduler, which records how long each part
+ * of the screen took to render and uses it to plan the tiles of the next
+ * frame.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __TILESCHED_H__
+#define __TILESCHED_H__
+
+/* Width and height of a cost cell, i.e. the smallest tile */
+#define TILESCHED_CELL     16
+
+/* Width and height of the largest tile */
+#define TILESCHED_TILE_MAX 64
+
+/* Number of tiles aimed for per worker, tiles predicted to be more
+ * expensive than the total cost divided by this and the number of
+ * workers are split */
+#define TILESCHED_TILES_PER_WORKER 16
+
+/* Planned tile */
+typedef struct {
+   int   x0, y0;   /* First column and row */
+   int   x1, y1;   /* Column and row after the last one */
+   float cost;     /* Predicted render time in seconds, or pixel count if
+                    * there is no history */
+} tilesched_tile_t;
+
+double tilesched_time (void);
+void tilesched_begin (int screen_width, int screen_height);
+void tilesched_record (int x0, int y0, int x1, int y1, double t);
+int tilesched_plan (int screen_width,
+                    int screen_height,
+                    int num_workers,
+                    tilesched_tile_t **tiles);
+
+#endif /* __TILESCHED_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -23,14 +23,22 @@
 #ifndef __VECTOR_H__
 #define __VECTOR_H__
 
+#include "precision.h"
+
 /* Vector class */
 typedef struct {
    float x, y, z;   /* Vertex's for the x, y, and z axis. */
 } vector_t;
 
+/* Vector class in double precision, used to store world coordinates */
+typedef struct {
+   double x, y, z;
+} dvector_t;
+
 void vector_sub (vector_t *vr, vector_t *v1, vector_t *v2);
 float vector_length (vector_t *v);
 void vector_normal (vector_t *v);
+void vector_normal_tier (vector_t *v, precision_t p);
 float vector_dot (vector_t *v1, vector_t *v2);
 
 #endif /* __VECTOR_H__ */
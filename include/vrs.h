@@ -0,0 +1,58 @@
+/**
+ * vrs.h - Variable rate class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines the rate maps used for variable rate rendering, see
+ * render_vrs().
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef __VRS_H__
+#define __VRS_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Width and height of a rate map cell */
+#define VRS_CELL 16
+
+/* Number of rate map columns and rows covering a screen */
+#define VRS_COLS(w) (((w) + VRS_CELL - 1) / VRS_CELL)
+#define VRS_ROWS(h) (((h) + VRS_CELL - 1) / VRS_CELL)
+
+/* Radius of the full rate area around the foveation centre, as part of the
+ * screen diagonal. Cells within twice the radius get rate 2, others 4 */
+#define VRS_FOVEA 0.125f
+
+/*
+ * A rate map holds one byte per cell, VRS_COLS() per row, starting with
+ * the lower left cell like the image. The value is the number of pixels per
+ * ray along each axis: 1, 2, 4, 8 or 16.
+ */
+
+uint8_t* vrs_alloc (int width, int height);
+void vrs_foveate (uint8_t* rate, int width, int height, int cx, int cy);
+void vrs_edges (uint8_t* rate, const uint8_t* image, int width, int height);
+
+#endif /* __VRS_H__ */
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -23,7 +23,11 @@
 #ifndef __XML_H__
 #define __XML_H__
 
+#include "scene.h"
+
+int xml_load (void);
 int xml_parse(char *doc);
+int xml_parse_scene (scene_t *scene, char *doc);
 
 #endif /* __XML_H__ */
 
@@ -0,0 +1,294 @@
+/**
+ * batch.c - Batch render class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines batched rendering of many small images into one
+ * contiguous output arena, by a pool of threads kept between batches.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "scene.h"
+#include "render.h"
+
+#include "batch.h"
+
+/* Worker pool, started by the first batch needing it and kept for the
+ * following batches */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  pool_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  pool_done = PTHREAD_COND_INITIALIZER;
+static int             pool_threads = 0;    /* Number of started threads */
+static unsigned long   pool_gen     = 0;    /* Bumped for each batch */
+static batch_t        *pool_batch   = NULL; /* Batch being rendered */
+static int             pool_want    = 0;    /* Threads rendering the batch */
+static int             pool_busy    = 0;    /* Threads not done with it */
+
+/* Serializes batch_render() calls, which share the pool */
+static pthread_mutex_t render_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * batch_init - Setup an empty batch.
+ * @batch: Pointer to batch.
+ *
+ * Returns:
+ * none.
+ */
+void batch_init (batch_t *batch)
+{
+   memset (batch, 0, sizeof(*batch));
+}
+
+/**
+ * batch_add - Add a render job.
+ * @batch:  Pointer to batch.
+ * @scene:  Pointer to scene to render, must be valid until rendered.
+ * @width:  Width of rendered image.
+ * @height: Height of rendered image.
+ *
+ * The image will be placed right after the image of the previous job in
+ * the output arena.
+ *
+ * Returns:
+ * Job number or -1 on error.
+ */
+int batch_add (batch_t *batch, scene_t *scene, int width, int height)
+{
+   batch_job_t *job;
+
+   if (width < 1 || height < 1)
+      return -1;
+
+   if (batch->num == batch->max)
+   {
+      int max = batch->max ? batch->max * 2 : 64;
+
+      job = realloc (batch->job, max * sizeof(*job));
+      if (!job)
+      {
+         fprintf (stderr, "error: Unable to alloc memory for render jobs\n");
+         return -1;
+      }
+      batch->job = job;
+      batch->max = max;
+   }
+
+   job = &batch->job[batch->num];
+   job->scene  = scene;
+   job->width  = width;
+   job->height = height;
+   job->offset = batch->size;
+   batch->size += (size_t)width * height * 3;
+
+   return batch->num++;
+}
+
+/**
+ * batch_work - Claim and render jobs until there are none left.
+ * @batch: Pointer to batch.
+ *
+ * Each job is a single task, i.e. the whole image is rendered by the
+ * thread claiming it, straight into the arena. The render is set up once
+ * for each scene and size, see render_init(), and kept for the following
+ * jobs claimed by the thread as long as they have the same scene and size.
+ *
+ * Returns:
+ * none.
+ */
+static void batch_work (batch_t *batch)
+{
+   const batch_job_t *cur = NULL;   /* Job the render was set up for */
+   kernel_ctx_t ctx;
+   uint32_t n;
+
+   while ((n = __atomic_fetch_add (&batch->next, 1, __ATOMIC_RELAXED)) < (uint32_t)batch->num)
+   {
+      const batch_job_t *job = &batch->job[n];
+
+      if (cur && (job->scene != cur->scene || job->width != cur->width ||
+                  job->height != cur->height))
+      {
+         kernel_done (&ctx);
+         cur = NULL;
+      }
+      if (!cur)
+      {
+         if (render_init (&ctx, job->scene, job->width, job->height,
+                          KERNEL_FMT_RGB24))
+            break;
+         cur = job;
+      }
+
+      if (render_tile_ctx (&ctx, batch->arena + job->offset,
+                           (size_t)job->width * job->height * 3,
+                           0, 0, job->width, job->height))
+         break;
+   }
+
+   if (n < (uint32_t)batch->num)
+      __atomic_store_n (&batch->failed, 1, __ATOMIC_RELAXED);
+   if (cur)
+      kernel_done (&ctx);
+}
+
+/**
+ * batch_thread - Thread of the worker pool.
+ * @arg: Index of the thread.
+ *
+ * Waits for a batch, see batch_render(), and renders jobs of it if it is
+ * one of the threads wanted for it.
+ *
+ * Returns:
+ * NULL.
+ */
+static void* batch_thread (void *arg)
+{
+   const int id = (int)(long)arg;
+   unsigned long gen = 0;
+
+   pthread_mutex_lock (&pool_lock);
+   while (1)
+   {
+      batch_t *batch;
+
+      while (pool_gen == gen)
+         pthread_cond_wait (&pool_work, &pool_lock);
+      gen = pool_gen;
+      if (id >= pool_want)
+         continue;
+
+      batch = pool_batch;
+      pthread_mutex_unlock (&pool_lock);
+      batch_work (batch);
+      pthread_mutex_lock (&pool_lock);
+
+      if (!--pool_busy)
+         pthread_cond_signal (&pool_done);
+   }
+
+   return NULL;
+}
+
+/**
+ * batch_render - Render all jobs of a batch.
+ * @batch:       Pointer to batch.
+ * @num_threads: Number of threads rendering the batch.
+ *
+ * This function will render all jobs into one contiguous arena. The
+ * calling thread and @num_threads - 1 threads of a worker pool, which is
+ * started once and kept for the following batches, claim whole jobs
+ * through an atomic counter. Each thread sets up a render once for each
+ * scene and size, so the per image cost is only the render itself: no per
+ * image setup, allocation, clearing of a full buffer, time recording or
+ * output call is done.
+ * The images are available through batch_get_image() until the batch is
+ * rendered again or freed.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int batch_render (batch_t *batch, int num_threads)
+{
+   uint8_t *arena;
+
+   arena = realloc (batch->arena, batch->size ? batch->size : 1);
+   if (!arena)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for the batch\n");
+      return 1;
+   }
+   batch->arena  = arena;
+   batch->next   = 0;
+   batch->failed = 0;
+
+   if (num_threads > batch->num)
+      num_threads = batch->num;
+   if (num_threads > BATCH_MAX_THREADS)
+      num_threads = BATCH_MAX_THREADS;
+
+   pthread_mutex_lock (&render_lock);
+   pthread_mutex_lock (&pool_lock);
+
+   /* Grow the pool to the number of threads needed besides this one */
+   while (pool_threads < num_threads - 1)
+   {
+      pthread_t thread;
+
+      if (pthread_create (&thread, NULL, batch_thread, (void*)(long)pool_threads))
+         break;
+      pthread_detach (thread);
+      pool_threads++;
+   }
+
+   pool_batch = batch;
+   pool_want  = num_threads - 1 < pool_threads ? num_threads - 1 : pool_threads;
+   pool_busy  = pool_want > 0 ? pool_want : 0;
+   pool_gen++;
+   pthread_cond_broadcast (&pool_work);
+   pthread_mutex_unlock (&pool_lock);
+
+   batch_work (batch);
+
+   pthread_mutex_lock (&pool_lock);
+   while (pool_busy)
+      pthread_cond_wait (&pool_done, &pool_lock);
+   pool_batch = NULL;
+   pthread_mutex_unlock (&pool_lock);
+   pthread_mutex_unlock (&render_lock);
+
+   return batch->failed;
+}
+
+/**
+ * batch_get_image - Get rendered image of a job.
+ * @batch: Pointer to batch.
+ * @job:   Job number returned by batch_add().
+ *
+ * Returns:
+ * Pointer to the image in the arena, or NULL if not rendered.
+ */
+uint8_t* batch_get_image (batch_t *batch, int job)
+{
+   if (!batch->arena || job < 0 || job >= batch->num)
+      return NULL;
+
+   return batch->arena + batch->job[job].offset;
+}
+
+/**
+ * batch_free - Free a batch.
+ * @batch: Pointer to batch.
+ *
+ * Returns:
+ * none.
+ */
+void batch_free (batch_t *batch)
+{
+   free (batch->arena);
+   free (batch->job);
+   batch_init (batch);
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
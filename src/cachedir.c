@@ -0,0 +1,128 @@
+/**
+ * cachedir.c - Cache directory class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines the private cache directories, where files reused by
+ * later srt processes of the same user are kept.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cachedir.h"
+
+/**
+ * cachedir_make - Create a private directory.
+ * @dir: Path of directory.
+ *
+ * The directory is created unless it exists, and is then checked with
+ * lstat(), so a symbolic link isn't followed. Only a directory owned by the
+ * user, without permissions for the group or others, is private. Others
+ * could otherwise replace the files, e.g. a kernel loaded by jit_render().
+ *
+ * Returns:
+ * POSIX OK (zero) if @dir is a private directory, or non-zero if not.
+ */
+static int cachedir_make (const char *dir)
+{
+   struct stat st;
+
+   if (mkdir (dir, 0700) && errno != EEXIST)
+      return 1;
+   if (lstat (dir, &st))
+      return 1;
+
+   return !S_ISDIR (st.st_mode) || st.st_uid != getuid () ||
+          (st.st_mode & (S_IRWXG | S_IRWXO));
+}
+
+/**
+ * cachedir_get - Find a private cache directory.
+ * @env:    Environment variable selecting the directory, or NULL.
+ * @name:   Name of the cache.
+ * @dir:    Buffer where to return the path of the directory.
+ * @dir_sz: Size of @dir.
+ *
+ * The directory is the one selected by @env, which must be private, see
+ * cachedir_make(). Otherwise it is /tmp/srt-<@name>-<UID>, shared by the
+ * processes of the user. If someone else created that path first, the
+ * directory is srt-<@name> in $XDG_CACHE_HOME or ~/.cache, and as a last
+ * resort a new directory made by mkdtemp() for this process only.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int cachedir_get (const char *env, const char *name, char *dir, size_t dir_sz)
+{
+   const char *path = env ? getenv (env) : NULL;
+   const char *xdg  = getenv ("XDG_CACHE_HOME");
+   const char *home = getenv ("HOME");
+   char base[PATH_MAX];
+   char tmp[PATH_MAX];
+
+   if (path)
+   {
+      if (snprintf (dir, dir_sz, "%s", path) >= (int)dir_sz || cachedir_make (dir))
+      {
+         fprintf (stderr, "error: %s is not a private directory of the user.\n", path);
+         return 1;
+      }
+      return 0;
+   }
+
+   snprintf (tmp, sizeof(tmp), "/tmp/srt-%s-%d", name, (int)getuid ());
+   if (!cachedir_make (tmp) && snprintf (dir, dir_sz, "%s", tmp) < (int)dir_sz)
+      return 0;
+
+   base[0] = '\0';
+   if (xdg && *xdg)
+      snprintf (base, sizeof(base), "%s", xdg);
+   else if (home && *home)
+      snprintf (base, sizeof(base), "%s/.cache", home);
+   if (base[0])
+   {
+      mkdir (base, 0700);
+      if (snprintf (dir, dir_sz, "%s/srt-%s", base, name) < (int)dir_sz &&
+          !cachedir_make (dir))
+      {
+         fprintf (stderr, "warning: %s is not private, using %s.\n", tmp, dir);
+         return 0;
+      }
+   }
+
+   if (snprintf (dir, dir_sz, "/tmp/srt-%s-XXXXXX", name) < (int)dir_sz &&
+       mkdtemp (dir))
+   {
+      fprintf (stderr, "warning: %s is not private, using %s.\n", tmp, dir);
+      return 0;
+   }
+
+   fprintf (stderr, "error: Unable to create a private %s cache: %s\n", name, strerror (errno));
+   return 1;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -21,21 +21,159 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <readline/readline.h>
-#include <readline/history.h>
+#include <unistd.h>
+#include <dlfcn.h>
 
 #include "render.h"
 #include "scene.h"
 #include "output.h"
+#include "dist.h"
+#include "mproc.h"
+#include "composite.h"
+#include "batch.h"
+#include "tilesched.h"
+#include "vrs.h"
+#include "precision.h"
+#include "fixed.h"
+#include "jit.h"
+#include "kernel.h"
+#include "server.h"
+#include "tilecache.h"
+#include "startup.h"
+#include "edit.h"
+#include "snapshot.h"
+#include "delta.h"
+#include "quality.h"
+#include "span.h"
 
 #include "cli.h"
 
+/* Number of processes used when rendering */
+static int num_procs = 1;
+
+/* Render with a kernel compiled for the scene */
+static int use_jit = 0;
+
+/* Scene edits, committed when each edit is made unless begun with "begin" */
+static edit_txn_t txn;
+
+/* Names of libreadline to try, in order */
+static const char *readline_names[] = {
+   "libreadline.so.8",
+   "libreadline.so.7",
+   "libreadline.so",
+   NULL
+};
+
+/* readline() of libreadline, loaded by cli_readline() */
+static char* (*cli_rl) (const char *prompt) = NULL;
+static int cli_rl_loaded = 0;
+
+/**
+ * cli_readline - Read a command line.
+ * @prompt: Prompt to show.
+ *
+ * libreadline isn't linked into srt. It's loaded with dlopen() when the
+ * first line is read from a terminal, so e.g. commands piped from a script
+ * don't pay for loading it. Without a terminal, or libreadline, the lines
+ * are read from stdin as they are, and echoed after the prompt. srt exits
+ * when stdin is closed.
+ *
+ * Returns:
+ * Pointer to the line, allocated with malloc().
+ */
+static char* cli_readline (const char* prompt)
+{
+   char *line = NULL;
+   size_t sz = 0;
+   ssize_t len;
+
+   if (!cli_rl_loaded)
+   {
+      void *handle = NULL;
+      int i;
+
+      cli_rl_loaded = 1;
+      for (i = 0; isatty (STDIN_FILENO) && readline_names[i] && !handle; i++)
+         handle = dlopen (readline_names[i], RTLD_NOW | RTLD_LOCAL);
+      /* POSIX allows converting object pointers to function pointers */
+      if (handle)
+         *(void**)&cli_rl = dlsym (handle, "readline");
+      startup_mark ("readline");
+   }
+
+   if (cli_rl)
+   {
+      line = cli_rl (prompt);
+      if (!line)
+      {
+         printf ("\n");
+         exit (0);
+      }
+      return line;
+   }
+
+   printf ("%s", prompt);
+   fflush (stdout);
+   len = getline (&line, &sz, stdin);
+   if (len < 0)
+   {
+      printf ("\n");
+      exit (0);
+   }
+   if (len && line[len - 1] == '\n')
+      line[len - 1] = 0;
+   printf ("%s\n", line);
+
+   return line;
+}
+
 static char* cli_pop_token (char* line)
 {
    return strtok (line, " ");
 }
 
+/**
+ * cli_commit - Commit the scene edits.
+ *
+ * The new version of the scene is published for the renders running in the
+ * background, see snapshot_publish().
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+static int cli_commit (void)
+{
+   return snapshot_commit (&txn);
+}
+
+/**
+ * cli_edit_begin - Begin a scene edit.
+ *
+ * Returns:
+ * Non-zero if the edit must be committed by cli_edit_end(), i.e. if no
+ * transaction was begun with "begin".
+ */
+static int cli_edit_begin (void)
+{
+   return !edit_active (&txn) && !edit_begin (&txn, scene_get_scene ());
+}
+
+/**
+ * cli_edit_end - End a scene edit.
+ * @commit: Value returned by cli_edit_begin().
+ *
+ * Returns:
+ * none.
+ */
+static void cli_edit_end (int commit)
+{
+   if (commit)
+      cli_commit ();
+}
+
 static void cli_enter_camera (void)
 {
    char* line;
@@ -43,11 +181,12 @@ static void cli_enter_camera (void)
    int end = 0;
    int i;
    int param[3]; /* x, y, z or r, g, b */
+   int commit;
    camera_t *cam = scene_get_camera (scene_get_scene ());
 
    while (!end)
    {
-      line = readline ("scene/camera> ");
+      line = cli_readline ("scene/camera> ");
 
       token = cli_pop_token (line);
 
@@ -63,9 +202,9 @@ static void cli_enter_camera (void)
                continue;
             param[i] = strtol (token, NULL, 10);
          }
-         cam->pos.x = param[0];
-         cam->pos.y = param[1];
-         cam->pos.z = param[2];
+         commit = cli_edit_begin ();
+         edit_camera_pos (&txn, param[0], param[1], param[2]);
+         cli_edit_end (commit);
       }
       else
       if (!strcmp (token, "fov"))
@@ -77,13 +216,18 @@ static void cli_enter_camera (void)
             continue;
          fov = strtol (token, NULL, 10);
 
-         cam->fov = 3.14 * fov / 180.0;
+         commit = cli_edit_begin ();
+         edit_camera_fov (&txn, 3.14 * fov / 180.0);
+         cli_edit_end (commit);
       }
       else
       if (!strcmp (token, "show"))
       {
+         dvector_t pos;
+
+         scene_get_camera_pos (scene_get_scene (), &pos);
          printf ("  x: %.0f, y: %.0f, z: %.0f\n",
-                 cam->pos.x, cam->pos.y, cam->pos.z);
+                 pos.x, pos.y, pos.z);
          printf ("  fov: %.0f\n",
                  cam->fov * 180.0 / 3.14);
 
@@ -118,12 +262,13 @@ static void cli_enter_sphere (int id)
    int end = 0;
    int i;
    int param[3]; /* x, y, z or r, g, b */
+   int commit;
    sphere_t *sphere = scene_get_sphere (scene_get_scene ());
 
    while (!end)
    {
       snprintf (prompt, sizeof(prompt), "scene/sphere-%d> ", id);
-      line = readline (prompt);
+      line = cli_readline (prompt);
 
       token = cli_pop_token (line);
 
@@ -139,9 +284,9 @@ static void cli_enter_sphere (int id)
                continue;
             param[i] = strtol (token, NULL, 10);
          }
-         sphere[id].center.x = param[0];
-         sphere[id].center.y = param[1];
-         sphere[id].center.z = param[2];
+         commit = cli_edit_begin ();
+         edit_sphere_center (&txn, id, param[0], param[1], param[2]);
+         cli_edit_end (commit);
       }
       else
       if (!strcmp (token, "radius"))
@@ -149,7 +294,9 @@ static void cli_enter_sphere (int id)
          token = cli_pop_token (NULL);
          if (!token)
             continue;
-         sphere[id].radius = strtol (token, NULL, 10);
+         commit = cli_edit_begin ();
+         edit_sphere_radius (&txn, id, strtol (token, NULL, 10));
+         cli_edit_end (commit);
       }
       else
       if (!strcmp (token, "color"))
@@ -161,15 +308,19 @@ static void cli_enter_sphere (int id)
                continue;
             param[i] = strtol (token, NULL, 10);
          }
-         color_set (&sphere[id].color, param[0], param[1], param[2]);
+         commit = cli_edit_begin ();
+         edit_sphere_color (&txn, id, param[0], param[1], param[2]);
+         cli_edit_end (commit);
       }
       else
       if (!strcmp (token, "show"))
       {
          int r,g,b;
+         dvector_t center;
 
+         scene_get_sphere_center (scene_get_scene (), id, &center);
          printf ("x: %.0f, y: %.0f, z: %.0f\n",
-                 sphere[id].center.x, sphere[id].center.y, sphere[id].center.z);
+                 center.x, center.y, center.z);
          printf ("radius: %.0f\n", sphere[id].radius);
          color_get (&sphere[id].color, &r, &g, &b);
          printf ("r: %d, g: %d, b: %d\n", r, g, b);
@@ -205,7 +356,7 @@ static void cli_enter_scene (void)
 
    while (!end)
    {
-      line = readline ("scene> ");
+      line = cli_readline ("scene> ");
 
       token = cli_pop_token (line);
 
@@ -230,35 +381,60 @@ static void cli_enter_scene (void)
          }
 
          id = strtol (token, NULL, 10);
-         if (id >=0  && id < scene_get_num_spheres())
+         if (id >=0  && id < scene_get_num_spheres (scene_get_scene ()))
          {
             printf ("Entering sphere context\n");
             cli_enter_sphere (id);
          }
          else
          {
-            printf ("Invalid ID, must be between 0 and %d\n", scene_get_num_spheres());
+            printf ("Invalid ID, must be between 0 and %d\n", scene_get_num_spheres (scene_get_scene ()) - 1);
+         }
+      }
+      else
+      if (!strcmp (token, "remove"))
+      {
+         int id, commit;
+
+         token = cli_pop_token (NULL);
+         if (!token)
+         {
+            printf ("Missing sphere ID.\n");
+            continue;
+         }
+
+         id = strtol (token, NULL, 10);
+         if (id < 0)
+         {
+            printf ("Invalid ID.\n");
+            continue;
          }
+         commit = cli_edit_begin ();
+         edit_sphere_remove (&txn, id);
+         cli_edit_end (commit);
       }
       else
       if (!strcmp (token, "show"))
       {
          camera_t *cam    = scene_get_camera (scene_get_scene ());
          sphere_t *sphere = scene_get_sphere (scene_get_scene ());
+         dvector_t pos;
          int i;
 
+         scene_get_camera_pos (scene_get_scene (), &pos);
          printf ("Camera\n");
          printf ("  x: %.0f, y: %.0f, z: %.0f\n",
-                 cam->pos.x, cam->pos.y, cam->pos.z);
+                 pos.x, pos.y, pos.z);
          printf ("  fov: %.0f\n",
                  cam->fov * 180.0 / 3.14);
-         for (i=0; i<scene_get_num_spheres (); i++)
+         for (i=0; i<scene_get_num_spheres (scene_get_scene ()); i++)
          {
             int r,g,b;
 
+            scene_get_sphere_center (scene_get_scene (), i, &pos);
             printf ("Sphere %d\n", i);
             printf ("  x: %.0f, y: %.0f, z: %.0f\n",
-                    sphere[i].center.x, sphere[i].center.y, sphere[i].center.z);
+                    pos.x, pos.y, pos.z);
             printf ("  radius: %.0f\n", sphere[i].radius);
             color_get (&sphere[i].color, &r, &g, &b);
             printf ("r: %d, g: %d, b: %d\n", r, g, b);
@@ -269,7 +445,8 @@ static void cli_enter_scene (void)
       {
          printf ("camera"       "\t\tSetup camera.\n");
          printf ("sphere <ID>"  "\tSetup sphere object.\n");
-         printf (               "\t\t<ID> sphere identity, 0-%d.\n", scene_get_num_spheres());
+         printf (               "\t\t<ID> sphere identity, 0-%d.\n", scene_get_num_spheres (scene_get_scene ()) - 1);
+         printf ("remove <ID>"  "\tRemove sphere object, the last sphere takes its ID.\n");
          printf ("show"         "\t\tShow objects settings.\n");
          printf ("help"         "\t\tShow this help text.\n");
          printf ("end"          "\t\tExit context.\n");
@@ -296,7 +473,7 @@ int cli_enter (void)
    printf ("Enter 'help' for available commands.\n");
    while (!quit)
    {
-      line = readline ("> ");
+      line = cli_readline ("> ");
 
       token = cli_pop_token (line);
 
@@ -307,6 +484,9 @@ int cli_enter (void)
       {
          printf ("Entering scene context\n");
          cli_enter_scene ();
+
+         /* The scene may have changed, cached tiles are outdated */
+         tilecache_flush ();
       }
       else
       if (!strcmp (token, "width"))
@@ -321,24 +501,521 @@ int cli_enter (void)
          output_set_image_height (atoi(arg));
       }
       else
+      if (!strcmp (token, "precision"))
+      {
+         char* arg = cli_pop_token (NULL);
+         precision_t p;
+
+         if (arg && !strcmp (arg, "check"))
+         {
+            for (p = PRECISION_FAST; p < PRECISION_NUM; p++)
+            {
+               precision_err_t err;
+               int rc = render_check_precision (p,
+                                                output_get_image_width (),
+                                                output_get_image_height (),
+                                                scene_get_scene (),
+                                                &err);
+
+               printf ("%-8s %ld pixels (%.3f%%) differ, max pixel error %d%s, "
+                       "max color error %d, max depth error %.2e: %s\n",
+                       precision_name (p), err.num_diff, err.pct_diff,
+                       err.max_shift > PRECISION_SEARCH ? PRECISION_SEARCH : err.max_shift,
+                       err.max_shift > PRECISION_SEARCH ? "+" : "",
+                       err.max_err, err.max_depth, rc ? "FAIL" : "PASS");
+            }
+            continue;
+         }
+         if (!arg || precision_parse (arg, &p))
+         {
+            printf ("Usage: precision <exact|fast|fastest|check>\n");
+            continue;
+         }
+         precision_set (p);
+      }
+      else
+      if (!strcmp (token, "jit"))
+      {
+         char* arg = cli_pop_token (NULL);
+
+         if (!arg || (strcmp (arg, "on") && strcmp (arg, "off")))
+         {
+            printf ("Usage: jit <on|off>\n");
+            continue;
+         }
+         use_jit = !strcmp (arg, "on");
+      }
+      else
+      if (!strcmp (token, "kernel"))
+      {
+         char* arg = cli_pop_token (NULL);
+         char* val = cli_pop_token (NULL);
+         kernel_stats_t st;
+
+         if (!arg)
+         {
+            if (kernel_get_stats (&st))
+               printf ("%llu rays, %llu sphere tests (%.2f per ray), %llu hits\n",
+                       (unsigned long long)st.rays, (unsigned long long)st.tests,
+                       st.rays ? (double)st.tests / st.rays : 0.0,
+                       (unsigned long long)st.hits);
+            else
+               printf ("Statistics are off.\n");
+            continue;
+         }
+         if (!val ||
+             (!strcmp (arg, "simd") && kernel_set_simd (atoi (val))) ||
+             (!strcmp (arg, "accel") && kernel_set_accel (val)) ||
+             (!strcmp (arg, "lod") && kernel_set_lod (atof (val))) ||
+             (!strcmp (arg, "stats") && strcmp (val, "on") && strcmp (val, "off")) ||
+             (strcmp (arg, "simd") && strcmp (arg, "accel") && strcmp (arg, "lod") &&
+              strcmp (arg, "stats")))
+         {
+            printf ("Usage: kernel [simd <1|4> | accel <none|cull> | lod <PIXELS> | stats <on|off>]\n");
+            continue;
+         }
+         if (!strcmp (arg, "stats"))
+            kernel_set_stats (!strcmp (val, "on"));
+      }
+      else
+      if (!strcmp (token, "begin"))
+      {
+         if (edit_begin (&txn, scene_get_scene ()))
+            printf ("A transaction is already begun.\n");
+      }
+      else
+      if (!strcmp (token, "commit"))
+      {
+         int num = edit_active (&txn) - 1;
+
+         if (num < 0)
+         {
+            printf ("No transaction begun.\n");
+            continue;
+         }
+         if (cli_commit ())
+         {
+            fprintf (stderr, "An error occured when committing the edits.\n");
+            continue;
+         }
+         printf ("%d edits committed, %d spheres%s changed.\n", num, txn.num_dirty,
+                 txn.cam_dirty ? " and the camera" : "");
+
+         /* The scene has changed, cached tiles are outdated */
+         if (num)
+            tilecache_flush ();
+      }
+      else
+      if (!strcmp (token, "abort"))
+      {
+         edit_abort (&txn);
+      }
+      else
+      if (!strcmp (token, "push"))
+      {
+         char* addr = cli_pop_token (NULL);
+         unsigned long version;
+         delta_t delta;
+
+         if (!addr)
+         {
+            printf ("Usage: push <ADDRESS>\n");
+            continue;
+         }
+         if (!edit_active (&txn))
+         {
+            printf ("No transaction begun.\n");
+            continue;
+         }
+
+         delta_init (&delta);
+         if (delta_encode (&delta, &txn) || delta_send (addr, &delta, &version))
+            fprintf (stderr, "An error occured when pushing the edits.\n");
+         else
+            printf ("Pushed %zu bytes, the server scene is at version %lu.\n",
+                    delta.len, version);
+         delta_free (&delta);
+      }
+      else
+      if (!strcmp (token, "save"))
+      {
+         char* arg = cli_pop_token (NULL);
+
+         if (!arg)
+         {
+            printf ("Usage: save <FILE>\n");
+            continue;
+         }
+         if (!scene_save (scene_get_scene (), arg))
+            printf ("Scene saved to %s, load it with 'srt -b %s'.\n", arg, arg);
+      }
+      else
+      if (!strcmp (token, "processes"))
+      {
+         char* arg = cli_pop_token (NULL);
+
+         if (!arg || atoi (arg) < 1)
+         {
+            printf ("Usage: processes <N>\n");
+            continue;
+         }
+         num_procs = atoi (arg);
+      }
+      else
       if (!strcmp (token, "show"))
       {
+         kernel_stats_t st;
+
          printf ("Screen width:  %d\n", output_get_image_width ());
          printf ("Screen height: %d\n", output_get_image_height ());
+         printf ("Processes:     %d\n", num_procs);
+         printf ("Precision:     %s\n", precision_name (precision_get ()));
+         printf ("JIT:           %s\n", use_jit ? "on" : "off");
+         printf ("Kernel:        simd %d, accel %s, lod %g, stats %s\n",
+                 kernel_get_simd (), kernel_get_accel (), kernel_get_lod (),
+                 kernel_get_stats (&st) ? "on" : "off");
+         if (edit_active (&txn))
+            printf ("Transaction:   %d edits pending\n", edit_active (&txn) - 1);
       }
       else
       if (!strcmp (token, "render"))
       {
+         int rc;
+
          printf ("Rendering scene\n");
          /* Render the scene */
-         if (render_scene (output_get_image (),
+         if (num_procs > 1)
+            rc = mproc_render (num_procs,
+                               output_get_image (),
+                               output_get_image_size (),
+                               output_get_image_width (),
+                               output_get_image_height (),
+                               scene_get_scene ());
+         else if (use_jit)
+            rc = jit_render (output_get_image (),
+                             output_get_image_size (),
+                             output_get_image_width (),
+                             output_get_image_height (),
+                             scene_get_scene ());
+         else
+            rc = render_scene (output_get_image (),
+                               output_get_image_size (),
+                               output_get_image_width (),
+                               output_get_image_height (),
+                               scene_get_scene ());
+         if (rc)
+         {
+            fprintf (stderr, "An error occured when rendering the scene.\n");
+         }
+         startup_mark ("render");
+         startup_report ();
+      }
+      else
+      if (!strcmp (token, "fixed"))
+      {
+         char* arg = cli_pop_token (NULL);
+
+         if (arg && !strcmp (arg, "check"))
+         {
+            precision_err_t err;
+            int rc = fixed_check (output_get_image_width (),
+                                  output_get_image_height (),
+                                  scene_get_scene (),
+                                  &err);
+
+            printf ("%d fractional bits, %ld pixels (%.3f%%) differ, max pixel error %d%s, "
+                    "max color error %d: %s\n",
+                    fixed_range (scene_get_scene ()), err.num_diff, err.pct_diff,
+                    err.max_shift > PRECISION_SEARCH ? PRECISION_SEARCH : err.max_shift,
+                    err.max_shift > PRECISION_SEARCH ? "+" : "",
+                    err.max_err, rc ? "FAIL" : "PASS");
+            continue;
+         }
+         if (arg)
+         {
+            printf ("Usage: fixed [check]\n");
+            continue;
+         }
+
+         printf ("Rendering scene in fixed point\n");
+         if (fixed_render (output_get_image (),
                            output_get_image_size (),
                            output_get_image_width (),
                            output_get_image_height (),
                            scene_get_scene ()))
+            fprintf (stderr, "An error occured when rendering the scene.\n");
+      }
+      else
+      if (!strcmp (token, "vrs"))
+      {
+         char* mode = cli_pop_token (NULL);
+         char* x    = NULL;
+         char* y    = NULL;
+         const int w = output_get_image_width ();
+         const int h = output_get_image_height ();
+         uint8_t* rate;
+         long rays;
+
+         if (mode && !strcmp (mode, "fovea"))
+         {
+            x = cli_pop_token (NULL);
+            y = cli_pop_token (NULL);
+         }
+         if (!mode || (strcmp (mode, "edges") && !y))
          {
+            printf ("Usage: vrs fovea <X> <Y>\n"
+                    "       vrs edges\n");
+            continue;
+         }
+
+         rate = vrs_alloc (w, h);
+         if (!rate)
+            continue;
+         if (y)
+            vrs_foveate (rate, w, h, atoi (x), atoi (y));
+         else
+            vrs_edges (rate, output_get_image (), w, h);
+
+         printf ("Rendering scene at variable rate\n");
+         if (render_vrs (output_get_image (),
+                         output_get_image_size (),
+                         w, h, rate,
+                         scene_get_scene (), &rays))
             fprintf (stderr, "An error occured when rendering the scene.\n");
+         else
+            printf ("Traced %ld rays, %.1f%% of a full render\n",
+                    rays, 100.0 * rays / ((double)w * h));
+         free (rate);
+      }
+      else
+      if (!strcmp (token, "spans"))
+      {
+         char* arg = cli_pop_token (NULL);
+         char* w   = cli_pop_token (NULL);
+         char* h   = cli_pop_token (NULL);
+         const int width  = h ? atoi (w) : output_get_image_width ();
+         const int height = h ? atoi (h) : output_get_image_height ();
+         span_stats_t st;
+
+         if (!arg || (w && !h) || (w && !strcmp (arg, "check")) ||
+             width < 1 || height < 1)
+         {
+            printf ("Usage: spans <FILE> [<WIDTH> <HEIGHT>]\n"
+                    "       spans check\n");
+            continue;
+         }
+
+         if (!strcmp (arg, "check"))
+         {
+            span_buf_t buf;
+            span_sink_t sink;
+            uint8_t* image = malloc (output_get_image_size ());
+            long diff = 0;
+            size_t i;
+
+            /* Room for a span per pixel, the check is for any scene */
+            if (!image ||
+                span_buf_init (&buf, width, height, (uint64_t)width * height))
+            {
+               free (image);
+               continue;
+            }
+            span_buf_sink (&buf, &sink);
+            if (render_scene (image, output_get_image_size (), width, height,
+                              scene_get_scene ()) ||
+                span_render (width, height, scene_get_scene (), &sink, &st) ||
+                span_buf_fill (&buf, output_get_image (), output_get_image_size ()))
+               fprintf (stderr, "An error occured when rendering the scene.\n");
+            else
+            {
+               for (i = 0; i < (size_t)width * height; i++)
+                  if (memcmp (&image[i * 3], &output_get_image ()[i * 3], 3))
+                     diff++;
+               printf ("%llu spans, %ld pixels differ from render: %s\n",
+                       (unsigned long long)st.spans, diff, diff ? "FAIL" : "PASS");
+            }
+            span_buf_free (&buf);
+            free (image);
+            continue;
          }
+
+         if (span_write (arg, width, height, scene_get_scene (), &st))
+            continue;
+         printf ("%llu spans, traced %.2f%% of %dx%d pixels, wrote %llu bytes "
+                 "(%.4f%% of the pixels)\n",
+                 (unsigned long long)st.spans,
+                 100.0 * st.traced / ((double)width * height), width, height,
+                 (unsigned long long)st.bytes,
+                 100.0 * st.bytes / ((double)width * height * 3));
+      }
+      else
+      if (!strcmp (token, "quality"))
+      {
+         char* arg    = cli_pop_token (NULL);
+         char* prefix = cli_pop_token (NULL);
+
+         if (arg && atoi (arg) < 1)
+         {
+            printf ("Usage: quality [<RUNS> [<MAP PREFIX>]]\n");
+            continue;
+         }
+         if (quality_bench (output_get_image_width (),
+                            output_get_image_height (),
+                            scene_get_scene (),
+                            arg ? atoi (arg) : QUALITY_RUNS,
+                            prefix))
+            fprintf (stderr, "An error occured when benchmarking the render modes.\n");
+      }
+      else
+      if (!strcmp (token, "region"))
+      {
+         char* arg[4];
+         char* mode;
+         int x0, y0, x1, y1;
+         int i;
+
+         for (i = 0; i < 4; i++)
+            arg[i] = cli_pop_token (NULL);
+         mode = cli_pop_token (NULL);
+
+         if (!arg[3] || (mode && strcmp (mode, "crop")))
+         {
+            printf ("Usage: region <X0> <Y0> <X1> <Y1> [crop]\n");
+            continue;
+         }
+         x0 = atoi (arg[0]);
+         y0 = atoi (arg[1]);
+         x1 = atoi (arg[2]);
+         y1 = atoi (arg[3]);
+
+         if (mode)
+         {
+            size_t sz = (size_t)(x1 - x0) * (y1 - y0) * 3;
+            uint8_t* crop;
+
+            if (x1 <= x0 || y1 <= y0 || !(crop = malloc (sz)))
+            {
+               fprintf (stderr, "An error occured when rendering the region.\n");
+               continue;
+            }
+
+            printf ("Rendering region as own image\n");
+            if (render_tile (crop, sz,
+                             output_get_image_width (),
+                             output_get_image_height (),
+                             x0, y0, x1, y1,
+                             scene_get_scene ()) ||
+                output_render_image (crop, x1 - x0, y1 - y0))
+               fprintf (stderr, "An error occured when rendering the region.\n");
+            free (crop);
+         }
+         else
+         {
+            printf ("Rendering region\n");
+            if (render_region (output_get_image (),
+                               output_get_image_size (),
+                               output_get_image_width (),
+                               output_get_image_height (),
+                               x0, y0, x1, y1,
+                               scene_get_scene ()))
+               fprintf (stderr, "An error occured when rendering the region.\n");
+         }
+      }
+      else
+      if (!strcmp (token, "distribute"))
+      {
+         char* addr = cli_pop_token (NULL);
+         char* arg  = cli_pop_token (NULL);
+
+         if (!addr || !arg || atoi (arg) < 1)
+         {
+            printf ("Usage: distribute <ADDRESS> <WORKERS>\n");
+            continue;
+         }
+
+         printf ("Rendering scene using %d workers\n", atoi (arg));
+         if (dist_master (addr, atoi (arg),
+                          output_get_image (),
+                          output_get_image_size (),
+                          output_get_image_width (),
+                          output_get_image_height (),
+                          scene_get_scene ()))
+         {
+            fprintf (stderr, "An error occured when rendering the scene.\n");
+         }
+      }
+      else
+      if (!strcmp (token, "composite"))
+      {
+         char* arg = cli_pop_token (NULL);
+
+         if (!arg || atoi (arg) < 1)
+         {
+            printf ("Usage: composite <PARTS>\n");
+            continue;
+         }
+
+         printf ("Rendering scene in %d parts\n", atoi (arg));
+         if (composite_render (atoi (arg),
+                               output_get_image (),
+                               output_get_image_size (),
+                               output_get_image_width (),
+                               output_get_image_height (),
+                               scene_get_scene ()))
+         {
+            fprintf (stderr, "An error occured when rendering the scene.\n");
+         }
+      }
+      else
+      if (!strcmp (token, "batch"))
+      {
+         char* count  = cli_pop_token (NULL);
+         char* width  = cli_pop_token (NULL);
+         char* height = cli_pop_token (NULL);
+         batch_t batch;
+         double t;
+         int i;
+
+         if (!count || !width || !height ||
+             atoi (count) < 1 || atoi (width) < 1 || atoi (height) < 1)
+         {
+            printf ("Usage: batch <COUNT> <WIDTH> <HEIGHT>\n");
+            continue;
+         }
+
+         batch_init (&batch);
+         for (i = 0; i < atoi (count); i++)
+            if (batch_add (&batch, scene_get_scene (), atoi (width), atoi (height)) < 0)
+               break;
+
+         t = tilesched_time ();
+         if (i < atoi (count) || batch_render (&batch, num_procs))
+            fprintf (stderr, "An error occured when rendering the batch.\n");
+         else
+         {
+            t = tilesched_time () - t;
+            printf ("Rendered %d images in %.3f s, %.0f images/s\n",
+                    batch.num, t, t > 0 ? batch.num / t : 0);
+         }
+         batch_free (&batch);
+      }
+      else
+      if (!strcmp (token, "serve"))
+      {
+         char* addr = cli_pop_token (NULL);
+         char* arg  = cli_pop_token (NULL);
+         size_t cache_size = SERVER_CACHE_SIZE;
+
+         if (!addr)
+         {
+            printf ("Usage: serve <ADDRESS> [<CACHE MB>]\n");
+            continue;
+         }
+         if (arg)
+            cache_size = (size_t)atoi (arg) << 20;
+
+         if (server_start (addr, cache_size))
+            fprintf (stderr, "An error occured when starting the server.\n");
       }
       else
       if (!strcmp (token, "output"))
@@ -353,8 +1030,43 @@ int cli_enter (void)
          printf ("scene"   "\tEnter scene context.\n");
          printf ("width"   "\tRendered screen width.\n");
          printf ("height"  "\tRendered screen height.\n");
+         printf ("composite <PARTS>\n"
+                 "\tRender scene with the spheres split into parts, merged by depth.\n");
+         printf ("batch <COUNT> <WIDTH> <HEIGHT>\n"
+                 "\tRender COUNT small images of the scene as one batch.\n");
+         printf ("serve <ADDRESS> [<CACHE MB>]\n"
+                 "\tServe tiles of the scene over HTTP in the background.\n");
+         printf ("begin"   "\tBegin a transaction, scene edits are applied on commit.\n");
+         printf ("commit"  "\tApply the scene edits since begin, all at once.\n");
+         printf ("abort"   "\tDrop the scene edits since begin.\n");
+         printf ("push <ADDRESS>\n"
+                 "\tSend the scene edits since begin to a server started with 'srt -s'.\n");
+         printf ("save <FILE>\n"
+                 "\tSave the scene as a binary scene file, see 'srt -b'.\n");
+         printf ("processes <N>\n"
+                 "\tNumber of processes used when rendering.\n");
+         printf ("jit <on|off>\n"
+                 "\tRender with a kernel compiled for the scene by the C compiler.\n");
+         printf ("kernel [simd <1|4> | accel <none|cull> | lod <PIXELS> | stats <on|off>]\n"
+                 "\tKernel used by the renders, or show the render statistics. Spheres\n"
+                 "\twith a projected radius below lod pixels are splatted, not traced.\n");
+         printf ("precision <exact|fast|fastest|check>\n"
+                 "\tPrecision of the ray kernels, or check the error of the fast ones.\n");
          printf ("show"    "\tShow settings.\n");
          printf ("render"  "\tRender scene.\n");
+         printf ("fixed [check]\n"
+                 "\tRender scene in fixed point, or compare it with the float render.\n");
+         printf ("vrs fovea <X> <Y> | vrs edges\n"
+                 "\tRender scene at lower rates away from <X>,<Y> or the edges of the last image.\n");
+         printf ("spans <FILE> [<WIDTH> <HEIGHT>] | spans check\n"
+                 "\tRender scene as spans straight to a TGA or PNG file, or compare with 'render'.\n");
+         printf ("quality [<RUNS> [<MAP PREFIX>]]\n"
+                 "\tTime each render mode and compare its image with 'render'.\n");
+         printf ("region <X0> <Y0> <X1> <Y1> [crop]\n"
+                 "\tRender part of the scene into the image, or output it as own image.\n");
+         printf ("distribute <ADDRESS> <WORKERS>\n"
+                 "\tRender scene using workers started with 'srt -w <ADDRESS>'.\n"
+                 "\t<ADDRESS> is unix:<PATH> or <HOST>:<PORT>.\n");
          printf ("output"  "\tSend the rendered scene to output function.\n");
          printf ("help"    "\tShow this help text.\n");
          printf ("quit"    "\tQuit.\n");
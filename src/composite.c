@@ -0,0 +1,269 @@
+/**
+ * composite.c - Depth compositing class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines sort-last rendering, where the spheres of a scene are
+ * split between processes and the rendered images are merged by depth.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "scene.h"
+#include "render.h"
+
+#include "composite.h"
+
+/* Four depth values compared at once */
+typedef float   v4sf __attribute__ ((vector_size (16)));
+typedef int32_t v4si __attribute__ ((vector_size (16)));
+
+/* Buffers of one part in the shared segment */
+typedef struct {
+   uint8_t *image;   /* Rendered image of the part */
+   float   *depth;   /* Depth of each pixel in @image */
+} composite_part_t;
+
+/**
+ * composite_merge - Merge two images by depth.
+ * @dst:        Pointer to image to merge into.
+ * @dst_depth:  Pointer to depth buffer of @dst.
+ * @src:        Pointer to image to merge from.
+ * @src_depth:  Pointer to depth buffer of @src.
+ * @num_pixels: Number of pixels in the images.
+ *
+ * This function will keep the nearest pixel of @dst and @src in @dst, and
+ * update @dst_depth accordingly. If the pixels are at the same depth the
+ * @dst pixel is kept. The depth values are compared four at a time and the
+ * colors are only touched where @src is nearer.
+ *
+ * Returns:
+ * none.
+ */
+void composite_merge (uint8_t* dst,
+                      float* dst_depth,
+                      const uint8_t* src,
+                      const float* src_depth,
+                      size_t num_pixels)
+{
+   size_t i;
+   int k;
+
+   for (i = 0; i + 4 <= num_pixels; i += 4)
+   {
+      v4sf d, s;
+      v4si m;
+
+      memcpy (&d, dst_depth + i, sizeof(d));
+      memcpy (&s, src_depth + i, sizeof(s));
+
+      /* All lanes set where the source pixel is nearer */
+      m = s < d;
+      if (!(m[0] | m[1] | m[2] | m[3]))
+         continue;
+
+      d = (v4sf)(((v4si)s & m) | ((v4si)d & ~m));
+      memcpy (dst_depth + i, &d, sizeof(d));
+
+      for (k = 0; k < 4; k++)
+         if (m[k])
+            memcpy (dst + (i + k) * 3, src + (i + k) * 3, 3);
+   }
+
+   for (; i < num_pixels; i++)
+   {
+      if (src_depth[i] < dst_depth[i])
+      {
+         dst_depth[i] = src_depth[i];
+         memcpy (dst + i * 3, src + i * 3, 3);
+      }
+   }
+}
+
+/**
+ * composite_wait - Wait for child processes.
+ * @pid: Pointer to list of process IDs, -1 for entries not started.
+ * @num: Number of entries in @pid.
+ *
+ * Returns:
+ * Number of processes which didn't exit normally.
+ */
+static int composite_wait (pid_t *pid, int num)
+{
+   int num_failed = 0;
+   int i;
+
+   for (i = 0; i < num; i++)
+   {
+      int status;
+      pid_t rc;
+
+      if (pid[i] < 0)
+         continue;
+      while ((rc = waitpid (pid[i], &status, 0)) < 0 && errno == EINTR)
+         ;
+      if (rc < 0 || !WIFEXITED (status) || WEXITSTATUS (status))
+         num_failed++;
+   }
+
+   return num_failed;
+}
+
+/**
+ * composite_render - Render a scene split by spheres.
+ * @num_parts:     Number of parts to split the spheres into.
+ * @image:         Pointer to buffer which will contain the rendered scene
+ * @image_sz:      Size of @image buffer
+ * @screen_width:  Width of rendered screen
+ * @screen_height: Height of rendered screen
+ * @scene:         Pointer to scene object
+ *
+ * This function does sort-last rendering. The sphere list is split into
+ * @num_parts consecutive parts and one process per part renders only its
+ * own spheres, i.e. a part scene points to 1/@num_parts of the spheres,
+ * into a color and depth buffer in shared memory (see render_depth()). The
+ * buffers are then merged by a tree reduction: in each level the buffer of
+ * part i + step is merged into part i, with all merges of a level running
+ * in parallel, until part 0 holds the final image.
+ * Since parts are merged in sphere order and equal depths keep the first
+ * part, the image is identical to the one created by render_scene().
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int composite_render (int num_parts,
+                      uint8_t* image,
+                      size_t image_sz,
+                      int screen_width,
+                      int screen_height,
+                      scene_t *scene)
+{
+   const int num_spheres = scene_get_num_spheres (scene);
+   const size_t num_pixels = (size_t)screen_width * screen_height;
+   const size_t fb_sz    = num_pixels * 3;
+   const size_t depth_sz = num_pixels * sizeof(float);
+   const size_t part_sz  = (depth_sz + fb_sz + 63) & ~(size_t)63;
+   composite_part_t *part = NULL;
+   pid_t *pid = NULL;
+   uint8_t *seg;
+   size_t seg_sz;
+   int step;
+   int rc = 1;
+   int i;
+
+   if (image_sz < fb_sz || num_parts < 1)
+      return 1;
+
+   /* No point in having parts without spheres */
+   if (num_parts > num_spheres)
+      num_parts = num_spheres ? num_spheres : 1;
+
+   seg_sz = num_parts * part_sz;
+   seg = mmap (NULL, seg_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+   if (seg == MAP_FAILED)
+   {
+      fprintf (stderr, "error: Unable to map shared memory for compositing\n");
+      return 1;
+   }
+
+   part = calloc (num_parts, sizeof(*part));
+   pid  = calloc (num_parts, sizeof(*pid));
+   if (!part || !pid)
+      goto out;
+
+   for (i = 0; i < num_parts; i++)
+   {
+      part[i].depth = (float*)(seg + i * part_sz);
+      part[i].image = seg + i * part_sz + depth_sz;
+   }
+
+   /* Render each part in its own process */
+   for (i = 0; i < num_parts; i++)
+   {
+      scene_t sub = *scene;
+      int first = (int)((long)num_spheres * i / num_parts);
+      int last  = (int)((long)num_spheres * (i + 1) / num_parts);
+
+      sub.sphere      = scene->sphere + first;
+      sub.num_spheres = last - first;
+
+      pid[i] = fork ();
+      if (pid[i] == 0)
+         _exit (render_depth (part[i].image, fb_sz, part[i].depth,
+                              screen_width, screen_height, &sub));
+      if (pid[i] < 0 &&
+          render_depth (part[i].image, fb_sz, part[i].depth,
+                        screen_width, screen_height, &sub))
+         break;
+   }
+   if (composite_wait (pid, i) || i < num_parts)
+   {
+      fprintf (stderr, "error: Rendering of a part failed.\n");
+      goto out;
+   }
+
+   /* Tree reduction, merge part i + step into part i */
+   for (step = 1; step < num_parts; step *= 2)
+   {
+      int n = 0;
+
+      for (i = 0; i + step < num_parts; i += 2 * step)
+      {
+         pid[n] = fork ();
+         if (pid[n] == 0)
+         {
+            composite_merge (part[i].image, part[i].depth,
+                             part[i + step].image, part[i + step].depth,
+                             num_pixels);
+            _exit (0);
+         }
+         if (pid[n] < 0)
+            composite_merge (part[i].image, part[i].depth,
+                             part[i + step].image, part[i + step].depth,
+                             num_pixels);
+         n++;
+      }
+      if (composite_wait (pid, n))
+      {
+         fprintf (stderr, "error: Merging of parts failed.\n");
+         goto out;
+      }
+   }
+
+   memcpy (image, part[0].image, fb_sz);
+   memset (image + fb_sz, 0, image_sz - fb_sz);
+   rc = 0;
+
+out:
+   free (part);
+   free (pid);
+   munmap (seg, seg_sz);
+
+   return rc;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,629 @@
+/**
+ * delta.c - Delta class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines scene deltas, a compact binary encoding of scene edits
+ * that is sent to a render server to update its scene incrementally.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "net.h"
+#include "scene.h"
+#include "edit.h"
+
+#include "delta.h"
+
+/**
+ * delta_put - Append bytes to a delta.
+ * @delta: Pointer to delta.
+ * @data:  Pointer to bytes.
+ * @len:   Number of bytes.
+ *
+ * The magic is written in front of the first record.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+static int delta_put (delta_t *delta, const void *data, size_t len)
+{
+   if (!delta->len)
+   {
+      uint32_t magic = DELTA_MAGIC;
+
+      if (delta->max < sizeof(magic))
+      {
+         uint8_t *buf = realloc (delta->buf, 256);
+
+         if (!buf)
+            goto fail;
+         delta->buf = buf;
+         delta->max = 256;
+      }
+      memcpy (delta->buf, &magic, sizeof(magic));
+      delta->len = sizeof(magic);
+   }
+
+   if (delta->len + len > delta->max)
+   {
+      size_t max = (delta->len + len) * 2;
+      uint8_t *buf = realloc (delta->buf, max);
+
+      if (!buf)
+         goto fail;
+      delta->buf = buf;
+      delta->max = max;
+   }
+
+   if (len)
+      memcpy (delta->buf + delta->len, data, len);
+   delta->len += len;
+
+   return 0;
+
+fail:
+   fprintf (stderr, "error: Unable to alloc memory for delta\n");
+   return 1;
+}
+
+/**
+ * delta_record - Append a record to a delta.
+ * @delta: Pointer to delta.
+ * @op:    Record operation.
+ * @id:    Sphere ID, or -1 for camera records.
+ * @pos:   Pointer to position, or NULL.
+ * @value: Radius or field of view, or negative if not used.
+ * @rgb:   Pointer to color, or NULL.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+static int delta_record (delta_t *delta, delta_op_t op, int id,
+                         const double *pos, double value, const int *rgb)
+{
+   uint8_t byte = op;
+   uint32_t sphere = id;
+   float f = value;
+   int i;
+
+   if (op >= DELTA_SPHERE_ADD && id < 0)
+   {
+      fprintf (stderr, "error: Invalid sphere ID (%d)\n", id);
+      return 1;
+   }
+
+   if (delta_put (delta, &byte, 1))
+      return 1;
+   if (id >= 0 && delta_put (delta, &sphere, sizeof(sphere)))
+      return 1;
+   if (pos && delta_put (delta, pos, 3 * sizeof(double)))
+      return 1;
+   if (value >= 0 && delta_put (delta, &f, sizeof(f)))
+      return 1;
+   for (i = 0; rgb && i < 3; i++)
+   {
+      byte = rgb[i] < 0 ? 0 : rgb[i] > 255 ? 255 : rgb[i];
+      if (delta_put (delta, &byte, 1))
+         return 1;
+   }
+
+   return 0;
+}
+
+/**
+ * delta_init - Init a delta object.
+ * @delta: Pointer to delta.
+ *
+ * Returns:
+ * none.
+ */
+void delta_init (delta_t *delta)
+{
+   memset (delta, 0, sizeof(*delta));
+}
+
+/**
+ * delta_free - Free a delta object.
+ * @delta: Pointer to delta.
+ *
+ * Returns:
+ * none.
+ */
+void delta_free (delta_t *delta)
+{
+   free (delta->buf);
+   delta_init (delta);
+}
+
+/**
+ * delta_camera_pos - Append a camera move.
+ * @delta: Pointer to delta.
+ * @x:     World x coordinate.
+ * @y:     World y coordinate.
+ * @z:     World z coordinate.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int delta_camera_pos (delta_t *delta, double x, double y, double z)
+{
+   double pos[3] = { x, y, z };
+
+   if (edit_check (EDIT_CAMERA_POS, x, y, z))
+      return 1;
+
+   return delta_record (delta, DELTA_CAMERA_POS, -1, pos, -1, NULL);
+}
+
+/**
+ * delta_camera_fov - Append a field of view change.
+ * @delta: Pointer to delta.
+ * @fov:   Field of view in radians.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int delta_camera_fov (delta_t *delta, double fov)
+{
+   fov = fov < 0 ? 0 : fov;
+   if (edit_check (EDIT_CAMERA_FOV, (float)fov, 0, 0))
+      return 1;
+
+   return delta_record (delta, DELTA_CAMERA_FOV, -1, NULL, fov, NULL);
+}
+
+/**
+ * delta_sphere_add - Append a new sphere.
+ * @delta:  Pointer to delta.
+ * @id:     Sphere ID, normally the number of spheres in the scene.
+ * @x:      World x coordinate.
+ * @y:      World y coordinate.
+ * @z:      World z coordinate.
+ * @radius: Radius.
+ * @r:      Red component.
+ * @g:      Green component.
+ * @b:      Blue component.
+ *
+ * The same as a center, radius and color record for @id, in one record.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int delta_sphere_add (delta_t *delta, int id, double x, double y, double z,
+                      double radius, int r, int g, int b)
+{
+   double pos[3] = { x, y, z };
+   int rgb[3] = { r, g, b };
+
+   radius = radius < 0 ? 0 : radius;
+   if (edit_check (EDIT_SPHERE_CENTER, x, y, z) ||
+       edit_check (EDIT_SPHERE_RADIUS, (float)radius, 0, 0))
+      return 1;
+
+   return delta_record (delta, DELTA_SPHERE_ADD, id, pos, radius, rgb);
+}
+
+/**
+ * delta_sphere_center - Append a sphere move.
+ * @delta: Pointer to delta.
+ * @id:    Sphere ID.
+ * @x:     World x coordinate.
+ * @y:     World y coordinate.
+ * @z:     World z coordinate.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int delta_sphere_center (delta_t *delta, int id, double x, double y, double z)
+{
+   double pos[3] = { x, y, z };
+
+   if (edit_check (EDIT_SPHERE_CENTER, x, y, z))
+      return 1;
+
+   return delta_record (delta, DELTA_SPHERE_CENTER, id, pos, -1, NULL);
+}
+
+/**
+ * delta_sphere_radius - Append a sphere radius change.
+ * @delta:  Pointer to delta.
+ * @id:     Sphere ID.
+ * @radius: Radius.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int delta_sphere_radius (delta_t *delta, int id, double radius)
+{
+   radius = radius < 0 ? 0 : radius;
+   if (edit_check (EDIT_SPHERE_RADIUS, (float)radius, 0, 0))
+      return 1;
+
+   return delta_record (delta, DELTA_SPHERE_RADIUS, id, NULL, radius, NULL);
+}
+
+/**
+ * delta_sphere_color - Append a sphere color change.
+ * @delta: Pointer to delta.
+ * @id:    Sphere ID.
+ * @r:     Red component.
+ * @g:     Green component.
+ * @b:     Blue component.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int delta_sphere_color (delta_t *delta, int id, int r, int g, int b)
+{
+   int rgb[3] = { r, g, b };
+
+   return delta_record (delta, DELTA_SPHERE_COLOR, id, NULL, -1, rgb);
+}
+
+/**
+ * delta_sphere_remove - Append a sphere removal.
+ * @delta: Pointer to delta.
+ * @id:    Sphere ID.
+ *
+ * The last sphere takes over @id, see scene_remove_sphere().
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int delta_sphere_remove (delta_t *delta, int id)
+{
+   return delta_record (delta, DELTA_SPHERE_REMOVE, id, NULL, -1, NULL);
+}
+
+/**
+ * delta_encode - Encode the edits of a transaction.
+ * @delta: Pointer to delta.
+ * @txn:   Pointer to begun transaction.
+ *
+ * Each logged edit is appended as a record, in order. The transaction is
+ * left as it is, i.e. it can still be committed or aborted.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int delta_encode (delta_t *delta, edit_txn_t *txn)
+{
+   int i, rc = 0;
+
+   for (i = 0; !rc && i < txn->num; i++)
+   {
+      const edit_t *e = &txn->log[i];
+
+      switch (e->op)
+      {
+         case EDIT_CAMERA_POS:
+            rc = delta_camera_pos (delta, e->v[0], e->v[1], e->v[2]);
+            break;
+
+         case EDIT_CAMERA_FOV:
+            rc = delta_camera_fov (delta, e->v[0]);
+            break;
+
+         case EDIT_SPHERE_CENTER:
+            rc = delta_sphere_center (delta, e->id, e->v[0], e->v[1], e->v[2]);
+            break;
+
+         case EDIT_SPHERE_RADIUS:
+            rc = delta_sphere_radius (delta, e->id, e->v[0]);
+            break;
+
+         case EDIT_SPHERE_COLOR:
+            rc = delta_sphere_color (delta, e->id, e->v[0], e->v[1], e->v[2]);
+            break;
+
+         case EDIT_SPHERE_REMOVE:
+            rc = delta_sphere_remove (delta, e->id);
+            break;
+      }
+   }
+
+   return rc;
+}
+
+/**
+ * delta_get - Read bytes from a delta.
+ * @p:    Pointer to read position, advanced past the bytes.
+ * @end:  End of the delta.
+ * @data: Pointer where to return the bytes.
+ * @len:  Number of bytes.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if the delta is truncated.
+ */
+static int delta_get (const uint8_t **p, const uint8_t *end, void *data, size_t len)
+{
+   if ((size_t)(end - *p) < len)
+      return 1;
+
+   memcpy (data, *p, len);
+   *p += len;
+
+   return 0;
+}
+
+/* Record read from a delta */
+typedef struct {
+   uint8_t  op;       /* Record operation, see delta_op_t */
+   uint32_t id;       /* Sphere ID */
+   double   pos[3];   /* Position */
+   float    value;    /* Radius or field of view */
+   uint8_t  rgb[3];   /* Color */
+} delta_rec_t;
+
+/**
+ * delta_read - Read and check a record of a delta.
+ * @p:   Pointer to read position, advanced past the record.
+ * @end: End of the delta.
+ * @rec: Pointer where to return the record.
+ *
+ * The values are checked with edit_check(), so that a record which reads
+ * is also logged.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if the record is malformed.
+ */
+static int delta_read (const uint8_t **p, const uint8_t *end, delta_rec_t *rec)
+{
+   int rc = 0;
+
+   memset (rec, 0, sizeof(*rec));
+   rec->op = *(*p)++;
+
+   if (rec->op >= DELTA_SPHERE_ADD && rec->op <= DELTA_SPHERE_REMOVE)
+   {
+      if (delta_get (p, end, &rec->id, sizeof(rec->id)))
+         goto truncated;
+      if (rec->id >= INT_MAX)
+      {
+         fprintf (stderr, "error: Sphere ID %u in delta is out of range\n", rec->id);
+         return 1;
+      }
+   }
+
+   switch (rec->op)
+   {
+      case DELTA_CAMERA_POS:
+         if (delta_get (p, end, rec->pos, sizeof(rec->pos)))
+            goto truncated;
+         rc = edit_check (EDIT_CAMERA_POS, rec->pos[0], rec->pos[1], rec->pos[2]);
+         break;
+
+      case DELTA_CAMERA_FOV:
+         if (delta_get (p, end, &rec->value, sizeof(rec->value)))
+            goto truncated;
+         rc = edit_check (EDIT_CAMERA_FOV, rec->value, 0, 0);
+         break;
+
+      case DELTA_SPHERE_ADD:
+         if (delta_get (p, end, rec->pos, sizeof(rec->pos)) ||
+             delta_get (p, end, &rec->value, sizeof(rec->value)) ||
+             delta_get (p, end, rec->rgb, sizeof(rec->rgb)))
+            goto truncated;
+         rc = edit_check (EDIT_SPHERE_CENTER, rec->pos[0], rec->pos[1], rec->pos[2]) ||
+              edit_check (EDIT_SPHERE_RADIUS, rec->value, 0, 0);
+         break;
+
+      case DELTA_SPHERE_CENTER:
+         if (delta_get (p, end, rec->pos, sizeof(rec->pos)))
+            goto truncated;
+         rc = edit_check (EDIT_SPHERE_CENTER, rec->pos[0], rec->pos[1], rec->pos[2]);
+         break;
+
+      case DELTA_SPHERE_RADIUS:
+         if (delta_get (p, end, &rec->value, sizeof(rec->value)))
+            goto truncated;
+         rc = edit_check (EDIT_SPHERE_RADIUS, rec->value, 0, 0);
+         break;
+
+      case DELTA_SPHERE_COLOR:
+         if (delta_get (p, end, rec->rgb, sizeof(rec->rgb)))
+            goto truncated;
+         break;
+
+      case DELTA_SPHERE_REMOVE:
+         break;
+
+      default:
+         fprintf (stderr, "error: Unknown delta record %d\n", rec->op);
+         return 1;
+   }
+
+   return rc;
+
+truncated:
+   fprintf (stderr, "error: Scene delta is truncated\n");
+   return 1;
+}
+
+/**
+ * delta_apply - Log the records of a delta as edits.
+ * @buf: Pointer to delta.
+ * @len: Number of bytes in @buf.
+ * @txn: Pointer to begun transaction.
+ *
+ * The whole delta is read and checked first, see delta_read(), so nothing
+ * is logged to @txn from a delta that is malformed. The records are then
+ * logged to @txn, which is committed or aborted by the caller, so applying
+ * a delta costs in proportion to the number of records and the spheres
+ * they change. A delta can only grow the scene by as many spheres as it has
+ * sphere records, which is checked by edit_commit(), see @max_added,
+ * against the scene as it is when committed. The scene isn't read here, as
+ * other deltas may be committed meanwhile.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if the delta is malformed or on error.
+ */
+int delta_apply (const uint8_t *buf, size_t len, edit_txn_t *txn)
+{
+   const uint8_t *p = buf, *end = buf + len;
+   const uint8_t *first;
+   delta_rec_t rec;
+   uint32_t magic;
+   int records = 0;   /* Number of sphere records */
+
+   if (!txn->scene)
+   {
+      fprintf (stderr, "error: No transaction begun\n");
+      return 1;
+   }
+   if (delta_get (&p, end, &magic, sizeof(magic)) || magic != DELTA_MAGIC)
+   {
+      fprintf (stderr, "error: Not a scene delta\n");
+      return 1;
+   }
+
+   first = p;
+   while (p < end)
+   {
+      if (delta_read (&p, end, &rec))
+         return 1;
+      if (rec.op >= DELTA_SPHERE_ADD)
+         records++;
+   }
+
+   p = first;
+   while (p < end)
+   {
+      int rc = 0;
+
+      delta_read (&p, end, &rec);
+      switch (rec.op)
+      {
+         case DELTA_CAMERA_POS:
+            rc = edit_camera_pos (txn, rec.pos[0], rec.pos[1], rec.pos[2]);
+            break;
+
+         case DELTA_CAMERA_FOV:
+            rc = edit_camera_fov (txn, rec.value);
+            break;
+
+         case DELTA_SPHERE_ADD:
+            rc = edit_sphere_center (txn, rec.id, rec.pos[0], rec.pos[1], rec.pos[2]) ||
+                 edit_sphere_radius (txn, rec.id, rec.value) ||
+                 edit_sphere_color (txn, rec.id, rec.rgb[0], rec.rgb[1], rec.rgb[2]);
+            break;
+
+         case DELTA_SPHERE_CENTER:
+            rc = edit_sphere_center (txn, rec.id, rec.pos[0], rec.pos[1], rec.pos[2]);
+            break;
+
+         case DELTA_SPHERE_RADIUS:
+            rc = edit_sphere_radius (txn, rec.id, rec.value);
+            break;
+
+         case DELTA_SPHERE_COLOR:
+            rc = edit_sphere_color (txn, rec.id, rec.rgb[0], rec.rgb[1], rec.rgb[2]);
+            break;
+
+         case DELTA_SPHERE_REMOVE:
+            rc = edit_sphere_remove (txn, rec.id);
+            break;
+      }
+      if (rc)
+         return 1;
+   }
+   txn->max_added = (txn->max_added > 0 ? txn->max_added : 0) + records;
+
+   return 0;
+}
+
+/**
+ * delta_send - Send a delta to a render server.
+ * @addr:    Server address, see net_connect().
+ * @delta:   Pointer to delta.
+ * @version: Pointer where to return the scene version of the server.
+ *
+ * The delta is posted to /scene on a server started with "srt -s", which
+ * applies it to its scene as one transaction.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int delta_send (const char *addr, delta_t *delta, unsigned long *version)
+{
+   char buf[512];
+   char *body;
+   size_t len = 0;
+   int status = 0;
+   int fd, n;
+
+   if (!delta->len && delta_put (delta, NULL, 0))
+      return 1;
+
+   fd = net_connect (addr);
+   if (fd < 0)
+   {
+      fprintf (stderr, "error: Unable to connect to %s\n", addr);
+      return 1;
+   }
+
+   n = snprintf (buf, sizeof(buf),
+                 "POST /scene HTTP/1.1\r\nHost: srt\r\n"
+                 "Content-Type: application/octet-stream\r\n"
+                 "Content-Length: %zu\r\nConnection: close\r\n\r\n", delta->len);
+   if (net_write (fd, buf, n) || net_write (fd, delta->buf, delta->len))
+   {
+      fprintf (stderr, "error: Unable to send delta to %s\n", addr);
+      close (fd);
+      return 1;
+   }
+
+   /* The response is short, read it until the server closes */
+   while (len < sizeof(buf) - 1)
+   {
+      ssize_t r = read (fd, buf + len, sizeof(buf) - 1 - len);
+
+      if (r <= 0)
+         break;
+      len += r;
+   }
+   buf[len] = 0;
+   close (fd);
+
+   body = strstr (buf, "\r\n\r\n");
+   if (sscanf (buf, "HTTP/1.%*d %d", &status) != 1 || !body)
+   {
+      fprintf (stderr, "error: Invalid response from %s\n", addr);
+      return 1;
+   }
+   body += 4;
+   if (status != 200)
+   {
+      fprintf (stderr, "error: Delta rejected by %s (%d): %s", addr, status, body);
+      return 1;
+   }
+   if (sscanf (body, "version: %lu", version) != 1)
+      *version = 0;
+
+   return 0;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
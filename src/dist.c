@@ -0,0 +1,558 @@
+/**
+ * dist.c - Distributed render class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines distributed rendering, where a master process hands
+ * out tiles of the screen to worker processes over sockets.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+
+#include "net.h"
+#include "scene.h"
+#include "render.h"
+
+#include "dist.h"
+
+/* Message types */
+#define DIST_MSG_SCENE   1   /* Master -> worker: frame size and scene */
+#define DIST_MSG_TILE    2   /* Master -> worker: tile to render */
+#define DIST_MSG_PIXELS  3   /* Worker -> master: rendered tile */
+#define DIST_MSG_QUIT    4   /* Master -> worker: frame is done */
+
+/* Maximum number of workers rendering the same tile at once. A tile is
+ * handed out a second time only when all other tiles are done or taken,
+ * i.e. an idle worker takes over the outstanding tile of a slow worker and
+ * whoever finishes first wins. */
+#define DIST_MAX_COPIES      2
+
+/* Number of connection attempts a worker does before giving up, and the
+ * delay in microseconds between each attempt */
+#define DIST_CONNECT_RETRIES 100
+#define DIST_CONNECT_DELAY   100000
+
+/* Largest packed scene accepted by a worker */
+#define DIST_MAX_SCENE_SZ    (1 << 30)
+
+/* Frame description sent in front of the packed scene */
+typedef struct {
+   int32_t width;    /* Width of the whole rendered screen */
+   int32_t height;   /* Height of the whole rendered screen */
+} dist_frame_t;
+
+/* Tile description, sent to a worker and returned in front of the pixels */
+typedef struct {
+   int32_t id;       /* Tile number */
+   int32_t x0, y0;   /* First column and row */
+   int32_t x1, y1;   /* Column and row after the last one */
+} dist_tile_msg_t;
+
+/* Master side state of a tile */
+typedef struct {
+   dist_tile_msg_t msg;   /* Tile description */
+   int    done;           /* Non-zero when the pixels are in the image */
+   int    issued;         /* Number of workers currently rendering the tile */
+   double issue_time;     /* Time when the tile was last handed out */
+} dist_tile_t;
+
+/* Master side state of a worker */
+typedef struct {
+   int fd;         /* Connection to worker, -1 if the worker is gone */
+   int tile;       /* Tile being rendered by the worker, -1 if idle */
+   int rendered;   /* Number of tiles the worker was first to deliver */
+} dist_node_t;
+
+/**
+ * dist_time - Get monotonic time in seconds.
+ *
+ * Returns:
+ * Current time.
+ */
+static double dist_time (void)
+{
+   struct timespec ts;
+
+   clock_gettime (CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * dist_pick_tile - Select the next tile for an idle worker.
+ * @tile:      Pointer to tile list.
+ * @num_tiles: Number of tiles in @tile.
+ * @next:      Pointer to index of first tile never handed out.
+ *
+ * Tiles are handed out in order. When all tiles have been handed out, the
+ * undone tile with fewest workers on it is picked, oldest hand out first.
+ * This will first pick up tiles lost by a disconnected worker and then
+ * duplicate tiles held by slow workers.
+ *
+ * Returns:
+ * Tile number or -1 if there is nothing left to hand out.
+ */
+static int dist_pick_tile (dist_tile_t *tile, int num_tiles, int *next)
+{
+   int best = -1;
+   int i;
+
+   if (*next < num_tiles)
+      return (*next)++;
+
+   for (i = 0; i < num_tiles; i++)
+   {
+      if (tile[i].done || tile[i].issued >= DIST_MAX_COPIES)
+         continue;
+      if (best == -1 ||
+          tile[i].issued < tile[best].issued ||
+          (tile[i].issued == tile[best].issued &&
+           tile[i].issue_time < tile[best].issue_time))
+         best = i;
+   }
+
+   return best;
+}
+
+/**
+ * dist_assign - Hand out a tile to an idle worker.
+ * @node:      Pointer to worker.
+ * @tile:      Pointer to tile list.
+ * @num_tiles: Number of tiles in @tile.
+ * @next:      Pointer to index of first tile never handed out.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if the worker couldn't be reached.
+ */
+static int dist_assign (dist_node_t *node, dist_tile_t *tile, int num_tiles, int *next)
+{
+   int id = dist_pick_tile (tile, num_tiles, next);
+
+   node->tile = id;
+   if (id == -1)
+      return 0;
+
+   tile[id].issued++;
+   tile[id].issue_time = dist_time ();
+
+   return net_send_msg (node->fd, DIST_MSG_TILE, &tile[id].msg, sizeof(tile[id].msg));
+}
+
+/**
+ * dist_drop - Remove a worker which has gone away.
+ * @node: Pointer to worker.
+ * @tile: Pointer to tile list.
+ *
+ * The tile held by the worker is released so it can be handed out again.
+ *
+ * Returns:
+ * none.
+ */
+static void dist_drop (dist_node_t *node, dist_tile_t *tile)
+{
+   fprintf (stderr, "warning: Lost connection to a worker.\n");
+
+   if (node->tile != -1)
+      tile[node->tile].issued--;
+
+   close (node->fd);
+   node->fd   = -1;
+   node->tile = -1;
+}
+
+/**
+ * dist_wake - Hand out tiles to idle workers.
+ * @node:        Pointer to worker list.
+ * @num_workers: Number of workers in @node.
+ * @tile:        Pointer to tile list.
+ * @num_tiles:   Number of tiles in @tile.
+ * @next:        Pointer to index of first tile never handed out.
+ *
+ * An idle worker only asks for a tile by delivering one, so when a worker
+ * is dropped the tile it released must be handed to an idle worker here,
+ * or the master would wait for the idle workers forever. Workers which
+ * can't be reached are dropped in turn.
+ *
+ * Returns:
+ * none.
+ */
+static void dist_wake (dist_node_t *node, int num_workers,
+                       dist_tile_t *tile, int num_tiles, int *next)
+{
+   int i;
+
+   for (i = 0; i < num_workers; i++)
+   {
+      if (node[i].fd < 0 || node[i].tile != -1)
+         continue;
+      if (dist_assign (&node[i], tile, num_tiles, next))
+      {
+         dist_drop (&node[i], tile);
+         i = -1;   /* Its tile may be taken by an earlier worker */
+      }
+   }
+}
+
+/**
+ * dist_put_tile - Copy a rendered tile into the image.
+ * @image:        Pointer to image buffer.
+ * @screen_width: Width of image.
+ * @msg:          Tile description.
+ * @pixels:       Pointer to packed tile pixels.
+ *
+ * Returns:
+ * none.
+ */
+static void dist_put_tile (uint8_t *image, int screen_width,
+                           dist_tile_msg_t *msg, const uint8_t *pixels)
+{
+   size_t row_sz = (msg->x1 - msg->x0) * 3;
+   int y;
+
+   for (y = msg->y0; y < msg->y1; y++)
+   {
+      memcpy (image + ((size_t)y * screen_width + msg->x0) * 3, pixels, row_sz);
+      pixels += row_sz;
+   }
+}
+
+/**
+ * dist_master - Render a scene using worker processes.
+ * @addr:          Address to listen on for workers.
+ * @num_workers:   Number of workers to wait for.
+ * @image:         Pointer to buffer which will contain the rendered scene
+ * @image_sz:      Size of @image buffer
+ * @screen_width:  Width of rendered screen
+ * @screen_height: Height of rendered screen
+ * @scene:         Pointer to scene object
+ *
+ * This function will wait for @num_workers workers (see dist_worker()) to
+ * connect to @addr and then send the scene to each of them, once. The screen
+ * is split into tiles of DIST_TILE_SIZE x DIST_TILE_SIZE pixels which are
+ * handed out one at a time, i.e. a fast worker will ask for new tiles more
+ * often than a slow one. When there are no more tiles to hand out, idle
+ * workers will also render the tiles still held by slower workers, and the
+ * first result to arrive is used. Tiles held by a worker that disconnects
+ * are handed out again. If all workers are lost, the remaining tiles are
+ * rendered locally.
+ * The image is identical to the one created by render_scene().
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int dist_master (const char *addr,
+                 int num_workers,
+                 uint8_t* image,
+                 size_t image_sz,
+                 int screen_width,
+                 int screen_height,
+                 scene_t *scene)
+{
+   const int cols = (screen_width  + DIST_TILE_SIZE - 1) / DIST_TILE_SIZE;
+   const int rows = (screen_height + DIST_TILE_SIZE - 1) / DIST_TILE_SIZE;
+   const int num_tiles = cols * rows;
+   dist_tile_t *tile = NULL;
+   dist_node_t *node = NULL;
+   struct pollfd *pfd = NULL;
+   uint8_t *buf = NULL;       /* Packed scene, later received tiles */
+   size_t buf_sz = 0;
+   dist_frame_t *frame;
+   int num_done = 0;
+   int next = 0;
+   int lfd;
+   int rc = 1;
+   int i;
+
+   if (num_workers < 1 || image_sz < (size_t)screen_width * screen_height * 3)
+      return 1;
+
+   lfd = net_listen (addr);
+   if (lfd < 0)
+      return 1;
+
+   tile = calloc (num_tiles, sizeof(*tile));
+   node = calloc (num_workers, sizeof(*node));
+   pfd  = calloc (num_workers, sizeof(*pfd));
+   buf_sz = sizeof(*frame) + scene_pack_size (scene);
+   buf  = malloc (buf_sz);
+   if (!tile || !node || !pfd || !buf)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for distributed rendering\n");
+      goto out;
+   }
+
+   /* Setup tiles */
+   for (i = 0; i < num_tiles; i++)
+   {
+      dist_tile_msg_t *msg = &tile[i].msg;
+
+      msg->id = i;
+      msg->x0 = (i % cols) * DIST_TILE_SIZE;
+      msg->y0 = (i / cols) * DIST_TILE_SIZE;
+      msg->x1 = msg->x0 + DIST_TILE_SIZE;
+      msg->y1 = msg->y0 + DIST_TILE_SIZE;
+      if (msg->x1 > screen_width)
+         msg->x1 = screen_width;
+      if (msg->y1 > screen_height)
+         msg->y1 = screen_height;
+   }
+
+   /* The scene is only packed once and shipped once to each worker */
+   frame = (dist_frame_t*)buf;
+   frame->width  = screen_width;
+   frame->height = screen_height;
+   scene_pack (scene, buf + sizeof(*frame), buf_sz - sizeof(*frame));
+
+   printf ("Waiting for %d workers on %s\n", num_workers, addr);
+   for (i = 0; i < num_workers; i++)
+   {
+      node[i].fd   = net_accept (lfd);
+      node[i].tile = -1;
+      if (node[i].fd < 0)
+      {
+         fprintf (stderr, "error: Unable to accept worker connection.\n");
+         for (i--; i >= 0; i--)
+            close (node[i].fd);
+         goto out;
+      }
+      if (net_send_msg (node[i].fd, DIST_MSG_SCENE, buf, buf_sz) ||
+          dist_assign (&node[i], tile, num_tiles, &next))
+         dist_drop (&node[i], tile);
+   }
+
+   dist_wake (node, num_workers, tile, num_tiles, &next);
+
+   while (num_done < num_tiles)
+   {
+      int num_alive = 0;
+      int dropped   = 0;
+
+      for (i = 0; i < num_workers; i++)
+      {
+         pfd[i].fd     = node[i].fd;
+         pfd[i].events = POLLIN;
+         if (node[i].fd >= 0)
+            num_alive++;
+      }
+      if (!num_alive)
+         break;
+
+      if (poll (pfd, num_workers, -1) < 0)
+         continue;
+
+      for (i = 0; i < num_workers; i++)
+      {
+         dist_tile_msg_t *msg;
+         net_msg_t hdr;
+
+         if (node[i].fd < 0 || !pfd[i].revents)
+            continue;
+
+         if (net_recv_msg (node[i].fd, &hdr, (void**)&buf, &buf_sz,
+                           sizeof(*msg) + DIST_TILE_SIZE * DIST_TILE_SIZE * 3) ||
+             hdr.type != DIST_MSG_PIXELS || hdr.len < sizeof(*msg))
+         {
+            dist_drop (&node[i], tile);
+            dropped = 1;
+            continue;
+         }
+
+         msg = (dist_tile_msg_t*)buf;
+         if (msg->id < 0 || msg->id >= num_tiles ||
+             hdr.len != sizeof(*msg) + (size_t)(msg->x1 - msg->x0) * (msg->y1 - msg->y0) * 3 ||
+             memcmp (msg, &tile[msg->id].msg, sizeof(*msg)))
+         {
+            dist_drop (&node[i], tile);
+            dropped = 1;
+            continue;
+         }
+
+         tile[msg->id].issued--;
+         if (!tile[msg->id].done)
+         {
+            dist_put_tile (image, screen_width, msg, buf + sizeof(*msg));
+            tile[msg->id].done = 1;
+            node[i].rendered++;
+            num_done++;
+         }
+
+         if (dist_assign (&node[i], tile, num_tiles, &next))
+         {
+            dist_drop (&node[i], tile);
+            dropped = 1;
+         }
+      }
+
+      if (dropped)
+         dist_wake (node, num_workers, tile, num_tiles, &next);
+   }
+
+   /* Render whatever is left if all workers were lost */
+   if (num_done < num_tiles)
+   {
+      const size_t max_sz = DIST_TILE_SIZE * DIST_TILE_SIZE * 3;
+
+      fprintf (stderr, "warning: No workers left, rendering %d tiles locally.\n",
+               num_tiles - num_done);
+      if (buf_sz < max_sz)
+      {
+         uint8_t *p = realloc (buf, max_sz);
+
+         if (!p)
+            goto out;
+         buf    = p;
+         buf_sz = max_sz;
+      }
+      for (i = 0; i < num_tiles; i++)
+      {
+         dist_tile_msg_t *msg = &tile[i].msg;
+         size_t sz = (size_t)(msg->x1 - msg->x0) * (msg->y1 - msg->y0) * 3;
+
+         if (tile[i].done)
+            continue;
+         if (render_tile (buf, sz, screen_width, screen_height,
+                          msg->x0, msg->y0, msg->x1, msg->y1, scene))
+            goto out;
+         dist_put_tile (image, screen_width, msg, buf);
+      }
+   }
+
+   for (i = 0; i < num_workers; i++)
+   {
+      if (node[i].fd < 0)
+         continue;
+      printf ("  worker %d: %d tiles\n", i, node[i].rendered);
+      net_send_msg (node[i].fd, DIST_MSG_QUIT, NULL, 0);
+      close (node[i].fd);
+   }
+   rc = 0;
+
+out:
+   net_close (lfd, addr);
+   free (tile);
+   free (node);
+   free (pfd);
+   free (buf);
+
+   return rc;
+}
+
+/**
+ * dist_worker - Serve a master process with rendered tiles.
+ * @addr: Address of the master.
+ *
+ * This function will connect to a master process (see dist_master()),
+ * retrying for a while if the master isn't listening yet. The scene is
+ * received once and then each tile handed out by the master is rendered
+ * and sent back, until the master says the frame is done.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int dist_worker (const char *addr)
+{
+   static scene_t scene;
+   dist_frame_t frame = { 0, 0 };
+   uint8_t *buf = NULL;    /* Received message payload */
+   size_t buf_sz = 0;
+   uint8_t *out = NULL;    /* Outgoing tile, header followed by pixels */
+   int fd = -1;
+   int rc = 1;
+   int i;
+
+   for (i = 0; i < DIST_CONNECT_RETRIES && fd < 0; i++)
+   {
+      fd = net_connect (addr);
+      if (fd < 0)
+         usleep (DIST_CONNECT_DELAY);
+   }
+   if (fd < 0)
+   {
+      fprintf (stderr, "error: Unable to connect to master at %s.\n", addr);
+      return 1;
+   }
+
+   out = malloc (sizeof(dist_tile_msg_t) + DIST_TILE_SIZE * DIST_TILE_SIZE * 3);
+   if (!out)
+      goto out;
+
+   while (1)
+   {
+      net_msg_t hdr;
+
+      if (net_recv_msg (fd, &hdr, (void**)&buf, &buf_sz,
+                        sizeof(frame) + DIST_MAX_SCENE_SZ))
+      {
+         fprintf (stderr, "error: Lost connection to master.\n");
+         break;
+      }
+
+      if (hdr.type == DIST_MSG_SCENE)
+      {
+         if (hdr.len < sizeof(frame) ||
+             scene_unpack (&scene, buf + sizeof(frame), hdr.len - sizeof(frame)))
+         {
+            fprintf (stderr, "error: Invalid scene received from master.\n");
+            break;
+         }
+         memcpy (&frame, buf, sizeof(frame));
+      }
+      else
+      if (hdr.type == DIST_MSG_TILE)
+      {
+         dist_tile_msg_t *msg = (dist_tile_msg_t*)out;
+         size_t sz;
+
+         if (hdr.len != sizeof(*msg))
+            break;
+         memcpy (msg, buf, sizeof(*msg));
+         if (msg->x1 - msg->x0 > DIST_TILE_SIZE || msg->y1 - msg->y0 > DIST_TILE_SIZE)
+            break;
+
+         sz = (size_t)(msg->x1 - msg->x0) * (msg->y1 - msg->y0) * 3;
+         if (render_tile (out + sizeof(*msg), sz, frame.width, frame.height,
+                          msg->x0, msg->y0, msg->x1, msg->y1, &scene))
+            break;
+         if (net_send_msg (fd, DIST_MSG_PIXELS, out, sizeof(*msg) + sz))
+            break;
+      }
+      else
+      if (hdr.type == DIST_MSG_QUIT)
+      {
+         rc = 0;
+         break;
+      }
+   }
+
+out:
+   close (fd);
+   free (buf);
+   free (out);
+
+   return rc;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
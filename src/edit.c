@@ -0,0 +1,453 @@
+/**
+ * edit.c - Edit class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines scene edit transactions. Edits are recorded in a log
+ * and applied to the scene all at once when the transaction is committed.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* memset */
+#include <math.h>
+
+#include "camera.h"
+#include "sphere.h"
+#include "color.h"
+#include "scene.h"
+
+#include "edit.h"
+
+/**
+ * edit_log - Append an edit to the log.
+ * @txn: Pointer to transaction.
+ * @op:  Operation.
+ * @id:  Sphere ID, -1 for camera edits.
+ * @a:   First value.
+ * @b:   Second value.
+ * @c:   Third value.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+static int edit_log (edit_txn_t *txn, edit_op_t op, int id, double a, double b, double c)
+{
+   edit_t *e;
+
+   if (!txn->scene)
+   {
+      fprintf (stderr, "error: No transaction begun\n");
+      return 1;
+   }
+   if (op >= EDIT_SPHERE_CENTER && id < 0)
+   {
+      fprintf (stderr, "error: Invalid sphere ID (%d)\n", id);
+      return 1;
+   }
+   if (edit_check (op, a, b, c))
+      return 1;
+
+   if (txn->num == txn->max)
+   {
+      int max = txn->max ? txn->max * 2 : 64;
+      edit_t *log = realloc (txn->log, max * sizeof(edit_t));
+
+      if (!log)
+      {
+         fprintf (stderr, "error: Unable to alloc memory for edit log\n");
+         return 1;
+      }
+      txn->log = log;
+      txn->max = max;
+   }
+
+   e = &txn->log[txn->num++];
+   e->op   = op;
+   e->id   = id;
+   e->v[0] = a;
+   e->v[1] = b;
+   e->v[2] = c;
+
+   return 0;
+}
+
+/**
+ * edit_cmp_id - Compare sphere IDs, for qsort().
+ * @a: Pointer to first ID.
+ * @b: Pointer to second ID.
+ *
+ * Returns:
+ * Negative, zero or positive as @a is less than, equal to or greater than @b.
+ */
+static int edit_cmp_id (const void *a, const void *b)
+{
+   return *(const int *)a - *(const int *)b;
+}
+
+/**
+ * edit_init - Init a transaction object.
+ * @txn: Pointer to transaction.
+ *
+ * Returns:
+ * none.
+ */
+void edit_init (edit_txn_t *txn)
+{
+   memset (txn, 0, sizeof(*txn));
+   txn->max_added = -1;
+}
+
+/**
+ * edit_begin - Begin a transaction.
+ * @txn:   Pointer to transaction.
+ * @scene: Pointer to scene to edit.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if a transaction is already begun.
+ */
+int edit_begin (edit_txn_t *txn, scene_t *scene)
+{
+   if (txn->scene)
+      return 1;
+
+   txn->scene     = scene;
+   txn->num       = 0;
+   txn->max_added = -1;
+
+   return 0;
+}
+
+/**
+ * edit_active - Check if a transaction is begun.
+ * @txn: Pointer to transaction.
+ *
+ * Returns:
+ * Number of logged edits plus one if begun, otherwise zero.
+ */
+int edit_active (edit_txn_t *txn)
+{
+   return txn->scene ? txn->num + 1 : 0;
+}
+
+/**
+ * edit_check - Check the values of an edit.
+ * @op: Operation.
+ * @a:  First value.
+ * @b:  Second value.
+ * @c:  Third value.
+ *
+ * Positions must be finite, a radius or field of view finite and not
+ * negative. Edits are checked when logged, but values received from
+ * elsewhere, e.g. by delta_apply(), can be checked up front as well.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if a value is invalid.
+ */
+int edit_check (edit_op_t op, double a, double b, double c)
+{
+   switch (op)
+   {
+      case EDIT_CAMERA_POS:
+      case EDIT_SPHERE_CENTER:
+         if (isfinite (a) && isfinite (b) && isfinite (c))
+            return 0;
+         fprintf (stderr, "error: Invalid position (%g, %g, %g)\n", a, b, c);
+         return 1;
+
+      case EDIT_CAMERA_FOV:
+      case EDIT_SPHERE_RADIUS:
+         if (isfinite (a) && a >= 0)
+            return 0;
+         fprintf (stderr, "error: Invalid %s (%g)\n",
+                  op == EDIT_CAMERA_FOV ? "field of view" : "radius", a);
+         return 1;
+
+      default:
+         return 0;
+   }
+}
+
+/**
+ * edit_camera_pos - Log a camera move.
+ * @txn: Pointer to transaction.
+ * @x:   World x coordinate.
+ * @y:   World y coordinate.
+ * @z:   World z coordinate.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int edit_camera_pos (edit_txn_t *txn, double x, double y, double z)
+{
+   return edit_log (txn, EDIT_CAMERA_POS, -1, x, y, z);
+}
+
+/**
+ * edit_camera_fov - Log a field of view change.
+ * @txn: Pointer to transaction.
+ * @fov: Field of view in radians.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int edit_camera_fov (edit_txn_t *txn, double fov)
+{
+   return edit_log (txn, EDIT_CAMERA_FOV, -1, fov, 0, 0);
+}
+
+/**
+ * edit_sphere_center - Log a sphere move.
+ * @txn: Pointer to transaction.
+ * @id:  Sphere ID. The scene is grown on commit if @id is beyond it.
+ * @x:   World x coordinate.
+ * @y:   World y coordinate.
+ * @z:   World z coordinate.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int edit_sphere_center (edit_txn_t *txn, int id, double x, double y, double z)
+{
+   return edit_log (txn, EDIT_SPHERE_CENTER, id, x, y, z);
+}
+
+/**
+ * edit_sphere_radius - Log a sphere radius change.
+ * @txn:    Pointer to transaction.
+ * @id:     Sphere ID. The scene is grown on commit if @id is beyond it.
+ * @radius: Radius.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int edit_sphere_radius (edit_txn_t *txn, int id, double radius)
+{
+   return edit_log (txn, EDIT_SPHERE_RADIUS, id, radius, 0, 0);
+}
+
+/**
+ * edit_sphere_color - Log a sphere color change.
+ * @txn: Pointer to transaction.
+ * @id:  Sphere ID. The scene is grown on commit if @id is beyond it.
+ * @r:   Red component.
+ * @g:   Green component.
+ * @b:   Blue component.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int edit_sphere_color (edit_txn_t *txn, int id, int r, int g, int b)
+{
+   return edit_log (txn, EDIT_SPHERE_COLOR, id, r, g, b);
+}
+
+/**
+ * edit_sphere_remove - Log a sphere removal.
+ * @txn: Pointer to transaction.
+ * @id:  Sphere ID, must exist when the removal is applied.
+ *
+ * The last sphere is moved into the slot of the removed one, see
+ * scene_remove_sphere(), so later edits in the transaction that refer to
+ * the last sphere must use @id.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int edit_sphere_remove (edit_txn_t *txn, int id)
+{
+   return edit_log (txn, EDIT_SPHERE_REMOVE, id, 0, 0, 0);
+}
+
+/**
+ * edit_commit - Commit a transaction.
+ * @txn: Pointer to transaction.
+ *
+ * The logged edits are applied to the scene in order, all or none of them.
+ * Everything that can fail, i.e. checking that each removed sphere exists
+ * and that no more than @max_added spheres are added, growing the scene to
+ * the most spheres it will hold and allocating the dirty list, is done
+ * before the scene is touched. Only the last camera move is applied, so the
+ * spheres are rebased on the camera once however many moves were logged.
+ * When done, the dirty list holds each edited sphere once, and @cam_dirty
+ * is set if the camera was edited, which doesn't dirty the spheres as their
+ * world positions are unchanged. The scene version is bumped once, so
+ * derived data, e.g. a scene snapshot, is updated once per commit, for the
+ * edited spheres only. A commit costs in proportion to its edits, not to
+ * the size of the scene, except for a camera move. The transaction ends
+ * either way.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int edit_commit (edit_txn_t *txn)
+{
+   scene_t *scene = txn->scene;
+   const edit_t *cam_pos = NULL;
+   int *dirty;
+   int num, cur, max;
+   int i, n, rc = 1;
+
+   if (!scene)
+      return 1;
+
+   /* Replay the number of spheres to check removals and find the peak */
+   cur = num = max = scene_get_num_spheres (scene);
+   for (i = 0; i < txn->num; i++)
+   {
+      const edit_t *e = &txn->log[i];
+
+      if (e->op == EDIT_SPHERE_REMOVE)
+      {
+         if (e->id >= num)
+         {
+            fprintf (stderr, "error: No sphere %d to remove\n", e->id);
+            goto out;
+         }
+         num--;
+      }
+      else if (e->id >= num)
+      {
+         num = e->id + 1;
+         if (num > max)
+            max = num;
+      }
+   }
+
+   if (txn->max_added >= 0 && max - cur > txn->max_added)
+   {
+      fprintf (stderr, "error: Commit adds %d spheres, at most %d allowed\n",
+               max - cur, txn->max_added);
+      goto out;
+   }
+
+   /* Each edit dirties at most two spheres */
+   dirty = realloc (txn->dirty, (2 * txn->num + 1) * sizeof(int));
+   if (!dirty)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for commit\n");
+      goto out;
+   }
+   txn->dirty = dirty;
+   if (max > cur && scene_set_num_spheres (scene, max))
+      goto out;
+
+   /* Nothing can fail from here on, the scene is allocated for the peak */
+   scene_set_num_spheres (scene, cur);
+   txn->cam_dirty = 0;
+   n = 0;
+   for (i = 0; i < txn->num; i++)
+   {
+      const edit_t *e = &txn->log[i];
+      sphere_t *sphere = scene_get_sphere (scene);
+
+      if (e->id >= scene_get_num_spheres (scene))
+         scene_set_num_spheres (scene, e->id + 1);
+
+      switch (e->op)
+      {
+         case EDIT_CAMERA_POS:
+            cam_pos = e;
+            break;
+
+         case EDIT_CAMERA_FOV:
+            scene_get_camera (scene)->fov = e->v[0];
+            break;
+
+         case EDIT_SPHERE_CENTER:
+            scene_set_sphere_center (scene, e->id, e->v[0], e->v[1], e->v[2]);
+            break;
+
+         case EDIT_SPHERE_RADIUS:
+            sphere[e->id].radius = e->v[0];
+            break;
+
+         case EDIT_SPHERE_COLOR:
+            color_set (&sphere[e->id].color, e->v[0], e->v[1], e->v[2]);
+            break;
+
+         case EDIT_SPHERE_REMOVE:
+            /* Both the removed slot and the moved last sphere change */
+            dirty[n++] = scene_get_num_spheres (scene) - 1;
+            scene_remove_sphere (scene, e->id);
+            break;
+      }
+
+      if (e->id < 0)
+         txn->cam_dirty = 1;
+      else
+         dirty[n++] = e->id;
+   }
+
+   if (cam_pos)
+      scene_set_camera_pos (scene, cam_pos->v[0], cam_pos->v[1], cam_pos->v[2]);
+
+   /* Sort the dirty list, dropping repeats and spheres removed since */
+   qsort (dirty, n, sizeof(int), edit_cmp_id);
+   num = scene_get_num_spheres (scene);
+   txn->num_dirty = 0;
+   for (i = 0; i < n && dirty[i] < num; i++)
+      if (!txn->num_dirty || dirty[txn->num_dirty - 1] != dirty[i])
+         dirty[txn->num_dirty++] = dirty[i];
+
+   if (txn->num)
+      scene_touch (scene);
+   rc = 0;
+
+out:
+   txn->scene = NULL;
+   txn->num   = 0;
+
+   return rc;
+}
+
+/**
+ * edit_abort - Abort a transaction.
+ * @txn: Pointer to transaction.
+ *
+ * The logged edits are dropped, the scene is left untouched.
+ *
+ * Returns:
+ * none.
+ */
+void edit_abort (edit_txn_t *txn)
+{
+   txn->scene = NULL;
+   txn->num   = 0;
+}
+
+/**
+ * edit_free - Free a transaction object.
+ * @txn: Pointer to transaction.
+ *
+ * Returns:
+ * none.
+ */
+void edit_free (edit_txn_t *txn)
+{
+   free (txn->log);
+   free (txn->dirty);
+   edit_init (txn);
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
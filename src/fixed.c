@@ -0,0 +1,304 @@
+/**
+ * fixed.c - Fixed point class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines a fixed point rendering backend, for targets where
+ * floating point is slow or emulated.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "scene.h"
+#include "render.h"
+#include "kernel.h"
+
+#include "fixed.h"
+
+/* Sphere in fixed point, relative to the camera */
+typedef struct {
+   fixed_t x, y, z;   /* Center, i.e. the O-E vector of sphere_intersect() */
+   int64_t k;         /* r² - c², Q2n */
+} fixed_sphere_t;
+
+/**
+ * fixed_sqrt - Integer square root.
+ * @x: Value.
+ *
+ * Returns:
+ * Largest integer whose square is not above @x.
+ */
+static uint64_t fixed_sqrt (uint64_t x)
+{
+   uint64_t r = 0;
+   uint64_t b = (uint64_t)1 << 62;
+
+   while (b > x)
+      b >>= 2;
+
+   while (b)
+   {
+      if (x >= r + b)
+      {
+         x -= r + b;
+         r  = (r >> 1) + b;
+      }
+      else
+         r >>= 1;
+      b >>= 2;
+   }
+
+   return r;
+}
+
+/**
+ * fixed_range - Find the Q format of a scene.
+ * @scene: Pointer to scene object.
+ *
+ * The largest coordinate of any sphere relative to the camera, or radius,
+ * bounds all values of the intersection test. This function returns the
+ * largest number of fractional bits, up to FIXED_MAX_FRAC, that keeps the
+ * bound below 2^FIXED_RANGE_BITS.
+ *
+ * Returns:
+ * Number of fractional bits, or -1 if the scene is too large even with
+ * FIXED_MIN_FRAC bits.
+ */
+int fixed_range (scene_t* scene)
+{
+   camera_t *cam    = scene_get_camera (scene);
+   sphere_t *sphere = scene_get_sphere (scene);
+   float bound = 1.0f;   /* The ray direction is a unit vector */
+   int frac;
+   int i;
+
+   for (i = 0; i < scene_get_num_spheres (scene); i++)
+   {
+      bound = fmaxf (bound, fabsf (sphere[i].center.x - cam->pos.x));
+      bound = fmaxf (bound, fabsf (sphere[i].center.y - cam->pos.y));
+      bound = fmaxf (bound, fabsf (sphere[i].center.z - cam->pos.z));
+      bound = fmaxf (bound, fabsf (sphere[i].radius));
+   }
+
+#ifdef FIXED_FRAC
+   frac = FIXED_FRAC;
+#else
+   frac = FIXED_MAX_FRAC;
+   while (frac > FIXED_MIN_FRAC && ldexpf (bound, frac) >= ldexpf (1.0f, FIXED_RANGE_BITS))
+      frac--;
+#endif
+
+   if (ldexpf (bound, frac) >= ldexpf (1.0f, FIXED_RANGE_BITS))
+   {
+      fprintf (stderr, "error: Scene is too large for fixed point, bound %g.\n", bound);
+      return -1;
+   }
+
+   return frac;
+}
+
+/**
+ * fixed_render - Creates a rendered scene in fixed point.
+ * @image:         Pointer to buffer which will contain the rendered scene
+ * @image_sz:      Size of @image buffer
+ * @screen_width:  Width of rendered screen
+ * @screen_height: Height of rendered screen
+ * @scene:         Pointer to scene object
+ *
+ * This function works as render_scene(), but rays are generated and spheres
+ * intersected using integer arithmetic only. Floating point is only used to
+ * convert the scene and camera once per frame. Spheres are converted relative
+ * to the camera, so the ray origin is zero and c² of each sphere is constant
+ * for the frame, leaving a dot product and, on a hit, an integer square root
+ * per sphere and pixel. The image may differ from render_scene() in pixels
+ * at sphere edges, see fixed_check(). With a level of detail set, see
+ * kernel_set_lod(), the scene is rendered by render_scene() instead, which
+ * splats the small spheres.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int fixed_render (uint8_t* image,
+                  size_t image_sz,
+                  int screen_width,
+                  int screen_height,
+                  scene_t* scene)
+{
+   camera_t *cam         = scene_get_camera (scene);
+   sphere_t *sphere_list = scene_get_sphere (scene);
+   const int num_spheres = scene_get_num_spheres (scene);
+   const float aspect_ratio = (float)screen_height / (float)screen_width;
+   const double ftan_x = tan (cam->fov);
+   const double ftan_y = tan (cam->fov * aspect_ratio);
+   fixed_sphere_t *fs;
+   int64_t tan_x, tan_y;   /* Tangent of field of view */
+   size_t image_ofs = 0;
+   int frac;
+   int x, y, i;
+
+   if (image_sz < (size_t)screen_width * screen_height * 3)
+      return 1;
+
+   if (kernel_get_lod () > 0)
+      return render_scene (image, image_sz, screen_width, screen_height, scene);
+
+   if (!(ftan_x > 0 && ftan_y > 0 &&
+         ftan_x * ftan_x + ftan_y * ftan_y + 1 < FIXED_MAX_TAN2))
+   {
+      fprintf (stderr, "error: Field of view is too wide for fixed point.\n");
+      return 1;
+   }
+
+   frac = fixed_range (scene);
+   if (frac < 0)
+      return 1;
+
+   fs = malloc ((num_spheres ? num_spheres : 1) * sizeof(*fs));
+   if (!fs)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for fixed point scene\n");
+      return 1;
+   }
+
+   /* Convert the scene */
+   for (i = 0; i < num_spheres; i++)
+   {
+      sphere_t *s = &sphere_list[i];
+      int64_t r = lrintf (ldexpf (s->radius, frac));
+
+      fs[i].x = lrintf (ldexpf (s->center.x - cam->pos.x, frac));
+      fs[i].y = lrintf (ldexpf (s->center.y - cam->pos.y, frac));
+      fs[i].z = lrintf (ldexpf (s->center.z - cam->pos.z, frac));
+      fs[i].k = r * r - ((int64_t)fs[i].x * fs[i].x +
+                         (int64_t)fs[i].y * fs[i].y +
+                         (int64_t)fs[i].z * fs[i].z);
+   }
+   tan_x = llrint (ldexp (ftan_x, FIXED_DIR_FRAC - 2));
+   tan_y = llrint (ldexp (ftan_y, FIXED_DIR_FRAC - 2));
+
+   for (y = 0; y < screen_height; y++)
+   {
+      /* Unnormalized ray direction as in kernel_trace() */
+      const int64_t ty = tan_y * (2*y - screen_height) / screen_height;
+
+      for (x = 0; x < screen_width; x++)
+      {
+         const int64_t tx = tan_x * (2*x - screen_width) / screen_width;
+         const int64_t tz = -((int64_t)1 << (FIXED_DIR_FRAC - 2));
+         int64_t len;
+         int64_t dx, dy, dz;      /* Normalized ray direction */
+         int64_t min_dist = INT64_MAX;
+         int closest_sphere = -1;
+
+         /* Normalize the direction */
+         len = fixed_sqrt (tx * tx + ty * ty + tz * tz);
+         dx  = tx * ((int64_t)1 << FIXED_DIR_FRAC) / len;
+         dy  = ty * ((int64_t)1 << FIXED_DIR_FRAC) / len;
+         dz  = tz * ((int64_t)1 << FIXED_DIR_FRAC) / len;
+
+         for (i = 0; i < num_spheres; i++)
+         {
+            const fixed_sphere_t *s = &fs[i];
+            int64_t v, d2, dist;
+
+            /* Scalar projection of O-E onto the ray, see sphere_intersect() */
+            v = (s->x * dx + s->y * dy + s->z * dz) >> FIXED_DIR_FRAC;
+            if (v < 0)
+               continue;
+
+            d2 = s->k + v * v;
+            if (d2 < 0)
+               continue;
+
+            dist = v - (int64_t)fixed_sqrt (d2);
+            if (dist > 0 && dist < min_dist)
+            {
+               min_dist       = dist;
+               closest_sphere = i;
+            }
+         }
+
+         if (closest_sphere != -1)
+         {
+            int r, g, b;
+
+            color_get (&sphere_list[closest_sphere].color, &r, &g, &b);
+            image[image_ofs + 0] = r;
+            image[image_ofs + 1] = g;
+            image[image_ofs + 2] = b;
+         }
+         else
+            memset (image + image_ofs, 0, 3);
+
+         image_ofs += 3;
+      }
+   }
+
+   free (fs);
+
+   return 0;
+}
+
+/**
+ * fixed_check - Compare the fixed point backend with the float path.
+ * @width:  Width of rendered screen.
+ * @height: Height of rendered screen.
+ * @scene:  Pointer to scene object.
+ * @err:    Pointer where to return the measured error, the depth error is
+ *          not measured.
+ *
+ * The images are compared as the precision tiers, see precision_compare().
+ *
+ * Returns:
+ * POSIX OK (zero) if no pixel is off by more than FIXED_MAX_SHIFT pixels,
+ * or non-zero if one is or on error.
+ */
+int fixed_check (int width, int height, scene_t* scene, precision_err_t* err)
+{
+   const size_t num = (size_t)width * height;
+   uint8_t *image = malloc (num * 3 * 2);
+   int rc = 1;
+
+   memset (err, 0, sizeof(*err));
+
+   if (!image)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for fixed point check\n");
+      return 1;
+   }
+
+   if (render_scene (image, num * 3, width, height, scene) ||
+       fixed_render (image + num * 3, num * 3, width, height, scene))
+      goto out;
+
+   precision_compare (image, image + num * 3, NULL, NULL, width, height, err);
+   rc = err->max_shift > FIXED_MAX_SHIFT;
+
+out:
+   free (image);
+
+   return rc;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,226 @@
+/**
+ * http.c - HTTP class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines a minimal HTTP/1.1 server side, enough to serve
+ * rendered images to a local viewer.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE   /* memmem, strcasestr */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "net.h"
+
+#include "http.h"
+
+/**
+ * http_init - Setup a connection.
+ * @conn: Pointer to connection.
+ * @fd:   Connected socket.
+ *
+ * Returns:
+ * none.
+ */
+void http_init (http_conn_t *conn, int fd)
+{
+   conn->fd  = fd;
+   conn->len = 0;
+}
+
+/**
+ * http_fill - Receive more data into the connection buffer.
+ * @conn: Pointer to connection.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error, closed connection or full buffer.
+ */
+static int http_fill (http_conn_t *conn)
+{
+   ssize_t n;
+
+   if (conn->len == sizeof(conn->buf))
+      return 1;
+
+   do
+      n = read (conn->fd, conn->buf + conn->len, sizeof(conn->buf) - conn->len);
+   while (n < 0 && errno == EINTR);
+
+   if (n <= 0)
+      return 1;
+   conn->len += n;
+
+   return 0;
+}
+
+/**
+ * http_consume - Remove data from the front of the connection buffer.
+ * @conn: Pointer to connection.
+ * @len:  Number of bytes to remove.
+ *
+ * Returns:
+ * none.
+ */
+static void http_consume (http_conn_t *conn, size_t len)
+{
+   memmove (conn->buf, conn->buf + len, conn->len - len);
+   conn->len -= len;
+}
+
+/**
+ * http_read_request - Read a request head.
+ * @conn: Pointer to connection.
+ * @req:  Pointer where to return the request.
+ *
+ * This function will read the request line and the headers. Only the
+ * Content-Length and Connection headers are used, the rest is ignored.
+ * HTTP/1.1 connections are kept alive unless the client asks otherwise.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error or closed connection.
+ */
+int http_read_request (http_conn_t *conn, http_req_t *req)
+{
+   char *end;
+   char *line;
+   char *next;
+   char version[16];
+
+   while (!(end = memmem (conn->buf, conn->len, "\r\n\r\n", 4)))
+      if (http_fill (conn))
+         return 1;
+   *end = 0;
+
+   memset (req, 0, sizeof(*req));
+   if (sscanf (conn->buf, "%7s %255s %15s", req->method, req->path, version) != 3)
+      return 1;
+   req->keep_alive = !strcmp (version, "HTTP/1.1");
+
+   for (line = strstr (conn->buf, "\r\n"); line && line < end; line = next)
+   {
+      line += 2;
+      next = strstr (line, "\r\n");
+      if (next)
+         *next = 0;
+
+      if (!strncasecmp (line, "Content-Length:", 15))
+         req->content_length = strtoul (line + 15, NULL, 10);
+      else
+      if (!strncasecmp (line, "Connection:", 11))
+      {
+         if (strcasestr (line + 11, "close"))
+            req->keep_alive = 0;
+         if (strcasestr (line + 11, "keep-alive"))
+            req->keep_alive = 1;
+      }
+   }
+
+   http_consume (conn, end + 4 - conn->buf);
+
+   return 0;
+}
+
+/**
+ * http_read_body - Read a request body.
+ * @conn: Pointer to connection.
+ * @buf:  Pointer to buffer.
+ * @len:  Number of bytes to read, i.e. the request content length.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error or closed connection.
+ */
+int http_read_body (http_conn_t *conn, void *buf, size_t len)
+{
+   size_t n = conn->len < len ? conn->len : len;
+
+   memcpy (buf, conn->buf, n);
+   http_consume (conn, n);
+
+   return net_read (conn->fd, (char*)buf + n, len - n);
+}
+
+/**
+ * http_reason - Get reason phrase of a status code.
+ * @status: HTTP status code.
+ *
+ * Returns:
+ * Reason phrase.
+ */
+static const char* http_reason (int status)
+{
+   switch (status)
+   {
+      case 200: return "OK";
+      case 400: return "Bad Request";
+      case 403: return "Forbidden";
+      case 404: return "Not Found";
+      case 405: return "Method Not Allowed";
+      case 413: return "Payload Too Large";
+      case 503: return "Service Unavailable";
+   }
+
+   return "Internal Server Error";
+}
+
+/**
+ * http_respond - Send a response.
+ * @conn:       Pointer to connection.
+ * @status:     HTTP status code.
+ * @type:       Content type of @body.
+ * @body:       Pointer to response body.
+ * @len:        Length of @body.
+ * @keep_alive: Non-zero if the connection will be kept.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int http_respond (http_conn_t *conn,
+                  int status,
+                  const char *type,
+                  const void *body,
+                  size_t len,
+                  int keep_alive)
+{
+   char head[256];
+   int n;
+
+   n = snprintf (head, sizeof(head),
+                 "HTTP/1.1 %d %s\r\n"
+                 "Content-Type: %s\r\n"
+                 "Content-Length: %zu\r\n"
+                 "Connection: %s\r\n"
+                 "\r\n",
+                 status, http_reason (status), type, len,
+                 keep_alive ? "keep-alive" : "close");
+
+   if (net_write (conn->fd, head, n))
+      return 1;
+
+   return len ? net_write (conn->fd, body, len) : 0;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,362 @@
+/**
+ * jit.c - JIT class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines rendering with a kernel specialised for the scene,
+ * compiled at runtime by the system C compiler.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "scene.h"
+#include "render.h"
+#include "precision.h"
+#include "kernel.h"
+#include "cachedir.h"
+
+#include "jit.h"
+
+/* Generated kernel, renders rows @y0 up to @y1 of the whole image */
+typedef void (*jit_kernel_t)(uint8_t* image, int y0, int y1);
+
+/* Currently loaded kernel */
+static void*        jit_handle = NULL;
+static uint64_t     jit_hash   = 0;
+static jit_kernel_t jit_kernel = NULL;
+
+/* Set when the compiler can't be run, to not try again for every frame */
+static int jit_no_cc = 0;
+
+/* Cache directory, found on first use, see cachedir_get() */
+static char jit_dir[PATH_MAX - 32];   /* Leave room for the file names */
+
+/**
+ * jit_emit - Write the C source of a kernel specialised for a scene.
+ * @fp:            Stream to write to.
+ * @screen_width:  Width of rendered screen.
+ * @screen_height: Height of rendered screen.
+ * @scene:         Pointer to scene object.
+ *
+ * The kernel does the same float operations as render_rect() does with the
+ * exact precision tier, with all the constants that don't depend on the ray
+ * baked in, see KERNEL_SPHERE_SETUP in kernel.c. Floats are written in hex
+ * to keep them exact.
+ *
+ * Returns:
+ * none.
+ */
+static void jit_emit (FILE* fp, int screen_width, int screen_height, scene_t* scene)
+{
+   camera_t *cam    = scene_get_camera (scene);
+   sphere_t *sphere = scene_get_sphere (scene);
+   const int num    = scene_get_num_spheres (scene);
+   const float aspect_ratio = (float)screen_height / (float)screen_width;
+   int i;
+
+   fprintf (fp, "/* Kernel generated by srt */\n"
+                "#include <math.h>\n"
+                "#include <string.h>\n\n"
+                "#define W %d\n#define H %d\n#define N %d\n\n",
+            screen_width, screen_height, num);
+   fprintf (fp, "static const double tan_x = %a;\n", tan (cam->fov));
+   fprintf (fp, "static const double tan_y = %a;\n\n", tan (cam->fov * aspect_ratio));
+
+   /* O-E vector, r² - c² and color of each sphere */
+   fprintf (fp, "static const float ox[N] = {");
+   for (i = 0; i < num; i++)
+      fprintf (fp, "%s%a", i ? ", " : "", (double)(sphere[i].center.x - cam->pos.x));
+   fprintf (fp, "};\nstatic const float oy[N] = {");
+   for (i = 0; i < num; i++)
+      fprintf (fp, "%s%a", i ? ", " : "", (double)(sphere[i].center.y - cam->pos.y));
+   fprintf (fp, "};\nstatic const float oz[N] = {");
+   for (i = 0; i < num; i++)
+      fprintf (fp, "%s%a", i ? ", " : "", (double)(sphere[i].center.z - cam->pos.z));
+   fprintf (fp, "};\nstatic const float k[N] = {");
+   for (i = 0; i < num; i++)
+   {
+      const float x = sphere[i].center.x - cam->pos.x;
+      const float y = sphere[i].center.y - cam->pos.y;
+      const float z = sphere[i].center.z - cam->pos.z;
+      const float c = sqrt (x * x + y * y + z * z);
+      const float k = (sphere[i].radius * sphere[i].radius) - (c * c);
+
+      fprintf (fp, "%s%a", i ? ", " : "", (double)k);
+   }
+   fprintf (fp, "};\nstatic const unsigned char color[N][3] = {");
+   for (i = 0; i < num; i++)
+   {
+      int r, g, b;
+
+      color_get (&sphere[i].color, &r, &g, &b);
+      fprintf (fp, "%s{%d, %d, %d}", i ? ", " : "", (uint8_t)r, (uint8_t)g, (uint8_t)b);
+   }
+   fprintf (fp, "};\n\n");
+
+   fprintf (fp,
+            "void jit_kernel (unsigned char* image, int y0, int y1)\n"
+            "{\n"
+            "   int x, y, i;\n\n"
+            "   for (y = y0; y < y1; y++)\n"
+            "   {\n"
+            "      unsigned char* p = image + (size_t)y * W * 3;\n"
+            "      const float ry = tan_y * (2*y - H) / H;\n\n"
+            "      for (x = 0; x < W; x++, p += 3)\n"
+            "      {\n"
+            "         float dx = tan_x * (2*x - W) / W;\n"
+            "         float dy = ry;\n"
+            "         float dz = -1;\n"
+            "         float len = sqrt (dx * dx + dy * dy + dz * dz);\n"
+            "         float min_dist = 100000;\n"
+            "         int closest = -1;\n\n"
+            "         if (len == 0.0f)\n"
+            "            len = 1.0f;\n"
+            "         dx = dx / len;\n"
+            "         dy = dy / len;\n"
+            "         dz = dz / len;\n\n"
+            "         for (i = 0; i < N; i++)\n"
+            "         {\n"
+            "            float v = ox[i] * dx + oy[i] * dy + oz[i] * dz;\n\n"
+            "            if (v >= 0)\n"
+            "            {\n"
+            "               float d2 = k[i] + (v * v);\n\n"
+            "               if (d2 >= 0)\n"
+            "               {\n"
+            "                  float dist = v - sqrtf (d2);\n\n"
+            "                  if (dist > 0.0 && dist < min_dist)\n"
+            "                  {\n"
+            "                     min_dist = dist;\n"
+            "                     closest  = i;\n"
+            "                  }\n"
+            "               }\n"
+            "            }\n"
+            "         }\n\n"
+            "         if (closest != -1)\n"
+            "            memcpy (p, color[closest], 3);\n"
+            "         else\n"
+            "            memset (p, 0, 3);\n"
+            "      }\n"
+            "   }\n"
+            "}\n");
+}
+
+/**
+ * jit_compile - Compile a kernel source to a shared object.
+ * @src: Path of C source.
+ * @obj: Path of shared object to create.
+ *
+ * The object is built under a temporary name and renamed when done, so
+ * other srt processes sharing the cache never load a partial object.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+static int jit_compile (const char* src, const char* obj)
+{
+   const char *cc = getenv ("CC") ? getenv ("CC") : JIT_CC;
+   char tmp[PATH_MAX + 16];
+   pid_t pid;
+   int status;
+
+   if (snprintf (tmp, sizeof(tmp), "%s.%d", obj, (int)getpid ()) >= (int)sizeof(tmp))
+      return 1;
+
+   pid = fork ();
+   if (pid < 0)
+      return 1;
+   if (pid == 0)
+   {
+      execlp (cc, cc, "-O2", "-shared", "-fPIC", "-ffp-contract=off",
+              "-o", tmp, src, "-lm", (char*)NULL);
+      _exit (127);
+   }
+   while (waitpid (pid, &status, 0) < 0)
+      if (errno != EINTR)
+         return 1;
+
+   if (!WIFEXITED (status) || WEXITSTATUS (status))
+   {
+      if (WIFEXITED (status) && WEXITSTATUS (status) == 127)
+      {
+         fprintf (stderr, "note: No C compiler (%s) found, using the generic renderer.\n", cc);
+         jit_no_cc = 1;
+      }
+      unlink (tmp);
+      return 1;
+   }
+
+   return rename (tmp, obj);
+}
+
+/**
+ * jit_load - Load the kernel for a scene, compiling it if not cached.
+ * @screen_width:  Width of rendered screen.
+ * @screen_height: Height of rendered screen.
+ * @scene:         Pointer to scene object.
+ *
+ * The kernel source is hashed, and the object is cached as <hash>.so in the
+ * cache directory, see JIT_DIR_ENV, next to its source <hash>.c. Both are
+ * written under names of their own for each process and then renamed, so
+ * processes compiling the same kernel don't overwrite each other's files.
+ * A kernel already loaded for the same source is reused.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+static int jit_load (int screen_width, int screen_height, scene_t* scene)
+{
+   char src[PATH_MAX], obj[PATH_MAX], tmp[PATH_MAX];
+   char *code = NULL;
+   size_t len = 0;
+   uint64_t hash = 0xcbf29ce484222325ULL;
+   FILE *fp;
+   size_t i;
+
+   fp = open_memstream (&code, &len);
+   if (!fp)
+      return 1;
+   jit_emit (fp, screen_width, screen_height, scene);
+   fclose (fp);
+
+   /* FNV-1a hash of the source */
+   for (i = 0; i < len; i++)
+      hash = (hash ^ (uint8_t)code[i]) * 0x100000001b3ULL;
+
+   if (jit_kernel && hash == jit_hash)
+   {
+      free (code);
+      return 0;
+   }
+
+   if (!jit_dir[0] && cachedir_get (JIT_DIR_ENV, "jit", jit_dir, sizeof(jit_dir)))
+   {
+      jit_dir[0] = '\0';
+      free (code);
+      return 1;
+   }
+   snprintf (src, sizeof(src), "%s/%016llx.c",  jit_dir, (unsigned long long)hash);
+   snprintf (obj, sizeof(obj), "%s/%016llx.so", jit_dir, (unsigned long long)hash);
+   snprintf (tmp, sizeof(tmp), "%s/%016llx.%d.c", jit_dir, (unsigned long long)hash,
+             (int)getpid ());
+
+   if (access (obj, R_OK))
+   {
+      int rc;
+
+      /* The source keeps its .c suffix, for the compiler */
+      fp = fopen (tmp, "w");
+      rc = !fp;
+      if (fp)
+      {
+         rc = fwrite (code, 1, len, fp) != len;
+         if (fclose (fp))
+            rc = 1;
+      }
+      if (rc)
+      {
+         fprintf (stderr, "error: Unable to write %s\n", tmp);
+         unlink (tmp);
+         free (code);
+         return 1;
+      }
+
+      rc = jit_compile (tmp, obj);
+      if (rc || rename (tmp, src))
+         unlink (tmp);
+      if (rc)
+      {
+         free (code);
+         return 1;
+      }
+   }
+   free (code);
+
+   if (jit_handle)
+      dlclose (jit_handle);
+   jit_kernel = NULL;
+
+   jit_handle = dlopen (obj, RTLD_NOW | RTLD_LOCAL);
+   if (!jit_handle)
+   {
+      fprintf (stderr, "error: Unable to load %s: %s\n", obj, dlerror ());
+      return 1;
+   }
+   jit_kernel = (jit_kernel_t)dlsym (jit_handle, "jit_kernel");
+   if (!jit_kernel)
+   {
+      fprintf (stderr, "error: No kernel in %s\n", obj);
+      return 1;
+   }
+   jit_hash = hash;
+
+   return 0;
+}
+
+/**
+ * jit_render - Creates a rendered scene with a scene specialised kernel.
+ * @image:         Pointer to buffer which will contain the rendered scene
+ * @image_sz:      Size of @image buffer
+ * @screen_width:  Width of rendered screen
+ * @screen_height: Height of rendered screen
+ * @scene:         Pointer to scene object
+ *
+ * This function works as render_scene(), but uses a kernel with the camera,
+ * the screen size and all spheres compiled in as constants. The first render
+ * of a scene pays for the compilation, later renders of the same scene and
+ * settings, also by other srt processes, load the cached object. If the
+ * kernel can't be built, e.g. if there is no C compiler, or if a precision
+ * tier other than exact or a level of detail is selected, render_scene() is
+ * used instead. So is it for scenes of more than JIT_MAX_SPHERES spheres,
+ * where the culling of render_scene() beats testing every sphere.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int jit_render (uint8_t* image,
+                size_t image_sz,
+                int screen_width,
+                int screen_height,
+                scene_t* scene)
+{
+   if (image_sz < (size_t)screen_width * screen_height * 3)
+      return 1;
+
+   if (jit_no_cc || precision_get () != PRECISION_EXACT || kernel_get_lod () > 0 ||
+       scene_get_num_spheres (scene) < 1 ||
+       scene_get_num_spheres (scene) > JIT_MAX_SPHERES ||
+       jit_load (screen_width, screen_height, scene))
+      return render_scene (image, image_sz, screen_width, screen_height, scene);
+
+   jit_kernel (image, 0, screen_height);
+
+   return 0;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
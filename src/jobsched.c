@@ -0,0 +1,407 @@
+/**
+ * jobsched.c - Job scheduler class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines a pool of render threads shared by render jobs of
+ * different priority classes, which are scheduled one tile at a time.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "render.h"
+#include "tilesched.h"
+
+#include "jobsched.h"
+
+/* Render job, the tiles are handed out in row order */
+typedef struct jobsched_job {
+   jobsched_class_t cls;         /* Priority class */
+   double    deadline;           /* Time it should be done, 0 for none */
+   double    submit;             /* Time it was submitted */
+   double    first;              /* Time its first tile was started */
+   uint8_t  *image;              /* Rendered region, packed */
+   int       screen_width;       /* Width of the whole rendered screen */
+   int       screen_height;      /* Height of the whole rendered screen */
+   int       x0, y0, x1, y1;     /* Rendered region */
+   scene_t  *scene;              /* Scene, not changed while rendering */
+   int       cols;               /* Number of tile columns */
+   int       num_tiles;          /* Number of tiles */
+   int       next;               /* Next tile to hand out */
+   int       done;               /* Number of finished tiles */
+   int       failed;             /* Non-zero if a tile failed */
+   struct jobsched_job *chain;   /* Next job of the class queue */
+} jobsched_job_t;
+
+/* Scheduler state, protected by @lock */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  work = PTHREAD_COND_INITIALIZER;   /* Tiles queued */
+static pthread_cond_t  done = PTHREAD_COND_INITIALIZER;   /* Job finished */
+static jobsched_job_t *queue[JOBSCHED_CLASSES];  /* Jobs with tiles left,
+                                                  * by deadline */
+static double vtime[JOBSCHED_CLASSES];           /* Virtual time, tiles
+                                                  * handed out / weight */
+static int weights[JOBSCHED_CLASSES] = JOBSCHED_WEIGHTS;
+static jobsched_stats_t stats[JOBSCHED_CLASSES];
+static int num_threads = 0;
+
+/* Class names, in class order */
+static const char *class_name[JOBSCHED_CLASSES] = { "interactive", "normal", "batch" };
+
+/**
+ * jobsched_pick - Pick the next tile to render.
+ * @tile: Pointer where to return the tile index.
+ *
+ * The class is picked by weighted fair sharing: each class has a virtual
+ * time that advances by one over its weight for each tile handed out, and
+ * the runnable class with the lowest virtual time goes next, the highest
+ * priority class on ties. A class that was idle starts at the lowest
+ * virtual time of the runnable classes, so it can't save up a share while
+ * idle. Within the class, the job with the earliest deadline goes first,
+ * jobs without a deadline last, in the order they were submitted. Call with
+ * @lock held.
+ *
+ * Returns:
+ * Pointer to the job of the tile, or NULL if there is none.
+ */
+static jobsched_job_t* jobsched_pick (int *tile)
+{
+   jobsched_job_t *job;
+   int c, best = -1;
+
+   for (c = 0; c < JOBSCHED_CLASSES; c++)
+      if (queue[c] && (best < 0 || vtime[c] < vtime[best]))
+         best = c;
+   if (best < 0)
+      return NULL;
+
+   job = queue[best];
+   *tile = job->next++;
+   if (job->next == job->num_tiles)
+      queue[best] = job->chain;
+   if (!*tile)
+      job->first = tilesched_time ();
+
+   vtime[best] += 1.0 / weights[best];
+   stats[best].tiles++;
+
+   return job;
+}
+
+/**
+ * jobsched_thread - Render thread.
+ * @arg: Unused.
+ *
+ * Renders one tile at a time, picking the tile anew after each, so a job
+ * of a higher class submitted meanwhile is started as soon as a tile is
+ * done. The tiles of the job it preempted are left in its queue, i.e. no
+ * work is lost or redone.
+ *
+ * Returns:
+ * NULL.
+ */
+static void* jobsched_thread (void *arg)
+{
+   uint8_t *buf = malloc (JOBSCHED_TILE * JOBSCHED_TILE * 3);
+
+   (void)arg;
+   if (!buf)
+      return NULL;
+
+   pthread_mutex_lock (&lock);
+   while (1)
+   {
+      jobsched_job_t *job;
+      int tile, x0, y0, x1, y1, w, y, rc;
+
+      job = jobsched_pick (&tile);
+      if (!job)
+      {
+         pthread_cond_wait (&work, &lock);
+         continue;
+      }
+      pthread_mutex_unlock (&lock);
+
+      x0 = job->x0 + (tile % job->cols) * JOBSCHED_TILE;
+      y0 = job->y0 + (tile / job->cols) * JOBSCHED_TILE;
+      x1 = x0 + JOBSCHED_TILE < job->x1 ? x0 + JOBSCHED_TILE : job->x1;
+      y1 = y0 + JOBSCHED_TILE < job->y1 ? y0 + JOBSCHED_TILE : job->y1;
+      w  = x1 - x0;
+
+      rc = render_tile (buf, JOBSCHED_TILE * JOBSCHED_TILE * 3,
+                        job->screen_width, job->screen_height,
+                        x0, y0, x1, y1, job->scene);
+      for (y = 0; !rc && y < y1 - y0; y++)
+         memcpy (job->image + ((size_t)(y0 - job->y0 + y) * (job->x1 - job->x0) +
+                               (x0 - job->x0)) * 3,
+                 buf + (size_t)y * w * 3, (size_t)w * 3);
+
+      pthread_mutex_lock (&lock);
+      if (rc)
+         job->failed = 1;
+      if (++job->done == job->num_tiles)
+         pthread_cond_broadcast (&done);
+   }
+
+   return NULL;
+}
+
+/**
+ * jobsched_start - Start the render threads.
+ * @num: Number of threads, or 0 for one for each online CPU.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int jobsched_start (int num)
+{
+   int i;
+
+   if (num_threads)
+      return 0;
+   if (num <= 0)
+      num = sysconf (_SC_NPROCESSORS_ONLN);
+   if (num <= 0)
+      num = 1;
+   if (num > JOBSCHED_MAX_THREADS)
+      num = JOBSCHED_MAX_THREADS;
+
+   pthread_mutex_lock (&lock);
+   for (i = 0; i < num; i++)
+   {
+      pthread_t thread;
+
+      if (pthread_create (&thread, NULL, jobsched_thread, NULL))
+         break;
+      pthread_detach (thread);
+   }
+   num_threads = i;
+   pthread_mutex_unlock (&lock);
+
+   if (!i)
+   {
+      fprintf (stderr, "error: Unable to start render threads.\n");
+      return 1;
+   }
+
+   return 0;
+}
+
+/**
+ * jobsched_get_threads - Get number of render threads.
+ *
+ * Returns:
+ * Number of running render threads.
+ */
+int jobsched_get_threads (void)
+{
+   int num;
+
+   pthread_mutex_lock (&lock);
+   num = num_threads;
+   pthread_mutex_unlock (&lock);
+
+   return num;
+}
+
+/**
+ * jobsched_class - Get a class by name.
+ * @name: Class name, "interactive", "normal" or "batch".
+ *
+ * Returns:
+ * Class, or JOBSCHED_CLASSES if @name is unknown.
+ */
+jobsched_class_t jobsched_class (const char *name)
+{
+   int c;
+
+   for (c = 0; c < JOBSCHED_CLASSES; c++)
+      if (!strcmp (name, class_name[c]))
+         break;
+
+   return c;
+}
+
+/**
+ * jobsched_class_name - Get name of a class.
+ * @cls: Class.
+ *
+ * Returns:
+ * Class name.
+ */
+const char* jobsched_class_name (jobsched_class_t cls)
+{
+   return cls < JOBSCHED_CLASSES ? class_name[cls] : "unknown";
+}
+
+/**
+ * jobsched_set_weight - Set share weight of a class.
+ * @cls:    Class.
+ * @weight: Weight, a class gets @weight tiles for each tile of a class with
+ *          weight one when both have tiles queued.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if @cls or @weight is invalid.
+ */
+int jobsched_set_weight (jobsched_class_t cls, int weight)
+{
+   if (cls >= JOBSCHED_CLASSES || weight < 1)
+      return 1;
+
+   pthread_mutex_lock (&lock);
+   weights[cls] = weight;
+   pthread_mutex_unlock (&lock);
+
+   return 0;
+}
+
+/**
+ * jobsched_render - Render a region with the render threads.
+ * @image:         Pointer to buffer which will contain the rendered region
+ * @image_sz:      Size of @image buffer
+ * @screen_width:  Width of the whole rendered screen
+ * @screen_height: Height of the whole rendered screen
+ * @x0:            First column of the region
+ * @y0:            First row of the region
+ * @x1:            Column after the last column of the region
+ * @y1:            Row after the last row of the region
+ * @scene:         Pointer to scene object, must not be changed until done
+ * @cls:           Priority class
+ * @deadline:      Seconds until the region should be done, or 0 for none
+ *
+ * This function works as render_tile(), but the region is split into tiles
+ * of JOBSCHED_TILE pixels which are rendered by the render threads, see
+ * jobsched_pick() for the order, and waits for them. The render threads
+ * must be started with jobsched_start() first.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int jobsched_render (uint8_t* image,
+                     size_t image_sz,
+                     int screen_width,
+                     int screen_height,
+                     int x0,
+                     int y0,
+                     int x1,
+                     int y1,
+                     scene_t *scene,
+                     jobsched_class_t cls,
+                     double deadline)
+{
+   jobsched_job_t job, **p;
+   double now = tilesched_time ();
+   int c, idle = 1;
+   int rc;
+
+   if (cls >= JOBSCHED_CLASSES || x0 < 0 || y0 < 0 || x0 >= x1 || y0 >= y1 ||
+       x1 > screen_width || y1 > screen_height ||
+       image_sz < (size_t)(x1 - x0) * (y1 - y0) * 3)
+      return 1;
+
+   memset (&job, 0, sizeof(job));
+   job.cls           = cls;
+   job.submit        = now;
+   job.deadline      = deadline > 0 ? now + deadline : 0;
+   job.image         = image;
+   job.screen_width  = screen_width;
+   job.screen_height = screen_height;
+   job.x0            = x0;
+   job.y0            = y0;
+   job.x1            = x1;
+   job.y1            = y1;
+   job.scene         = scene;
+   job.cols          = (x1 - x0 + JOBSCHED_TILE - 1) / JOBSCHED_TILE;
+   job.num_tiles     = job.cols * ((y1 - y0 + JOBSCHED_TILE - 1) / JOBSCHED_TILE);
+
+   pthread_mutex_lock (&lock);
+   if (!num_threads)
+   {
+      pthread_mutex_unlock (&lock);
+      fprintf (stderr, "error: Render threads are not started.\n");
+      return 1;
+   }
+
+   /* An idle class starts at the virtual time of the busy ones */
+   if (!queue[cls])
+   {
+      double min = 0;
+
+      for (c = 0; c < JOBSCHED_CLASSES; c++)
+         if (queue[c] && (idle || vtime[c] < min))
+         {
+            min  = vtime[c];
+            idle = 0;
+         }
+      if (!idle && vtime[cls] < min)
+         vtime[cls] = min;
+   }
+
+   /* Earliest deadline first, no deadline last, in submit order */
+   for (p = &queue[cls]; *p; p = &(*p)->chain)
+      if (job.deadline && (!(*p)->deadline || job.deadline < (*p)->deadline))
+         break;
+   job.chain = *p;
+   *p = &job;
+   stats[cls].queued++;
+   pthread_cond_broadcast (&work);
+
+   while (job.done < job.num_tiles)
+      pthread_cond_wait (&done, &lock);
+
+   now = tilesched_time ();
+   stats[cls].queued--;
+   stats[cls].jobs++;
+   stats[cls].wait += job.first - job.submit;
+   stats[cls].time += now - job.submit;
+   if (job.deadline && now > job.deadline)
+      stats[cls].missed++;
+   rc = job.failed;
+   pthread_mutex_unlock (&lock);
+
+   return rc;
+}
+
+/**
+ * jobsched_get_stats - Get statistics of a class.
+ * @cls:   Class.
+ * @s:     Pointer where to return the statistics.
+ *
+ * Returns:
+ * none.
+ */
+void jobsched_get_stats (jobsched_class_t cls, jobsched_stats_t *s)
+{
+   memset (s, 0, sizeof(*s));
+   if (cls >= JOBSCHED_CLASSES)
+      return;
+
+   pthread_mutex_lock (&lock);
+   *s = stats[cls];
+   s->weight = weights[cls];
+   pthread_mutex_unlock (&lock);
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,1850 @@
+/**
+ * kernel.c - Kernel class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines the render kernels. A kernel is compiled for each
+ * combination of pixel format, SIMD width, accelerator and statistics, and
+ * for each small sphere count, and is picked once per render.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* memset */
+#include <float.h>
+#include <math.h>
+
+#include "vector.h"
+#include "ray.h"
+#include "camera.h"
+#include "sphere.h"
+#include "scene.h"
+
+#include "kernel.h"
+
+/* Vectors of four floats and of four comparison results */
+typedef float   v4sf __attribute__ ((vector_size (16)));
+typedef int32_t v4si __attribute__ ((vector_size (16)));
+
+/* Node of the sphere tree of kernel_init_splats(), with the aggregate of
+ * its spheres, relative to the camera */
+typedef struct {
+   int   first;      /* First sphere, in tree order */
+   int   num;        /* Number of spheres */
+   int   child;      /* First of the two children, -1 for a leaf */
+   float c[3];       /* Center of the bounding sphere */
+   float r;          /* Radius of the bounding sphere */
+   float m[3];       /* Sum of the centers weighted by r² */
+   float area;       /* Sum of r² */
+   float color[3];   /* Sum of the colors weighted by r² */
+} kernel_node_t;
+
+/* Kernel settings, used by the following renders */
+static kernel_simd_t  simd  = KERNEL_SIMD_4;
+static kernel_accel_t accel = KERNEL_ACCEL_CULL;
+static int            stats = 0;
+static float          lod   = 0;
+
+/* Statistics of all renders with statistics enabled */
+static kernel_stats_t total;
+
+/* Accelerator names */
+static const char *accel_names[KERNEL_ACCEL_NUM] = {
+   "none",
+   "cull",
+};
+
+/**
+ * kernel_ray - Setup the ray through a pixel.
+ * @ctx: Pointer to render context.
+ * @x:   Column of the pixel.
+ * @y:   Row of the pixel.
+ * @d:   Array where to return the ray direction.
+ * @l2:  Pointer where to return the squared length of the direction.
+ * @rl:  Pointer where to return the reciprocal length of the direction.
+ *
+ * The exact tier normalizes the direction, giving @l2 and @rl of one. The
+ * fast tiers leave it as is and only find @rl, at the precision of the
+ * tier. The ray tests then scale d² by @l2 and the distance by @rl, see
+ * kernel_test(), so only the distance depends on the precision of @rl and
+ * the hits are the same as for a unit direction.
+ *
+ * Returns:
+ * none.
+ */
+static inline __attribute__ ((always_inline))
+void kernel_ray (kernel_ctx_t* ctx, int x, int y, float* d,
+                float* l2, float* rl)
+{
+   vector_t dir;
+
+   dir.x = ctx->dir_x[x];
+   dir.y = ctx->dir_y[y];
+   dir.z = -1;
+
+   if (ctx->prec == PRECISION_EXACT)
+   {
+      vector_normal (&dir);
+      *l2 = 1;
+      *rl = 1;
+   }
+   else
+   {
+      *l2 = dir.x * dir.x + dir.y * dir.y + dir.z * dir.z;
+      *rl = precision_rsqrt (*l2, ctx->prec);
+   }
+
+   d[0] = dir.x;
+   d[1] = dir.y;
+   d[2] = dir.z;
+}
+
+/**
+ * kernel_v - Find the scalar projection of O-E onto a ray.
+ * @ctx: Pointer to render context.
+ * @s:   Pointer to sphere constants.
+ * @d:   Ray direction, see kernel_ray().
+ *
+ * In the fast tiers the ray direction isn't normalized, so its y and z are
+ * the same for the whole row and their part of v can be found once per row,
+ * see kernel_body(). It is added last, to give the same v either way.
+ *
+ * Returns:
+ * Scalar projection v.
+ */
+static inline __attribute__ ((always_inline))
+float kernel_v (kernel_ctx_t* ctx, const kernel_sphere_t* s, const float* d)
+{
+   if (ctx->prec == PRECISION_EXACT)
+      return s->ox * d[0] + s->oy * d[1] + s->oz * d[2];
+
+   return s->ox * d[0] + (s->oy * d[1] - s->oz);
+}
+
+/**
+ * kernel_test - Test a ray against a sphere.
+ * @ctx:      Pointer to render context.
+ * @id:       Array ID of sphere.
+ * @v:        Scalar projection of O-E onto the ray.
+ * @d2:       Computed d² value, see sphere_intersect().
+ * @rl:       Reciprocal length of the ray direction, see kernel_ray().
+ * @min_dist: Pointer to distance of the closest hit so far.
+ * @closest:  Pointer to array ID of the closest sphere so far.
+ *
+ * The last part of sphere_intersect(), for a ray where @v and @d2 are known
+ * to be zero or greater. The closest hit is updated if the sphere is closer.
+ *
+ * Returns:
+ * none.
+ */
+static inline __attribute__ ((always_inline))
+void kernel_test (kernel_ctx_t* ctx, int id, float v, float d2,
+                 float rl, float* min_dist, int* closest)
+{
+   const float dist = ctx->prec == PRECISION_EXACT ? v - sqrtf (d2) :
+                      (v - precision_sqrt (d2, ctx->prec)) * rl;
+
+   if (dist > 0.0f && dist < *min_dist)
+   {
+      *min_dist = dist;
+      *closest  = id;
+   }
+}
+
+/**
+ * kernel_rsqrt4 - Calculate four reciprocal square roots.
+ * @x: Values, greater than zero.
+ * @p: Precision tier.
+ *
+ * Returns:
+ * precision_rsqrt() of each value of @x.
+ */
+static inline __attribute__ ((always_inline))
+v4sf kernel_rsqrt4 (v4sf x, precision_t p)
+{
+#ifdef __SSE__
+   const v4sf one  = { 1.0f, 1.0f, 1.0f, 1.0f };
+   const v4sf half = { 0.5f, 0.5f, 0.5f, 0.5f };
+   const v4sf c    = { 1.5f, 1.5f, 1.5f, 1.5f };
+   v4sf y;
+
+   if (p == PRECISION_EXACT)
+      return one / (v4sf)_mm_sqrt_ps ((__m128)x);
+
+   y = (v4sf)_mm_rsqrt_ps ((__m128)x);
+   if (p == PRECISION_FAST)
+      y = y * (c - half * x * y * y);
+
+   return y;
+#else
+   v4sf y;
+   int l;
+
+   for (l = 0; l < 4; l++)
+      y[l] = precision_rsqrt (x[l], p);
+
+   return y;
+#endif
+}
+
+/**
+ * kernel_sqrt4 - Calculate four square roots.
+ * @x: Values, zero or greater.
+ * @p: Precision tier.
+ *
+ * Returns:
+ * precision_sqrt() of each value of @x.
+ */
+static inline __attribute__ ((always_inline))
+v4sf kernel_sqrt4 (v4sf x, precision_t p)
+{
+#ifdef __SSE__
+   if (p == PRECISION_EXACT)
+      return (v4sf)_mm_sqrt_ps ((__m128)x);
+
+   return x * kernel_rsqrt4 (x, p);
+#else
+   v4sf y;
+   int l;
+
+   for (l = 0; l < 4; l++)
+      y[l] = precision_sqrt (x[l], p);
+
+   return y;
+#endif
+}
+
+/**
+ * kernel_any4 - Check if any of four comparison results is true.
+ * @m: Comparison results.
+ *
+ * Returns:
+ * Non-zero if any lane of @m is true.
+ */
+static inline __attribute__ ((always_inline))
+int kernel_any4 (v4si m)
+{
+#ifdef __SSE__
+   return _mm_movemask_ps ((__m128)m);
+#else
+   return m[0] | m[1] | m[2] | m[3];
+#endif
+}
+
+/**
+ * kernel_lanes - Test four rays against the spheres.
+ * @ctx:      Pointer to render context.
+ * @list:     Array IDs of the spheres to test, or NULL for all.
+ * @num:      Number of spheres to test.
+ * @DX:       Ray direction x, see kernel_ray().
+ * @DY:       Ray direction y.
+ * @DZ:       Ray direction z.
+ * @L2:       Squared length of the ray direction.
+ * @RL:       Reciprocal length of the ray direction.
+ * @prec:     Precision tier.
+ * @min_dist: Pointer to distance of the closest hit so far of each ray.
+ * @closest:  Pointer to array ID of the closest sphere so far of each ray.
+ *
+ * This function does the tests of kernel_v() and kernel_test() on all four
+ * lanes. It is inlined with a constant @prec, keeping the tier branches out
+ * of the sphere loop.
+ *
+ * Returns:
+ * none.
+ */
+static inline __attribute__ ((always_inline))
+void kernel_lanes (kernel_ctx_t* ctx,
+                   const int* list,
+                   int num,
+                   v4sf DX,
+                   v4sf DY,
+                   v4sf DZ,
+                   v4sf L2,
+                   v4sf RL,
+                   const precision_t prec,
+                   v4sf* min_dist,
+                   v4si* closest)
+{
+   const v4sf zero = { 0, 0, 0, 0 };
+   v4sf MIN = *min_dist;
+   v4si CLOSEST = *closest;
+   int i;
+
+   for (i = 0; i < num; i++)
+   {
+      const int id = list ? list[i] : i;
+      const kernel_sphere_t *s = &ctx->sphere[id];
+      const v4sf OX = { s->ox, s->ox, s->ox, s->ox };
+      const v4sf K  = { s->k, s->k, s->k, s->k };
+      v4sf V, D2;
+      v4si M;
+
+      if (prec == PRECISION_EXACT)
+      {
+         const v4sf OY = { s->oy, s->oy, s->oy, s->oy };
+         const v4sf OZ = { s->oz, s->oz, s->oz, s->oz };
+
+         V = OX * DX + OY * DY + OZ * DZ;
+      }
+      else
+      {
+         const v4sf R = { ctx->row[i], ctx->row[i], ctx->row[i], ctx->row[i] };
+
+         V = OX * DX + R;
+      }
+      D2 = K * L2 + V * V;
+      M  = (V >= zero) & (D2 >= zero);
+
+      if (kernel_any4 (M))
+      {
+         const v4si ID   = { id, id, id, id };
+         const v4sf DIST = (V - kernel_sqrt4 (D2, prec)) * RL;
+         const v4si C    = M & (DIST > zero) & (DIST < MIN);
+
+         MIN     = (v4sf)(((v4si)MIN & ~C) | ((v4si)DIST & C));
+         CLOSEST = (CLOSEST & ~C) | (ID & C);
+      }
+   }
+
+   *min_dist = MIN;
+   *closest  = CLOSEST;
+}
+
+/**
+ * kernel_rays4 - Trace four rays of a row.
+ * @ctx:      Pointer to render context.
+ * @list:     Array IDs of the spheres to test, or NULL for all.
+ * @num:      Number of spheres to test.
+ * @DX:       Ray direction x of each ray.
+ * @dy:       Ray direction y of the row.
+ * @min_dist: Pointer where to return the distance to the closest hit of
+ *            each ray.
+ * @closest:  Pointer where to return the array ID of the closest sphere hit
+ *            by each ray, or -1.
+ *
+ * The rays are setup as kernel_ray() does and tested with kernel_lanes(). In
+ * the fast tiers ctx->row must hold the part of v of the row for each
+ * sphere of @list, see kernel_v().
+ *
+ * Returns:
+ * none.
+ */
+static inline __attribute__ ((always_inline))
+void kernel_rays4 (kernel_ctx_t* ctx,
+                   const int* list,
+                   int num,
+                   v4sf DX,
+                   float dy,
+                   v4sf* min_dist,
+                   v4si* closest)
+{
+   const v4sf one = { 1, 1, 1, 1 };
+   v4sf DY = { dy, dy, dy, dy };
+   v4sf DZ = -one;
+   v4sf L2 = DX * DX + DY * DY + DZ * DZ;
+   v4sf RL = one;
+   v4sf MIN = { 100000, 100000, 100000, 100000 };
+   v4si CLOSEST = { -1, -1, -1, -1 };
+
+   if (ctx->prec == PRECISION_EXACT)
+   {
+      const v4sf LEN = kernel_sqrt4 (L2, PRECISION_EXACT);
+
+      DX = DX / LEN;
+      DY = DY / LEN;
+      DZ = DZ / LEN;
+      L2 = one;
+      kernel_lanes (ctx, list, num, DX, DY, DZ, L2, RL,
+                    PRECISION_EXACT, &MIN, &CLOSEST);
+   }
+   else if (ctx->prec == PRECISION_FAST)
+   {
+      RL = kernel_rsqrt4 (L2, PRECISION_FAST);
+      kernel_lanes (ctx, list, num, DX, DY, DZ, L2, RL,
+                    PRECISION_FAST, &MIN, &CLOSEST);
+   }
+   else
+   {
+      RL = kernel_rsqrt4 (L2, PRECISION_FASTEST);
+      kernel_lanes (ctx, list, num, DX, DY, DZ, L2, RL,
+                    PRECISION_FASTEST, &MIN, &CLOSEST);
+   }
+
+   *min_dist = MIN;
+   *closest  = CLOSEST;
+}
+
+/**
+ * kernel_body - Common code of the kernel matrix.
+ * @ctx:    Pointer to render context.
+ * @tile:   Pointer to the first pixel of the rectangle.
+ * @depth:  Pointer to the first depth of the rectangle or NULL.
+ * @stride: Number of pixels between rows in @tile and @depth.
+ * @x0:     First column of the rectangle.
+ * @y0:     First row of the rectangle.
+ * @x1:     Column after the last column of the rectangle.
+ * @y1:     Row after the last row of the rectangle.
+ * @fmt:    Pixel format.
+ * @width:  SIMD width.
+ * @acc:    Accelerator.
+ * @count:  Non-zero to count statistics.
+ *
+ * This function is inlined into each kernel of the matrix with constant
+ * @fmt, @width, @acc and @count, so each kernel is compiled without the
+ * branches of the other combinations. Rays are generated and tested as in
+ * kernel_trace(), giving the same pixels whatever the combination.
+ *
+ * Returns:
+ * none.
+ */
+static inline __attribute__ ((always_inline))
+void kernel_body (kernel_ctx_t* ctx,
+                  uint8_t* tile,
+                  float* depth,
+                  int stride,
+                  int x0,
+                  int y0,
+                  int x1,
+                  int y1,
+                  const kernel_fmt_t fmt,
+                  const kernel_simd_t width,
+                  const kernel_accel_t acc,
+                  const int count)
+{
+   sphere_t *sphere = scene_get_sphere (ctx->scene);
+   const int bpp    = fmt == KERNEL_FMT_RGBA32 ? 4 : 3;
+   const int lanes  = width == KERNEL_SIMD_4 ? 4 : 1;
+   const int *list  = NULL;
+   int num = scene_get_num_spheres (ctx->scene);
+   int x, y, i, l;
+
+   /* Select the spheres to test, of the traced ones if some are splatted */
+   if (acc == KERNEL_ACCEL_CULL)
+   {
+      const int num_trace = ctx->trace ? ctx->num_trace : num;
+      int *sel = ctx->list;
+      int n = 0;
+
+      for (l = 0; l < num_trace; l++)
+      {
+         const int *b;
+
+         i = ctx->trace ? ctx->trace[l] : l;
+         b = &ctx->bounds[i * 4];
+         if (b[0] < x1 && b[2] > x0 && b[1] < y1 && b[3] > y0)
+            sel[n++] = i;
+      }
+      list = sel;
+      num  = n;
+   }
+
+   for (y = y0; y < y1; y++)
+   {
+      uint8_t *row = tile + (size_t)(y - y0) * stride * bpp;
+
+      /* Clear the row to set black as default background color */
+      memset (row, 0, (size_t)(x1 - x0) * bpp);
+
+      /* Part of v which is the same for the whole row, see kernel_v() */
+      if (ctx->prec != PRECISION_EXACT)
+      {
+         for (i = 0; i < num; i++)
+         {
+            const kernel_sphere_t *s = &ctx->sphere[list ? list[i] : i];
+
+            ctx->row[i] = s->oy * ctx->dir_y[y] - s->oz;
+         }
+      }
+
+      for (x = x0; x < x1; x += lanes)
+      {
+         const int n = x1 - x < lanes ? x1 - x : lanes;
+         float min_dist[4];
+         int closest[4];
+
+         if (width == KERNEL_SIMD_4)
+         {
+            /* Lanes after the rectangle trace rays which are not written */
+            const v4sf DX = { ctx->dir_x[x],     ctx->dir_x[x + 1],
+                              ctx->dir_x[x + 2], ctx->dir_x[x + 3] };
+            v4sf MIN;
+            v4si CLOSEST;
+
+            kernel_rays4 (ctx, list, num, DX, ctx->dir_y[y], &MIN, &CLOSEST);
+            if (count)
+               ctx->stats.tests += (uint64_t)num * n;
+
+            for (l = 0; l < 4; l++)
+            {
+               min_dist[l] = MIN[l];
+               closest[l]  = CLOSEST[l];
+            }
+         }
+         else
+         {
+            float d[3], l2, rl;
+
+            kernel_ray (ctx, x, y, d, &l2, &rl);
+            min_dist[0] = 100000;
+            closest[0]  = -1;
+
+            for (i = 0; i < num; i++)
+            {
+               const int id = list ? list[i] : i;
+               const kernel_sphere_t *s = &ctx->sphere[id];
+               const float v = kernel_v (ctx, s, d);
+
+               if (v >= 0)
+               {
+                  const float d2 = s->k * l2 + (v * v);
+
+                  if (d2 >= 0)
+                     kernel_test (ctx, id, v, d2, rl, &min_dist[0], &closest[0]);
+               }
+            }
+            if (count)
+               ctx->stats.tests += num;
+         }
+
+         /* Write the pixels */
+         for (l = 0; l < n; l++)
+         {
+            uint8_t *p = row + (size_t)(x - x0 + l) * bpp;
+
+            if (depth)
+               depth[(size_t)(y - y0) * stride + x - x0 + l] =
+                  closest[l] != -1 ? min_dist[l] : FLT_MAX;
+
+            if (closest[l] != -1)
+            {
+               int r, g, b;
+
+               color_get (&sphere[closest[l]].color, &r, &g, &b);
+               p[0] = r;
+               p[1] = g;
+               p[2] = b;
+               if (fmt == KERNEL_FMT_RGBA32)
+                  p[3] = 255;
+
+               if (count)
+                  ctx->stats.hits++;
+            }
+         }
+         if (count)
+            ctx->stats.rays += n;
+      }
+   }
+}
+
+/*
+ * The kernel matrix. Each entry X(FMT, SIMD, ACCEL, STATS) is compiled as a
+ * kernel of its own, see KERNEL_INSTANCE, and put in the dispatch table.
+ */
+#define KERNEL_MATRIX(X)                                                \
+   X(RGB24,  1, NONE, 0) X(RGB24,  1, NONE, 1)                          \
+   X(RGB24,  1, CULL, 0) X(RGB24,  1, CULL, 1)                          \
+   X(RGB24,  4, NONE, 0) X(RGB24,  4, NONE, 1)                          \
+   X(RGB24,  4, CULL, 0) X(RGB24,  4, CULL, 1)                          \
+   X(RGBA32, 1, NONE, 0) X(RGBA32, 1, NONE, 1)                          \
+   X(RGBA32, 1, CULL, 0) X(RGBA32, 1, CULL, 1)                          \
+   X(RGBA32, 4, NONE, 0) X(RGBA32, 4, NONE, 1)                          \
+   X(RGBA32, 4, CULL, 0) X(RGBA32, 4, CULL, 1)
+
+#define KERNEL_INSTANCE(FMT, SIMD, ACCEL, STATS)                        \
+static void kernel_##FMT##_##SIMD##_##ACCEL##_##STATS (kernel_ctx_t* ctx, \
+                                                     uint8_t* tile,     \
+                                                     float* depth,      \
+                                                     int stride,        \
+                                                     int x0,            \
+                                                     int y0,            \
+                                                     int x1,            \
+                                                     int y1)            \
+{                                                                       \
+   kernel_body (ctx, tile, depth, stride, x0, y0, x1, y1,               \
+                KERNEL_FMT_##FMT, KERNEL_SIMD_##SIMD,                   \
+                KERNEL_ACCEL_##ACCEL, STATS);                           \
+}
+
+#define KERNEL_ENTRY(FMT, SIMD, ACCEL, STATS)                           \
+   [KERNEL_FMT_##FMT][KERNEL_SIMD_##SIMD][KERNEL_ACCEL_##ACCEL][STATS] = \
+      kernel_##FMT##_##SIMD##_##ACCEL##_##STATS,
+
+KERNEL_MATRIX(KERNEL_INSTANCE)
+
+/* Dispatch table of the kernel matrix */
+static const kernel_t matrix[KERNEL_FMT_NUM][KERNEL_SIMD_NUM][KERNEL_ACCEL_NUM][2] = {
+   KERNEL_MATRIX(KERNEL_ENTRY)
+};
+
+/* Repeat a macro for the sphere IDs 0 to N-1 */
+#define KERNEL_REP_1(M)  M(0)
+#define KERNEL_REP_2(M)  KERNEL_REP_1(M)  M(1)
+#define KERNEL_REP_3(M)  KERNEL_REP_2(M)  M(2)
+#define KERNEL_REP_4(M)  KERNEL_REP_3(M)  M(3)
+#define KERNEL_REP_5(M)  KERNEL_REP_4(M)  M(4)
+#define KERNEL_REP_6(M)  KERNEL_REP_5(M)  M(5)
+#define KERNEL_REP_7(M)  KERNEL_REP_6(M)  M(6)
+#define KERNEL_REP_8(M)  KERNEL_REP_7(M)  M(7)
+#define KERNEL_REP_9(M)  KERNEL_REP_8(M)  M(8)
+#define KERNEL_REP_10(M) KERNEL_REP_9(M)  M(9)
+#define KERNEL_REP_11(M) KERNEL_REP_10(M) M(10)
+#define KERNEL_REP_12(M) KERNEL_REP_11(M) M(11)
+#define KERNEL_REP_13(M) KERNEL_REP_12(M) M(12)
+#define KERNEL_REP_14(M) KERNEL_REP_13(M) M(13)
+#define KERNEL_REP_15(M) KERNEL_REP_14(M) M(14)
+#define KERNEL_REP_16(M) KERNEL_REP_15(M) M(15)
+
+/* Load the constants of sphere i into local variables */
+#define KERNEL_SPHERE_SETUP(i)                                          \
+   const kernel_sphere_t s##i = ctx->sphere[i];
+
+/*
+ * Test the ray against sphere i, as sphere_intersect(), and record it if it
+ * is the closest hit so far.
+ */
+#define KERNEL_SPHERE_TEST(i)                                           \
+   v = kernel_v (ctx, &s##i, d);                                        \
+   if (v >= 0)                                                          \
+   {                                                                    \
+      float d2 = s##i.k * l2 + (v * v);                                 \
+                                                                        \
+      if (d2 >= 0)                                                      \
+         kernel_test (ctx, i, v, d2, rl, &min_dist, &closest_sphere);   \
+   }
+
+/*
+ * Define the kernel for N spheres. It works as the RGB24, scalar kernel of
+ * the matrix without accelerator and statistics, with the sphere loop fully
+ * unrolled and the constants of each sphere kept in local variables.
+ */
+#define KERNEL_DEFINE(N)                                                \
+static void kernel_##N (kernel_ctx_t* ctx,                              \
+                        uint8_t* tile,                                  \
+                        float* depth,                                   \
+                        int stride,                                     \
+                        int x0,                                         \
+                        int y0,                                         \
+                        int x1,                                         \
+                        int y1)                                         \
+{                                                                       \
+   sphere_t *sphere = scene_get_sphere (ctx->scene);                    \
+   int x, y;                                                            \
+   size_t image_ofs;                                                    \
+   KERNEL_REP_##N (KERNEL_SPHERE_SETUP)                                 \
+                                                                        \
+   for (y = y0; y < y1; y++)                                            \
+   {                                                                    \
+      image_ofs = (size_t)(y - y0) * stride * 3;                        \
+      memset (tile + image_ofs, 0, (x1 - x0) * 3);                      \
+                                                                        \
+      for (x = x0; x < x1; x++)                                         \
+      {                                                                 \
+         int closest_sphere = -1;                                       \
+         float min_dist = 100000;                                       \
+         float d[3], l2, rl, v;                                         \
+                                                                        \
+         kernel_ray (ctx, x, y, d, &l2, &rl);                           \
+                                                                        \
+         KERNEL_REP_##N (KERNEL_SPHERE_TEST)                            \
+                                                                        \
+         if (depth)                                                     \
+            depth[(size_t)(y - y0) * stride + x - x0] =                 \
+               closest_sphere != -1 ? min_dist : FLT_MAX;               \
+                                                                        \
+         if (closest_sphere != -1)                                      \
+         {                                                              \
+            int r, g, b;                                                \
+                                                                        \
+            color_get (&sphere[closest_sphere].color, &r, &g, &b);      \
+            tile[image_ofs + 0] = r;                                    \
+            tile[image_ofs + 1] = g;                                    \
+            tile[image_ofs + 2] = b;                                    \
+         }                                                              \
+         image_ofs += 3;                                                \
+      }                                                                 \
+   }                                                                    \
+}
+
+KERNEL_DEFINE(1)
+KERNEL_DEFINE(2)
+KERNEL_DEFINE(3)
+KERNEL_DEFINE(4)
+KERNEL_DEFINE(5)
+KERNEL_DEFINE(6)
+KERNEL_DEFINE(7)
+KERNEL_DEFINE(8)
+KERNEL_DEFINE(9)
+KERNEL_DEFINE(10)
+KERNEL_DEFINE(11)
+KERNEL_DEFINE(12)
+KERNEL_DEFINE(13)
+KERNEL_DEFINE(14)
+KERNEL_DEFINE(15)
+KERNEL_DEFINE(16)
+
+/* Kernels by number of spheres */
+static const kernel_t unrolled[KERNEL_MAX_SPHERES + 1] = {
+   NULL,      kernel_1,  kernel_2,  kernel_3,  kernel_4,  kernel_5,
+   kernel_6,  kernel_7,  kernel_8,  kernel_9,  kernel_10, kernel_11,
+   kernel_12, kernel_13, kernel_14, kernel_15, kernel_16,
+};
+
+/**
+ * kernel_bounds - Find the screen bounds of the spheres.
+ * @ctx: Pointer to render context.
+ *
+ * The rays through a sphere pass through its axis aligned bounding box, and
+ * the screen position of a point is a linear fractional function of it, so
+ * the extremes over the box are found at its corners. A box reaching the
+ * camera plane covers the whole screen, a box behind the camera none of it.
+ * The hits don't depend on the precision tier, see kernel_ray(), so neither
+ * do the bounds.
+ *
+ * Returns:
+ * none.
+ */
+static void kernel_bounds (kernel_ctx_t* ctx)
+{
+   sphere_t *sphere = scene_get_sphere (ctx->scene);
+   const int w = ctx->screen_width;
+   const int h = ctx->screen_height;
+   int i, c;
+
+   for (i = 0; i < scene_get_num_spheres (ctx->scene); i++)
+   {
+      const kernel_sphere_t *s = &ctx->sphere[i];
+      const double r = fabs (sphere[i].radius);
+      int *b = &ctx->bounds[i * 4];
+      double min_x = INFINITY, max_x = -INFINITY;
+      double min_y = INFINITY, max_y = -INFINITY;
+
+      if (s->oz - r >= 0)
+      {
+         b[0] = b[1] = b[2] = b[3] = 0;
+         continue;
+      }
+      if (s->oz + r >= 0 || ctx->tan_x <= 0 || ctx->tan_y <= 0)
+      {
+         b[0] = 0;
+         b[1] = 0;
+         b[2] = w;
+         b[3] = h;
+         continue;
+      }
+
+      for (c = 0; c < 8; c++)
+      {
+         const double z  = -(s->oz + (c & 4 ? r : -r));
+         const double px = (s->ox + (c & 1 ? r : -r)) / z;
+         const double py = (s->oy + (c & 2 ? r : -r)) / z;
+
+         min_x = fmin (min_x, px);
+         max_x = fmax (max_x, px);
+         min_y = fmin (min_y, py);
+         max_y = fmax (max_y, py);
+      }
+
+      /* Ray direction to pixel, see kernel_init() */
+      min_x = floor ((min_x / ctx->tan_x + 1) * w / 2) - KERNEL_CULL_MARGIN;
+      max_x = ceil  ((max_x / ctx->tan_x + 1) * w / 2) + KERNEL_CULL_MARGIN + 1;
+      min_y = floor ((min_y / ctx->tan_y + 1) * h / 2) - KERNEL_CULL_MARGIN;
+      max_y = ceil  ((max_y / ctx->tan_y + 1) * h / 2) + KERNEL_CULL_MARGIN + 1;
+
+      b[0] = fmax (0, fmin (w, min_x));
+      b[1] = fmax (0, fmin (h, min_y));
+      b[2] = fmax (0, fmin (w, max_x));
+      b[3] = fmax (0, fmin (h, max_y));
+   }
+}
+
+/**
+ * kernel_bpp - Get bytes per pixel of a pixel format.
+ * @fmt: Pixel format.
+ *
+ * Returns:
+ * Number of bytes per pixel.
+ */
+int kernel_bpp (kernel_fmt_t fmt)
+{
+   return fmt == KERNEL_FMT_RGBA32 ? 4 : 3;
+}
+
+/**
+ * kernel_init - Setup a render.
+ * @ctx:           Pointer to render context to setup.
+ * @scene:         Pointer to scene object.
+ * @screen_width:  Width of the whole rendered screen.
+ * @screen_height: Height of the whole rendered screen.
+ * @fmt:           Pixel format.
+ *
+ * This function computes the constants of the render and selects the kernel
+ * with a single table lookup: scenes of up to KERNEL_MAX_SPHERES spheres
+ * use the kernel for their sphere count when rendered to RGB24 without
+ * accelerator and statistics, other renders the kernel of the matrix for
+ * the format and the current settings. Call kernel_done() when the render
+ * is done.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int kernel_init (kernel_ctx_t* ctx,
+                 scene_t* scene,
+                 int screen_width,
+                 int screen_height,
+                 kernel_fmt_t fmt)
+{
+   camera_t *cam    = scene_get_camera (scene);
+   sphere_t *sphere = scene_get_sphere (scene);
+   const int num    = scene_get_num_spheres (scene);
+   const float aspect_ratio = (float)screen_height / (float)screen_width;
+   int i;
+
+   memset (ctx, 0, sizeof(*ctx));
+   ctx->scene         = scene;
+   ctx->screen_width  = screen_width;
+   ctx->screen_height = screen_height;
+   ctx->fmt           = fmt;
+   ctx->prec          = precision_get ();
+   ctx->tan_x         = tan (cam->fov);
+   ctx->tan_y         = tan (cam->fov * aspect_ratio);
+
+   ctx->sphere = malloc ((num ? num : 1) * sizeof(kernel_sphere_t));
+   ctx->dir_x  = malloc ((screen_width + 3) * sizeof(float));
+   ctx->dir_y  = malloc (screen_height * sizeof(float));
+   ctx->row    = malloc ((num ? num : 1) * sizeof(float));
+   if (!ctx->sphere || !ctx->dir_x || !ctx->dir_y || !ctx->row)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for render\n");
+      kernel_done (ctx);
+      return 1;
+   }
+
+   /* Ray direction of each column and row, the lanes after the last column
+    * repeat its ray */
+   for (i = 0; i < screen_width + 3; i++)
+   {
+      const int x = i < screen_width ? i : screen_width - 1;
+
+      ctx->dir_x[i] = ctx->tan_x * (2*x - screen_width) / screen_width;
+   }
+   for (i = 0; i < screen_height; i++)
+      ctx->dir_y[i] = ctx->tan_y * (2*i - screen_height) / screen_height;
+
+   /* O-E vector and r² - c², with c² computed as in the precision tier */
+   for (i = 0; i < num; i++)
+   {
+      kernel_sphere_t *s = &ctx->sphere[i];
+      float c2, c;
+
+      s->ox = sphere[i].center.x - cam->pos.x;
+      s->oy = sphere[i].center.y - cam->pos.y;
+      s->oz = sphere[i].center.z - cam->pos.z;
+      c2    = s->ox * s->ox + s->oy * s->oy + s->oz * s->oz;
+      c     = sqrt (c2);
+      s->k  = (sphere[i].radius * sphere[i].radius) -
+              (ctx->prec == PRECISION_EXACT ? c * c : c2);
+   }
+
+   if (fmt == KERNEL_FMT_RGB24 && accel == KERNEL_ACCEL_NONE && !stats &&
+       num >= 1 && num <= KERNEL_MAX_SPHERES)
+   {
+      ctx->kernel = unrolled[num];
+      return 0;
+   }
+
+   if (accel == KERNEL_ACCEL_CULL)
+   {
+      ctx->bounds = malloc ((num ? num : 1) * 4 * sizeof(int));
+      ctx->list   = malloc ((num ? num : 1) * sizeof(int));
+      if (!ctx->bounds || !ctx->list)
+      {
+         fprintf (stderr, "error: Unable to alloc memory for render\n");
+         kernel_done (ctx);
+         return 1;
+      }
+      kernel_bounds (ctx);
+   }
+
+   ctx->kernel = matrix[fmt][simd][accel][stats];
+
+   return 0;
+}
+
+/**
+ * kernel_done - Finish a render.
+ * @ctx: Pointer to render context.
+ *
+ * The statistics of the render are added to the total.
+ *
+ * Returns:
+ * none.
+ */
+void kernel_done (kernel_ctx_t* ctx)
+{
+   __atomic_fetch_add (&total.rays,  ctx->stats.rays,  __ATOMIC_RELAXED);
+   __atomic_fetch_add (&total.tests, ctx->stats.tests, __ATOMIC_RELAXED);
+   __atomic_fetch_add (&total.hits,  ctx->stats.hits,  __ATOMIC_RELAXED);
+
+   free (ctx->sphere);
+   free (ctx->dir_x);
+   free (ctx->dir_y);
+   free (ctx->row);
+   free (ctx->bounds);
+   free (ctx->list);
+   free (ctx->splat);
+   free (ctx->splat_row);
+   free (ctx->trace);
+   ctx->sphere    = NULL;
+   ctx->dir_x     = NULL;
+   ctx->dir_y     = NULL;
+   ctx->row       = NULL;
+   ctx->bounds    = NULL;
+   ctx->list      = NULL;
+   ctx->splat     = NULL;
+   ctx->splat_row = NULL;
+   ctx->trace     = NULL;
+   ctx->num_splat = 0;
+}
+
+/**
+ * kernel_init_bounds - Find the screen bounds of the spheres of a render.
+ * @ctx: Pointer to render context, setup by kernel_init().
+ *
+ * The bounds are only found by kernel_init() for the "cull" accelerator.
+ * This function finds them for other renders needing them, see
+ * kernel_spans().
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int kernel_init_bounds (kernel_ctx_t* ctx)
+{
+   const int num = scene_get_num_spheres (ctx->scene);
+
+   if (ctx->bounds)
+      return 0;
+
+   ctx->bounds = malloc ((num ? num : 1) * 4 * sizeof(int));
+   if (!ctx->bounds)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for render\n");
+      return 1;
+   }
+   kernel_bounds (ctx);
+
+   return 0;
+}
+
+/**
+ * kernel_splat_cmp - Compare two splats of a row.
+ * @a: Pointer to first splat.
+ * @b: Pointer to second splat.
+ *
+ * Splats are ordered by column, and splats of the same column by distance
+ * and then color, giving the same order whatever order they are sorted from.
+ *
+ * Returns:
+ * Less than, equal to or greater than zero if @a is before, the same as or
+ * after @b.
+ */
+static int kernel_splat_cmp (const void* a, const void* b)
+{
+   const kernel_splat_t *sa = a;
+   const kernel_splat_t *sb = b;
+
+   if (sa->x != sb->x)
+      return sa->x < sb->x ? -1 : 1;
+   if (sa->dist != sb->dist)
+      return sa->dist < sb->dist ? -1 : 1;
+
+   return memcmp (sa->color, sb->color, 3);
+}
+
+/**
+ * kernel_axis - Get a coordinate of the O-E vector of a sphere.
+ * @s:    Pointer to sphere constants.
+ * @axis: Axis, 0 to 2 for x to z.
+ *
+ * Returns:
+ * The coordinate.
+ */
+static inline float kernel_axis (const kernel_sphere_t* s, int axis)
+{
+   return axis == 0 ? s->ox : axis == 1 ? s->oy : s->oz;
+}
+
+/**
+ * kernel_tree_less - Compare two spheres along an axis.
+ * @ctx:  Pointer to render context.
+ * @a:    Array ID of first sphere.
+ * @b:    Array ID of second sphere.
+ * @axis: Axis, 0 to 2 for x to z.
+ *
+ * Spheres at the same position are ordered by array ID, so the tree is the
+ * same whatever order the spheres are split from.
+ *
+ * Returns:
+ * Non-zero if the center of @a is before the center of @b.
+ */
+static inline int kernel_tree_less (kernel_ctx_t* ctx, int a, int b, int axis)
+{
+   const float ka = kernel_axis (&ctx->sphere[a], axis);
+   const float kb = kernel_axis (&ctx->sphere[b], axis);
+
+   return ka < kb || (ka == kb && a < b);
+}
+
+/**
+ * kernel_tree_select - Split spheres at their median along an axis.
+ * @ctx:  Pointer to render context.
+ * @ids:  Array IDs of the spheres.
+ * @num:  Number of spheres in @ids.
+ * @k:    Number of spheres to put first.
+ * @axis: Axis, 0 to 2 for x to z.
+ *
+ * The spheres of @ids are reordered so the @k first ones are the ones with
+ * the centers before the rest along @axis.
+ *
+ * Returns:
+ * none.
+ */
+static void kernel_tree_select (kernel_ctx_t* ctx, int* ids, int num, int k,
+                                int axis)
+{
+   int lo = 0, hi = num - 1;
+
+   while (lo < hi)
+   {
+      const int p = ids[lo + (hi - lo) / 2];
+      int i = lo, j = hi;
+
+      while (i <= j)
+      {
+         while (kernel_tree_less (ctx, ids[i], p, axis))
+            i++;
+         while (kernel_tree_less (ctx, p, ids[j], axis))
+            j--;
+         if (i <= j)
+         {
+            const int t = ids[i];
+
+            ids[i++] = ids[j];
+            ids[j--] = t;
+         }
+      }
+      if (k <= j)
+         hi = j;
+      else if (k >= i)
+         lo = i;
+      else
+         break;
+   }
+}
+
+/**
+ * kernel_tree_leaf - Find the aggregate of a leaf of the sphere tree.
+ * @ctx: Pointer to render context.
+ * @ids: Array IDs of the spheres, in tree order.
+ * @nd:  Pointer to the node, with its spheres set.
+ *
+ * The bounding sphere is grown to cover each sphere in turn, and the
+ * centers, colors and areas are summed, weighted by r².
+ *
+ * Returns:
+ * none.
+ */
+static void kernel_tree_leaf (kernel_ctx_t* ctx, const int* ids,
+                              kernel_node_t* nd)
+{
+   sphere_t *sphere = scene_get_sphere (ctx->scene);
+   int i, c;
+
+   memset (nd->m, 0, sizeof(nd->m));
+   memset (nd->color, 0, sizeof(nd->color));
+   nd->area  = 0;
+   nd->child = -1;
+
+   for (i = nd->first; i < nd->first + nd->num; i++)
+   {
+      const kernel_sphere_t *s = &ctx->sphere[ids[i]];
+      const double r  = fabs (sphere[ids[i]].radius);
+      const double r2 = r * r;
+      double d = 0;
+      int rgb[3];
+
+      color_get (&sphere[ids[i]].color, &rgb[0], &rgb[1], &rgb[2]);
+      for (c = 0; c < 3; c++)
+      {
+         nd->m[c]     += r2 * kernel_axis (s, c);
+         nd->color[c] += r2 * rgb[c];
+      }
+      nd->area += r2;
+
+      if (i == nd->first)
+      {
+         for (c = 0; c < 3; c++)
+            nd->c[c] = kernel_axis (s, c);
+         nd->r = r;
+         continue;
+      }
+      for (c = 0; c < 3; c++)
+         d += (kernel_axis (s, c) - nd->c[c]) * (kernel_axis (s, c) - nd->c[c]);
+      d = sqrt (d);
+      if (d + r > nd->r)
+      {
+         const double R = (d + r + nd->r) / 2;
+
+         for (c = 0; c < 3; c++)
+            nd->c[c] += (kernel_axis (s, c) - nd->c[c]) * (R - nd->r) / d;
+         nd->r = R;
+      }
+   }
+}
+
+/**
+ * kernel_tree_build - Build a node of the sphere tree.
+ * @ctx:       Pointer to render context.
+ * @node:      Nodes of the tree.
+ * @num_nodes: Pointer to number of nodes used.
+ * @ids:       Array IDs of the spheres, in tree order.
+ * @n:         Index of the node to build, with its spheres set.
+ *
+ * Nodes of more than KERNEL_LEAF_SPHERES spheres are split in two at the
+ * median of the longest axis of the sphere centers, other nodes are leaves,
+ * see kernel_tree_leaf(). A split node gets the sums of the aggregates of
+ * its children and a bounding sphere covering theirs.
+ *
+ * Returns:
+ * none.
+ */
+static void kernel_tree_build (kernel_ctx_t* ctx,
+                               kernel_node_t* node,
+                               int* num_nodes,
+                               int* ids,
+                               int n)
+{
+   kernel_node_t *nd = &node[n];
+   const kernel_node_t *part[2];
+   int i, j, c;
+
+   if (nd->num <= KERNEL_LEAF_SPHERES)
+   {
+      kernel_tree_leaf (ctx, ids, nd);
+      return;
+   }
+
+   /* Split along the longest axis */
+   {
+      float lo[3], hi[3];
+      int axis = 0;
+
+      for (c = 0; c < 3; c++)
+         lo[c] = hi[c] = kernel_axis (&ctx->sphere[ids[nd->first]], c);
+      for (i = nd->first + 1; i < nd->first + nd->num; i++)
+      {
+         for (c = 0; c < 3; c++)
+         {
+            lo[c] = fminf (lo[c], kernel_axis (&ctx->sphere[ids[i]], c));
+            hi[c] = fmaxf (hi[c], kernel_axis (&ctx->sphere[ids[i]], c));
+         }
+      }
+      for (c = 1; c < 3; c++)
+         if (hi[c] - lo[c] > hi[axis] - lo[axis])
+            axis = c;
+
+      kernel_tree_select (ctx, ids + nd->first, nd->num, nd->num / 2, axis);
+   }
+
+   nd->child = *num_nodes;
+   *num_nodes += 2;
+   memset (nd->m, 0, sizeof(nd->m));
+   memset (nd->color, 0, sizeof(nd->color));
+   nd->area = 0;
+   node[nd->child].first     = nd->first;
+   node[nd->child].num       = nd->num / 2;
+   node[nd->child + 1].first = nd->first + nd->num / 2;
+   node[nd->child + 1].num   = nd->num - nd->num / 2;
+   kernel_tree_build (ctx, node, num_nodes, ids, nd->child);
+   kernel_tree_build (ctx, node, num_nodes, ids, nd->child + 1);
+
+   /* Sum the aggregates and cover the bounding spheres of the children */
+   part[0] = &node[nd->child];
+   part[1] = &node[nd->child + 1];
+   for (j = 0; j < 2; j++)
+   {
+      for (c = 0; c < 3; c++)
+      {
+         nd->m[c]     += part[j]->m[c];
+         nd->color[c] += part[j]->color[c];
+      }
+      nd->area += part[j]->area;
+   }
+   {
+      double d = 0;
+
+      if (part[0]->r < part[1]->r)
+      {
+         part[0] = &node[nd->child + 1];
+         part[1] = &node[nd->child];
+      }
+      for (c = 0; c < 3; c++)
+         d += (part[1]->c[c] - part[0]->c[c]) * (part[1]->c[c] - part[0]->c[c]);
+      d = sqrt (d);
+
+      memcpy (nd->c, part[0]->c, sizeof(nd->c));
+      nd->r = part[0]->r;
+      if (d + part[1]->r > part[0]->r)
+      {
+         nd->r = (d + part[0]->r + part[1]->r) / 2;
+         for (c = 0; c < 3; c++)
+            nd->c[c] += (part[1]->c[c] - part[0]->c[c]) * (nd->r - part[0]->r) / d;
+      }
+   }
+}
+
+/**
+ * kernel_splat_add - Add a splat.
+ * @ctx:   Pointer to render context.
+ * @splat: Splats so far.
+ * @n:     Number of splats in @splat.
+ * @nd:    Node of the spheres drawn by the splat.
+ *
+ * The splat is put at the weighted center of the spheres, at the distance
+ * of the front of their bounding sphere, with their weighted mean color and
+ * the sum of their projected areas as coverage. Splats outside the screen
+ * aren't added.
+ *
+ * Returns:
+ * Number of splats in @splat.
+ */
+static int kernel_splat_add (kernel_ctx_t* ctx, kernel_splat_t* splat, int n,
+                             const kernel_node_t* nd)
+{
+   const int w = ctx->screen_width;
+   const int h = ctx->screen_height;
+   double m[3], z, px, py;
+   int c;
+
+   if (nd->area <= 0)
+      return n;
+
+   for (c = 0; c < 3; c++)
+      m[c] = nd->m[c] / nd->area;
+   z = -m[2];
+
+   /* Ray direction to pixel, see kernel_init() */
+   px = (m[0] / z / ctx->tan_x + 1) * w / 2;
+   py = (m[1] / z / ctx->tan_y + 1) * h / 2;
+   if (!(px >= -1 && px < w && py >= -1 && py < h))
+      return n;
+
+   splat[n].x    = floor (px);
+   splat[n].y    = floor (py);
+   splat[n].fx   = px - splat[n].x;
+   splat[n].fy   = py - splat[n].y;
+   splat[n].dist = sqrt ((double)nd->c[0] * nd->c[0] + (double)nd->c[1] * nd->c[1] +
+                         (double)nd->c[2] * nd->c[2]) - nd->r;
+   splat[n].cov  = fmin (1, M_PI * nd->area * w / (2 * ctx->tan_x * z) *
+                         h / (2 * ctx->tan_y * z));
+   for (c = 0; c < 3; c++)
+      splat[n].color[c] = fmin (255, floor (nd->color[c] / nd->area + 0.5));
+   ctx->splat_row[splat[n].y + 2]++;
+
+   return n + 1;
+}
+
+/**
+ * kernel_init_splats - Select the spheres to splat in a render.
+ * @ctx: Pointer to render context, setup by kernel_init().
+ *
+ * With a level of detail set, see kernel_set_lod(), the spheres are put in
+ * a tree, see kernel_tree_build(), which is walked from the root. A node in
+ * front of the camera whose bounding sphere has a projected radius below
+ * the level is drawn as a single splat of the aggregate of its spheres, see
+ * kernel_splat_add(), without visiting them, so a distant cluster costs as
+ * much as a single small sphere. Spheres of leaves reached by the walk are
+ * traced unless they are small enough to be splatted on their own.
+ *
+ * Splatted spheres are removed from the traced spheres, by emptying their
+ * screen bounds and making every ray miss them, and only the traced ones
+ * are tested by the "cull" accelerator. The splats are drawn by
+ * kernel_splat(). They are bucketed by the row of their center, from the
+ * row below the screen, and sorted by column within each row.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int kernel_init_splats (kernel_ctx_t* ctx)
+{
+   const int num    = scene_get_num_spheres (ctx->scene);
+   const int w      = ctx->screen_width;
+   const int h      = ctx->screen_height;
+   kernel_splat_t *splat = NULL;
+   kernel_node_t *node   = NULL;
+   uint8_t *traced       = NULL;
+   int *ids              = NULL;
+   int stack[64];
+   int i, sp, n = 0, num_nodes = 1;
+   int rc = 1;
+
+   if (lod <= 0 || ctx->splat || !num || ctx->tan_x <= 0 || ctx->tan_y <= 0)
+      return 0;
+
+   splat          = malloc (num * sizeof(kernel_splat_t));
+   node           = malloc ((num + 1) * sizeof(kernel_node_t));
+   traced         = malloc (num);
+   ids            = malloc (num * sizeof(int));
+   ctx->splat     = malloc (num * sizeof(kernel_splat_t));
+   ctx->splat_row = calloc ((size_t)h + 2, sizeof(int));
+   ctx->trace     = malloc (num * sizeof(int));
+   if (!splat || !node || !traced || !ids || !ctx->splat || !ctx->splat_row ||
+       !ctx->trace)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for render\n");
+      goto out;
+   }
+
+   for (i = 0; i < num; i++)
+      ids[i] = i;
+   memset (traced, 0, num);
+   node[0].first = 0;
+   node[0].num   = num;
+   kernel_tree_build (ctx, node, &num_nodes, ids, 0);
+
+   /* Walk the tree, splatting the nodes below the level of detail */
+   stack[0] = 0;
+   sp = 1;
+   while (sp)
+   {
+      const kernel_node_t *nd = &node[stack[--sp]];
+      const double z = -nd->c[2];
+
+      if (z - nd->r > 0 &&
+          nd->r * fmax (w / ctx->tan_x, h / ctx->tan_y) / (2 * z) < lod)
+      {
+         n = kernel_splat_add (ctx, splat, n, nd);
+         continue;
+      }
+      if (nd->child >= 0)
+      {
+         stack[sp++] = nd->child + 1;
+         stack[sp++] = nd->child;
+         continue;
+      }
+
+      /* Leaf, splat the small spheres on their own */
+      for (i = nd->first; i < nd->first + nd->num; i++)
+      {
+         kernel_node_t one;
+
+         one.first = i;
+         one.num   = 1;
+         kernel_tree_leaf (ctx, ids, &one);
+         if (-one.c[2] - one.r > 0 &&
+             one.r * fmax (w / ctx->tan_x, h / ctx->tan_y) / (-2 * one.c[2]) < lod)
+            n = kernel_splat_add (ctx, splat, n, &one);
+         else
+            traced[ids[i]] = 1;
+      }
+   }
+
+   /* Take the splatted spheres out of the traced ones */
+   ctx->num_trace = 0;
+   for (i = 0; i < num; i++)
+   {
+      if (traced[i])
+      {
+         ctx->trace[ctx->num_trace++] = i;
+         continue;
+      }
+      ctx->sphere[i].k = -INFINITY;
+      if (ctx->bounds)
+         memset (&ctx->bounds[i * 4], 0, 4 * sizeof(int));
+   }
+
+   /* Bucket by row, then sort each row */
+   for (i = 1; i <= h + 1; i++)
+      ctx->splat_row[i] += ctx->splat_row[i - 1];
+   for (i = 0; i < n; i++)
+      ctx->splat[ctx->splat_row[splat[i].y + 1]++] = splat[i];
+   for (i = 0; i <= h; i++)
+      qsort (&ctx->splat[i ? ctx->splat_row[i - 1] : 0],
+             ctx->splat_row[i] - (i ? ctx->splat_row[i - 1] : 0),
+             sizeof(kernel_splat_t), kernel_splat_cmp);
+   memmove (&ctx->splat_row[1], &ctx->splat_row[0], (h + 1) * sizeof(int));
+   ctx->splat_row[0] = 0;
+   ctx->num_splat = n;
+   rc = 0;
+
+out:
+   free (splat);
+   free (node);
+   free (traced);
+   free (ids);
+
+   return rc;
+}
+
+/**
+ * kernel_splat - Draw the splatted spheres over rendered pixels.
+ * @ctx:    Pointer to render context, see kernel_init_splats().
+ * @tile:   Pointer to the first pixel of the rectangle.
+ * @depth:  Pointer to the first depth of the rectangle.
+ * @stride: Number of pixels between rows in @tile and @depth.
+ * @x0:     First column of the rectangle.
+ * @y0:     First row of the rectangle.
+ * @x1:     Column after the last column of the rectangle.
+ * @y1:     Row after the last row of the rectangle.
+ *
+ * The coverage of each splat is shared between the four pixels around its
+ * center, weighted by the distance of the center to each of them. Where the
+ * splat is in front of the traced depth, its color and weight are summed in
+ * the pixel. The pixel is then blended with the mean color of its splats,
+ * by their summed coverage up to a whole pixel. The sums don't depend on
+ * the order the splats are drawn in, and each pixel sums its splats in the
+ * same order whatever rectangle it is rendered in, so tiles give the same
+ * pixels as a whole screen. @depth is left untouched.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int kernel_splat (kernel_ctx_t* ctx,
+                  uint8_t* tile,
+                  const float* depth,
+                  int stride,
+                  int x0,
+                  int y0,
+                  int x1,
+                  int y1)
+{
+   const int bpp = kernel_bpp (ctx->fmt);
+   const int tw  = x1 - x0;
+   float *acc;   /* Summed coverage, red, green and blue of each pixel */
+   int x, y, i;
+
+   if (!ctx->num_splat || x0 >= x1 || y0 >= y1)
+      return 0;
+
+   acc = calloc ((size_t)tw * (y1 - y0) * 4, sizeof(float));
+   if (!acc)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for render\n");
+      return 1;
+   }
+
+   /* Rows of splats reaching the rectangle */
+   for (y = y0 - 1; y < y1; y++)
+   {
+      int lo = ctx->splat_row[y + 1];
+      int hi = ctx->splat_row[y + 2];
+
+      /* First splat reaching the first column */
+      while (lo < hi)
+      {
+         const int mid = (lo + hi) / 2;
+
+         if (ctx->splat[mid].x < x0 - 1)
+            lo = mid + 1;
+         else
+            hi = mid;
+      }
+
+      for (i = lo; i < ctx->splat_row[y + 2] && ctx->splat[i].x < x1; i++)
+      {
+         const kernel_splat_t *sp = &ctx->splat[i];
+         int c;
+
+         for (c = 0; c < 4; c++)
+         {
+            const int px = sp->x + (c & 1);
+            const int py = sp->y + (c >> 1);
+            const float wt = sp->cov * (c & 1 ? sp->fx : 1 - sp->fx) *
+                             (c & 2 ? sp->fy : 1 - sp->fy);
+            float *a;
+
+            if (px < x0 || px >= x1 || py < y0 || py >= y1 || wt <= 0 ||
+                sp->dist >= depth[(size_t)(py - y0) * stride + px - x0])
+               continue;
+
+            a = &acc[((size_t)(py - y0) * tw + px - x0) * 4];
+            a[0] += wt;
+            a[1] += wt * sp->color[0];
+            a[2] += wt * sp->color[1];
+            a[3] += wt * sp->color[2];
+         }
+      }
+   }
+
+   /* Blend the pixels */
+   for (y = y0; y < y1; y++)
+   {
+      for (x = x0; x < x1; x++)
+      {
+         const float *a = &acc[((size_t)(y - y0) * tw + x - x0) * 4];
+         uint8_t *p = tile + ((size_t)(y - y0) * stride + x - x0) * bpp;
+         const float alpha = a[0] < 1 ? a[0] : 1;
+
+         if (a[0] <= 0)
+            continue;
+
+         for (i = 0; i < 3; i++)
+            p[i] = p[i] + alpha * (a[i + 1] / a[0] - p[i]) + 0.5f;
+         if (ctx->fmt == KERNEL_FMT_RGBA32)
+            p[3] = p[3] + alpha * (255 - p[3]) + 0.5f;
+      }
+   }
+
+   free (acc);
+
+   return 0;
+}
+
+/**
+ * kernel_select - Find the spheres which may be hit in a rectangle.
+ * @ctx:  Pointer to render context, with bounds, see kernel_init_bounds().
+ * @x0:   First column of the rectangle.
+ * @y0:   First row of the rectangle.
+ * @x1:   Column after the last column of the rectangle.
+ * @y1:   Row after the last row of the rectangle.
+ * @from: Array IDs of the spheres to select from, in increasing order, e.g.
+ *        the spheres selected for a larger rectangle, or NULL for all the
+ *        traced spheres.
+ * @num:  Number of spheres in @from.
+ * @ids:  Pointer where to return the array IDs of the spheres, room for all
+ *        spheres of the scene. May be @from.
+ *
+ * Returns:
+ * Number of spheres whose screen bounds overlap the rectangle, in @ids in
+ * increasing order.
+ */
+int kernel_select (kernel_ctx_t* ctx, int x0, int y0, int x1, int y1,
+                   const int* from, int num, int* ids)
+{
+   int i, n = 0;
+
+   if (!from)
+   {
+      from = ctx->trace;
+      num  = ctx->trace ? ctx->num_trace : scene_get_num_spheres (ctx->scene);
+   }
+
+   for (i = 0; i < num; i++)
+   {
+      const int id = from ? from[i] : i;
+      const int *b = &ctx->bounds[id * 4];
+
+      if (b[0] < x1 && b[2] > x0 && b[1] < y1 && b[3] > y0)
+         ids[n++] = id;
+   }
+
+   return n;
+}
+
+/**
+ * kernel_trace - Trace the ray through a pixel.
+ * @ctx:  Pointer to render context.
+ * @x:    Column of the pixel.
+ * @y:    Row of the pixel.
+ * @ids:  Array IDs of the spheres to test, in increasing order.
+ * @num:  Number of spheres in @ids.
+ * @dist: Pointer where to return the distance to the closest hit.
+ *
+ * The ray is traced with the same ray and tests as the kernels, so it hits
+ * the sphere seen in the pixel of a rendered image as long as @ids holds
+ * every sphere which may be hit, e.g. all spheres whose screen bounds
+ * cover the pixel, see kernel_select().
+ *
+ * Returns:
+ * Array ID of the closest sphere hit by the ray, or -1 if no sphere was hit.
+ */
+int kernel_trace (kernel_ctx_t* ctx, int x, int y, const int* ids, int num,
+                  float* dist)
+{
+   float min_dist = 100000;
+   int closest    = -1;
+   float d[3], l2, rl;
+   int i;
+
+   kernel_ray (ctx, x, y, d, &l2, &rl);
+
+   for (i = 0; i < num; i++)
+   {
+      const kernel_sphere_t *s = &ctx->sphere[ids[i]];
+      const float v = kernel_v (ctx, s, d);
+
+      if (v >= 0)
+      {
+         const float d2 = s->k * l2 + (v * v);
+
+         if (d2 >= 0)
+            kernel_test (ctx, ids[i], v, d2, rl, &min_dist, &closest);
+      }
+   }
+
+   *dist = min_dist;
+
+   return closest;
+}
+
+/**
+ * kernel_trace_row - Trace the rays through pixels of a row.
+ * @ctx:  Pointer to render context.
+ * @x:    Columns of the pixels.
+ * @n:    Number of pixels.
+ * @y:    Row of the pixels.
+ * @ids:  Array IDs of the spheres to test, in increasing order.
+ * @num:  Number of spheres in @ids.
+ * @id:   Pointer where to return the array ID of the closest sphere hit by
+ *        the ray of each pixel, or -1.
+ * @dist: Pointer where to return the distance to the closest hit of each
+ *        pixel, or FLT_MAX if no sphere was hit.
+ *
+ * The rays are traced four at a time like the SIMD kernels, for pixels
+ * which are not next to each other, and hit the same spheres as
+ * kernel_trace().
+ *
+ * Returns:
+ * none.
+ */
+void kernel_trace_row (kernel_ctx_t* ctx, const int* x, int n, int y,
+                       const int* ids, int num, int* id, float* dist)
+{
+   int i, l;
+
+   /* Part of v which is the same for the whole row, see kernel_v() */
+   if (ctx->prec != PRECISION_EXACT)
+   {
+      for (i = 0; i < num; i++)
+      {
+         const kernel_sphere_t *s = &ctx->sphere[ids[i]];
+
+         ctx->row[i] = s->oy * ctx->dir_y[y] - s->oz;
+      }
+   }
+
+   for (i = 0; i < n; i += 4)
+   {
+      /* Lanes after the last pixel trace its ray again */
+      const v4sf DX = { ctx->dir_x[x[i]],
+                        ctx->dir_x[x[i + 1 < n ? i + 1 : i]],
+                        ctx->dir_x[x[i + 2 < n ? i + 2 : i]],
+                        ctx->dir_x[x[i + 3 < n ? i + 3 : i]] };
+      v4sf MIN;
+      v4si CLOSEST;
+
+      kernel_rays4 (ctx, ids, num, DX, ctx->dir_y[y], &MIN, &CLOSEST);
+
+      for (l = 0; l < 4 && i + l < n; l++)
+      {
+         id[i + l]   = CLOSEST[l];
+         dist[i + l] = CLOSEST[l] != -1 ? MIN[l] : FLT_MAX;
+      }
+   }
+}
+
+/**
+ * kernel_spans - Render pixels of a row as spans.
+ * @ctx:  Pointer to render context.
+ * @y:    Row.
+ * @x0:   First column.
+ * @x1:   Column after the last column.
+ * @ids:  Array IDs of the spheres to test, in increasing order.
+ * @num:  Number of spheres in @ids.
+ * @span: Pointer to the spans of the row so far.
+ * @n:    Number of spans in @span.
+ *
+ * The pixels are traced one at a time, see kernel_trace(), so they get the
+ * same color as in a rendered image as long as @ids holds every sphere
+ * which may be hit. The pixels are appended to @span, extending the last
+ * span while the color stays the same. @span must have room for @x1 - @x0
+ * more spans.
+ *
+ * Returns:
+ * Number of spans in @span.
+ */
+int kernel_spans (kernel_ctx_t* ctx,
+                  int y,
+                  int x0,
+                  int x1,
+                  const int* ids,
+                  int num,
+                  span_t* span,
+                  int n)
+{
+   sphere_t *sphere = scene_get_sphere (ctx->scene);
+   int x;
+
+   for (x = x0; x < x1; x++)
+   {
+      uint8_t color[3] = { 0, 0, 0 };
+      float dist;
+      const int closest = kernel_trace (ctx, x, y, ids, num, &dist);
+
+      if (closest != -1)
+      {
+         int r, g, b;
+
+         color_get (&sphere[closest].color, &r, &g, &b);
+         color[0] = r;
+         color[1] = g;
+         color[2] = b;
+      }
+
+      if (n && span[n - 1].x1 == x && !memcmp (span[n - 1].color, color, 3))
+         span[n - 1].x1++;
+      else
+      {
+         span[n].x0 = x;
+         span[n].x1 = x + 1;
+         memcpy (span[n].color, color, 3);
+         n++;
+      }
+   }
+
+   return n;
+}
+
+/**
+ * kernel_set_simd - Set SIMD width.
+ * @width: Number of pixels traced together, 1 or 4.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if @width isn't supported.
+ */
+int kernel_set_simd (int width)
+{
+   if (width != 1 && width != 4)
+      return 1;
+
+   simd = width == 4 ? KERNEL_SIMD_4 : KERNEL_SIMD_1;
+
+   return 0;
+}
+
+/**
+ * kernel_get_simd - Get SIMD width.
+ *
+ * Returns:
+ * Number of pixels traced together.
+ */
+int kernel_get_simd (void)
+{
+   return simd == KERNEL_SIMD_4 ? 4 : 1;
+}
+
+/**
+ * kernel_set_accel - Set accelerator.
+ * @name: Name of accelerator, "none" or "cull".
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if @name isn't an accelerator.
+ */
+int kernel_set_accel (const char* name)
+{
+   int i;
+
+   for (i = 0; i < KERNEL_ACCEL_NUM; i++)
+   {
+      if (!strcmp (name, accel_names[i]))
+      {
+         accel = i;
+         return 0;
+      }
+   }
+
+   return 1;
+}
+
+/**
+ * kernel_get_accel - Get accelerator.
+ *
+ * Returns:
+ * Name of accelerator.
+ */
+const char* kernel_get_accel (void)
+{
+   return accel_names[accel];
+}
+
+/**
+ * kernel_set_lod - Set level of detail.
+ * @pixels: Projected radius in pixels below which spheres are splatted
+ *          instead of traced, zero to trace every sphere.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if @pixels is negative.
+ */
+int kernel_set_lod (float pixels)
+{
+   if (!(pixels >= 0))
+      return 1;
+
+   lod = pixels;
+
+   return 0;
+}
+
+/**
+ * kernel_get_lod - Get level of detail.
+ *
+ * Returns:
+ * Projected radius in pixels below which spheres are splatted.
+ */
+float kernel_get_lod (void)
+{
+   return lod;
+}
+
+/**
+ * kernel_set_stats - Enable or disable statistics.
+ * @on: Non-zero to count statistics in the following renders.
+ *
+ * Enabling statistics clears the totals.
+ *
+ * Returns:
+ * none.
+ */
+void kernel_set_stats (int on)
+{
+   if (on)
+      memset (&total, 0, sizeof(total));
+   stats = !!on;
+}
+
+/**
+ * kernel_get_stats - Get statistics.
+ * @st: Pointer where to return the totals of all renders in this process
+ *      since statistics were enabled.
+ *
+ * Returns:
+ * Non-zero if statistics are enabled.
+ */
+int kernel_get_stats (kernel_stats_t* st)
+{
+   st->rays  = __atomic_load_n (&total.rays,  __ATOMIC_RELAXED);
+   st->tests = __atomic_load_n (&total.tests, __ATOMIC_RELAXED);
+   st->hits  = __atomic_load_n (&total.hits,  __ATOMIC_RELAXED);
+
+   return stats;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
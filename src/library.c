@@ -0,0 +1,511 @@
+/**
+ * library.c - Library class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines the scene library of the render server, which keeps
+ * the most recently used scenes of a directory loaded within a budget.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "scene.h"
+#include "xml.h"
+#include "cachedir.h"
+
+#include "library.h"
+
+/* Library state, protected by @lock. Loaded and loading scenes are all in
+ * the LRU list, so each scene is only loaded once. */
+static pthread_mutex_t lock  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  ready = PTHREAD_COND_INITIALIZER;
+static library_entry_t *lru_head = NULL;   /* Most recently used */
+static library_entry_t *lru_tail = NULL;   /* Least recently used */
+static library_stats_t stats;
+static unsigned long num_loads = 0;
+
+/* Only one XML file is parsed at a time, see xml_parse_scene() */
+static pthread_mutex_t xml_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Directory of the XML scenes, and of the binary cache */
+static char scene_dir[PATH_MAX - 128] = "";
+static char cache_dir[PATH_MAX - 128] = "";
+
+/* Header of a binary copy of a scene, followed by the scene packed with
+ * scene_pack(). The XML file it was parsed from is identified by its
+ * modification time and size. */
+typedef struct {
+   uint32_t magic;      /* LIBRARY_CACHE_MAGIC */
+   uint32_t version;    /* SCENE_FILE_VERSION */
+   int64_t  mtime;      /* Modification time of the XML file, seconds */
+   int64_t  mtime_ns;   /* Nanoseconds of @mtime */
+   int64_t  size;       /* Size of the XML file */
+} library_hdr_t;
+
+/**
+ * library_lru_unlink - Remove an entry from the LRU list.
+ * @entry: Pointer to entry.
+ *
+ * Returns:
+ * none.
+ */
+static void library_lru_unlink (library_entry_t *entry)
+{
+   if (entry->prev)
+      entry->prev->next = entry->next;
+   else
+      lru_head = entry->next;
+   if (entry->next)
+      entry->next->prev = entry->prev;
+   else
+      lru_tail = entry->prev;
+
+   entry->prev = entry->next = NULL;
+}
+
+/**
+ * library_lru_push - Put an entry first in the LRU list.
+ * @entry: Pointer to entry, not in the list.
+ *
+ * Returns:
+ * none.
+ */
+static void library_lru_push (library_entry_t *entry)
+{
+   entry->prev = NULL;
+   entry->next = lru_head;
+   if (lru_head)
+      lru_head->prev = entry;
+   lru_head = entry;
+   if (!lru_tail)
+      lru_tail = entry;
+}
+
+/**
+ * library_free - Free an entry.
+ * @entry: Pointer to entry.
+ *
+ * Returns:
+ * none.
+ */
+static void library_free (library_entry_t *entry)
+{
+   scene_free (entry->scene);
+   free (entry);
+}
+
+/**
+ * library_drop - Drop a loaded scene from the library.
+ * @entry: Pointer to entry, not pending.
+ *
+ * The entry is freed at once if nobody uses it, else by the last
+ * library_release().
+ *
+ * Returns:
+ * none.
+ */
+static void library_drop (library_entry_t *entry)
+{
+   library_lru_unlink (entry);
+   stats.bytes -= entry->size;
+   stats.entries--;
+   entry->cached = 0;
+
+   if (!entry->refs)
+      library_free (entry);
+}
+
+/**
+ * library_name_ok - Check a scene name.
+ * @name: Scene name.
+ *
+ * Names are used as file names, so only letters, digits, '-' and '_' are
+ * allowed.
+ *
+ * Returns:
+ * Non-zero if @name is valid.
+ */
+static int library_name_ok (const char *name)
+{
+   size_t len = strlen (name);
+
+   if (!len || len >= LIBRARY_NAME_SIZE)
+      return 0;
+
+   return strspn (name, "abcdefghijklmnopqrstuvwxyz"
+                        "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                        "0123456789-_") == len;
+}
+
+/**
+ * library_hdr - Setup the header of a binary copy of a scene.
+ * @hdr: Pointer to header.
+ * @xst: Status of the XML file of the scene.
+ *
+ * Returns:
+ * none.
+ */
+static void library_hdr (library_hdr_t *hdr, const struct stat *xst)
+{
+   memset (hdr, 0, sizeof(*hdr));
+   hdr->magic    = LIBRARY_CACHE_MAGIC;
+   hdr->version  = SCENE_FILE_VERSION;
+   hdr->mtime    = xst->st_mtim.tv_sec;
+   hdr->mtime_ns = xst->st_mtim.tv_nsec;
+   hdr->size     = xst->st_size;
+}
+
+/**
+ * library_read - Load a scene from its binary copy.
+ * @scene: Pointer to scene.
+ * @file:  File name of the binary copy.
+ * @xst:   Status of the XML file of the scene.
+ *
+ * The copy is only used if it was parsed from an XML file of the same
+ * modification time and size, i.e. an XML file edited after the copy was
+ * written is parsed again, even in the same second.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if there is no valid copy.
+ */
+static int library_read (scene_t *scene, const char *file, const struct stat *xst)
+{
+   library_hdr_t hdr, want;
+   uint8_t *buf = NULL;
+   FILE *fp;
+   long len;
+   int rc = 1;
+
+   fp = fopen (file, "rb");
+   if (!fp)
+      return 1;
+
+   library_hdr (&want, xst);
+   if (fread (&hdr, sizeof(hdr), 1, fp) != 1 || memcmp (&hdr, &want, sizeof(hdr)) ||
+       fseek (fp, 0, SEEK_END) || (len = ftell (fp)) < (long)sizeof(hdr) ||
+       fseek (fp, sizeof(hdr), SEEK_SET))
+      goto out;
+   len -= sizeof(hdr);
+
+   buf = malloc (len ? len : 1);
+   if (buf && fread (buf, 1, len, fp) == (size_t)len && !scene_unpack (scene, buf, len))
+      rc = 0;
+
+out:
+   free (buf);
+   fclose (fp);
+
+   return rc;
+}
+
+/**
+ * library_write - Write the binary copy of a scene.
+ * @scene: Pointer to scene.
+ * @file:  File name of the binary copy.
+ * @xst:   Status of the XML file the scene was parsed from.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+static int library_write (scene_t *scene, const char *file, const struct stat *xst)
+{
+   size_t len = scene_pack_size (scene);
+   uint8_t *buf = malloc (len);
+   library_hdr_t hdr;
+   FILE *fp;
+   int rc = 0;
+
+   if (!buf)
+      return 1;
+   scene_pack (scene, buf, len);
+   library_hdr (&hdr, xst);
+
+   fp = fopen (file, "wb");
+   if (!fp)
+   {
+      free (buf);
+      return 1;
+   }
+   if (fwrite (&hdr, sizeof(hdr), 1, fp) != 1 || fwrite (buf, len, 1, fp) != 1)
+      rc = 1;
+   if (fclose (fp))
+      rc = 1;
+   free (buf);
+
+   return rc;
+}
+
+/**
+ * library_load - Load a scene.
+ * @name:    Scene name.
+ * @version: Version of the load, makes the temporary file unique.
+ * @cached:  Pointer where to return non-zero if loaded from the cache.
+ *
+ * The scene <name>.xml of the scene directory is loaded from its binary
+ * copy in the cache directory, unless the XML file has changed since the
+ * copy was written, see library_read(). Otherwise the XML file is parsed
+ * and the binary copy written, so that the next load of the scene, e.g.
+ * after it has been evicted, is fast. The XML file is checked before it is
+ * parsed, so a copy of a file edited meanwhile is parsed again next time.
+ *
+ * Returns:
+ * Pointer to the scene, or NULL on error.
+ */
+static scene_t* library_load (const char *name, unsigned long version, int *cached)
+{
+   char xml[PATH_MAX], bin[PATH_MAX], tmp[PATH_MAX];
+   struct stat xst;
+   scene_t *scene;
+   int rc;
+
+   *cached = 0;
+   snprintf (xml, sizeof(xml), "%s/%s.xml",  scene_dir, name);
+   snprintf (bin, sizeof(bin), "%s/%s.srts", cache_dir, name);
+   if (stat (xml, &xst))
+      return NULL;
+
+   scene = scene_new ();
+   if (!scene)
+      return NULL;
+
+   if (!library_read (scene, bin, &xst))
+   {
+      *cached = 1;
+      return scene;
+   }
+
+   /* A failed binary load may have left a part of the scene */
+   scene_free (scene);
+   scene = scene_new ();
+   if (!scene)
+      return NULL;
+
+   pthread_mutex_lock (&xml_lock);
+   rc = xml_parse_scene (scene, xml);
+   pthread_mutex_unlock (&xml_lock);
+   if (rc)
+   {
+      scene_free (scene);
+      return NULL;
+   }
+
+   /* Write the copy under another name first, loads never see half of it */
+   snprintf (tmp, sizeof(tmp), "%s/%s.srts.%lu", cache_dir, name, version);
+   if (library_write (scene, tmp, &xst) || rename (tmp, bin))
+      unlink (tmp);
+
+   return scene;
+}
+
+/**
+ * library_init - Setup the library.
+ * @dir:       Directory of the scenes, <NAME>.xml.
+ * @max_bytes: Budget of the loaded scenes in bytes.
+ *
+ * Binary copies of the scenes are kept in the private cache directory
+ * selected with LIBRARY_DIR_ENV, see cachedir_get().
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int library_init (const char *dir, size_t max_bytes)
+{
+   if (cachedir_get (LIBRARY_DIR_ENV, "library", cache_dir, sizeof(cache_dir)))
+      return 1;
+   snprintf (scene_dir, sizeof(scene_dir), "%s", dir);
+
+   pthread_mutex_lock (&lock);
+   memset (&stats, 0, sizeof(stats));
+   stats.max_bytes = max_bytes;
+   pthread_mutex_unlock (&lock);
+
+   return 0;
+}
+
+/**
+ * library_enabled - Check if the library is set up.
+ *
+ * Returns:
+ * Non-zero if library_init() has been called.
+ */
+int library_enabled (void)
+{
+   return scene_dir[0] != 0;
+}
+
+/**
+ * library_get - Get a scene.
+ * @name: Scene name, see library_load().
+ *
+ * If the scene is loaded it is returned at once. If another caller is
+ * already loading it, this function waits for that load. Otherwise the
+ * scene is loaded, and least recently used scenes nobody is waiting for
+ * are dropped until the library is within its budget. The scene must not
+ * be changed, and the entry must be released with library_release().
+ *
+ * Returns:
+ * Pointer to entry, or NULL if there is no such scene or it couldn't be
+ * loaded.
+ */
+library_entry_t* library_get (const char *name)
+{
+   library_entry_t *entry, *next;
+   int cached;
+
+   if (!library_enabled () || !library_name_ok (name))
+      return NULL;
+
+   pthread_mutex_lock (&lock);
+
+   for (entry = lru_head; entry; entry = entry->next)
+      if (!strcmp (entry->name, name))
+         break;
+
+   if (entry)
+   {
+      entry->refs++;
+      if (entry->pending)
+      {
+         stats.coalesced++;
+         while (entry->pending)
+            pthread_cond_wait (&ready, &lock);
+      }
+      else
+      {
+         stats.hits++;
+         library_lru_unlink (entry);
+         library_lru_push (entry);
+      }
+
+      if (!entry->scene)
+      {
+         entry->refs--;
+         if (!entry->refs && !entry->cached)
+            library_free (entry);
+         entry = NULL;
+      }
+      pthread_mutex_unlock (&lock);
+
+      return entry;
+   }
+
+   entry = calloc (1, sizeof(*entry));
+   if (!entry)
+   {
+      pthread_mutex_unlock (&lock);
+      return NULL;
+   }
+   snprintf (entry->name, sizeof(entry->name), "%s", name);
+   entry->version = ++num_loads;
+   entry->pending = 1;
+   entry->cached  = 1;
+   entry->refs    = 1;
+   library_lru_push (entry);
+   stats.misses++;
+   stats.entries++;
+
+   pthread_mutex_unlock (&lock);
+
+   entry->scene = library_load (name, entry->version, &cached);
+   if (entry->scene)
+      entry->size = sizeof(scene_t) + entry->scene->max_spheres *
+                    (sizeof(sphere_t) + sizeof(dvector_t));
+
+   pthread_mutex_lock (&lock);
+
+   entry->pending = 0;
+   if (!entry->scene)
+   {
+      library_lru_unlink (entry);
+      stats.entries--;
+      entry->cached = 0;
+      entry->refs--;
+      if (!entry->refs)
+         library_free (entry);
+      entry = NULL;
+   }
+   else
+   {
+      if (cached)
+         stats.cache_loads++;
+      else
+         stats.xml_loads++;
+      stats.bytes += entry->size;
+
+      /* Entries being loaded are skipped, their size isn't known yet */
+      for (next = lru_tail; next && stats.bytes > stats.max_bytes; )
+      {
+         library_entry_t *e = next;
+
+         next = e->prev;
+         if (e == entry || e->pending)
+            continue;
+         stats.evictions++;
+         library_drop (e);
+      }
+   }
+
+   pthread_cond_broadcast (&ready);
+   pthread_mutex_unlock (&lock);
+
+   return entry;
+}
+
+/**
+ * library_release - Release an entry.
+ * @entry: Pointer to entry returned by library_get().
+ *
+ * Returns:
+ * none.
+ */
+void library_release (library_entry_t *entry)
+{
+   pthread_mutex_lock (&lock);
+
+   entry->refs--;
+   if (!entry->refs && !entry->cached)
+      library_free (entry);
+
+   pthread_mutex_unlock (&lock);
+}
+
+/**
+ * library_get_stats - Get library statistics.
+ * @s: Pointer where to return the statistics.
+ *
+ * Returns:
+ * none.
+ */
+void library_get_stats (library_stats_t *s)
+{
+   pthread_mutex_lock (&lock);
+   *s = stats;
+   pthread_mutex_unlock (&lock);
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,585 @@
+/**
+ * loadgen.c - Load generator class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines a load generator, which requests tiles from a render
+ * server over many connections at a fixed rate and reports the latency.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h> /* strncasecmp */
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "net.h"
+#include "server.h"
+#include "library.h"
+#include "tilesched.h"
+
+#include "loadgen.h"
+
+/* Number of buckets of a histogram */
+#define LOADGEN_BUCKETS (LOADGEN_MAGS << LOADGEN_SUB_BITS)
+
+/* Most request kinds in a mix */
+#define LOADGEN_MAX_MIX 64
+
+/* Request kind of a mix, tiles are picked at random within the level */
+typedef struct {
+   int  weight;                    /* Relative share of the requests */
+   char scene[LIBRARY_NAME_SIZE];  /* Library scene, empty for the main */
+   int  width;                     /* Full resolution width */
+   int  height;                    /* Full resolution height */
+   int  level;                     /* Level */
+   int  cols;                      /* Number of tile columns at @level */
+   int  rows;                      /* Number of tile rows at @level */
+} loadgen_kind_t;
+
+/* Latency histogram in microseconds */
+typedef struct {
+   uint64_t count[LOADGEN_BUCKETS];
+   uint64_t total;
+   double   sum;      /* Sum of the values, for the mean */
+   double   sum2;     /* Sum of the squared values, for the deviation */
+   uint64_t max;
+} loadgen_hist_t;
+
+/* Connection thread */
+typedef struct {
+   const loadgen_conf_t *conf;
+   int            id;          /* Connection index */
+   double         start;       /* Start time of the run */
+   unsigned int   seed;        /* Random seed of the tile picks */
+   loadgen_hist_t hist;        /* Latency of this connection */
+   unsigned long  ok;          /* Requests answered with 200 */
+   unsigned long  failed;      /* Requests answered otherwise, or lost */
+   size_t         bytes;       /* Received body bytes */
+} loadgen_conn_t;
+
+/* Request mix, read-only while running */
+static loadgen_kind_t mix[LOADGEN_MAX_MIX];
+static int num_mix = 0;
+static int mix_weight = 0;
+
+/**
+ * loadgen_bucket - Get histogram bucket of a value.
+ * @v: Value.
+ *
+ * Values below 2^LOADGEN_SUB_BITS have a bucket each, above that each power
+ * of two is split into 2^(LOADGEN_SUB_BITS - 1) buckets.
+ *
+ * Returns:
+ * Bucket index.
+ */
+static int loadgen_bucket (uint64_t v)
+{
+   int msb = 63 - __builtin_clzll (v | 1);
+   int shift = msb < LOADGEN_SUB_BITS ? 0 : msb - LOADGEN_SUB_BITS + 1;
+   int b = (shift << LOADGEN_SUB_BITS) + (int)(v >> shift);
+
+   return b < LOADGEN_BUCKETS ? b : LOADGEN_BUCKETS - 1;
+}
+
+/**
+ * loadgen_bucket_value - Get highest value of a histogram bucket.
+ * @b: Bucket index.
+ *
+ * Returns:
+ * Highest value counted in bucket @b.
+ */
+static uint64_t loadgen_bucket_value (int b)
+{
+   int shift = b >> LOADGEN_SUB_BITS;
+   uint64_t sub = b & ((1 << LOADGEN_SUB_BITS) - 1);
+
+   return ((sub + 1) << shift) - 1;
+}
+
+/**
+ * loadgen_record - Record a value in a histogram.
+ * @h: Pointer to histogram.
+ * @v: Value.
+ *
+ * Returns:
+ * none.
+ */
+static void loadgen_record (loadgen_hist_t *h, uint64_t v)
+{
+   h->count[loadgen_bucket (v)]++;
+   h->total++;
+   h->sum  += v;
+   h->sum2 += (double)v * v;
+   if (v > h->max)
+      h->max = v;
+}
+
+/**
+ * loadgen_percentile - Get a percentile of a histogram.
+ * @h: Pointer to histogram.
+ * @p: Percentile, 0-100.
+ *
+ * Returns:
+ * Highest value of the bucket holding percentile @p.
+ */
+static uint64_t loadgen_percentile (const loadgen_hist_t *h, double p)
+{
+   uint64_t rank = (uint64_t)ceil (p / 100.0 * h->total);
+   uint64_t n = 0;
+   int b;
+
+   if (!rank)
+      rank = 1;
+   for (b = 0; b < LOADGEN_BUCKETS; b++)
+   {
+      n += h->count[b];
+      if (n >= rank)
+      {
+         uint64_t v = loadgen_bucket_value (b);
+
+         return v < h->max ? v : h->max;
+      }
+   }
+
+   return h->max;
+}
+
+/**
+ * loadgen_dump - Dump a histogram.
+ * @h:    Pointer to histogram.
+ * @file: File name.
+ *
+ * The histogram is written in the percentile distribution format of
+ * HdrHistogram, values in milliseconds, one line for each used bucket, so
+ * it can be plotted with the usual HdrHistogram tools.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+static int loadgen_dump (const loadgen_hist_t *h, const char *file)
+{
+   FILE *fp = fopen (file, "w");
+   double mean = h->total ? h->sum / h->total : 0;
+   double dev  = h->total ? sqrt (fmax (0, h->sum2 / h->total - mean * mean)) : 0;
+   uint64_t n = 0;
+   int b;
+
+   if (!fp)
+   {
+      fprintf (stderr, "error: Unable to create %s.\n", file);
+      return 1;
+   }
+
+   fprintf (fp, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+   for (b = 0; b < LOADGEN_BUCKETS; b++)
+   {
+      double p;
+
+      if (!h->count[b])
+         continue;
+      n += h->count[b];
+      p = (double)n / h->total;
+      if (p < 1)
+         fprintf (fp, "%12.3f %1.12f %10llu %14.2f\n", loadgen_bucket_value (b) / 1000.0,
+                  p, (unsigned long long)n, 1 / (1 - p));
+      else
+         fprintf (fp, "%12.3f %1.12f %10llu\n", h->max / 1000.0,
+                  p, (unsigned long long)n);
+   }
+   fprintf (fp, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n", mean / 1000.0, dev / 1000.0);
+   fprintf (fp, "#[Max     = %12.3f, Total count    = %12llu]\n", h->max / 1000.0,
+            (unsigned long long)h->total);
+   fprintf (fp, "#[Buckets = %12d, SubBuckets     = %12d]\n", LOADGEN_MAGS, 1 << LOADGEN_SUB_BITS);
+
+   if (fclose (fp))
+   {
+      fprintf (stderr, "error: Unable to write %s.\n", file);
+      return 1;
+   }
+
+   return 0;
+}
+
+/**
+ * loadgen_add_kind - Add a request kind to the mix.
+ * @weight: Relative share of the requests.
+ * @scene:  Library scene name, or "-" for the main scene.
+ * @width:  Full resolution width.
+ * @height: Full resolution height.
+ * @level:  Level.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+static int loadgen_add_kind (int weight, const char *scene, int width, int height, int level)
+{
+   loadgen_kind_t *k = &mix[num_mix];
+   int lw, lh;
+
+   if (num_mix == LOADGEN_MAX_MIX || weight < 1 || width < 1 || height < 1 ||
+       width > SERVER_MAX_SIZE || height > SERVER_MAX_SIZE || level < 0 || level > 20 ||
+       strlen (scene) >= sizeof(k->scene))
+      return 1;
+
+   lw = (width  + (1 << level) - 1) >> level;
+   lh = (height + (1 << level) - 1) >> level;
+
+   k->weight = weight;
+   snprintf (k->scene, sizeof(k->scene), "%s", strcmp (scene, "-") ? scene : "");
+   k->width  = width;
+   k->height = height;
+   k->level  = level;
+   k->cols   = (lw + SERVER_TILE_SIZE - 1) / SERVER_TILE_SIZE;
+   k->rows   = (lh + SERVER_TILE_SIZE - 1) / SERVER_TILE_SIZE;
+   num_mix++;
+   mix_weight += weight;
+
+   return 0;
+}
+
+/**
+ * loadgen_read_mix - Read a request mix file.
+ * @file: File name.
+ *
+ * Each line is "<WEIGHT> <SCENE> <WIDTH>x<HEIGHT> <LEVEL>", where <SCENE> is
+ * a library scene name or "-" for the main scene. Empty lines and lines
+ * starting with '#' are skipped.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+static int loadgen_read_mix (const char *file)
+{
+   FILE *fp = fopen (file, "r");
+   char line[256];
+   int num = 0;
+
+   if (!fp)
+   {
+      fprintf (stderr, "error: Unable to open %s.\n", file);
+      return 1;
+   }
+
+   while (fgets (line, sizeof(line), fp))
+   {
+      char scene[LIBRARY_NAME_SIZE];
+      int weight, width, height, level;
+      char *p = line + strspn (line, " \t");
+
+      num++;
+      if (*p == '#' || *p == '\n' || !*p)
+         continue;
+      if (sscanf (p, "%d %63s %dx%d %d", &weight, scene, &width, &height, &level) != 5 ||
+          loadgen_add_kind (weight, scene, width, height, level))
+      {
+         fprintf (stderr, "error: %s:%d: Invalid request kind.\n", file, num);
+         fclose (fp);
+         return 1;
+      }
+   }
+   fclose (fp);
+
+   if (!num_mix)
+   {
+      fprintf (stderr, "error: %s has no requests.\n", file);
+      return 1;
+   }
+
+   return 0;
+}
+
+/**
+ * loadgen_path - Pick the path of the next request.
+ * @c:    Pointer to connection.
+ * @path: Pointer to buffer.
+ * @len:  Size of @path.
+ *
+ * Returns:
+ * none.
+ */
+static void loadgen_path (loadgen_conn_t *c, char *path, size_t len)
+{
+   int w = rand_r (&c->seed) % mix_weight;
+   loadgen_kind_t *k = mix;
+   int n;
+
+   while (w >= k->weight)
+   {
+      w -= k->weight;
+      k++;
+   }
+
+   n = k->scene[0] ? snprintf (path, len, "/scenes/%s", k->scene) : 0;
+   snprintf (path + n, len - n, "/tile/%dx%d/%d/%d/%d.png",
+             k->width, k->height, k->level,
+             rand_r (&c->seed) % k->cols, rand_r (&c->seed) % k->rows);
+}
+
+/**
+ * loadgen_request - Make a request and read the response.
+ * @fd:    Socket, a kept-alive connection.
+ * @path:  Request path.
+ * @bytes: Pointer where to return the body length.
+ *
+ * Returns:
+ * HTTP status, or -1 if the connection failed.
+ */
+static int loadgen_request (int fd, const char *path, size_t *bytes)
+{
+   char buf[8192];
+   size_t len = 0, body = 0, head;
+   char *end, *p;
+   int status, n;
+
+   n = snprintf (buf, sizeof(buf), "GET %s HTTP/1.1\r\nHost: srt\r\n\r\n", path);
+   if (net_write (fd, buf, n))
+      return -1;
+
+   /* Read the head, and maybe a part of the body */
+   while (1)
+   {
+      ssize_t r;
+
+      buf[len] = 0;
+      end = strstr (buf, "\r\n\r\n");
+      if (end)
+         break;
+      if (len == sizeof(buf) - 1)
+         return -1;
+      r = read (fd, buf + len, sizeof(buf) - 1 - len);
+      if (r <= 0)
+         return -1;
+      len += r;
+   }
+   head = end + 4 - buf;
+
+   if (sscanf (buf, "HTTP/1.%*d %d", &status) != 1)
+      return -1;
+   for (p = strstr (buf, "\r\n"); p && p < end; p = strstr (p + 2, "\r\n"))
+      if (!strncasecmp (p + 2, "Content-Length:", 15))
+         body = strtoul (p + 17, NULL, 10);
+
+   /* Skip the rest of the body */
+   *bytes = body;
+   body -= len - head < body ? len - head : body;
+   while (body)
+   {
+      ssize_t r = read (fd, buf, body < sizeof(buf) ? body : sizeof(buf));
+
+      if (r <= 0)
+         return -1;
+      body -= r;
+   }
+
+   return status;
+}
+
+/**
+ * loadgen_conn - Connection thread.
+ * @arg: Pointer to connection.
+ *
+ * The requests of all connections are spread evenly in time at the rate of
+ * the run, each connection sending every conns'th request. A request is
+ * timed from when it was due rather than from when it was sent, so a slow
+ * server also counts the time requests queue up on the client side, i.e.
+ * the latency isn't underestimated when the server can't keep up.
+ *
+ * Returns:
+ * NULL.
+ */
+static void* loadgen_conn (void *arg)
+{
+   loadgen_conn_t *c = arg;
+   const loadgen_conf_t *conf = c->conf;
+   const double interval = conf->conns / conf->rate;
+   double due = c->start + c->id / conf->rate;
+   int fd = -1;
+
+   while (due < c->start + conf->duration)
+   {
+      char path[128];
+      size_t bytes = 0;
+      double now = tilesched_time ();
+      int status;
+
+      if (now < due)
+      {
+         struct timespec ts;
+
+         ts.tv_sec  = (time_t)(due - now);
+         ts.tv_nsec = (long)((due - now - ts.tv_sec) * 1e9);
+         nanosleep (&ts, NULL);
+      }
+
+      if (fd < 0)
+         fd = net_connect (conf->addr);
+
+      loadgen_path (c, path, sizeof(path));
+      status = fd < 0 ? -1 : loadgen_request (fd, path, &bytes);
+      if (status < 0 && fd >= 0)
+      {
+         close (fd);
+         fd = -1;
+      }
+
+      if (status == 200)
+      {
+         double t = tilesched_time () - due;
+
+         loadgen_record (&c->hist, t > 0 ? (uint64_t)(t * 1e6) : 0);
+         c->ok++;
+         c->bytes += bytes;
+      }
+      else
+         c->failed++;
+
+      due += interval;
+   }
+
+   if (fd >= 0)
+      close (fd);
+
+   return NULL;
+}
+
+/**
+ * loadgen_init - Setup a load generator with the defaults.
+ * @conf: Pointer to setup.
+ * @addr: Server address.
+ *
+ * Returns:
+ * none.
+ */
+void loadgen_init (loadgen_conf_t *conf, const char *addr)
+{
+   memset (conf, 0, sizeof(*conf));
+   conf->addr     = addr;
+   conf->conns    = LOADGEN_CONNECTIONS;
+   conf->rate     = LOADGEN_RATE;
+   conf->duration = LOADGEN_DURATION;
+}
+
+/**
+ * loadgen_run - Generate load on a server.
+ * @conf: Pointer to setup.
+ *
+ * This function will request tiles from the server of @conf, with the mix
+ * of requests of @conf, and print the latency percentiles and the
+ * throughput when done.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int loadgen_run (loadgen_conf_t *conf)
+{
+   loadgen_conn_t *conn;
+   pthread_t *thread;
+   loadgen_hist_t *hist;
+   unsigned long ok = 0, failed = 0;
+   size_t bytes = 0;
+   double start, t;
+   int i, b, rc = 0;
+
+   if (conf->conns < 1 || conf->rate <= 0 || conf->duration <= 0)
+   {
+      fprintf (stderr, "error: Invalid connections, rate or duration.\n");
+      return 1;
+   }
+
+   num_mix = mix_weight = 0;
+   if (conf->mix ? loadgen_read_mix (conf->mix) : loadgen_add_kind (1, "-", 1920, 1080, 0))
+      return 1;
+
+   conn   = calloc (conf->conns, sizeof(*conn));
+   thread = calloc (conf->conns, sizeof(*thread));
+   hist   = calloc (1, sizeof(*hist));
+   if (!conn || !thread || !hist)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for %d connections.\n", conf->conns);
+      free (conn);
+      free (thread);
+      free (hist);
+      return 1;
+   }
+
+   printf ("Requesting %.0f tiles/s from %s over %d connections for %.0f s\n",
+           conf->rate, conf->addr, conf->conns, conf->duration);
+
+   start = tilesched_time ();
+   for (i = 0; i < conf->conns; i++)
+   {
+      conn[i].conf  = conf;
+      conn[i].id    = i;
+      conn[i].start = start;
+      conn[i].seed  = 1 + i;
+      if (pthread_create (&thread[i], NULL, loadgen_conn, &conn[i]))
+      {
+         fprintf (stderr, "error: Unable to start connection thread.\n");
+         conf->conns = i;
+         rc = 1;
+         break;
+      }
+   }
+
+   for (i = 0; i < conf->conns; i++)
+   {
+      pthread_join (thread[i], NULL);
+
+      for (b = 0; b < LOADGEN_BUCKETS; b++)
+         hist->count[b] += conn[i].hist.count[b];
+      hist->total += conn[i].hist.total;
+      hist->sum   += conn[i].hist.sum;
+      hist->sum2  += conn[i].hist.sum2;
+      if (conn[i].hist.max > hist->max)
+         hist->max = conn[i].hist.max;
+      ok     += conn[i].ok;
+      failed += conn[i].failed;
+      bytes  += conn[i].bytes;
+   }
+   t = tilesched_time () - start;
+
+   printf ("Requests: %lu ok, %lu failed in %.3f s\n", ok, failed, t);
+   printf ("Throughput: %.1f requests/s, %.1f MB/s\n", ok / t, bytes / t / (1 << 20));
+   if (hist->total)
+      printf ("Latency (ms): p50 %.3f, p95 %.3f, p99 %.3f, p99.9 %.3f, max %.3f\n",
+              loadgen_percentile (hist, 50) / 1000.0,
+              loadgen_percentile (hist, 95) / 1000.0,
+              loadgen_percentile (hist, 99) / 1000.0,
+              loadgen_percentile (hist, 99.9) / 1000.0,
+              hist->max / 1000.0);
+
+   if (conf->hdr && loadgen_dump (hist, conf->hdr))
+      rc = 1;
+
+   free (conn);
+   free (thread);
+   free (hist);
+
+   return rc || !ok;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
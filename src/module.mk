@@ -1,5 +1,7 @@
 MODULES := ssil
 MODDIR  := src
-MODOBJS := cli.o xml.o output.o render.o scene.o sphere.o vector.o color.o
+MODOBJS := cli.o xml.o output.o render.o scene.o sphere.o vector.o color.o \
+           net.o dist.o mproc.o composite.o tilesched.o jobsched.o batch.o vrs.o precision.o fixed.o kernel.o jit.o cachedir.o startup.o edit.o snapshot.o delta.o \
+           http.o server.o tilecache.o library.o loadgen.o quality.o span.o
 
 include eval.mk
@@ -0,0 +1,327 @@
+/**
+ * mproc.c - Multi-process render class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines rendering of a scene using several forked processes
+ * sharing the image buffer.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "scene.h"
+#include "render.h"
+#include "tilesched.h"
+
+#include "mproc.h"
+
+/* Tile states, a claimed tile holds the number of the worker (1..N) */
+#define MPROC_TILE_TODO  0
+#define MPROC_TILE_DONE -1
+
+/* Shared segment header. The segment holds, in order: the read-only scene
+ * copy (own pages), this header, the tile states, the list of tiles to
+ * render in this round, the tile render times and the image buffer. */
+typedef struct {
+   uint32_t next;       /* Next entry in @list to claim, atomic counter */
+   uint32_t num_list;   /* Number of entries in @list */
+   int32_t *state;      /* State of each tile */
+   int32_t *list;       /* Tiles to render in this round */
+   float   *time;       /* Render time of each tile */
+   uint8_t *image;      /* Shared image buffer */
+   scene_t *scene;      /* Read-only scene */
+   tilesched_tile_t *tile;   /* Planned tiles, private copy in each worker */
+   int      width;      /* Width of the rendered screen */
+   int      height;     /* Height of the rendered screen */
+} mproc_shm_t;
+
+/**
+ * mproc_align - Round up a size.
+ * @sz:    Size to round up.
+ * @align: Alignment, must be a power of two.
+ *
+ * Returns:
+ * @sz rounded up to a multiple of @align.
+ */
+static size_t mproc_align (size_t sz, size_t align)
+{
+   return (sz + align - 1) & ~(align - 1);
+}
+
+/**
+ * mproc_work - Claim and render tiles until there are none left.
+ * @shm:  Pointer to shared segment header.
+ * @id:   Worker number, 1..N.
+ * @tile: Pointer to a private tile buffer.
+ *
+ * Tiles are claimed by atomically incrementing the shared counter, i.e.
+ * each entry in the list is rendered by exactly one worker. The tile state
+ * is set to the worker number while rendering and to done when the pixels
+ * are in the shared image, so the tile can be reclaimed if the worker dies.
+ * The render time of each tile is stored for the tile scheduler.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+static int mproc_work (mproc_shm_t *shm, int id, uint8_t *tile)
+{
+   uint32_t n;
+
+   while ((n = __atomic_fetch_add (&shm->next, 1, __ATOMIC_RELAXED)) < shm->num_list)
+   {
+      int t  = shm->list[n];
+      int x0 = shm->tile[t].x0;
+      int y0 = shm->tile[t].y0;
+      int x1 = shm->tile[t].x1;
+      int y1 = shm->tile[t].y1;
+      size_t row_sz = (size_t)(x1 - x0) * 3;
+      double start;
+      int y;
+
+      __atomic_store_n (&shm->state[t], id, __ATOMIC_RELAXED);
+      start = tilesched_time ();
+
+      if (render_tile (tile, row_sz * (y1 - y0), shm->width, shm->height,
+                       x0, y0, x1, y1, shm->scene))
+         return 1;
+
+      for (y = y0; y < y1; y++)
+         memcpy (shm->image + ((size_t)y * shm->width + x0) * 3,
+                 tile + (y - y0) * row_sz, row_sz);
+
+      shm->time[t] = tilesched_time () - start;
+      __atomic_store_n (&shm->state[t], MPROC_TILE_DONE, __ATOMIC_RELEASE);
+   }
+
+   return 0;
+}
+
+/**
+ * mproc_round - Fork workers to render the listed tiles.
+ * @shm:       Pointer to shared segment header.
+ * @num_procs: Number of worker processes.
+ * @tile:      Pointer to a tile buffer, each worker gets its own copy.
+ *
+ * Returns:
+ * Number of workers which didn't exit normally.
+ */
+static int mproc_round (mproc_shm_t *shm, int num_procs, uint8_t *tile)
+{
+   pid_t *pid;
+   int num_failed = 0;
+   int num_forked = 0;
+   int i;
+
+   pid = calloc (num_procs, sizeof(*pid));
+   if (!pid)
+      return num_procs;
+
+   for (i = 0; i < num_procs; i++)
+   {
+      pid[i] = fork ();
+      if (pid[i] == 0)
+         _exit (mproc_work (shm, i + 1, tile));
+      if (pid[i] < 0)
+      {
+         fprintf (stderr, "warning: Unable to fork worker %d.\n", i + 1);
+         break;
+      }
+      num_forked++;
+   }
+
+   /* Render in this process if no worker could be started */
+   if (!num_forked && mproc_work (shm, num_procs + 1, tile))
+      num_failed++;
+
+   for (i = 0; i < num_forked; i++)
+   {
+      int status;
+      pid_t rc;
+
+      while ((rc = waitpid (pid[i], &status, 0)) < 0 && errno == EINTR)
+         ;
+
+      if (rc < 0)
+      {
+         fprintf (stderr, "warning: Unable to wait for worker %d (pid %d).\n",
+                  i + 1, (int)pid[i]);
+         num_failed++;
+      }
+      else
+      if (WIFSIGNALED (status))
+      {
+         fprintf (stderr, "warning: Worker %d (pid %d) was killed by signal %d.\n",
+                  i + 1, (int)pid[i], WTERMSIG (status));
+         num_failed++;
+      }
+      else
+      if (WEXITSTATUS (status))
+      {
+         fprintf (stderr, "warning: Worker %d (pid %d) failed.\n", i + 1, (int)pid[i]);
+         num_failed++;
+      }
+   }
+
+   free (pid);
+
+   return num_failed;
+}
+
+/**
+ * mproc_render - Render a scene using several processes.
+ * @num_procs:     Number of worker processes.
+ * @image:         Pointer to buffer which will contain the rendered scene
+ * @image_sz:      Size of @image buffer
+ * @screen_width:  Width of rendered screen
+ * @screen_height: Height of rendered screen
+ * @scene:         Pointer to scene object
+ *
+ * This function will map a shared segment holding the image buffer and a
+ * read-only copy of the scene, and then fork @num_procs worker processes.
+ * The screen is split into tiles by tilesched_plan(), most expensive tile
+ * first, and the workers claim tiles in that order through an atomic
+ * counter in the segment. The render time of each tile is recorded for
+ * planning the next frame.
+ * When all workers have exited, any tile not marked as done, e.g. the tile a
+ * crashed worker was rendering, is reclaimed and rendered again by a new set
+ * of workers, at most MPROC_MAX_ROUNDS times.
+ * The image is identical to the one created by render_scene().
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int mproc_render (int num_procs,
+                  uint8_t* image,
+                  size_t image_sz,
+                  int screen_width,
+                  int screen_height,
+                  scene_t *scene)
+{
+   const size_t page_sz  = sysconf (_SC_PAGESIZE);
+   const size_t scene_sz = mproc_align (sizeof(scene_t) + scene->num_spheres * sizeof(sphere_t),
+                                        page_sz);
+   const size_t fb_sz    = (size_t)screen_width * screen_height * 3;
+   tilesched_tile_t *plan = NULL;
+   int num_tiles;
+   size_t state_sz;
+   size_t shm_sz;
+   uint8_t *seg;
+   uint8_t *tile;
+   mproc_shm_t *shm;
+   int round;
+   int rc = 1;
+   int i;
+
+   if (num_procs < 1 || image_sz < fb_sz)
+      return 1;
+
+   num_tiles = tilesched_plan (screen_width, screen_height, num_procs, &plan);
+   if (num_tiles < 0)
+      return 1;
+   state_sz = mproc_align (num_tiles * sizeof(int32_t), 64);
+
+   shm_sz = scene_sz + mproc_align (sizeof(*shm), 64) + 3 * state_sz + fb_sz;
+   seg = mmap (NULL, shm_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+   if (seg == MAP_FAILED)
+   {
+      fprintf (stderr, "error: Unable to map shared memory for rendering\n");
+      free (plan);
+      return 1;
+   }
+
+   tile = malloc (TILESCHED_TILE_MAX * TILESCHED_TILE_MAX * 3);
+   if (!tile)
+   {
+      munmap (seg, shm_sz);
+      free (plan);
+      return 1;
+   }
+
+   /* Setup the shared segment, the scene is made read-only for all workers */
+   shm = (mproc_shm_t*)(seg + scene_sz);
+   shm->scene = (scene_t*)seg;
+   memcpy (shm->scene, scene, sizeof(scene_t));
+   shm->scene->sphere = (sphere_t*)(seg + sizeof(scene_t));
+   memcpy (shm->scene->sphere, scene->sphere, scene->num_spheres * sizeof(sphere_t));
+   mprotect (seg, scene_sz, PROT_READ);
+
+   shm->state  = (int32_t*)(seg + scene_sz + mproc_align (sizeof(*shm), 64));
+   shm->list   = shm->state + state_sz / sizeof(int32_t);
+   shm->time   = (float*)(shm->list + state_sz / sizeof(int32_t));
+   shm->image  = (uint8_t*)shm->state + 3 * state_sz;
+   shm->tile   = plan;
+   shm->width  = screen_width;
+   shm->height = screen_height;
+
+   for (round = 0; round < MPROC_MAX_ROUNDS; round++)
+   {
+      uint32_t n = 0;
+
+      /* List all tiles not done, i.e. all tiles in the first round */
+      for (i = 0; i < num_tiles; i++)
+         if (shm->state[i] != MPROC_TILE_DONE)
+            shm->list[n++] = i;
+
+      if (!n)
+         break;
+      if (round)
+         fprintf (stderr, "warning: Rendering %u tiles left by crashed workers.\n", n);
+
+      shm->next     = 0;
+      shm->num_list = n;
+
+      mproc_round (shm, num_procs < (int)n ? num_procs : (int)n, tile);
+   }
+
+   for (i = 0; i < num_tiles; i++)
+      if (shm->state[i] != MPROC_TILE_DONE)
+         break;
+
+   if (i == num_tiles)
+   {
+      tilesched_begin (screen_width, screen_height);
+      for (i = 0; i < num_tiles; i++)
+         tilesched_record (plan[i].x0, plan[i].y0, plan[i].x1, plan[i].y1,
+                           shm->time[i]);
+
+      memcpy (image, shm->image, fb_sz);
+      memset (image + fb_sz, 0, image_sz - fb_sz);
+      rc = 0;
+   }
+   else
+   {
+      fprintf (stderr, "error: Tiles could not be rendered, workers keep crashing.\n");
+   }
+
+   free (tile);
+   free (plan);
+   munmap (seg, shm_sz);
+
+   return rc;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
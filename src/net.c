@@ -0,0 +1,406 @@
+/**
+ * net.c - Network class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines socket helpers and the message framing used when
+ * processes talk to each other over TCP or Unix sockets.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "net.h"
+
+/* Prefix used to select a Unix socket address */
+#define UNIX_PREFIX "unix:"
+
+/**
+ * net_is_unix - Check if an address is a Unix socket address.
+ * @addr: Address string.
+ *
+ * An address is a Unix socket path if it starts with "unix:" or "/",
+ * otherwise it is treated as a TCP "host:port" address.
+ *
+ * Returns:
+ * Pointer to the socket path or NULL if @addr is a TCP address.
+ */
+static const char* net_is_unix (const char *addr)
+{
+   if (!strncmp (addr, UNIX_PREFIX, strlen (UNIX_PREFIX)))
+      return addr + strlen (UNIX_PREFIX);
+   if (addr[0] == '/')
+      return addr;
+
+   return NULL;
+}
+
+/**
+ * net_unix_addr - Setup a Unix socket address.
+ * @un:   Pointer to socket address to setup.
+ * @path: Socket path.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if @path is too long.
+ */
+static int net_unix_addr (struct sockaddr_un *un, const char *path)
+{
+   memset (un, 0, sizeof(*un));
+   un->sun_family = AF_UNIX;
+   if (strlen (path) >= sizeof(un->sun_path))
+   {
+      fprintf (stderr, "error: Socket path %s is too long.\n", path);
+      return 1;
+   }
+   strcpy (un->sun_path, path);
+
+   return 0;
+}
+
+/**
+ * net_tcp_addr - Resolve a TCP address.
+ * @addr: Address string, "host:port" or ":port" for any host.
+ * @res:  Pointer where to return the resolved address list.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+static int net_tcp_addr (const char *addr, struct addrinfo **res)
+{
+   struct addrinfo hints;
+   char host[256];
+   const char *port;
+   size_t len;
+
+   port = strrchr (addr, ':');
+   if (!port)
+   {
+      fprintf (stderr, "error: Invalid address %s, expected host:port.\n", addr);
+      return 1;
+   }
+   len = port - addr;
+   if (len >= sizeof(host))
+      len = sizeof(host) - 1;
+   memcpy (host, addr, len);
+   host[len] = 0;
+   port++;
+
+   memset (&hints, 0, sizeof(hints));
+   hints.ai_family   = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+   hints.ai_flags    = AI_PASSIVE;
+
+   if (getaddrinfo (len ? host : NULL, port, &hints, res))
+   {
+      fprintf (stderr, "error: Unable to resolve %s.\n", addr);
+      return 1;
+   }
+
+   return 0;
+}
+
+/**
+ * net_listen - Create a listening socket.
+ * @addr: Address to listen on, "unix:/path", "/path" or "host:port".
+ *
+ * Any stale Unix socket file at the path is removed before binding.
+ *
+ * Returns:
+ * Socket file descriptor or -1 on error.
+ */
+int net_listen (const char *addr)
+{
+   const char *path = net_is_unix (addr);
+   int fd;
+
+   if (path)
+   {
+      struct sockaddr_un un;
+
+      if (net_unix_addr (&un, path))
+         return -1;
+
+      fd = socket (AF_UNIX, SOCK_STREAM, 0);
+      if (fd < 0)
+         return -1;
+
+      unlink (path);
+      if (bind (fd, (struct sockaddr*)&un, sizeof(un)) || listen (fd, 64))
+      {
+         fprintf (stderr, "error: Unable to listen on %s: %s\n", addr, strerror (errno));
+         close (fd);
+         return -1;
+      }
+   }
+   else
+   {
+      struct addrinfo *res;
+      int on = 1;
+
+      if (net_tcp_addr (addr, &res))
+         return -1;
+
+      fd = socket (res->ai_family, res->ai_socktype, res->ai_protocol);
+      if (fd < 0)
+      {
+         freeaddrinfo (res);
+         return -1;
+      }
+
+      setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+      if (bind (fd, res->ai_addr, res->ai_addrlen) || listen (fd, 64))
+      {
+         fprintf (stderr, "error: Unable to listen on %s: %s\n", addr, strerror (errno));
+         freeaddrinfo (res);
+         close (fd);
+         return -1;
+      }
+      freeaddrinfo (res);
+   }
+
+   return fd;
+}
+
+/**
+ * net_accept - Accept a connection on a listening socket.
+ * @fd: Listening socket.
+ *
+ * Returns:
+ * Connected socket file descriptor or -1 on error.
+ */
+int net_accept (int fd)
+{
+   int cfd;
+
+   do
+      cfd = accept (fd, NULL, NULL);
+   while (cfd < 0 && errno == EINTR);
+
+   return cfd;
+}
+
+/**
+ * net_connect - Connect to a listening socket.
+ * @addr: Address to connect to, "unix:/path", "/path" or "host:port".
+ *
+ * Returns:
+ * Connected socket file descriptor or -1 on error.
+ */
+int net_connect (const char *addr)
+{
+   const char *path = net_is_unix (addr);
+   int fd;
+
+   if (path)
+   {
+      struct sockaddr_un un;
+
+      if (net_unix_addr (&un, path))
+         return -1;
+
+      fd = socket (AF_UNIX, SOCK_STREAM, 0);
+      if (fd < 0)
+         return -1;
+
+      if (connect (fd, (struct sockaddr*)&un, sizeof(un)))
+      {
+         close (fd);
+         return -1;
+      }
+   }
+   else
+   {
+      struct addrinfo *res;
+
+      if (net_tcp_addr (addr, &res))
+         return -1;
+
+      fd = socket (res->ai_family, res->ai_socktype, res->ai_protocol);
+      if (fd >= 0 && connect (fd, res->ai_addr, res->ai_addrlen))
+      {
+         close (fd);
+         fd = -1;
+      }
+      freeaddrinfo (res);
+   }
+
+   return fd;
+}
+
+/**
+ * net_close - Close a socket.
+ * @fd:   Socket file descriptor.
+ * @addr: Address the socket was listening on or NULL.
+ *
+ * If @addr is a Unix socket address the socket file is removed.
+ *
+ * Returns:
+ * none.
+ */
+void net_close (int fd, const char *addr)
+{
+   const char *path = addr ? net_is_unix (addr) : NULL;
+
+   close (fd);
+   if (path)
+      unlink (path);
+}
+
+/**
+ * net_write - Write a whole buffer to a socket.
+ * @fd:  Socket file descriptor.
+ * @buf: Pointer to data.
+ * @len: Number of bytes in @buf.
+ *
+ * A peer that has gone away will not raise SIGPIPE, the write will
+ * just fail.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int net_write (int fd, const void *buf, size_t len)
+{
+   const uint8_t *p = buf;
+
+   while (len)
+   {
+      ssize_t n = send (fd, p, len, MSG_NOSIGNAL);
+
+      if (n < 0 && errno == EINTR)
+         continue;
+      if (n <= 0)
+         return 1;
+
+      p   += n;
+      len -= n;
+   }
+
+   return 0;
+}
+
+/**
+ * net_read - Read a whole buffer from a socket.
+ * @fd:  Socket file descriptor.
+ * @buf: Pointer to buffer.
+ * @len: Number of bytes to read into @buf.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error or if the peer closed the connection.
+ */
+int net_read (int fd, void *buf, size_t len)
+{
+   uint8_t *p = buf;
+
+   while (len)
+   {
+      ssize_t n = read (fd, p, len);
+
+      if (n < 0 && errno == EINTR)
+         continue;
+      if (n <= 0)
+         return 1;
+
+      p   += n;
+      len -= n;
+   }
+
+   return 0;
+}
+
+/**
+ * net_send_msg - Send a message.
+ * @fd:   Socket file descriptor.
+ * @type: Message type.
+ * @buf:  Pointer to message payload or NULL.
+ * @len:  Length of payload.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int net_send_msg (int fd, uint32_t type, const void *buf, size_t len)
+{
+   net_msg_t msg;
+
+   msg.type = type;
+   msg.len  = len;
+
+   if (net_write (fd, &msg, sizeof(msg)))
+      return 1;
+   if (len && net_write (fd, buf, len))
+      return 1;
+
+   return 0;
+}
+
+/**
+ * net_recv_msg - Receive a message.
+ * @fd:  Socket file descriptor.
+ * @msg: Pointer where to return the message header.
+ * @buf: Pointer to a malloc'ed payload buffer, or to NULL.
+ * @len: Pointer to size of *@buf.
+ * @max: Largest payload accepted.
+ *
+ * The payload buffer is grown with realloc() when the payload doesn't fit,
+ * so the same buffer can be reused for all messages on a connection. The
+ * caller must free *@buf when done. A message with a payload larger than
+ * @max is an error, so a peer can't make the buffer grow without bound.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error or if the peer closed the connection.
+ */
+int net_recv_msg (int fd, net_msg_t *msg, void **buf, size_t *len, size_t max)
+{
+   if (net_read (fd, msg, sizeof(*msg)))
+      return 1;
+
+   if (msg->len > max)
+   {
+      fprintf (stderr, "error: Message too large (%u bytes).\n", msg->len);
+      return 1;
+   }
+
+   if (msg->len > *len)
+   {
+      void *p = realloc (*buf, msg->len);
+
+      if (!p)
+      {
+         fprintf (stderr, "error: Unable to alloc memory for message (%u bytes).\n", msg->len);
+         return 1;
+      }
+      *buf = p;
+      *len = msg->len;
+   }
+
+   if (msg->len && net_read (fd, *buf, msg->len))
+      return 1;
+
+   return 0;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -95,6 +95,30 @@ int output_render (void)
    return output_render_cb (image, screen_width, screen_height);
 }
 
+/**
+ * output_render_image - Call the output rendering function for an image.
+ * @img:    Pointer to image.
+ * @width:  Width of @img.
+ * @height: Height of @img.
+ *
+ * This function works as output_render(), but outputs @img instead of the
+ * image buffer, e.g. a cropped region of the scene.
+ *
+ * Returns:
+ * Output from callback function,
+ * which should be POSIX OK (zero) or non-zero on error.
+ */
+int output_render_image (uint8_t* img, int width, int height)
+{
+   if (!output_render_cb)
+   {
+      fprintf (stderr, "error: No renderdeing output method found.\n");
+      return 1;
+   }
+
+   return output_render_cb (img, width, height);
+}
+
 /**
  * output_get_image - Get pointer to rendered image buffer.
  *
@@ -0,0 +1,233 @@
+/**
+ * precision.c - Precision class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines the numeric precision tiers of the ray kernels.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h> /* abs */
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include "precision.h"
+
+/* Current precision tier */
+static precision_t precision = PRECISION_EXACT;
+
+/* Tier names */
+static const char *precision_names[PRECISION_NUM] = {
+   "exact",
+   "fast",
+   "fastest",
+};
+
+#ifndef PRECISION
+/**
+ * precision_get - Get the precision tier.
+ *
+ * Returns:
+ * Precision tier used when rendering.
+ */
+precision_t precision_get (void)
+{
+   return precision;
+}
+#endif
+
+/**
+ * precision_set - Set the precision tier.
+ * @p: Precision tier.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if the tier is fixed at compile time.
+ */
+int precision_set (precision_t p)
+{
+#ifdef PRECISION
+   if (p != PRECISION)
+   {
+      fprintf (stderr, "error: Precision is fixed to %s at compile time.\n",
+               precision_name (PRECISION));
+      return 1;
+   }
+#endif
+   precision = p;
+
+   return 0;
+}
+
+/**
+ * precision_name - Get the name of a precision tier.
+ * @p: Precision tier.
+ *
+ * Returns:
+ * Name of tier @p.
+ */
+const char* precision_name (precision_t p)
+{
+   if (p >= PRECISION_NUM)
+      return "unknown";
+
+   return precision_names[p];
+}
+
+/**
+ * precision_parse - Get a precision tier from its name.
+ * @name: Name of tier.
+ * @p:    Pointer where to return the tier.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if @name is not a tier.
+ */
+int precision_parse (const char *name, precision_t *p)
+{
+   int i;
+
+   for (i = 0; i < PRECISION_NUM; i++)
+   {
+      if (!strcmp (name, precision_names[i]))
+      {
+         *p = i;
+         return 0;
+      }
+   }
+
+   return 1;
+}
+
+/**
+ * precision_shift - Find how far a color is from a pixel.
+ * @image:  Pointer to image.
+ * @width:  Width of image.
+ * @height: Height of image.
+ * @x:      Column of pixel.
+ * @y:      Row of pixel.
+ * @color:  Pointer to red, green and blue component.
+ *
+ * Returns:
+ * Smallest distance, as the largest of the column and row distance, from
+ * pixel @x, @y to a pixel of @image with color @color, or PRECISION_SEARCH
+ * + 1 if there is none that close.
+ */
+static int precision_shift (const uint8_t *image, int width, int height,
+                            int x, int y, const uint8_t *color)
+{
+   int r, i, j;
+
+   for (r = 0; r <= PRECISION_SEARCH; r++)
+   {
+      for (j = y - r; j <= y + r; j++)
+      {
+         if (j < 0 || j >= height)
+            continue;
+
+         /* Only the pixels at distance r, the rest were searched before */
+         for (i = x - r; i <= x + r; i += (j == y - r || j == y + r) ? 1 : 2 * r)
+         {
+            if (i >= 0 && i < width &&
+                !memcmp (&image[((size_t)j * width + i) * 3], color, 3))
+               return r;
+         }
+      }
+   }
+
+   return PRECISION_SEARCH + 1;
+}
+
+/**
+ * precision_compare - Compare an image with a reference.
+ * @ref:       Pointer to reference image, RGB24.
+ * @image:     Pointer to compared image, RGB24.
+ * @ref_depth: Pointer to depth of @ref, or NULL.
+ * @depth:     Pointer to depth of @image, or NULL.
+ * @width:     Width of images.
+ * @height:    Height of images.
+ * @err:       Pointer where to return the error.
+ *
+ * The spheres have flat colors, so a pixel differing from @ref shows another
+ * sphere, or the background, and the color error says little. The error of
+ * a differing pixel is instead how far its color is from it in @ref, or the
+ * color of @ref from it in @image if closer, i.e. about how far an edge has
+ * moved. The second distance covers spheres smaller than a pixel, which are
+ * hit in only one of the images. Pixels of the same color give the depth
+ * error, if the depths are given.
+ *
+ * Returns:
+ * none.
+ */
+void precision_compare (const uint8_t *ref,
+                        const uint8_t *image,
+                        const float *ref_depth,
+                        const float *depth,
+                        int width,
+                        int height,
+                        precision_err_t *err)
+{
+   const size_t num = (size_t)width * height;
+   size_t i;
+   int c;
+
+   memset (err, 0, sizeof(*err));
+
+   for (i = 0; i < num; i++)
+   {
+      const uint8_t *a = &ref[i * 3];
+      const uint8_t *b = &image[i * 3];
+      const int x = i % width;
+      const int y = i / width;
+
+      if (memcmp (a, b, 3))
+      {
+         int shift;
+
+         err->num_diff++;
+         for (c = 0; c < 3; c++)
+            if (abs (a[c] - b[c]) > err->max_err)
+               err->max_err = abs (a[c] - b[c]);
+
+         shift = precision_shift (ref, width, height, x, y, b);
+         if (shift > 1)
+         {
+            const int s = precision_shift (image, width, height, x, y, a);
+
+            if (s < shift)
+               shift = s;
+         }
+         if (shift > err->max_shift)
+            err->max_shift = shift;
+      }
+      else if (ref_depth && depth &&
+               ref_depth[i] != FLT_MAX && depth[i] != FLT_MAX)
+      {
+         float e = fabsf (depth[i] - ref_depth[i]) / ref_depth[i];
+
+         if (e > err->max_depth)
+            err->max_depth = e;
+      }
+   }
+   err->pct_diff = num ? 100.0f * err->num_diff / num : 0;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
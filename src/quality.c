@@ -0,0 +1,577 @@
+/**
+ * quality.c - Image quality class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines image quality metrics, comparing a rendered image with
+ * a reference, and a benchmark of the render modes reporting their quality
+ * next to their speed.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "render.h"
+#include "precision.h"
+#include "mproc.h"
+#include "composite.h"
+#include "jit.h"
+#include "fixed.h"
+#include "vrs.h"
+#include "tilesched.h"
+#include "ssil/tga.h"
+
+#include "quality.h"
+
+/* Four luma values at once */
+typedef float v4sf __attribute__ ((vector_size (16)));
+
+/* SSIM stabilizing constants, for a dynamic range of 255 */
+#define QUALITY_C1 ((0.01 * 255) * (0.01 * 255))
+#define QUALITY_C2 ((0.03 * 255) * (0.03 * 255))
+
+/* Part of a comparison done by one thread */
+typedef struct {
+   const uint8_t *ref;      /* Reference image */
+   const uint8_t *image;    /* Compared image */
+   uint8_t       *map;      /* Error map, or NULL */
+   int            width;    /* Image width */
+   int            height;   /* Image height */
+   int            y0, y1;   /* Rows to compare */
+   int            w0, w1;   /* Rows of SSIM windows to compare */
+   int            win_w;    /* SSIM window width */
+   int            win_h;    /* SSIM window height */
+   int            num_wx;   /* SSIM windows per row */
+   uint64_t       sq;       /* Sum of squared color errors */
+   long           num_diff; /* Number of differing pixels */
+   int            max_err;  /* Largest color error */
+   double         ssim;     /* Sum of the SSIM of the windows */
+   int            failed;   /* Non-zero if out of memory */
+} quality_part_t;
+
+/**
+ * quality_luma - Convert rows of an image to luma.
+ * @luma:   Pointer to luma buffer, @num rows of @width values.
+ * @image:  Pointer to first row of image.
+ * @width:  Image width.
+ * @num:    Number of rows.
+ *
+ * Returns:
+ * none.
+ */
+static void quality_luma (float *luma, const uint8_t *image, int width, int num)
+{
+   size_t i;
+
+   for (i = 0; i < (size_t)width * num; i++)
+      luma[i] = 0.299f * image[i * 3] + 0.587f * image[i * 3 + 1] +
+                0.114f * image[i * 3 + 2];
+}
+
+/**
+ * quality_window - Compute the SSIM of a window.
+ * @a:      Pointer to first luma value of the window in the reference.
+ * @b:      Pointer to first luma value of the window in the image.
+ * @stride: Number of luma values per row.
+ * @w:      Window width.
+ * @h:      Window height.
+ *
+ * Windows of QUALITY_SSIM_WINDOW columns are summed four columns at a
+ * time.
+ *
+ * Returns:
+ * SSIM of the window.
+ */
+static double quality_window (const float *a, const float *b, int stride, int w, int h)
+{
+   double sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+   double n = (double)w * h;
+   double ma, mb, va, vb, cov;
+   int x, y, k;
+
+   if (w == QUALITY_SSIM_WINDOW)
+   {
+      v4sf va4 = { 0 }, vb4 = { 0 }, vaa4 = { 0 }, vbb4 = { 0 }, vab4 = { 0 };
+
+      for (y = 0; y < h; y++)
+         for (x = 0; x < QUALITY_SSIM_WINDOW; x += 4)
+         {
+            v4sf p, q;
+
+            memcpy (&p, a + (size_t)y * stride + x, sizeof(p));
+            memcpy (&q, b + (size_t)y * stride + x, sizeof(q));
+            va4  += p;
+            vb4  += q;
+            vaa4 += p * p;
+            vbb4 += q * q;
+            vab4 += p * q;
+         }
+      for (k = 0; k < 4; k++)
+      {
+         sa  += va4[k];
+         sb  += vb4[k];
+         saa += vaa4[k];
+         sbb += vbb4[k];
+         sab += vab4[k];
+      }
+   }
+   else
+   {
+      for (y = 0; y < h; y++)
+         for (x = 0; x < w; x++)
+         {
+            double p = a[(size_t)y * stride + x];
+            double q = b[(size_t)y * stride + x];
+
+            sa  += p;
+            sb  += q;
+            saa += p * p;
+            sbb += q * q;
+            sab += p * q;
+         }
+   }
+
+   ma  = sa / n;
+   mb  = sb / n;
+   va  = saa / n - ma * ma;
+   vb  = sbb / n - mb * mb;
+   cov = sab / n - ma * mb;
+
+   return ((2 * ma * mb + QUALITY_C1) * (2 * cov + QUALITY_C2)) /
+          ((ma * ma + mb * mb + QUALITY_C1) * (va + vb + QUALITY_C2));
+}
+
+/**
+ * quality_part - Compare a part of an image.
+ * @arg: Pointer to part.
+ *
+ * Sums the errors of the rows @y0 to @y1 and the SSIM of the windows in
+ * the rows of windows @w0 to @w1, whose luma is converted as needed.
+ *
+ * Returns:
+ * NULL.
+ */
+static void* quality_part (void *arg)
+{
+   quality_part_t *part = arg;
+   const int w = part->width;
+   float *la = NULL, *lb = NULL;
+   size_t i;
+   int wy, wx;
+
+   for (i = (size_t)part->y0 * w; i < (size_t)part->y1 * w; i++)
+   {
+      const uint8_t *a = &part->ref[i * 3];
+      const uint8_t *b = &part->image[i * 3];
+      int e = 0;
+      int c;
+
+      for (c = 0; c < 3; c++)
+      {
+         int d = abs (a[c] - b[c]);
+
+         part->sq += d * d;
+         if (d > e)
+            e = d;
+      }
+      if (e)
+      {
+         part->num_diff++;
+         if (e > part->max_err)
+            part->max_err = e;
+      }
+
+      /* Black where equal, through red and yellow to white */
+      if (part->map)
+      {
+         part->map[i * 3]     = e * 4 > 255 ? 255 : e * 4;
+         part->map[i * 3 + 1] = e * 4 - 255 > 255 ? 255 : e * 4 - 255 < 0 ? 0 : e * 4 - 255;
+         part->map[i * 3 + 2] = e * 4 - 510 < 0 ? 0 : e * 4 - 510;
+      }
+   }
+
+   if (part->w0 >= part->w1)
+      return NULL;
+
+   la = malloc ((size_t)w * part->win_h * sizeof(float));
+   lb = malloc ((size_t)w * part->win_h * sizeof(float));
+   if (!la || !lb)
+   {
+      part->failed = 1;
+      goto out;
+   }
+
+   for (wy = part->w0; wy < part->w1; wy++)
+   {
+      size_t row = (size_t)wy * QUALITY_SSIM_STEP * w;
+
+      quality_luma (la, part->ref + row * 3, w, part->win_h);
+      quality_luma (lb, part->image + row * 3, w, part->win_h);
+      for (wx = 0; wx < part->num_wx; wx++)
+         part->ssim += quality_window (la + wx * QUALITY_SSIM_STEP,
+                                       lb + wx * QUALITY_SSIM_STEP,
+                                       w, part->win_w, part->win_h);
+   }
+
+out:
+   free (la);
+   free (lb);
+
+   return NULL;
+}
+
+/**
+ * quality_compare - Compare an image with a reference.
+ * @ref:    Pointer to reference image.
+ * @image:  Pointer to image to compare.
+ * @width:  Image width.
+ * @height: Image height.
+ * @map:    Pointer to error map of @width x @height pixels, or NULL.
+ * @q:      Pointer where to return the quality.
+ *
+ * The images are in the layout of the rendered image, see README. The PSNR
+ * is computed over all color components, and the SSIM over the luma of
+ * windows of QUALITY_SSIM_WINDOW pixels, or of the whole image if it is
+ * smaller. Each pixel of @map shows the largest color error of the pixel,
+ * black where it is the same and white where it is off by 192 or more.
+ * The work is split on one thread for each online CPU.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int quality_compare (const uint8_t* ref,
+                     const uint8_t* image,
+                     int width,
+                     int height,
+                     uint8_t* map,
+                     quality_t* q)
+{
+   quality_part_t part[QUALITY_MAX_THREADS];
+   pthread_t thread[QUALITY_MAX_THREADS];
+   int win_w = width  < QUALITY_SSIM_WINDOW ? width  : QUALITY_SSIM_WINDOW;
+   int win_h = height < QUALITY_SSIM_WINDOW ? height : QUALITY_SSIM_WINDOW;
+   int num_wx = (width  - win_w) / QUALITY_SSIM_STEP + 1;
+   int num_wy = (height - win_h) / QUALITY_SSIM_STEP + 1;
+   int num = sysconf (_SC_NPROCESSORS_ONLN);
+   int i, started;
+   int rc = 0;
+
+   memset (q, 0, sizeof(*q));
+   if (width < 1 || height < 1)
+      return 1;
+
+   if (num < 1)
+      num = 1;
+   if (num > QUALITY_MAX_THREADS)
+      num = QUALITY_MAX_THREADS;
+   if (num > num_wy)
+      num = num_wy;
+
+   for (i = 0; i < num; i++)
+   {
+      memset (&part[i], 0, sizeof(part[i]));
+      part[i].ref    = ref;
+      part[i].image  = image;
+      part[i].map    = map;
+      part[i].width  = width;
+      part[i].height = height;
+      part[i].y0     = (int)((long)height * i / num);
+      part[i].y1     = (int)((long)height * (i + 1) / num);
+      part[i].w0     = (int)((long)num_wy * i / num);
+      part[i].w1     = (int)((long)num_wy * (i + 1) / num);
+      part[i].win_w  = win_w;
+      part[i].win_h  = win_h;
+      part[i].num_wx = num_wx;
+   }
+
+   /* The first part is done by the calling thread */
+   for (started = 1; started < num; started++)
+      if (pthread_create (&thread[started], NULL, quality_part, &part[started]))
+         break;
+   quality_part (&part[0]);
+   for (i = 1; i < started; i++)
+      pthread_join (thread[i], NULL);
+   for (i = started; i < num; i++)
+      quality_part (&part[i]);
+
+   for (i = 0; i < num; i++)
+   {
+      q->mse      += part[i].sq;
+      q->num_diff += part[i].num_diff;
+      q->ssim     += part[i].ssim;
+      if (part[i].max_err > q->max_err)
+         q->max_err = part[i].max_err;
+      rc |= part[i].failed;
+   }
+   if (rc)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for image comparison\n");
+      return 1;
+   }
+
+   q->mse  /= (double)width * height * 3;
+   q->psnr  = q->mse ? 10 * log10 (255.0 * 255.0 / q->mse) : INFINITY;
+   q->ssim /= (double)num_wx * num_wy;
+
+   return 0;
+}
+
+/**
+ * quality_compare_files - Compare a TGA image with a reference.
+ * @ref:   Reference TGA file.
+ * @image: TGA file to compare.
+ * @map:   TGA file to write the error map to, or NULL.
+ * @q:     Pointer where to return the quality.
+ *
+ * See quality_compare(), the images must be of the same size.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int quality_compare_files (const char* ref, const char* image, const char* map,
+                           quality_t* q)
+{
+   uint8_t *a = NULL, *b = NULL, *m = NULL;
+   int aw, ah, bw, bh;
+   int rc = 1;
+
+   if (tga_read (ref, &aw, &ah, &a) || tga_read (image, &bw, &bh, &b))
+      goto out;
+   if (aw != bw || ah != bh)
+   {
+      fprintf (stderr, "error: %s is %dx%d, but %s is %dx%d\n",
+               image, bw, bh, ref, aw, ah);
+      goto out;
+   }
+   if (map)
+   {
+      m = malloc ((size_t)aw * ah * 3);
+      if (!m)
+      {
+         fprintf (stderr, "error: Unable to alloc memory for error map\n");
+         goto out;
+      }
+   }
+
+   if (quality_compare (a, b, aw, ah, m, q) || (m && tga_write (map, aw, ah, m)))
+      goto out;
+   rc = 0;
+
+out:
+   free (a);
+   free (b);
+   free (m);
+
+   return rc;
+}
+
+/* Image of the reference render, used by the VRS modes to find edges */
+static const uint8_t *bench_ref;
+
+static int bench_processes (uint8_t* image, size_t image_sz, int w, int h, scene_t* scene)
+{
+   int num = sysconf (_SC_NPROCESSORS_ONLN);
+
+   return mproc_render (num > 1 ? num : 2, image, image_sz, w, h, scene);
+}
+
+static int bench_composite (uint8_t* image, size_t image_sz, int w, int h, scene_t* scene)
+{
+   return composite_render (4, image, image_sz, w, h, scene);
+}
+
+static int bench_precision (precision_t p,
+                            uint8_t* image, size_t image_sz, int w, int h, scene_t* scene)
+{
+   precision_t old = precision_get ();
+   int rc;
+
+   if (precision_set (p))
+      return 1;
+   rc = render_scene (image, image_sz, w, h, scene);
+   precision_set (old);
+
+   return rc;
+}
+
+static int bench_fast (uint8_t* image, size_t image_sz, int w, int h, scene_t* scene)
+{
+   return bench_precision (PRECISION_FAST, image, image_sz, w, h, scene);
+}
+
+static int bench_fastest (uint8_t* image, size_t image_sz, int w, int h, scene_t* scene)
+{
+   return bench_precision (PRECISION_FASTEST, image, image_sz, w, h, scene);
+}
+
+static int bench_vrs (int edges,
+                      uint8_t* image, size_t image_sz, int w, int h, scene_t* scene)
+{
+   uint8_t *rate = vrs_alloc (w, h);
+   long rays;
+   int rc;
+
+   if (!rate)
+      return 1;
+   if (edges)
+      vrs_edges (rate, bench_ref, w, h);
+   else
+      vrs_foveate (rate, w, h, w / 2, h / 2);
+   rc = render_vrs (image, image_sz, w, h, rate, scene, &rays);
+   free (rate);
+
+   return rc;
+}
+
+static int bench_vrs_edges (uint8_t* image, size_t image_sz, int w, int h, scene_t* scene)
+{
+   return bench_vrs (1, image, image_sz, w, h, scene);
+}
+
+static int bench_vrs_fovea (uint8_t* image, size_t image_sz, int w, int h, scene_t* scene)
+{
+   return bench_vrs (0, image, image_sz, w, h, scene);
+}
+
+/* Render modes of the benchmark, the first one is the reference */
+static const struct {
+   const char *name;
+   int (*render) (uint8_t* image, size_t image_sz, int w, int h, scene_t* scene);
+} bench_modes[] = {
+   { "render",            render_scene    },
+   { "processes",         bench_processes },
+   { "composite",         bench_composite },
+   { "jit",               jit_render      },
+   { "fixed",             fixed_render    },
+   { "precision-fast",    bench_fast      },
+   { "precision-fastest", bench_fastest   },
+   { "vrs-edges",         bench_vrs_edges },
+   { "vrs-fovea",         bench_vrs_fovea },
+};
+
+/**
+ * quality_bench - Benchmark the render modes.
+ * @width:      Width of rendered screen.
+ * @height:     Height of rendered screen.
+ * @scene:      Pointer to scene object.
+ * @runs:       Number of renders of each mode, the fastest is reported.
+ * @map_prefix: Prefix of the error map files, or NULL for none.
+ *
+ * This function renders @scene with each render mode, and prints the time
+ * and the quality compared with "render" at the exact precision tier. The
+ * error map of each mode is written to <@map_prefix><MODE>.tga. A mode
+ * that can't render, e.g. a precision tier when the tier is fixed at
+ * compile time, is shown as such.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int quality_bench (int width, int height, scene_t* scene, int runs,
+                   const char* map_prefix)
+{
+   const size_t image_sz = (size_t)width * height * 3;
+   uint8_t *ref   = malloc (image_sz);
+   uint8_t *image = malloc (image_sz);
+   uint8_t *map   = map_prefix ? malloc (image_sz) : NULL;
+   double ref_time = 0;
+   size_t i;
+   int rc = 1;
+#ifndef PRECISION
+   precision_t old = precision_get ();
+
+   precision_set (PRECISION_EXACT);
+#endif
+
+   if (!ref || !image || (map_prefix && !map))
+   {
+      fprintf (stderr, "error: Unable to alloc memory for benchmark\n");
+      goto out;
+   }
+   if (runs < 1)
+      runs = 1;
+
+   printf ("%-18s %10s %8s %8s %7s %8s\n",
+           "mode", "time ms", "speedup", "PSNR dB", "SSIM", "differ");
+   bench_ref = ref;
+   for (i = 0; i < sizeof(bench_modes) / sizeof(bench_modes[0]); i++)
+   {
+      uint8_t *dst = i ? image : ref;
+      double best = 0;
+      quality_t q;
+      int run;
+
+      for (run = 0; run < runs; run++)
+      {
+         double t = tilesched_time ();
+
+         if (bench_modes[i].render (dst, image_sz, width, height, scene))
+            break;
+         t = tilesched_time () - t;
+         if (!run || t < best)
+            best = t;
+      }
+      if (run < runs)
+      {
+         if (!i)
+         {
+            fprintf (stderr, "error: Reference could not be rendered.\n");
+            goto out;
+         }
+         printf ("%-18s %10s\n", bench_modes[i].name, "n/a");
+         continue;
+      }
+      if (!i)
+         ref_time = best;
+
+      if (quality_compare (ref, dst, width, height, map, &q))
+         goto out;
+      printf ("%-18s %10.2f %7.2fx %8.2f %7.4f %7.3f%%\n",
+              bench_modes[i].name, best * 1000, best > 0 ? ref_time / best : 0,
+              q.psnr, q.ssim, 100.0 * q.num_diff / ((double)width * height));
+
+      if (map)
+      {
+         char fname[256];
+
+         snprintf (fname, sizeof(fname), "%s%s.tga", map_prefix, bench_modes[i].name);
+         if (tga_write (fname, width, height, map))
+            goto out;
+      }
+   }
+   rc = 0;
+
+out:
+#ifndef PRECISION
+   precision_set (old);
+#endif
+   bench_ref = NULL;
+   free (ref);
+   free (image);
+   free (map);
+
+   return rc;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
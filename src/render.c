@@ -21,8 +21,10 @@
  */
 
 #include <stdio.h>
+#include <float.h>
 #include <math.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h> /* memset */
 
 #include "vector.h"
@@ -30,30 +32,523 @@
 #include "camera.h"
 #include "sphere.h"
 #include "scene.h"
+#include "tilesched.h"
+#include "vrs.h"
+#include "kernel.h"
 
 #include "render.h"
 
+/**
+ * render_set_pixel - Sets the color of a pixel.
+ * @pixel:  Pointer to the pixel
+ * @scene:  Pointer to scene object
+ * @sphere: Array ID of the sphere hit by the ray through the pixel, or -1
+ *
+ * If a sphere was intersected by the ray, the pixel is set to the color of
+ * the sphere object, else the pixel is left untouched, i.e. keeps the
+ * background color.
+ *
+ * Returns:
+ * none.
+ */
+static inline void render_set_pixel (uint8_t* pixel, scene_t* scene, int sphere)
+{
+   if (sphere != -1)
+   {
+      int r, g, b;
+
+      color_get (&scene_get_sphere (scene)[sphere].color, &r, &g, &b);
+
+      pixel[0] = r;
+      pixel[1] = g;
+      pixel[2] = b;
+   }
+}
+
+/**
+ * render_rect - Creates a rendered rectangle of a scene.
+ * @ctx:     Pointer to render context, see kernel_init()
+ * @tile:    Pointer to buffer which will contain the rendered pixels,
+ *           pointing at the first pixel of the rectangle
+ * @tile_sz: Size of @tile buffer
+ * @depth:   Pointer to depth buffer or NULL
+ * @stride:  Number of pixels between rows in @tile and @depth
+ * @x0:      First column of the rectangle
+ * @y0:      First row of the rectangle
+ * @x1:      Column after the last column of the rectangle
+ * @y1:      Row after the last row of the rectangle
+ *
+ * Common code for render_tile(), render_depth() and render_scene(). Each row
+ * of the rectangle is cleared before it is rendered, pixels outside the
+ * rectangle are left untouched. If @depth is given, the distance to the
+ * closest hit is written for each pixel, or FLT_MAX if no sphere was hit.
+ * The pixels are rendered by the kernel selected for the render, which gives
+ * the same pixels as kernel_trace(), and the splatted spheres of the render
+ * are then drawn over them, see kernel_splat().
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+static int render_rect (kernel_ctx_t* ctx,
+                        uint8_t* tile,
+                        size_t tile_sz,
+                        float* depth,
+                        int stride,
+                        int x0,
+                        int y0,
+                        int x1,
+                        int y1)
+{
+   float *tmp = NULL;
+   int rc = 0;
+
+   if (x0 < 0 || y0 < 0 || x1 > ctx->screen_width || y1 > ctx->screen_height ||
+       x0 > x1 || y0 > y1)
+      return 1;
+
+   /* Check that the last row isn't pointing outside the tile buffer */
+   if (y1 > y0 &&
+       ((size_t)(y1 - y0 - 1) * stride + (x1 - x0)) * kernel_bpp (ctx->fmt) > tile_sz)
+      return 1;
+
+   /* Splats are depth tested against the traced pixels */
+   if (ctx->num_splat && !depth && y1 > y0)
+   {
+      tmp = malloc (((size_t)(y1 - y0 - 1) * stride + (x1 - x0)) * sizeof(float));
+      if (!tmp)
+      {
+         fprintf (stderr, "error: Unable to alloc memory for render\n");
+         return 1;
+      }
+      depth = tmp;
+   }
+
+   ctx->kernel (ctx, tile, depth, stride, x0, y0, x1, y1);
+   if (ctx->num_splat)
+      rc = kernel_splat (ctx, tile, depth, stride, x0, y0, x1, y1);
+
+   free (tmp);
+
+   return rc;
+}
+
+/**
+ * render_init - Setup a render of whole rectangles.
+ * @ctx:           Pointer to render context to setup
+ * @scene:         Pointer to scene object
+ * @screen_width:  Width of the whole rendered screen
+ * @screen_height: Height of the whole rendered screen
+ * @fmt:           Pixel format
+ *
+ * Sets up the render as kernel_init() and selects the spheres to splat, see
+ * kernel_init_splats(), for renders drawing every pixel with render_rect().
+ * The context can be used for any number of tiles, see render_tile_ctx(),
+ * and is freed with kernel_done().
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int render_init (kernel_ctx_t* ctx,
+                 scene_t* scene,
+                 int screen_width,
+                 int screen_height,
+                 kernel_fmt_t fmt)
+{
+   if (kernel_init (ctx, scene, screen_width, screen_height, fmt))
+      return 1;
+   if (kernel_init_splats (ctx))
+   {
+      kernel_done (ctx);
+      return 1;
+   }
+
+   return 0;
+}
+
+/**
+ * render_tile - Creates a rendered tile of a scene.
+ * @tile:          Pointer to buffer which will contain the rendered tile
+ * @tile_sz:       Size of @tile buffer
+ * @screen_width:  Width of the whole rendered screen
+ * @screen_height: Height of the whole rendered screen
+ * @x0:            First column of the tile
+ * @y0:            First row of the tile
+ * @x1:            Column after the last column of the tile
+ * @y1:            Row after the last row of the tile
+ * @scene:         Pointer to scene object
+ *
+ * This function will render the pixels from (@x0, @y0) up to, but not
+ * including, (@x1, @y1) of the screen. The rays are generated exactly as if
+ * the whole screen was rendered, i.e. a set of tiles covering the screen will
+ * give the same image as render_scene(). The output is written to @tile as a
+ * packed array of (@x1 - @x0) x (@y1 - @y0) pixels, using the same pixel
+ * layout as render_scene().
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int render_tile (uint8_t* tile,
+                 size_t tile_sz,
+                 int screen_width,
+                 int screen_height,
+                 int x0,
+                 int y0,
+                 int x1,
+                 int y1,
+                 scene_t* scene)
+{
+   return render_tile_fmt (tile, tile_sz, KERNEL_FMT_RGB24, screen_width,
+                           screen_height, x0, y0, x1, y1, scene);
+}
+
+/**
+ * render_tile_fmt - Creates a rendered tile of a scene in a pixel format.
+ * @tile:          Pointer to buffer which will contain the rendered tile
+ * @tile_sz:       Size of @tile buffer
+ * @fmt:           Pixel format, see kernel.h
+ * @screen_width:  Width of the whole rendered screen
+ * @screen_height: Height of the whole rendered screen
+ * @x0:            First column of the tile
+ * @y0:            First row of the tile
+ * @x1:            Column after the last column of the tile
+ * @y1:            Row after the last row of the tile
+ * @scene:         Pointer to scene object
+ *
+ * This function works as render_tile(), but the pixels are written in the
+ * format @fmt, e.g. KERNEL_FMT_RGBA32 for an image with alpha to composite
+ * onto a background.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int render_tile_fmt (uint8_t* tile,
+                     size_t tile_sz,
+                     kernel_fmt_t fmt,
+                     int screen_width,
+                     int screen_height,
+                     int x0,
+                     int y0,
+                     int x1,
+                     int y1,
+                     scene_t* scene)
+{
+   kernel_ctx_t ctx;
+   int rc;
+
+   if (render_init (&ctx, scene, screen_width, screen_height, fmt))
+      return 1;
+   rc = render_tile_ctx (&ctx, tile, tile_sz, x0, y0, x1, y1);
+   kernel_done (&ctx);
+
+   return rc;
+}
+
+/**
+ * render_tile_ctx - Creates a rendered tile of a set up render.
+ * @ctx:     Pointer to render context, see render_init()
+ * @tile:    Pointer to buffer which will contain the rendered tile
+ * @tile_sz: Size of @tile buffer
+ * @x0:      First column of the tile
+ * @y0:      First row of the tile
+ * @x1:      Column after the last column of the tile
+ * @y1:      Row after the last row of the tile
+ *
+ * This function works as render_tile_fmt() with the scene, screen and pixel
+ * format of @ctx, so renders of many tiles or images of the same scene and
+ * size only set up the render once.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int render_tile_ctx (kernel_ctx_t* ctx,
+                     uint8_t* tile,
+                     size_t tile_sz,
+                     int x0,
+                     int y0,
+                     int x1,
+                     int y1)
+{
+   return render_rect (ctx, tile, tile_sz, NULL, x1 - x0, x0, y0, x1, y1);
+}
+
+/**
+ * render_region - Re-renders a region of a rendered scene.
+ * @image:         Pointer to buffer containing the rendered scene
+ * @image_sz:      Size of @image buffer
+ * @screen_width:  Width of rendered screen
+ * @screen_height: Height of rendered screen
+ * @x0:            First column of the region
+ * @y0:            First row of the region
+ * @x1:            Column after the last column of the region
+ * @y1:            Row after the last row of the region
+ * @scene:         Pointer to scene object
+ *
+ * This function will render the pixels from (@x0, @y0) up to, but not
+ * including, (@x1, @y1) in place in @image, e.g. to patch a part of a frame
+ * after the scene was changed. Only rays through the region are traced and
+ * the rest of @image is left untouched. Use render_tile() to render a region
+ * into a buffer of its own.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int render_region (uint8_t* image,
+                   size_t image_sz,
+                   int screen_width,
+                   int screen_height,
+                   int x0,
+                   int y0,
+                   int x1,
+                   int y1,
+                   scene_t* scene)
+{
+   size_t ofs = ((size_t)y0 * screen_width + x0) * 3;
+   kernel_ctx_t ctx;
+   int rc;
+
+   if (image_sz < (size_t)screen_width * screen_height * 3 || ofs > image_sz)
+      return 1;
+
+   if (render_init (&ctx, scene, screen_width, screen_height, KERNEL_FMT_RGB24))
+      return 1;
+   rc = render_rect (&ctx, image + ofs, image_sz - ofs, NULL, screen_width,
+                     x0, y0, x1, y1);
+   kernel_done (&ctx);
+
+   return rc;
+}
+
+/**
+ * render_vrs - Creates a rendered scene with variable shading rate.
+ * @image:         Pointer to buffer which will contain the rendered scene
+ * @image_sz:      Size of @image buffer
+ * @screen_width:  Width of rendered screen
+ * @screen_height: Height of rendered screen
+ * @rate:          Rate map, see vrs.h
+ * @scene:         Pointer to scene object
+ * @rays:          Pointer where to return the number of traced rays, or NULL
+ *
+ * This function works as render_scene(), but the screen is rendered in cells
+ * of VRS_CELL x VRS_CELL pixels, each traced at the rate given for it in
+ * @rate. At rate N, a single ray is traced for each block of N x N pixels,
+ * through the first pixel of the block, and for the first pixels of the
+ * blocks right after the cell. If these rays all hit the same sphere, or no
+ * sphere, each block is filled with the color of its ray. Otherwise the cell
+ * is on an edge and is rendered as at rate 1, by the kernel of
+ * render_scene(), as soon as a ray differs. The rate is thus decided for
+ * whole cells, and a cell is either filled or rendered like render_scene()
+ * does, never traced one ray at a time. Cells without any sphere are filled
+ * without tracing, as the kernel does. Cells at rate 1 give the same pixels
+ * as render_scene(), coarser cells may miss spheres smaller than a block.
+ * Splatted spheres, see kernel_set_lod(), are blended into the cells of
+ * every rate, over the depth of their traced pixels.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int render_vrs (uint8_t* image,
+                size_t image_sz,
+                int screen_width,
+                int screen_height,
+                const uint8_t* rate,
+                scene_t* scene,
+                long* rays)
+{
+   const int cols = VRS_COLS (screen_width);
+   float hit[(VRS_CELL + 1) * (VRS_CELL + 1)];   /* Distances of the block hits */
+   int id[VRS_CELL + 1];                         /* Spheres hit by a row of them */
+   int col[VRS_CELL + 1];                        /* Columns of the block rays */
+   int *band = NULL;                             /* Spheres of a row of cells */
+   int *ids = NULL;                              /* Spheres which may be hit */
+   float *depth = NULL;                          /* Traced depth, if splatting */
+   long num_rays = 0;
+   kernel_ctx_t ctx;
+   int cx, cy, rc = 1;
+
+   if (image_sz < (size_t)screen_width * screen_height * 3)
+      return 1;
+
+   if (render_init (&ctx, scene, screen_width, screen_height, KERNEL_FMT_RGB24))
+      return 1;
+
+   band = malloc ((scene_get_num_spheres (scene) + 1) * sizeof(int));
+   ids  = malloc ((scene_get_num_spheres (scene) + 1) * sizeof(int));
+   if (ctx.num_splat)
+      depth = malloc ((size_t)screen_width * screen_height * sizeof(float));
+   if (!band || !ids || (ctx.num_splat && !depth))
+   {
+      fprintf (stderr, "error: Unable to alloc memory for render\n");
+      goto out;
+   }
+   if (kernel_init_bounds (&ctx))
+      goto out;
+
+   /* Clear whole image buffer to set black as default background color */
+   memset (image, 0, image_sz);
+
+   for (cy = 0; cy < VRS_ROWS (screen_height); cy++)
+   {
+      const int by = cy * VRS_CELL + VRS_CELL + 1;
+      const int num_band = kernel_select (&ctx, 0, cy * VRS_CELL, screen_width,
+                                          by < screen_height ? by : screen_height,
+                                          NULL, 0, band);
+
+      for (cx = 0; cx < cols; cx++)
+      {
+         const int x0 = cx * VRS_CELL;
+         const int y0 = cy * VRS_CELL;
+         const int x1 = x0 + VRS_CELL < screen_width  ? x0 + VRS_CELL : screen_width;
+         const int y1 = y0 + VRS_CELL < screen_height ? y0 + VRS_CELL : screen_height;
+         const size_t pos = (size_t)y0 * screen_width + x0;
+         int r = rate[cy * cols + cx];
+         int sphere = -1;
+         uint8_t rgb[3] = { 0, 0, 0 };
+         int nx, ny, n, i, j, x, y;
+
+         if (r < 1 || r > VRS_CELL || VRS_CELL % r)
+            r = 1;
+
+         if (r > 1)
+         {
+            /* Only test the spheres whose bounds overlap the traced pixels,
+             * which include the first pixels of the blocks right after the
+             * cell, selected from the spheres of the row of cells */
+            nx = (x1 - x0 + r - 1) / r;
+            ny = (y1 - y0 + r - 1) / r;
+            n  = kernel_select (&ctx, x0, y0,
+                                x0 + nx * r < screen_width  ? x0 + nx * r + 1 : screen_width,
+                                y0 + ny * r < screen_height ? y0 + ny * r + 1 : screen_height,
+                                band, num_band, ids);
+            for (i = 0; i <= nx; i++)
+               col[i] = x0 + i * r < screen_width ? x0 + i * r : screen_width - 1;
+            for (j = 0; r > 1 && j <= ny; j++)
+            {
+               float *h = &hit[j * (nx + 1)];
+
+               /* Like the kernels, no rays are traced where no sphere is */
+               if (!n)
+               {
+                  for (i = 0; i <= nx; i++)
+                     h[i] = FLT_MAX;
+                  continue;
+               }
+
+               y = y0 + j * r < screen_height ? y0 + j * r : screen_height - 1;
+               kernel_trace_row (&ctx, col, nx + 1, y, ids, n, id, h);
+               num_rays += nx + 1;
+               if (!j)
+                  sphere = id[0];
+               for (i = 0; i <= nx; i++)
+               {
+                  if (id[i] != sphere)
+                  {
+                     /* An edge, render the cell at rate 1 */
+                     r = 1;
+                     break;
+                  }
+               }
+            }
+         }
+
+         if (r == 1)
+         {
+            if (render_rect (&ctx, image + pos * 3, image_sz - pos * 3,
+                             depth ? depth + pos : NULL, screen_width, x0, y0, x1, y1))
+               goto out;
+            num_rays += (long)(x1 - x0) * (y1 - y0);
+            continue;
+         }
+
+         render_set_pixel (rgb, scene, sphere);
+         for (y = y0; y < y1; y++)
+         {
+            uint8_t *p = image + ((size_t)y * screen_width + x0) * 3;
+
+            for (x = x0; sphere >= 0 && x < x1; x++, p += 3)
+               memcpy (p, rgb, 3);
+            for (x = x0; depth && x < x1; x++)
+               depth[(size_t)y * screen_width + x] =
+                  hit[((y - y0) / r) * (nx + 1) + (x - x0) / r];
+         }
+
+         /* Blend in the splatted spheres as render_rect() does */
+         if (depth && kernel_splat (&ctx, image + pos * 3, depth + pos, screen_width,
+                                    x0, y0, x1, y1))
+            goto out;
+      }
+   }
+
+   if (rays)
+      *rays = num_rays;
+   rc = 0;
+
+out:
+   free (band);
+   free (ids);
+   free (depth);
+   kernel_done (&ctx);
+
+   return rc;
+}
+
+/**
+ * render_depth - Creates a rendered scene with depth information.
+ * @image:         Pointer to buffer which will contain the rendered scene
+ * @image_sz:      Size of @image buffer
+ * @depth:         Pointer to buffer of @screen_width x @screen_height floats
+ * @screen_width:  Width of rendered screen
+ * @screen_height: Height of rendered screen
+ * @scene:         Pointer to scene object
+ *
+ * This function works as render_scene(), but will also write the distance
+ * from the camera to the closest hit of each pixel to @depth, or FLT_MAX if
+ * the ray didn't hit any sphere. Images of different sets of spheres can then
+ * be merged by keeping the nearest pixel, see composite_merge(). Splatted
+ * spheres are blended into @image only, @depth holds the traced spheres.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int render_depth (uint8_t* image,
+                  size_t image_sz,
+                  float* depth,
+                  int screen_width,
+                  int screen_height,
+                  scene_t* scene)
+{
+   kernel_ctx_t ctx;
+   int rc;
+
+   if (render_init (&ctx, scene, screen_width, screen_height, KERNEL_FMT_RGB24))
+      return 1;
+   rc = render_rect (&ctx, image, image_sz, depth, screen_width,
+                     0, 0, screen_width, screen_height);
+   kernel_done (&ctx);
+
+   return rc;
+}
+
 /**
  * render_scene - Creates a rendered scene.
  * @image:         Pointer to buffer which will contain the rendered scene
  * @image_sz:      Size of @image buffer
  * @screen_width:  Width of rendered screen
  * @screen_height: Height of rendered screen
- * @cam:           Camera object
- * @screen:        Pointer to a screen plane object
- * @sphere_list:   Pointer to a list of sphere object
- * @num_spheres:   Num of spheres in @sphere_list
+ * @scene:         Pointer to scene object
  *
- * This function will create a rendered scene. The output is written to @output
+ * This function will create a rendered scene. The output is written to @image
  * and is stored as an array of pixels, starting with the pixel at the lower
  * left corner and then continuing with increasing x value. Each pixel is
  * stored in three bytes starting a value for the the red component followed by
  * the green and then the blue.
- * A ray from the camera, @cam, through each pixel is generated. For each
- * sphere in @sphere_list, a check is made to see if the object was hit. The
- * closest object to the camera which was hit is recorded and the color of the
- * pixel will be set to color of that object. If the ray doesn't hit any object,
- * no pixel color is set, i.e. the default background color (black) will remain.
+ * A ray from the camera through each pixel is generated. For each sphere in
+ * the scene, a check is made to see if the object was hit. The closest object
+ * to the camera which was hit is recorded and the color of the pixel will be
+ * set to color of that object. If the ray doesn't hit any object, no pixel
+ * color is set, i.e. the default background color (black) will remain.
+ *
+ * The screen is rendered in cells of TILESCHED_CELL x TILESCHED_CELL pixels
+ * and the render time of each cell is recorded, see tilesched_plan().
  *
  * Returns:
  * POSIX OK (zero) or non-zero on error.
@@ -64,110 +559,132 @@ int render_scene (uint8_t* image,
                   int screen_height,
                   scene_t* scene)
 {
-   camera_t *cam         = scene_get_camera (scene);
-   sphere_t *sphere_list = scene_get_sphere (scene);
-   const int num_spheres = scene_get_num_spheres ();
-   const float aspect_ratio = (float)screen_height / (float)screen_width;
-   const float fov_x = cam->fov;                  /* Field of view in the x-plane */
-   const float fov_y = cam->fov * aspect_ratio;   /* Field of view in the y-plane
-                                                   * with aspect ratio correction */
-   ray_t ray;          /* The ray that will be used to trace through every pixel
-                        * in the rendered image */
-   int x, y;           /* Loop variables for each pixel */
-   size_t image_ofs;   /* Offset in the rendered image, i.e. pointer to next pixel */
+   kernel_ctx_t ctx;
+   int x, y;
+
+   if (image_sz < (size_t)screen_width * screen_height * 3)
+      return 1;
+
+   if (render_init (&ctx, scene, screen_width, screen_height, KERNEL_FMT_RGB24))
+      return 1;
 
    /* Clear whole image buffer to set black as default background color */
    memset (image, 0, image_sz);
 
-   /* Set starting point for the ray to the camera position */
-   ray.origin.x = cam->pos.x;
-   ray.origin.y = cam->pos.y;
-   ray.origin.z = cam->pos.z;
-
-   /* Reset image offset pointer */
-   image_ofs = 0;
+   tilesched_begin (screen_width, screen_height);
 
-   /* Create directions for each ray, i.e. from the camera to each pixel in the
-    * rendered image. Then test if the ray hits any of the spheres and set the
-    * pixel to the color of that sphere object, or leave the pixel untouched if
-    * no intersection was detected. */
-   for (y = 0; y < screen_height; y++)
+   for (y = 0; y < screen_height; y += TILESCHED_CELL)
    {
-      for (x = 0; x < screen_width; x++)
+      for (x = 0; x < screen_width; x += TILESCHED_CELL)
       {
-         int i;
-         int closest_sphere = -1;   /* Array ID of closests sphere,
-                                     * -1 no sphere was hit by the ray */
-         float min_dist = 100000;   /* Distance from camera to the closests
-                                     * sphere. Start value is set to a very
-                                     * high value so that if a sphere was hit
-                                     * it should definitely be closer than this
-                                     * value */
-         float dist;                /* Distance from camera to the sphere */
-
-         /* Set the ray direction. The ray will start att the camera position
-          * and travel in a angle which at maximum is the field of view (fov)
-          * value. I.e. if fov is set to 45 degree, the direction will be from
-          * -45 to +45 degree from the camera center. The direction is for both
-          * x and y directions, but the y value is corrected by a aspect ratio,
-          * which will make a sphere look like a circle instead of an elipse on
-          * a not 1:1 screen width to height mapping.
-          * The camera will be looking along the negative z-axis. */
-
-         ray.dir.x = tan (fov_x) * (2*x - screen_width)  / screen_width;
-         ray.dir.y = tan (fov_y) * (2*y - screen_height) / screen_height;
-         ray.dir.z = -1;
-
-         /* Normalize the direction (a must for the intersection test) */
-         vector_normal (&ray.dir);
-
-         /* Loop through all spheres and check which one is the closest to the camera. */
-         for (i = 0; i < num_spheres; i++)
+         const int x1 = x + TILESCHED_CELL < screen_width  ? x + TILESCHED_CELL : screen_width;
+         const int y1 = y + TILESCHED_CELL < screen_height ? y + TILESCHED_CELL : screen_height;
+         const size_t ofs = ((size_t)y * screen_width + x) * 3;
+         double t = tilesched_time ();
+
+         if (render_rect (&ctx, image + ofs, image_sz - ofs, NULL,
+                          screen_width, x, y, x1, y1))
          {
-            sphere_t *sphere = &sphere_list[i];   /* Current sphere to check */
+            kernel_done (&ctx);
+            return 1;
+         }
 
-            /* Get distance from camera/ray origin to sphere, i.e. test if the
-             * ray hits the sphere by checking if the returned distance is
-             * greater than zero */
-            dist = sphere_intersect (sphere, &ray);
+         tilesched_record (x, y, x1, y1, tilesched_time () - t);
+      }
+   }
 
-            /* Record the current sphere if it was intersected by the ray and
-             * closer to the camera than any previous hit sphere. */
-            if (dist > 0.0)
-            {
-               if (dist < min_dist)
-               {
-                  min_dist       = dist;
-                  closest_sphere = i;
-               }
-            }
-         }
+   kernel_done (&ctx);
 
-         /* If a sphere was intersected by the ray, set the pixel to the color
-          * of the sphere object, else leave the pixel untouched, i.e. keep the
-          * background color */
-         if (closest_sphere != -1)
-         {
-            sphere_t *sphere = &sphere_list[closest_sphere];
-            int r, g, b;
+   return 0;
+}
 
-            /* Check that new offset isn't pointing outside the image buffer */
-            if (image_ofs >= (image_sz))
-               return 1;
+/**
+ * render_tier - Render with depth at a given precision.
+ * @p:      Precision tier.
+ * @image:  Pointer to image buffer.
+ * @depth:  Pointer to depth buffer.
+ * @width:  Width of rendered screen.
+ * @height: Height of rendered screen.
+ * @scene:  Pointer to scene object.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+static int render_tier (precision_t p, uint8_t *image, float *depth,
+                        int width, int height, scene_t *scene)
+{
+   precision_t old = precision_get ();
+   int rc;
 
-            color_get (&sphere->color, &r, &g, &b);
+   if (precision_set (p))
+      return 1;
+   rc = render_depth (image, (size_t)width * height * 3, depth, width, height, scene);
+   precision_set (old);
 
-            image[image_ofs + 0] = r;
-            image[image_ofs + 1] = g;
-            image[image_ofs + 2] = b;
-         }
+   return rc;
+}
 
-         /* Update image offset */
-         image_ofs += 3;
-      }
+/**
+ * render_check_precision - Check the error of a precision tier.
+ * @p:      Precision tier to check.
+ * @width:  Width of rendered screen.
+ * @height: Height of rendered screen.
+ * @scene:  Pointer to scene object.
+ * @err:    Pointer where to return the measured error.
+ *
+ * This function renders @scene with the exact tier and with tier @p and
+ * compares the images, see precision_compare(). Tier @p passes if no pixel
+ * is off by more than PRECISION_FAST_MAX_SHIFT or
+ * PRECISION_FASTEST_MAX_SHIFT pixels. The check fails if the tier is fixed
+ * at compile time.
+ *
+ * Returns:
+ * POSIX OK (zero) if tier @p passed, or non-zero if it failed or on error.
+ */
+int render_check_precision (precision_t p,
+                            int width,
+                            int height,
+                            scene_t* scene,
+                            precision_err_t* err)
+{
+   const size_t num = (size_t)width * height;
+   uint8_t *image = malloc (num * 3 * 2);
+   float *depth = malloc (num * sizeof(float) * 2);
+   int rc = 1;
+
+   memset (err, 0, sizeof(*err));
+
+   if (!image || !depth)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for precision check\n");
+      goto out;
    }
 
-   return 0;
+   if (render_tier (PRECISION_EXACT, image, depth, width, height, scene) ||
+       render_tier (p, image + num * 3, depth + num, width, height, scene))
+      goto out;
+
+   precision_compare (image, image + num * 3, depth, depth + num,
+                      width, height, err);
+
+   switch (p)
+   {
+      case PRECISION_FAST:
+         rc = err->max_shift > PRECISION_FAST_MAX_SHIFT;
+         break;
+      case PRECISION_FASTEST:
+         rc = err->max_shift > PRECISION_FASTEST_MAX_SHIFT;
+         break;
+      default:
+         rc = err->num_diff != 0;
+         break;
+   }
+
+out:
+   free (image);
+   free (depth);
+
+   return rc;
 }
 
 /**
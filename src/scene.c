@@ -20,6 +20,8 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stdio.h>
+#include <stdint.h>
 #include <string.h> /* memset */
 
 #include "camera.h"
@@ -44,7 +46,57 @@ static scene_t scene;
 void scene_init (void)
 {
    /* Clear the scene struct */
+   free (scene.sphere);
+   free (scene.center);
    memset (&scene, 0, sizeof(scene));
+
+   /* Setup default number of spheres */
+   scene_set_num_spheres (&scene, NUM_SPHERES);
+}
+
+/**
+ * scene_new - Create a scene object.
+ *
+ * This function will create a scene with the same default values as
+ * scene_init() sets up for the scene of the CLI, e.g. to load another scene
+ * into. Free it with scene_free().
+ *
+ * Returns:
+ * Pointer to scene object, or NULL on error.
+ */
+scene_t* scene_new (void)
+{
+   scene_t *s = calloc (1, sizeof(*s));
+
+   if (!s)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for scene\n");
+      return NULL;
+   }
+   if (scene_set_num_spheres (s, NUM_SPHERES))
+   {
+      scene_free (s);
+      return NULL;
+   }
+
+   return s;
+}
+
+/**
+ * scene_free - Free a scene object.
+ * @scene: Pointer to scene_t object created by scene_new(), or NULL
+ *
+ * Returns:
+ * none.
+ */
+void scene_free (scene_t* scene)
+{
+   if (!scene)
+      return;
+
+   free (scene->sphere);
+   free (scene->center);
+   free (scene);
 }
 
 /**
@@ -95,11 +147,381 @@ sphere_t* scene_get_sphere (scene_t* scene)
  * scene.
  *
  * Returns:
- * Pointer number of sphere objects.
+ * Number of sphere objects.
+ */
+int scene_get_num_spheres (scene_t* scene)
+{
+   return scene->num_spheres;
+}
+
+/**
+ * scene_set_num_spheres - Set number of sphere objects.
+ * @scene: Pointer to scene_t object
+ * @num:   Number of spheres
+ *
+ * This function will resize the list of spheres in the scene. New spheres
+ * are cleared, i.e. they have zero radius and will not be visible, and are
+ * placed at the world origin. The list is only reallocated when it grows
+ * past its allocated size, so shrinking it, or growing it back within the
+ * allocated size, cannot fail.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int scene_set_num_spheres (scene_t* scene, int num)
+{
+   sphere_t *sphere;
+   dvector_t *center;
+   int i;
+
+   if (num < 0)
+      return 1;
+
+   if (num > scene->max_spheres || !scene->sphere)
+   {
+      sphere = realloc (scene->sphere, (num ? num : 1) * sizeof(sphere_t));
+      if (!sphere)
+      {
+         fprintf (stderr, "error: Unable to alloc memory for %d spheres\n", num);
+         return 1;
+      }
+      scene->sphere = sphere;
+
+      center = realloc (scene->center, (num ? num : 1) * sizeof(dvector_t));
+      if (!center)
+      {
+         fprintf (stderr, "error: Unable to alloc memory for %d spheres\n", num);
+         return 1;
+      }
+      scene->center = center;
+      scene->max_spheres = num;
+   }
+
+   if (num > scene->num_spheres)
+   {
+      memset (scene->sphere + scene->num_spheres, 0,
+              (num - scene->num_spheres) * sizeof(sphere_t));
+      memset (scene->center + scene->num_spheres, 0,
+              (num - scene->num_spheres) * sizeof(dvector_t));
+      for (i = scene->num_spheres; i < num; i++)
+         scene_set_sphere_center (scene, i, 0, 0, 0);
+   }
+
+   scene->num_spheres = num;
+
+   return 0;
+}
+
+/**
+ * scene_remove_sphere - Remove a sphere object.
+ * @scene: Pointer to scene_t object
+ * @id:    Array ID of sphere
+ *
+ * The last sphere is moved into the slot of the removed one, i.e. it takes
+ * over @id, and the list shrinks by one. This keeps the list packed at a
+ * constant cost, whatever the number of spheres.
+ *
+ * Returns:
+ * none.
  */
-int scene_get_num_spheres (void)
+void scene_remove_sphere (scene_t* scene, int id)
 {
-   return NUM_SPHERES;
+   int last = scene->num_spheres - 1;
+
+   if (id < 0 || id > last)
+      return;
+
+   scene->sphere[id] = scene->sphere[last];
+   scene->center[id] = scene->center[last];
+   scene->num_spheres = last;
+}
+
+/**
+ * scene_get_camera_pos - Get camera position.
+ * @scene: Pointer to scene_t object
+ * @pos:   Pointer where to return the world position
+ *
+ * Returns:
+ * none.
+ */
+void scene_get_camera_pos (scene_t* scene, dvector_t* pos)
+{
+   *pos = scene->origin;
+}
+
+/**
+ * scene_set_camera_pos - Set camera position.
+ * @scene: Pointer to scene_t object
+ * @x:     World x-coordinate
+ * @y:     World y-coordinate
+ * @z:     World z-coordinate
+ *
+ * This function will move the camera and rebase the scene on it, i.e. the
+ * float center of each sphere is recomputed in double precision relative to
+ * the new camera position.
+ *
+ * Returns:
+ * none.
+ */
+void scene_set_camera_pos (scene_t* scene, double x, double y, double z)
+{
+   int i;
+
+   scene->origin.x = x;
+   scene->origin.y = y;
+   scene->origin.z = z;
+
+   scene->cam.pos.x = 0;
+   scene->cam.pos.y = 0;
+   scene->cam.pos.z = 0;
+
+   for (i = 0; i < scene->num_spheres; i++)
+      scene_set_sphere_center (scene, i, scene->center[i].x,
+                               scene->center[i].y, scene->center[i].z);
+}
+
+/**
+ * scene_get_sphere_center - Get sphere center.
+ * @scene:  Pointer to scene_t object
+ * @id:     Array ID of sphere
+ * @center: Pointer where to return the world position
+ *
+ * Returns:
+ * none.
+ */
+void scene_get_sphere_center (scene_t* scene, int id, dvector_t* center)
+{
+   *center = scene->center[id];
+}
+
+/**
+ * scene_set_sphere_center - Set sphere center.
+ * @scene: Pointer to scene_t object
+ * @id:    Array ID of sphere
+ * @x:     World x-coordinate
+ * @y:     World y-coordinate
+ * @z:     World z-coordinate
+ *
+ * Returns:
+ * none.
+ */
+void scene_set_sphere_center (scene_t* scene, int id, double x, double y, double z)
+{
+   scene->center[id].x = x;
+   scene->center[id].y = y;
+   scene->center[id].z = z;
+
+   scene->sphere[id].center.x = x - scene->origin.x;
+   scene->sphere[id].center.y = y - scene->origin.y;
+   scene->sphere[id].center.z = z - scene->origin.z;
+}
+
+/**
+ * scene_get_version - Get scene version.
+ * @scene: Pointer to scene_t object
+ *
+ * Data derived from the scene can be checked against the version to find
+ * out if the scene has changed since it was derived, see edit_commit().
+ *
+ * Returns:
+ * Scene version.
+ */
+unsigned long scene_get_version (scene_t* scene)
+{
+   return scene->version;
+}
+
+/**
+ * scene_touch - Mark a scene as changed.
+ * @scene: Pointer to scene_t object
+ *
+ * Returns:
+ * none.
+ */
+void scene_touch (scene_t* scene)
+{
+   scene->version++;
+}
+
+/**
+ * scene_pack_size - Get size of a packed scene.
+ * @scene: Pointer to scene_t object
+ *
+ * Returns:
+ * Number of bytes needed by scene_pack() for @scene.
+ */
+size_t scene_pack_size (scene_t* scene)
+{
+   return sizeof(camera_t) + sizeof(dvector_t) + sizeof(uint32_t) +
+      scene_get_num_spheres (scene) * (sizeof(sphere_t) + sizeof(dvector_t));
+}
+
+/**
+ * scene_pack - Pack a scene into a buffer.
+ * @scene: Pointer to scene_t object
+ * @buf:   Pointer to buffer
+ * @len:   Size of @buf
+ *
+ * This function will serialize @scene into @buf, e.g. to be sent to another
+ * srt process. The camera is stored first, followed by its world position,
+ * the number of spheres, the sphere objects and the world position of each
+ * sphere. The objects are stored in host format, i.e. the buffer can only be
+ * read by an srt built for the same architecture.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if @buf is too small.
+ */
+int scene_pack (scene_t* scene, uint8_t* buf, size_t len)
+{
+   uint32_t num_spheres = scene_get_num_spheres (scene);
+
+   if (len < scene_pack_size (scene))
+      return 1;
+
+   memcpy (buf, &scene->cam, sizeof(camera_t));
+   buf += sizeof(camera_t);
+   memcpy (buf, &scene->origin, sizeof(dvector_t));
+   buf += sizeof(dvector_t);
+   memcpy (buf, &num_spheres, sizeof(num_spheres));
+   buf += sizeof(num_spheres);
+   memcpy (buf, scene->sphere, num_spheres * sizeof(sphere_t));
+   buf += num_spheres * sizeof(sphere_t);
+   memcpy (buf, scene->center, num_spheres * sizeof(dvector_t));
+
+   return 0;
+}
+
+/**
+ * scene_unpack - Unpack a scene from a buffer.
+ * @scene: Pointer to scene_t object
+ * @buf:   Pointer to buffer created by scene_pack()
+ * @len:   Size of @buf
+ *
+ * The sphere list of @scene is resized to the number of packed spheres.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if @buf doesn't contain a valid scene.
+ */
+int scene_unpack (scene_t* scene, const uint8_t* buf, size_t len)
+{
+   const size_t hdr_sz = sizeof(camera_t) + sizeof(dvector_t) + sizeof(uint32_t);
+   uint32_t num_spheres;
+
+   if (len < hdr_sz)
+      return 1;
+
+   memcpy (&num_spheres, buf + hdr_sz - sizeof(num_spheres), sizeof(num_spheres));
+   if ((len - hdr_sz) / (sizeof(sphere_t) + sizeof(dvector_t)) < num_spheres)
+      return 1;
+   if (scene_set_num_spheres (scene, num_spheres))
+      return 1;
+
+   memcpy (&scene->cam, buf, sizeof(camera_t));
+   memcpy (&scene->origin, buf + sizeof(camera_t), sizeof(dvector_t));
+   memcpy (scene->sphere, buf + hdr_sz, num_spheres * sizeof(sphere_t));
+   memcpy (scene->center, buf + hdr_sz + num_spheres * sizeof(sphere_t),
+           num_spheres * sizeof(dvector_t));
+
+   return 0;
+}
+
+/**
+ * scene_save - Save a scene to a binary scene file.
+ * @scene: Pointer to scene_t object
+ * @file:  File name
+ *
+ * The file holds SCENE_FILE_MAGIC and SCENE_FILE_VERSION followed by the
+ * scene packed with scene_pack(), i.e. it can only be read by an srt built for the same
+ * architecture. Loading it is much cheaper than parsing XML.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int scene_save (scene_t* scene, const char* file)
+{
+   const uint32_t magic[2] = { SCENE_FILE_MAGIC, SCENE_FILE_VERSION };
+   size_t len = scene_pack_size (scene);
+   uint8_t *buf = malloc (len);
+   FILE *fp;
+   int rc = 0;
+
+   if (!buf)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for scene\n");
+      return 1;
+   }
+   scene_pack (scene, buf, len);
+
+   fp = fopen (file, "wb");
+   if (!fp)
+   {
+      fprintf (stderr, "error: Unable to create %s.\n", file);
+      free (buf);
+      return 1;
+   }
+   if (fwrite (magic, sizeof(magic), 1, fp) != 1 ||
+       fwrite (buf, len, 1, fp) != 1)
+      rc = 1;
+   if (fclose (fp))
+      rc = 1;
+   if (rc)
+      fprintf (stderr, "error: Unable to write %s.\n", file);
+   free (buf);
+
+   return rc;
+}
+
+/**
+ * scene_load - Load a scene from a binary scene file.
+ * @scene: Pointer to scene_t object
+ * @file:  File name of a file written by scene_save()
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int scene_load (scene_t* scene, const char* file)
+{
+   uint8_t *buf = NULL;
+   uint32_t magic[2];
+   long len;
+   FILE *fp;
+   int rc = 1;
+
+   fp = fopen (file, "rb");
+   if (!fp)
+   {
+      fprintf (stderr, "error: Unable to open %s.\n", file);
+      return 1;
+   }
+
+   if (fread (magic, sizeof(magic), 1, fp) != 1 || magic[0] != SCENE_FILE_MAGIC ||
+       fseek (fp, 0, SEEK_END) || (len = ftell (fp)) < (long)sizeof(magic) ||
+       fseek (fp, sizeof(magic), SEEK_SET))
+   {
+      fprintf (stderr, "error: %s is not a scene file.\n", file);
+      fclose (fp);
+      return 1;
+   }
+   if (magic[1] != SCENE_FILE_VERSION)
+   {
+      fprintf (stderr, "error: %s is from another version of srt.\n", file);
+      fclose (fp);
+      return 1;
+   }
+   len -= sizeof(magic);
+
+   buf = malloc (len ? len : 1);
+   if (!buf)
+      fprintf (stderr, "error: Unable to alloc memory for scene\n");
+   else if (fread (buf, 1, len, fp) != (size_t)len || scene_unpack (scene, buf, len))
+      fprintf (stderr, "error: %s is not a valid scene file.\n", file);
+   else
+      rc = 0;
+
+   free (buf);
+   fclose (fp);
+
+   return rc;
 }
 
 /**
@@ -0,0 +1,678 @@
+/**
+ * server.c - Render server class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines the render server, which renders and serves image
+ * tiles on request over HTTP.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "net.h"
+#include "http.h"
+#include "scene.h"
+#include "edit.h"
+#include "delta.h"
+#include "snapshot.h"
+#include "render.h"
+#include "tilecache.h"
+#include "library.h"
+#include "jobsched.h"
+#include "ssil/png.h"
+
+#include "server.h"
+
+/* Delays in microseconds after a failed accept(), doubled for each failure
+ * in a row, e.g. while out of file descriptors */
+#define SERVER_ACCEPT_DELAY     1000
+#define SERVER_ACCEPT_MAX_DELAY 1000000
+
+/* Listening socket and the thread accepting connections on it */
+static int listen_fd = -1;
+static pthread_t accept_thread;
+
+/* Non-zero if scene deltas are applied, see server_set_updates() */
+static int updates = 0;
+
+/**
+ * server_tile - Serve a tile of a tiled image.
+ * @conn:       Pointer to connection.
+ * @keep_alive: Non-zero if the connection will be kept.
+ * @scene:      Pointer to scene to render, not changed while rendering.
+ * @prefix:     Cache key prefix, unique for @scene and its version.
+ * @width:      Full resolution width.
+ * @height:     Full resolution height.
+ * @level:      Level, 0 is full resolution and each level halves the size.
+ * @tx:         Tile column, 0 is the leftmost.
+ * @ty:         Tile row, 0 is the top row.
+ * @cls:        Priority class of the render.
+ * @deadline:   Seconds until the render should be done, or 0 for none.
+ *
+ * The image at @level is rendered in a resolution of @width x @height
+ * divided by two to the power of @level, rounded up, so that each level of
+ * the pyramid is a render of its own rather than a downscale. Only the
+ * requested tile is rendered, with the camera mapping of the whole level,
+ * and the PNG encoded tile is kept in the tile cache under @prefix, so
+ * tiles of different scenes, or versions of a scene, are never mixed up.
+ * The tile is rendered by the render threads, see jobsched_render().
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if the connection should be closed.
+ */
+static int server_tile (http_conn_t *conn, int keep_alive,
+                        scene_t *scene, const char *prefix,
+                        int width, int height, int level, int tx, int ty,
+                        jobsched_class_t cls, double deadline)
+{
+   char key[TILECACHE_KEY_SIZE];
+   tilecache_entry_t *entry;
+   int lw, lh;   /* Size of the level */
+   int owner;
+   int rc;
+
+   if (width < 1 || height < 1 || width > SERVER_MAX_SIZE || height > SERVER_MAX_SIZE ||
+       level < 0 || level > 20)
+      return http_respond (conn, 400, "text/plain", "Bad size or level\n", 18, keep_alive);
+
+   lw = (width  + (1 << level) - 1) >> level;
+   lh = (height + (1 << level) - 1) >> level;
+   if (tx < 0 || ty < 0 || tx * SERVER_TILE_SIZE >= lw || ty * SERVER_TILE_SIZE >= lh)
+      return http_respond (conn, 404, "text/plain", "No such tile\n", 13, keep_alive);
+
+   snprintf (key, sizeof(key), "%s/%dx%d/%d/%d/%d", prefix,
+             width, height, level, tx, ty);
+   entry = tilecache_get (key, &owner);
+
+   if (owner)
+   {
+      /* Tile rows are counted from the top, image rows from the bottom */
+      int x0 = tx * SERVER_TILE_SIZE;
+      int x1 = x0 + SERVER_TILE_SIZE < lw ? x0 + SERVER_TILE_SIZE : lw;
+      int y1 = lh - ty * SERVER_TILE_SIZE;
+      int y0 = y1 - SERVER_TILE_SIZE > 0 ? y1 - SERVER_TILE_SIZE : 0;
+      size_t tile_sz = (size_t)(x1 - x0) * (y1 - y0) * 3;
+      size_t png_sz  = png_size (x1 - x0, y1 - y0);
+      uint8_t *tile  = malloc (tile_sz);
+      uint8_t *png   = malloc (png_sz);
+
+      if (!tile || !png || !scene ||
+          jobsched_render (tile, tile_sz, lw, lh, x0, y0, x1, y1, scene,
+                           cls, deadline) ||
+          png_encode (png, png_sz, x1 - x0, y1 - y0, tile))
+      {
+         free (png);
+         png = NULL;
+      }
+      free (tile);
+
+      tilecache_fill (entry, png, png_sz);
+      if (!png)
+      {
+         tilecache_release (entry);
+         entry = NULL;
+      }
+   }
+
+   if (!entry)
+      return http_respond (conn, 503, "text/plain", "Render failed\n", 14, keep_alive);
+
+   rc = http_respond (conn, 200, "image/png", entry->data, entry->len, keep_alive);
+   tilecache_release (entry);
+
+   return rc;
+}
+
+/**
+ * server_scene_tile - Serve a tile of the current scene.
+ * @conn:       Pointer to connection.
+ * @keep_alive: Non-zero if the connection will be kept.
+ * @width:      Full resolution width.
+ * @height:     Full resolution height.
+ * @level:      Level, see server_tile().
+ * @tx:         Tile column.
+ * @ty:         Tile row.
+ * @cls:        Priority class of the render.
+ * @deadline:   Seconds until the render should be done, or 0 for none.
+ *
+ * The tile is rendered from the current scene snapshot, so the scene can
+ * be edited meanwhile.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if the connection should be closed.
+ */
+static int server_scene_tile (http_conn_t *conn, int keep_alive,
+                              int width, int height, int level, int tx, int ty,
+                              jobsched_class_t cls, double deadline)
+{
+   char prefix[32];
+   snapshot_t *snap;
+   int rc;
+
+   snap = snapshot_pin ();
+   if (!snap)
+      return http_respond (conn, 503, "text/plain", "No scene\n", 9, keep_alive);
+
+   snprintf (prefix, sizeof(prefix), "%lu", snap->version);
+   rc = server_tile (conn, keep_alive, snapshot_get_scene (snap), prefix,
+                     width, height, level, tx, ty, cls, deadline);
+   snapshot_unpin (snap);
+
+   return rc;
+}
+
+/**
+ * server_library_tile - Serve a tile of a library scene.
+ * @conn:       Pointer to connection.
+ * @keep_alive: Non-zero if the connection will be kept.
+ * @name:       Scene name, see library_get().
+ * @width:      Full resolution width.
+ * @height:     Full resolution height.
+ * @level:      Level, see server_tile().
+ * @tx:         Tile column.
+ * @ty:         Tile row.
+ * @cls:        Priority class of the render.
+ * @deadline:   Seconds until the render should be done, or 0 for none.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if the connection should be closed.
+ */
+static int server_library_tile (http_conn_t *conn, int keep_alive, const char *name,
+                                int width, int height, int level, int tx, int ty,
+                                jobsched_class_t cls, double deadline)
+{
+   char prefix[LIBRARY_NAME_SIZE + 32];
+   library_entry_t *entry;
+   int rc;
+
+   if (!library_enabled ())
+      return http_respond (conn, 404, "text/plain", "No scene library\n", 17, keep_alive);
+
+   entry = library_get (name);
+   if (!entry)
+      return http_respond (conn, 404, "text/plain", "No such scene\n", 14, keep_alive);
+
+   /* The load is part of the key, a reloaded scene may have changed */
+   snprintf (prefix, sizeof(prefix), "%s@%lu", entry->name, entry->version);
+   rc = server_tile (conn, keep_alive, entry->scene, prefix,
+                     width, height, level, tx, ty, cls, deadline);
+   library_release (entry);
+
+   return rc;
+}
+
+/**
+ * server_image - Serve a whole image of the current scene.
+ * @conn:       Pointer to connection.
+ * @keep_alive: Non-zero if the connection will be kept.
+ * @width:      Width.
+ * @height:     Height.
+ * @cls:        Priority class of the render.
+ * @deadline:   Seconds until the render should be done, or 0 for none.
+ *
+ * The image is rendered from the current scene snapshot and not cached.
+ * It shares the render threads with the tiles, so a large image rendered
+ * as a batch job doesn't hold up the interactive tile requests.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if the connection should be closed.
+ */
+static int server_image (http_conn_t *conn, int keep_alive, int width, int height,
+                         jobsched_class_t cls, double deadline)
+{
+   snapshot_t *snap;
+   uint8_t *image = NULL;
+   uint8_t *png = NULL;
+   size_t image_sz, png_sz;
+   int rc;
+
+   if (width < 1 || height < 1 || width > SERVER_MAX_IMAGE || height > SERVER_MAX_IMAGE)
+      return http_respond (conn, 400, "text/plain", "Bad size\n", 9, keep_alive);
+
+   snap = snapshot_pin ();
+   if (!snap)
+      return http_respond (conn, 503, "text/plain", "No scene\n", 9, keep_alive);
+
+   image_sz = (size_t)width * height * 3;
+   png_sz   = png_size (width, height);
+   image    = malloc (image_sz);
+   png      = malloc (png_sz);
+   if (!image || !png ||
+       jobsched_render (image, image_sz, width, height, 0, 0, width, height,
+                        snapshot_get_scene (snap), cls, deadline) ||
+       png_encode (png, png_sz, width, height, image))
+   {
+      rc = http_respond (conn, 503, "text/plain", "Render failed\n", 14, keep_alive);
+      goto out;
+   }
+
+   rc = http_respond (conn, 200, "image/png", png, png_sz, keep_alive);
+
+out:
+   snapshot_unpin (snap);
+   free (image);
+   free (png);
+
+   return rc;
+}
+
+/**
+ * server_update - Apply a scene delta.
+ * @conn: Pointer to connection.
+ * @req:  Pointer to request, with the delta as body.
+ *
+ * The delta is applied to the scene as one transaction, and the new
+ * version of the scene published, see snapshot_commit(). Tiles of the
+ * previous version are no longer asked for and age out of the cache.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if the connection should be closed.
+ */
+static int server_update (http_conn_t *conn, http_req_t *req)
+{
+   edit_txn_t txn;
+   snapshot_stats_t ss;
+   uint8_t *delta;
+   char buf[64];
+   int n;
+
+   if (!updates)
+      return http_respond (conn, 403, "text/plain", "Scene is edited by the CLI\n", 27, 0);
+   if (req->content_length > DELTA_MAX_SIZE)
+      return http_respond (conn, 413, "text/plain", "Delta too large\n", 16, 0);
+
+   delta = malloc (req->content_length ? req->content_length : 1);
+   if (!delta)
+      return http_respond (conn, 503, "text/plain", "Out of memory\n", 14, 0);
+   if (http_read_body (conn, delta, req->content_length))
+   {
+      free (delta);
+      return 1;
+   }
+
+   edit_init (&txn);
+   edit_begin (&txn, scene_get_scene ());
+   if (delta_apply (delta, req->content_length, &txn))
+   {
+      edit_free (&txn);
+      free (delta);
+      return http_respond (conn, 400, "text/plain", "Bad delta\n", 10, req->keep_alive);
+   }
+   free (delta);
+
+   if (snapshot_commit (&txn))
+   {
+      edit_free (&txn);
+      return http_respond (conn, 503, "text/plain", "Commit failed\n", 14, req->keep_alive);
+   }
+   snapshot_get_stats (&ss);
+   n = snprintf (buf, sizeof(buf), "version: %lu\nchanged: %d\n",
+                 ss.version, txn.num_dirty);
+   edit_free (&txn);
+
+   return http_respond (conn, 200, "text/plain", buf, n, req->keep_alive);
+}
+
+/**
+ * server_stats - Serve cache statistics.
+ * @conn:       Pointer to connection.
+ * @keep_alive: Non-zero if the connection will be kept.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if the connection should be closed.
+ */
+static int server_stats (http_conn_t *conn, int keep_alive)
+{
+   tilecache_stats_t s;
+   snapshot_stats_t ss;
+   library_stats_t ls;
+   jobsched_stats_t js;
+   char buf[2048];
+   int c, n;
+
+   tilecache_get_stats (&s);
+   snapshot_get_stats (&ss);
+   n = snprintf (buf, sizeof(buf),
+                 "hits: %lu\nmisses: %lu\ncoalesced: %lu\nevictions: %lu\n"
+                 "entries: %d\nbytes: %zu\nmax_bytes: %zu\n"
+                 "version: %lu\nsnapshots: %d\nchunks: %d\n",
+                 s.hits, s.misses, s.coalesced, s.evictions,
+                 s.entries, s.bytes, s.max_bytes,
+                 ss.version, ss.snapshots, ss.chunks);
+
+   if (library_enabled ())
+   {
+      unsigned long total;
+
+      library_get_stats (&ls);
+      total = ls.hits + ls.misses + ls.coalesced;
+      n += snprintf (buf + n, sizeof(buf) - n,
+                     "scene_hits: %lu\nscene_misses: %lu\nscene_coalesced: %lu\n"
+                     "scene_hit_rate: %.3f\nscene_evictions: %lu\n"
+                     "scene_xml_loads: %lu\nscene_cache_loads: %lu\n"
+                     "scene_entries: %d\nscene_bytes: %zu\nscene_max_bytes: %zu\n",
+                     ls.hits, ls.misses, ls.coalesced,
+                     total ? (double)(ls.hits + ls.coalesced) / total : 0,
+                     ls.evictions, ls.xml_loads, ls.cache_loads,
+                     ls.entries, ls.bytes, ls.max_bytes);
+   }
+
+   n += snprintf (buf + n, sizeof(buf) - n, "render_threads: %d\n",
+                  jobsched_get_threads ());
+   for (c = 0; c < JOBSCHED_CLASSES; c++)
+   {
+      const char *name = jobsched_class_name (c);
+
+      jobsched_get_stats (c, &js);
+      n += snprintf (buf + n, sizeof(buf) - n,
+                     "%s_jobs: %lu\n%s_tiles: %lu\n%s_missed: %lu\n"
+                     "%s_queued: %d\n%s_weight: %d\n"
+                     "%s_wait_ms: %.3f\n%s_time_ms: %.3f\n",
+                     name, js.jobs, name, js.tiles, name, js.missed,
+                     name, js.queued, name, js.weight,
+                     name, js.jobs ? js.wait * 1000 / js.jobs : 0,
+                     name, js.jobs ? js.time * 1000 / js.jobs : 0);
+   }
+
+   return http_respond (conn, 200, "text/plain", buf, n, keep_alive);
+}
+
+/**
+ * server_query - Parse the query of a request.
+ * @query:    Query string, the part of the path after '?', or NULL.
+ * @cls:      Pointer to priority class, set if the query has "priority".
+ * @deadline: Pointer to deadline in seconds, set if the query has
+ *            "deadline", given in milliseconds.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if the query is invalid.
+ */
+static int server_query (char *query, jobsched_class_t *cls, double *deadline)
+{
+   char *param, *save = NULL;
+
+   if (!query)
+      return 0;
+
+   for (param = strtok_r (query, "&", &save); param; param = strtok_r (NULL, "&", &save))
+   {
+      char *end;
+
+      if (!strncmp (param, "priority=", 9))
+      {
+         *cls = jobsched_class (param + 9);
+         if (*cls >= JOBSCHED_CLASSES)
+            return 1;
+      }
+      else if (!strncmp (param, "deadline=", 9))
+      {
+         *deadline = strtod (param + 9, &end) / 1000;
+         if (end == param + 9 || *end || *deadline < 0)
+            return 1;
+      }
+   }
+
+   return 0;
+}
+
+/**
+ * server_request - Serve a request.
+ * @conn: Pointer to connection.
+ * @req:  Pointer to request.
+ *
+ * Available requests:
+ *   GET /tile/<WIDTH>x<HEIGHT>/<LEVEL>/<X>/<Y>.png - see server_tile()
+ *   GET /scenes/<NAME>/tile/...                    - the same, of a scene
+ *                                                    in the library
+ *   GET /image/<WIDTH>x<HEIGHT>.png                - see server_image()
+ *   GET /stats                                     - cache statistics
+ *   POST /scene                                    - see server_update()
+ *
+ * The renders can be given a priority class and a deadline in milliseconds
+ * with a query, e.g. "?priority=batch&deadline=60000". Tiles are rendered
+ * as interactive and images as batch jobs by default.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if the connection should be closed.
+ */
+static int server_request (http_conn_t *conn, http_req_t *req)
+{
+   char name[LIBRARY_NAME_SIZE];
+   char *query;
+   int width, height, level, tx, ty;
+   jobsched_class_t cls = JOBSCHED_CLASSES;
+   double deadline = 0;
+   int n = 0;
+
+   query = strchr (req->path, '?');
+   if (query)
+      *query++ = 0;
+   if (server_query (query, &cls, &deadline))
+      return http_respond (conn, 400, "text/plain", "Bad query\n", 10, req->keep_alive);
+
+   if (!strcmp (req->path, "/scene"))
+   {
+      if (strcmp (req->method, "POST"))
+         return http_respond (conn, 405, "text/plain", "Only POST is supported\n", 23, 0);
+      return server_update (conn, req);
+   }
+
+   if (strcmp (req->method, "GET"))
+      return http_respond (conn, 405, "text/plain", "Only GET is supported\n", 22, 0);
+
+   if (sscanf (req->path, "/tile/%dx%d/%d/%d/%d.png%n",
+               &width, &height, &level, &tx, &ty, &n) == 5 &&
+       req->path[n] == 0)
+      return server_scene_tile (conn, req->keep_alive, width, height, level, tx, ty,
+                                cls < JOBSCHED_CLASSES ? cls : JOBSCHED_INTERACTIVE,
+                                deadline);
+
+   if (sscanf (req->path, "/scenes/%63[^/]/tile/%dx%d/%d/%d/%d.png%n",
+               name, &width, &height, &level, &tx, &ty, &n) == 6 &&
+       req->path[n] == 0)
+      return server_library_tile (conn, req->keep_alive, name,
+                                  width, height, level, tx, ty,
+                                  cls < JOBSCHED_CLASSES ? cls : JOBSCHED_INTERACTIVE,
+                                  deadline);
+
+   if (sscanf (req->path, "/image/%dx%d.png%n", &width, &height, &n) == 2 &&
+       req->path[n] == 0)
+      return server_image (conn, req->keep_alive, width, height,
+                           cls < JOBSCHED_CLASSES ? cls : JOBSCHED_BATCH, deadline);
+
+   if (!strcmp (req->path, "/stats"))
+      return server_stats (conn, req->keep_alive);
+
+   return http_respond (conn, 404, "text/plain", "Not found\n", 10, req->keep_alive);
+}
+
+/**
+ * server_conn - Connection thread.
+ * @arg: Pointer to malloc'ed connection.
+ *
+ * Serves requests on a connection until the client closes it or asks for
+ * it to be closed.
+ *
+ * Returns:
+ * NULL.
+ */
+static void* server_conn (void *arg)
+{
+   http_conn_t *conn = arg;
+   http_req_t req;
+
+   while (!http_read_request (conn, &req))
+   {
+      /* Request bodies are only used for scene deltas */
+      if (req.content_length &&
+          (strcspn (req.path, "?") != 6 ||
+           strncmp (req.path, "/scene", 6)))
+      {
+         http_respond (conn, 413, "text/plain", "No body expected\n", 17, 0);
+         break;
+      }
+      if (server_request (conn, &req) || !req.keep_alive)
+         break;
+   }
+
+   close (conn->fd);
+   free (conn);
+
+   return NULL;
+}
+
+/**
+ * server_accept - Accept thread.
+ * @arg: Unused.
+ *
+ * Starts a detached thread for each accepted connection. When accept()
+ * fails, e.g. with EMFILE, the error is logged and the thread sleeps before
+ * trying again, backing off while the failures last.
+ *
+ * Returns:
+ * NULL.
+ */
+static void* server_accept (void *arg)
+{
+   useconds_t delay = 0;
+
+   (void)arg;
+
+   while (1)
+   {
+      http_conn_t *conn;
+      pthread_t thread;
+      int fd = net_accept (listen_fd);
+
+      if (fd < 0)
+      {
+         if (!delay)
+            fprintf (stderr, "warning: Unable to accept connection: %s\n",
+                     strerror (errno));
+         delay = delay ? delay * 2 : SERVER_ACCEPT_DELAY;
+         if (delay > SERVER_ACCEPT_MAX_DELAY)
+            delay = SERVER_ACCEPT_MAX_DELAY;
+         usleep (delay);
+         continue;
+      }
+      delay = 0;
+
+      conn = malloc (sizeof(*conn));
+      if (!conn)
+      {
+         close (fd);
+         continue;
+      }
+      http_init (conn, fd);
+
+      if (pthread_create (&thread, NULL, server_conn, conn))
+      {
+         close (fd);
+         free (conn);
+         continue;
+      }
+      pthread_detach (thread);
+   }
+
+   return NULL;
+}
+
+/**
+ * server_set_updates - Set if scene deltas are applied.
+ * @on: Non-zero to apply the deltas posted to /scene.
+ *
+ * Only enable when no one else edits the scene, i.e. when running as a
+ * server rather than from the CLI.
+ *
+ * Returns:
+ * none.
+ */
+void server_set_updates (int on)
+{
+   updates = on;
+}
+
+/**
+ * server_start - Start the render server.
+ * @addr:       Address to listen on, see net_listen().
+ * @cache_size: Tile cache budget in bytes.
+ *
+ * This function will start serving HTTP requests on @addr in the
+ * background, see server_request() for the available requests. Each
+ * connection is served by its own thread, and the renders are shared out
+ * on one render thread for each online CPU, see jobsched.h.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int server_start (const char *addr, size_t cache_size)
+{
+   if (listen_fd >= 0)
+   {
+      fprintf (stderr, "error: Server is already running.\n");
+      return 1;
+   }
+
+   listen_fd = net_listen (addr);
+   if (listen_fd < 0)
+      return 1;
+
+   tilecache_init (cache_size);
+   if (jobsched_start (0))
+   {
+      net_close (listen_fd, addr);
+      listen_fd = -1;
+      return 1;
+   }
+
+   if (pthread_create (&accept_thread, NULL, server_accept, NULL))
+   {
+      fprintf (stderr, "error: Unable to start server thread.\n");
+      net_close (listen_fd, addr);
+      listen_fd = -1;
+      return 1;
+   }
+
+   printf ("Serving on %s\n", addr);
+
+   return 0;
+}
+
+/**
+ * server_wait - Wait for the render server to stop.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if the server isn't running.
+ */
+int server_wait (void)
+{
+   if (listen_fd < 0)
+      return 1;
+
+   return pthread_join (accept_thread, NULL);
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
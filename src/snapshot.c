@@ -0,0 +1,425 @@
+/**
+ * snapshot.c - Snapshot class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines immutable, versioned snapshots of the scene, which
+ * are rendered while the scene is edited.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* memcpy */
+#include <pthread.h>
+
+#include "camera.h"
+#include "sphere.h"
+#include "scene.h"
+#include "edit.h"
+
+#include "snapshot.h"
+
+/* The current snapshot, and the lock protecting the pointer and the pin
+ * of it. The lock is only held while pinning or swapping the pointer, never
+ * while rendering or copying. */
+static snapshot_t *current = NULL;
+static pthread_mutex_t current_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Serialises the edits and publishes of snapshot_commit() */
+static pthread_mutex_t commit_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The last freed snapshot with a scene, kept with its chunks so the scene
+ * of a later snapshot is patched from it, see snapshot_get_scene() */
+static snapshot_t *spare = NULL;
+static pthread_mutex_t spare_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Statistics */
+static int num_snapshots = 0;
+static int num_chunks = 0;
+static long num_copied = 0;
+static long num_shared = 0;
+
+/**
+ * snapshot_chunk_put - Drop a reference to a chunk.
+ * @chunk: Pointer to chunk.
+ *
+ * The chunk is freed when no snapshot uses it.
+ *
+ * Returns:
+ * none.
+ */
+static void snapshot_chunk_put (snapshot_chunk_t *chunk)
+{
+   if (__atomic_sub_fetch (&chunk->refs, 1, __ATOMIC_ACQ_REL) == 0)
+   {
+      free (chunk);
+      __atomic_sub_fetch (&num_chunks, 1, __ATOMIC_RELAXED);
+   }
+}
+
+/**
+ * snapshot_destroy - Free a snapshot and its scene.
+ * @snap: Pointer to snapshot.
+ *
+ * Returns:
+ * none.
+ */
+static void snapshot_destroy (snapshot_t *snap)
+{
+   int i;
+
+   for (i = 0; i < snap->num_chunks; i++)
+      snapshot_chunk_put (snap->chunk[i]);
+   free (snap->chunk);
+
+   if (snap->scene)
+   {
+      free (snap->scene->sphere);
+      free (snap->scene->center);
+      free (snap->scene);
+   }
+   pthread_mutex_destroy (&snap->lock);
+   free (snap);
+}
+
+/**
+ * snapshot_free - Free a snapshot.
+ * @snap: Pointer to snapshot.
+ *
+ * A snapshot with a scene replaces the spare one instead, so its scene is
+ * reused by the next snapshot_get_scene().
+ *
+ * Returns:
+ * none.
+ */
+static void snapshot_free (snapshot_t *snap)
+{
+   __atomic_sub_fetch (&num_snapshots, 1, __ATOMIC_RELAXED);
+
+   if (snap->scene)
+   {
+      snapshot_t *prev;
+
+      pthread_mutex_lock (&spare_lock);
+      prev  = spare;
+      spare = snap;
+      pthread_mutex_unlock (&spare_lock);
+      snap = prev;
+   }
+   if (snap)
+      snapshot_destroy (snap);
+}
+
+/**
+ * snapshot_publish - Publish a new version of the scene.
+ * @scene:     Pointer to the edited scene.
+ * @dirty:     IDs of the spheres changed since the last publish, in
+ *             increasing order, or NULL if any sphere may have changed.
+ * @num_dirty: Number of IDs in @dirty.
+ *
+ * The next snapshot is built from @scene copy-on-write: chunks holding a
+ * dirty sphere, or beyond the previous snapshot, are copied from @scene,
+ * the others are shared with the previous snapshot. The new snapshot then
+ * replaces the current one. Renders which pinned the previous snapshot go
+ * on with it, it's freed when the last of them unpins it. Call with the
+ * dirty list of edit_commit() after each commit.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error, the current snapshot is then kept.
+ */
+int snapshot_publish (scene_t *scene, const int *dirty, int num_dirty)
+{
+   snapshot_t *prev, *snap;
+   const int num = scene_get_num_spheres (scene);
+   uint8_t *copy;
+   int i, d;
+
+   /* Only the publisher replaces the current snapshot, so it can be read
+    * without the lock */
+   prev = current;
+
+   snap = calloc (1, sizeof(*snap));
+   if (!snap)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for snapshot\n");
+      return 1;
+   }
+   snap->num_chunks = (num + SNAPSHOT_CHUNK - 1) / SNAPSHOT_CHUNK;
+   snap->chunk = calloc (snap->num_chunks ? snap->num_chunks : 1, sizeof(snapshot_chunk_t*));
+   copy = calloc (snap->num_chunks ? snap->num_chunks : 1, 1);
+   if (!snap->chunk || !copy)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for snapshot\n");
+      free (snap->chunk);
+      free (snap);
+      free (copy);
+      return 1;
+   }
+   pthread_mutex_init (&snap->lock, NULL);
+   __atomic_add_fetch (&num_snapshots, 1, __ATOMIC_RELAXED);
+
+   /* Find the chunks to copy */
+   for (i = 0; i < snap->num_chunks; i++)
+      copy[i] = !dirty || !prev || i >= prev->num_chunks ||
+                (i == prev->num_chunks - 1 && num > prev->num_spheres);
+   for (d = 0; dirty && d < num_dirty; d++)
+      if (dirty[d] >= 0 && dirty[d] < num)
+         copy[dirty[d] / SNAPSHOT_CHUNK] = 1;
+
+   for (i = 0; i < snap->num_chunks; i++)
+   {
+      snapshot_chunk_t *chunk;
+      int first = i * SNAPSHOT_CHUNK;
+      int n = num - first < SNAPSHOT_CHUNK ? num - first : SNAPSHOT_CHUNK;
+
+      if (!copy[i])
+      {
+         chunk = prev->chunk[i];
+         __atomic_add_fetch (&chunk->refs, 1, __ATOMIC_RELAXED);
+         snap->chunk[i] = chunk;
+         num_shared++;
+         continue;
+      }
+
+      chunk = malloc (sizeof(*chunk));
+      if (!chunk)
+      {
+         fprintf (stderr, "error: Unable to alloc memory for snapshot\n");
+         snap->num_chunks = i;
+         snapshot_free (snap);
+         free (copy);
+         return 1;
+      }
+      chunk->refs = 1;
+      memcpy (chunk->sphere, scene_get_sphere (scene) + first, n * sizeof(sphere_t));
+      memcpy (chunk->center, scene->center + first, n * sizeof(dvector_t));
+      snap->chunk[i] = chunk;
+      num_copied++;
+      __atomic_add_fetch (&num_chunks, 1, __ATOMIC_RELAXED);
+   }
+   free (copy);
+
+   snap->version     = scene_get_version (scene);
+   snap->refs        = 1;
+   snap->cam         = *scene_get_camera (scene);
+   snap->origin      = scene->origin;
+   snap->num_spheres = num;
+
+   pthread_mutex_lock (&current_lock);
+   current = snap;
+   pthread_mutex_unlock (&current_lock);
+
+   if (prev)
+      snapshot_unpin (prev);
+
+   return 0;
+}
+
+/**
+ * snapshot_commit - Commit an edit transaction and publish the result.
+ * @txn: Pointer to begun transaction.
+ *
+ * The transaction is committed, see edit_commit(), and the new version of
+ * the scene published with the dirty list of the commit. Commits from
+ * several threads, e.g. scene deltas received by the server, are applied
+ * one at a time.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int snapshot_commit (edit_txn_t *txn)
+{
+   scene_t *scene = txn->scene;
+   unsigned long version;
+   int rc = 1;
+
+   if (!scene)
+      return 1;
+
+   pthread_mutex_lock (&commit_lock);
+   version = scene_get_version (scene);
+   if (!edit_commit (txn))
+      rc = scene_get_version (scene) != version &&
+           snapshot_publish (scene, txn->dirty, txn->num_dirty);
+   pthread_mutex_unlock (&commit_lock);
+
+   return rc;
+}
+
+/**
+ * snapshot_pin - Pin the current snapshot.
+ *
+ * The snapshot stays unchanged, and allocated, until it's unpinned with
+ * snapshot_unpin(), however the scene is edited meanwhile.
+ *
+ * Returns:
+ * Pointer to the current snapshot, or NULL if none is published.
+ */
+snapshot_t* snapshot_pin (void)
+{
+   snapshot_t *snap;
+
+   pthread_mutex_lock (&current_lock);
+   snap = current;
+   if (snap)
+      __atomic_add_fetch (&snap->refs, 1, __ATOMIC_RELAXED);
+   pthread_mutex_unlock (&current_lock);
+
+   return snap;
+}
+
+/**
+ * snapshot_get_scene - Get a pinned snapshot as a scene.
+ * @snap: Pointer to pinned snapshot.
+ *
+ * The first call for a snapshot gathers its chunks into a scene object,
+ * which is then used by all renders of the snapshot. The scene of the last
+ * freed snapshot is reused, usually the previous version, and only its
+ * chunks which differ from the chunks of @snap are copied, unless the
+ * camera was moved, which moves every sphere relative to it. The scene
+ * must not be changed.
+ *
+ * Returns:
+ * Pointer to scene object, or NULL on error.
+ */
+scene_t* snapshot_get_scene (snapshot_t *snap)
+{
+   const int max = snap->num_spheres ? snap->num_spheres : 1;
+   snapshot_t *old;
+   scene_t *scene;
+   int i, j, rebase;
+
+   pthread_mutex_lock (&snap->lock);
+
+   if (snap->scene)
+      goto out;
+
+   pthread_mutex_lock (&spare_lock);
+   old   = spare;
+   spare = NULL;
+   pthread_mutex_unlock (&spare_lock);
+
+   scene = old ? old->scene : calloc (1, sizeof(*scene));
+   if (scene && max > scene->max_spheres)
+   {
+      sphere_t *sphere = realloc (scene->sphere, max * sizeof(sphere_t));
+      dvector_t *center;
+
+      if (sphere)
+         scene->sphere = sphere;
+      center = realloc (scene->center, max * sizeof(dvector_t));
+      if (center)
+         scene->center = center;
+      if (sphere && center)
+         scene->max_spheres = max;
+   }
+   if (!scene || max > scene->max_spheres)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for snapshot\n");
+      if (old)
+         snapshot_destroy (old);
+      else if (scene)
+      {
+         free (scene->sphere);
+         free (scene->center);
+         free (scene);
+      }
+      pthread_mutex_unlock (&snap->lock);
+      return NULL;
+   }
+
+   /* The spheres of a chunk copied for another camera position are moved */
+   rebase = !old || memcmp (&old->origin, &snap->origin, sizeof(dvector_t));
+
+   scene->cam         = snap->cam;
+   scene->origin      = snap->origin;
+   scene->num_spheres = snap->num_spheres;
+   scene->version     = snap->version;
+   for (i = 0; i < snap->num_chunks; i++)
+   {
+      const snapshot_chunk_t *chunk = snap->chunk[i];
+      int first = i * SNAPSHOT_CHUNK;
+      int n = snap->num_spheres - first < SNAPSHOT_CHUNK ?
+              snap->num_spheres - first : SNAPSHOT_CHUNK;
+
+      /* Chunks are never changed, so the same chunk holds the same spheres */
+      if (!rebase && i < old->num_chunks && old->chunk[i] == chunk &&
+          first + n <= old->num_spheres)
+         continue;
+
+      memcpy (scene->sphere + first, chunk->sphere, n * sizeof(sphere_t));
+      for (j = first; j < first + n; j++)
+         scene_set_sphere_center (scene, j, chunk->center[j - first].x,
+                                  chunk->center[j - first].y,
+                                  chunk->center[j - first].z);
+   }
+   snap->scene = scene;
+
+   if (old)
+   {
+      old->scene = NULL;
+      snapshot_destroy (old);
+   }
+
+out:
+   pthread_mutex_unlock (&snap->lock);
+
+   return snap->scene;
+}
+
+/**
+ * snapshot_unpin - Unpin a snapshot.
+ * @snap: Pointer to snapshot pinned with snapshot_pin().
+ *
+ * A snapshot which is no longer current is freed when its last pin is
+ * dropped.
+ *
+ * Returns:
+ * none.
+ */
+void snapshot_unpin (snapshot_t *snap)
+{
+   if (__atomic_sub_fetch (&snap->refs, 1, __ATOMIC_ACQ_REL) == 0)
+      snapshot_free (snap);
+}
+
+/**
+ * snapshot_get_stats - Get snapshot statistics.
+ * @stats: Pointer where to return the statistics.
+ *
+ * Returns:
+ * none.
+ */
+void snapshot_get_stats (snapshot_stats_t *stats)
+{
+   pthread_mutex_lock (&current_lock);
+   stats->version = current ? current->version : 0;
+   pthread_mutex_unlock (&current_lock);
+
+   stats->snapshots = __atomic_load_n (&num_snapshots, __ATOMIC_RELAXED);
+   stats->chunks    = __atomic_load_n (&num_chunks, __ATOMIC_RELAXED);
+   stats->copied    = num_copied;
+   stats->shared    = num_shared;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,605 @@
+/**
+ * span.c - Span class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines the span pipeline, which renders each row of the
+ * screen as runs of a single color and hands them to a sink, without ever
+ * holding the pixels of the image.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "kernel.h"
+#include "render.h"
+#include "ssil/tga.h"
+#include "ssil/png.h"
+
+#include "span.h"
+
+/* Sphere overlapping a row, see span_row() */
+typedef struct {
+   int x0;   /* First column of its screen bounds */
+   int x1;   /* Column after the last column of its screen bounds */
+   int id;   /* Array ID */
+} span_cand_t;
+
+/**
+ * span_cmp_cand - Compare spheres by first column, for qsort().
+ * @a: Pointer to first sphere.
+ * @b: Pointer to second sphere.
+ *
+ * Returns:
+ * Negative, zero or positive as @a starts before, with or after @b.
+ */
+static int span_cmp_cand (const void *a, const void *b)
+{
+   return ((const span_cand_t *)a)->x0 - ((const span_cand_t *)b)->x0;
+}
+
+/**
+ * span_cmp_id - Compare array IDs, for qsort().
+ * @a: Pointer to first ID.
+ * @b: Pointer to second ID.
+ *
+ * Returns:
+ * Negative, zero or positive as @a is less than, equal to or greater than @b.
+ */
+static int span_cmp_id (const void *a, const void *b)
+{
+   return *(const int *)a - *(const int *)b;
+}
+
+/**
+ * span_background - Add background pixels to a row.
+ * @span: Pointer to the spans of the row so far.
+ * @n:    Number of spans in @span.
+ * @x0:   First column.
+ * @x1:   Column after the last column.
+ *
+ * Returns:
+ * Number of spans in @span.
+ */
+static int span_background (span_t *span, int n, int x0, int x1)
+{
+   static const uint8_t black[3] = { 0, 0, 0 };
+
+   if (x0 >= x1)
+      return n;
+   if (n && span[n - 1].x1 == x0 && !memcmp (span[n - 1].color, black, 3))
+   {
+      span[n - 1].x1 = x1;
+      return n;
+   }
+   span[n].x0 = x0;
+   span[n].x1 = x1;
+   memcpy (span[n].color, black, 3);
+
+   return n + 1;
+}
+
+/**
+ * span_row - Render a row as spans.
+ * @ctx:    Pointer to render context, with the screen bounds of the spheres.
+ * @y:      Row.
+ * @cand:   Pointer to the spheres whose screen bounds cover row @y, sorted
+ *          in place.
+ * @num:    Number of spheres in @cand.
+ * @ids:    Pointer to room for @num array IDs.
+ * @span:   Pointer to room for a span for each column.
+ * @traced: Pointer to number of traced pixels, updated.
+ *
+ * The screen bounds of the spheres in the row are merged into intervals.
+ * Pixels outside them can't hit any sphere and become background spans
+ * without being traced, pixels inside them are traced against the spheres
+ * of their interval only, see kernel_spans().
+ *
+ * Returns:
+ * Number of spans of the row.
+ */
+static int span_row (kernel_ctx_t *ctx, int y, span_cand_t *cand, int num,
+                     int *ids, span_t *span, uint64_t *traced)
+{
+   int x = 0;   /* Column after the last column in @span */
+   int n = 0;
+   int i = 0;
+
+   qsort (cand, num, sizeof(*cand), span_cmp_cand);
+   while (i < num)
+   {
+      int x0 = cand[i].x0;
+      int x1 = cand[i].x1;
+      int k  = 0;
+
+      for (; i < num && cand[i].x0 < x1; i++)
+      {
+         if (cand[i].x1 > x1)
+            x1 = cand[i].x1;
+         ids[k++] = cand[i].id;
+      }
+      qsort (ids, k, sizeof(*ids), span_cmp_id);
+
+      n = span_background (span, n, x, x0);
+      n = kernel_spans (ctx, y, x0, x1, ids, k, span, n);
+      *traced += x1 - x0;
+      x = x1;
+   }
+
+   return span_background (span, n, x, ctx->screen_width);
+}
+
+/**
+ * span_pixels - Turn a rendered row into spans.
+ * @row:   Pointer to the RGB24 pixels of the row.
+ * @width: Number of pixels in @row.
+ * @span:  Pointer to room for a span for each column.
+ *
+ * Returns:
+ * Number of spans of the row.
+ */
+static int span_pixels (const uint8_t *row, int width, span_t *span)
+{
+   int x, n = 0;
+
+   for (x = 0; x < width; x++)
+   {
+      if (n && !memcmp (span[n - 1].color, row + x * 3, 3))
+      {
+         span[n - 1].x1 = x + 1;
+         continue;
+      }
+      span[n].x0 = x;
+      span[n].x1 = x + 1;
+      memcpy (span[n].color, row + x * 3, 3);
+      n++;
+   }
+
+   return n;
+}
+
+/**
+ * span_render - Render a scene as spans.
+ * @screen_width:  Width of the rendered screen.
+ * @screen_height: Height of the rendered screen.
+ * @scene:         Pointer to scene object.
+ * @sink:          Pointer to sink of the rows.
+ * @stats:         Pointer where to return statistics, or NULL.
+ *
+ * This function renders @scene a row at a time, as spans of a single color
+ * covering the row, and passes each row to @sink. The spans give the same
+ * image as render_scene(), where runs of pixels of the same color are a
+ * single span whatever their width, so large frames of few spheres are
+ * rendered with little memory, and only the pixels within the screen bounds
+ * of a sphere are traced. The spheres covering each row are kept in an
+ * active list, updated as the rows are rendered. If spheres are splatted,
+ * see kernel_set_lod(), each row is instead rendered as a tile with the
+ * splats, see render_tile_ctx(), and its pixels are merged into spans.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int span_render (int screen_width,
+                 int screen_height,
+                 scene_t *scene,
+                 span_sink_t *sink,
+                 span_stats_t *stats)
+{
+   const int num = scene_get_num_spheres (scene);
+   const int step = sink->top_down ? -1 : 1;
+   kernel_ctx_t ctx;
+   span_stats_t st;
+   span_cand_t *cand = NULL;
+   span_t *span = NULL;
+   int *start = NULL;   /* First sphere starting in each row */
+   int *next  = NULL;   /* Next sphere starting in the same row */
+   int *ids   = NULL;
+   uint8_t *row = NULL;   /* Pixels of a row, if spheres are splatted */
+   int i, y, num_cand = 0;
+   int rc = 1;
+
+   memset (&st, 0, sizeof(st));
+   if (screen_width < 1 || screen_height < 1)
+      return 1;
+   if (render_init (&ctx, scene, screen_width, screen_height, KERNEL_FMT_RGB24))
+      return 1;
+
+   if (ctx.num_splat)
+   {
+      row  = malloc ((size_t)screen_width * 3);
+      span = malloc ((size_t)screen_width * sizeof(span_t));
+      if (!row || !span)
+      {
+         fprintf (stderr, "error: Unable to alloc memory for span render\n");
+         goto out;
+      }
+      for (y = sink->top_down ? screen_height - 1 : 0;
+           y >= 0 && y < screen_height; y += step)
+      {
+         int n;
+
+         if (render_tile_ctx (&ctx, row, (size_t)screen_width * 3,
+                              0, y, screen_width, y + 1))
+            goto out;
+         n = span_pixels (row, screen_width, span);
+         st.spans  += n;
+         st.traced += screen_width;
+         if (sink->row (sink->data, y, span, n))
+            goto out;
+      }
+      rc = 0;
+      goto out;
+   }
+
+   start = malloc ((size_t)screen_height * sizeof(int));
+   next  = malloc ((num ? num : 1) * sizeof(int));
+   ids   = malloc ((num ? num : 1) * sizeof(int));
+   cand  = malloc ((num ? num : 1) * sizeof(span_cand_t));
+   span  = malloc ((size_t)screen_width * sizeof(span_t));
+   if (!start || !next || !ids || !cand || !span)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for span render\n");
+      goto out;
+   }
+   if (kernel_init_bounds (&ctx))
+      goto out;
+
+   /* Bucket the spheres by their first row in render order */
+   for (y = 0; y < screen_height; y++)
+      start[y] = -1;
+   for (i = num - 1; i >= 0; i--)
+   {
+      const int *b = &ctx.bounds[i * 4];
+
+      if (b[0] < b[2] && b[1] < b[3])
+      {
+         y = sink->top_down ? b[3] - 1 : b[1];
+         next[i]  = start[y];
+         start[y] = i;
+      }
+   }
+
+   for (y = sink->top_down ? screen_height - 1 : 0;
+        y >= 0 && y < screen_height; y += step)
+   {
+      int n;
+
+      /* Drop the spheres which ended, and add the ones starting */
+      for (i = 0; i < num_cand; )
+      {
+         const int *b = &ctx.bounds[cand[i].id * 4];
+
+         if (y < b[1] || y >= b[3])
+            cand[i] = cand[--num_cand];
+         else
+            i++;
+      }
+      for (i = start[y]; i >= 0; i = next[i])
+      {
+         cand[num_cand].x0 = ctx.bounds[i * 4];
+         cand[num_cand].x1 = ctx.bounds[i * 4 + 2];
+         cand[num_cand].id = i;
+         num_cand++;
+      }
+
+      n = span_row (&ctx, y, cand, num_cand, ids, span, &st.traced);
+      st.spans += n;
+      if (sink->row (sink->data, y, span, n))
+         goto out;
+   }
+   rc = 0;
+
+out:
+   kernel_done (&ctx);
+   free (start);
+   free (next);
+   free (ids);
+   free (cand);
+   free (span);
+   free (row);
+   if (stats)
+      *stats = st;
+
+   return rc;
+}
+
+/* File written by span_write() */
+typedef struct {
+   FILE         *fp;
+   png_stream_t *png;     /* PNG stream, or NULL for TGA */
+   uint64_t      bytes;   /* Bytes written */
+} span_file_t;
+
+/**
+ * span_tga_row - Write a row to a run-length encoded TGA file.
+ * @data: Pointer to file.
+ * @y:    Row.
+ * @span: Pointer to the spans of the row.
+ * @num:  Number of spans.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+static int span_tga_row (void *data, int y, const span_t *span, int num)
+{
+   span_file_t *f = data;
+   int i;
+
+   (void)y;
+   for (i = 0; i < num; i++)
+   {
+      size_t len = tga_rle_run (f->fp, span[i].color, span[i].x1 - span[i].x0);
+
+      if (!len)
+         return 1;
+      f->bytes += len;
+   }
+
+   return 0;
+}
+
+/**
+ * span_png_row - Write a row to a PNG stream.
+ * @data: Pointer to file.
+ * @y:    Row.
+ * @span: Pointer to the spans of the row.
+ * @num:  Number of spans.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+static int span_png_row (void *data, int y, const span_t *span, int num)
+{
+   span_file_t *f = data;
+   int i;
+
+   (void)y;
+   for (i = 0; i < num; i++)
+      if (png_stream_run (f->png, span[i].color, span[i].x1 - span[i].x0))
+         return 1;
+
+   return 0;
+}
+
+/**
+ * span_write - Render a scene as spans to an image file.
+ * @fname:         Image file name, ending with ".png" for a PNG image, or
+ *                 else a run-length encoded TGA image is written.
+ * @screen_width:  Width of the rendered screen.
+ * @screen_height: Height of the rendered screen.
+ * @scene:         Pointer to scene object.
+ * @stats:         Pointer where to return statistics, or NULL.
+ *
+ * Each span is written as a run of its color, see tga_rle_run() and
+ * png_stream_run(), so both the memory used and the size of the file
+ * follow the number of spans rather than the number of pixels.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int span_write (const char *fname,
+                int screen_width,
+                int screen_height,
+                scene_t *scene,
+                span_stats_t *stats)
+{
+   const size_t len = strlen (fname);
+   span_file_t f;
+   span_sink_t sink;
+   int rc = 1;
+
+   memset (&f, 0, sizeof(f));
+   memset (&sink, 0, sizeof(sink));
+   sink.data = &f;
+   if (stats)
+      memset (stats, 0, sizeof(*stats));
+
+   if (len > 4 && !strcmp (fname + len - 4, ".png"))
+   {
+      f.png = malloc (sizeof(*f.png));
+      if (!f.png)
+      {
+         fprintf (stderr, "error: Unable to alloc memory for PNG stream\n");
+         return 1;
+      }
+      sink.top_down = 1;
+      sink.row      = span_png_row;
+   }
+   else
+   {
+      if (screen_width > 65535 || screen_height > 65535)
+      {
+         fprintf (stderr, "error: TGA images are at most 65535x65535 pixels\n");
+         return 1;
+      }
+      sink.row = span_tga_row;
+   }
+
+   f.fp = fopen (fname, "w");
+   if (!f.fp)
+   {
+      fprintf (stderr, "error: Unable to create %s\n", fname);
+      free (f.png);
+      return 1;
+   }
+
+   if (f.png ? png_stream_begin (f.png, f.fp, screen_width, screen_height) :
+               tga_rle_begin (f.fp, screen_width, screen_height))
+      goto out;
+   if (span_render (screen_width, screen_height, scene, &sink, stats))
+      goto out;
+   if (f.png && png_stream_end (f.png))
+      goto out;
+   rc = 0;
+
+out:
+   if (fclose (f.fp))
+      rc = 1;
+   if (rc)
+      fprintf (stderr, "error: Unable to write %s\n", fname);
+   if (stats)
+      stats->bytes = f.png ? f.png->size : f.bytes + 18;
+   free (f.png);
+
+   return rc;
+}
+
+/**
+ * span_buf_init - Create a span buffer in shared memory.
+ * @buf:    Pointer to span buffer.
+ * @width:  Width of the screen.
+ * @height: Height of the screen.
+ * @max:    Number of spans to make room for, or 0 for SPAN_BUF_PER_ROW
+ *          for each row.
+ *
+ * The buffer is mapped shared, so it can be filled by a forked process, as
+ * the image of mproc_render(), and rows may be added by several processes
+ * at once. It holds at most @max spans.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int span_buf_init (span_buf_t *buf, int width, int height, uint64_t max)
+{
+   uint8_t *map;
+
+   memset (buf, 0, sizeof(*buf));
+   if (width < 1 || height < 1)
+      return 1;
+   if (!max)
+      max = (uint64_t)height * SPAN_BUF_PER_ROW;
+
+   buf->width  = width;
+   buf->height = height;
+   buf->max    = max;
+   buf->map_sz = (size_t)height * (sizeof(uint64_t) + sizeof(int)) +
+                 (size_t)max * sizeof(span_t);
+
+   map = mmap (NULL, buf->map_sz, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+   if (map == MAP_FAILED)
+   {
+      fprintf (stderr, "error: Unable to map span buffer\n");
+      return 1;
+   }
+
+   /* Rows not rendered yet have no spans */
+   buf->first = (uint64_t *)map;
+   buf->count = (int *)(buf->first + height);
+   buf->span  = (span_t *)(map + (size_t)height * (sizeof(uint64_t) + sizeof(int)));
+
+   return 0;
+}
+
+/**
+ * span_buf_free - Free a span buffer.
+ * @buf: Pointer to span buffer.
+ *
+ * Returns:
+ * none.
+ */
+void span_buf_free (span_buf_t *buf)
+{
+   if (buf->first)
+      munmap (buf->first, buf->map_sz);
+   memset (buf, 0, sizeof(*buf));
+}
+
+/**
+ * span_buf_row - Add a row to a span buffer.
+ * @data: Pointer to span buffer.
+ * @y:    Row.
+ * @span: Pointer to the spans of the row.
+ * @num:  Number of spans.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if the buffer is full.
+ */
+static int span_buf_row (void *data, int y, const span_t *span, int num)
+{
+   span_buf_t *buf = data;
+   uint64_t first  = __atomic_fetch_add (&buf->num, num, __ATOMIC_RELAXED);
+
+   if (y < 0 || y >= buf->height || first + num > buf->max)
+   {
+      fprintf (stderr, "error: Span buffer is full\n");
+      return 1;
+   }
+
+   memcpy (&buf->span[first], span, num * sizeof(*span));
+   buf->first[y] = first;
+   buf->count[y] = num;
+
+   return 0;
+}
+
+/**
+ * span_buf_sink - Get a sink filling a span buffer.
+ * @buf:  Pointer to span buffer.
+ * @sink: Pointer where to return the sink.
+ *
+ * Returns:
+ * none.
+ */
+void span_buf_sink (span_buf_t *buf, span_sink_t *sink)
+{
+   memset (sink, 0, sizeof(*sink));
+   sink->row  = span_buf_row;
+   sink->data = buf;
+}
+
+/**
+ * span_buf_fill - Draw the spans of a span buffer into an image.
+ * @buf:      Pointer to span buffer.
+ * @image:    Pointer to image buffer, in the layout of the rendered image.
+ * @image_sz: Size of @image buffer.
+ *
+ * Rows without spans are left untouched.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if @image is too small.
+ */
+int span_buf_fill (span_buf_t *buf, uint8_t *image, size_t image_sz)
+{
+   int y, i, x;
+
+   if (image_sz < (size_t)buf->width * buf->height * 3)
+      return 1;
+
+   for (y = 0; y < buf->height; y++)
+   {
+      uint8_t *row = image + (size_t)y * buf->width * 3;
+
+      for (i = 0; i < buf->count[y]; i++)
+      {
+         const span_t *s = &buf->span[buf->first[y] + i];
+
+         for (x = s->x0; x < s->x1; x++)
+            memcpy (row + (size_t)x * 3, s->color, 3);
+      }
+   }
+
+   return 0;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
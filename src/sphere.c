@@ -122,6 +122,42 @@ float sphere_intersect (sphere_t* sphere, ray_t* ray)
    return v - sqrt(d2);
 }
 
+/**
+ * sphere_intersect_tier - Check ray intersection at a given precision.
+ * @sphere: Pointer to sphere object
+ * @ray:    Pointer to normalized ray object
+ * @p:      Precision tier
+ *
+ * This function works as sphere_intersect(). The fast tiers take c² straight
+ * from the dot product of O-E with itself instead of squaring its length,
+ * and compute d with the square root of tier @p.
+ *
+ * Returns:
+ * Distance from @ray origin to the @sphere intersection point or 0 if no
+ * intersection was found.
+ */
+float sphere_intersect_tier (sphere_t* sphere, ray_t* ray, precision_t p)
+{
+   vector_t oe;   /* O-E vector in fig 1. */
+   float    v;    /* Length of E-A vector, i.e. v in fig 1. */
+   float    d2;   /* Computed d² value from formula (3). */
+
+   if (p == PRECISION_EXACT)
+      return sphere_intersect (sphere, ray);
+
+   vector_sub (&oe, &sphere->center, &ray->origin);
+
+   v = vector_dot (&oe, &ray->dir);
+   if (v < 0)
+      return 0.0;
+
+   d2 = (sphere->radius * sphere->radius) - vector_dot (&oe, &oe) + (v * v);
+   if (d2 < 0)
+      return 0.0;
+
+   return v - precision_sqrt (d2, p);
+}
+
 /**
  * Local Variables:
  *  c-file-style: "ellemtel"
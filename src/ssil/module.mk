@@ -1,5 +1,5 @@
 MODULES :=
 MODDIR  := src/ssil
-MODOBJS := tga.o
+MODOBJS := tga.o png.o
 
 include eval.mk
@@ -0,0 +1,602 @@
+/**
+ * png.c - PNG image class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * PNG image class.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "ssil/png.h"
+
+/* Largest payload of a stored (uncompressed) deflate block */
+#define PNG_BLOCK_MAX 65535
+
+/* Size of chunk length, type and CRC around chunk data */
+#define PNG_CHUNK_SZ  12
+
+/* CRC-32 of each byte value, filled once by png_crc_init() */
+static uint32_t       crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+/**
+ * png_crc_init - Fill the CRC-32 table.
+ *
+ * Run with pthread_once(), images may be encoded by many threads at once.
+ *
+ * Returns:
+ * none.
+ */
+static void png_crc_init (void)
+{
+   uint32_t i;
+
+   for (i = 0; i < 256; i++)
+   {
+      uint32_t c = i;
+      int k;
+
+      for (k = 0; k < 8; k++)
+         c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      crc_table[i] = c;
+   }
+}
+
+/**
+ * png_crc - Calculate CRC-32 as used by PNG.
+ * @crc: CRC of preceding data, 0 to start.
+ * @buf: Pointer to data.
+ * @len: Number of bytes in @buf.
+ *
+ * Returns:
+ * Updated CRC.
+ */
+static uint32_t png_crc (uint32_t crc, const uint8_t *buf, size_t len)
+{
+   size_t i;
+
+   pthread_once (&crc_once, png_crc_init);
+
+   crc = ~crc;
+   for (i = 0; i < len; i++)
+      crc = crc_table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+
+   return ~crc;
+}
+
+/**
+ * png_adler - Calculate Adler-32 as used by zlib.
+ * @adler: Adler-32 of preceding data, 1 to start.
+ * @buf:   Pointer to data.
+ * @len:   Number of bytes in @buf.
+ *
+ * The modulo is only taken every 5552 bytes, the most that can be summed
+ * without overflowing 32 bits.
+ *
+ * Returns:
+ * Updated Adler-32.
+ */
+static uint32_t png_adler (uint32_t adler, const uint8_t *buf, size_t len)
+{
+   uint32_t s1 = adler & 0xffff;
+   uint32_t s2 = adler >> 16;
+
+   while (len)
+   {
+      size_t n = len < 5552 ? len : 5552;
+
+      len -= n;
+      while (n--)
+      {
+         s1 += *buf++;
+         s2 += s1;
+      }
+      s1 %= 65521;
+      s2 %= 65521;
+   }
+
+   return (s2 << 16) | s1;
+}
+
+/**
+ * png_put32 - Store a big endian 32 bit value.
+ * @p: Pointer to buffer.
+ * @v: Value.
+ *
+ * Returns:
+ * Pointer to the byte after the value.
+ */
+static uint8_t* png_put32 (uint8_t *p, uint32_t v)
+{
+   p[0] = v >> 24;
+   p[1] = v >> 16;
+   p[2] = v >> 8;
+   p[3] = v;
+
+   return p + 4;
+}
+
+/**
+ * png_chunk_end - Finish a chunk by storing its length and CRC.
+ * @chunk: Pointer to start of chunk.
+ * @len:   Length of chunk data.
+ *
+ * Returns:
+ * Pointer to the byte after the chunk.
+ */
+static uint8_t* png_chunk_end (uint8_t *chunk, size_t len)
+{
+   png_put32 (chunk, len);
+
+   return png_put32 (chunk + 8 + len, png_crc (0, chunk + 4, len + 4));
+}
+
+/**
+ * png_size - Get size of an encoded PNG image.
+ * @width:  Image width.
+ * @height: Image height.
+ *
+ * Returns:
+ * Number of bytes png_encode() needs for the image.
+ */
+size_t png_size (int width, int height)
+{
+   size_t raw = (size_t)height * (1 + (size_t)width * 3);
+   size_t num_blocks = (raw + PNG_BLOCK_MAX - 1) / PNG_BLOCK_MAX;
+
+   return 8 +                                  /* Signature */
+      PNG_CHUNK_SZ + 13 +                      /* IHDR */
+      PNG_CHUNK_SZ + 2 + raw + 5 * num_blocks + 4 + /* IDAT, zlib stream */
+      PNG_CHUNK_SZ;                            /* IEND */
+}
+
+/**
+ * png_encode - Creates a PNG image in memory.
+ * @buf:    Pointer to output buffer.
+ * @len:    Size of @buf, at least png_size().
+ * @width:  Image width.
+ * @height: Image height.
+ * @image:  Pointer to image buffer.
+ *
+ * This funciton will encode @image as a PNG image in @buf. The image data is
+ * read from @image which should be an array of @width x @height pixel
+ * elements, where each pixel is represented by a a 24 bit color value,
+ * described in three bytes for the red, green and blue component. As for
+ * tga_write(), the first pixel in @image is the lower left corner.
+ * The image data is stored without compression, which keeps the encoder
+ * fast and simple; any PNG reader can still decode it.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if @buf is too small.
+ */
+int png_encode (uint8_t *buf, size_t len, int width, int height, const uint8_t *image)
+{
+   static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+   const size_t row_sz = (size_t)width * 3;
+   const size_t raw = (size_t)height * (1 + row_sz);
+   uint32_t adler = 1;
+   uint8_t *chunk;
+   uint8_t *p = buf;
+   size_t left;               /* Raw bytes left of the zlib stream */
+   size_t block;              /* Raw bytes left of the current block */
+   size_t ofs;                /* Offset in the current row, 0 is the filter byte */
+   int y;
+
+   assert (image);
+
+   if (len < png_size (width, height))
+      return 1;
+
+   memcpy (p, sig, sizeof(sig));
+   p += sizeof(sig);
+
+   /* Header: size, 8 bits per sample, true color, no interlace */
+   chunk = p;
+   memcpy (chunk + 4, "IHDR", 4);
+   p = png_put32 (chunk + 8, width);
+   p = png_put32 (p, height);
+   *p++ = 8;
+   *p++ = 2;
+   *p++ = 0;
+   *p++ = 0;
+   *p++ = 0;
+   p = png_chunk_end (chunk, 13);
+
+   /* Image data, a zlib stream of stored deflate blocks. Each row starts
+    * with filter type 0 (none) and rows are stored top row first. */
+   chunk = p;
+   memcpy (chunk + 4, "IDAT", 4);
+   p = chunk + 8;
+   *p++ = 0x78;
+   *p++ = 0x01;
+
+   left  = raw;
+   block = 0;
+   y     = height - 1;
+   ofs   = 0;
+   while (left)
+   {
+      size_t n;
+
+      if (!block)
+      {
+         block = left < PNG_BLOCK_MAX ? left : PNG_BLOCK_MAX;
+         *p++ = block == left;   /* Last block flag, type stored */
+         *p++ = block;
+         *p++ = block >> 8;
+         *p++ = ~block;
+         *p++ = ~block >> 8;
+      }
+
+      if (ofs == 0)
+      {
+         *p = 0;
+         adler = png_adler (adler, p++, 1);
+         ofs++;
+         block--;
+         left--;
+         continue;
+      }
+
+      n = row_sz + 1 - ofs;
+      if (n > block)
+         n = block;
+      memcpy (p, image + (size_t)y * row_sz + ofs - 1, n);
+      adler = png_adler (adler, p, n);
+      p     += n;
+      ofs   += n;
+      block -= n;
+      left  -= n;
+
+      if (ofs == row_sz + 1)
+      {
+         ofs = 0;
+         y--;
+      }
+   }
+   p = png_put32 (p, adler);
+   p = png_chunk_end (chunk, p - chunk - 8);
+
+   /* End */
+   chunk = p;
+   memcpy (chunk + 4, "IEND", 4);
+   png_chunk_end (chunk, 0);
+
+   return 0;
+}
+
+/**
+ * png_stream_write - Write to the file of a PNG stream.
+ * @s:   Pointer to stream.
+ * @buf: Pointer to data.
+ * @len: Number of bytes in @buf.
+ *
+ * Returns:
+ * none, a failed write is recorded in the stream.
+ */
+static void png_stream_write (png_stream_t *s, const uint8_t *buf, size_t len)
+{
+   if (len && fwrite (buf, len, 1, s->fp) != 1)
+      s->err = 1;
+   s->size += len;
+}
+
+/**
+ * png_stream_flush - Write the buffered data as an IDAT chunk.
+ * @s: Pointer to stream.
+ *
+ * Returns:
+ * none.
+ */
+static void png_stream_flush (png_stream_t *s)
+{
+   uint8_t hdr[8];
+   uint8_t crc[4];
+
+   if (!s->len)
+      return;
+
+   png_put32 (hdr, s->len);
+   memcpy (hdr + 4, "IDAT", 4);
+   png_put32 (crc, png_crc (png_crc (0, hdr + 4, 4), s->buf, s->len));
+   png_stream_write (s, hdr, sizeof(hdr));
+   png_stream_write (s, s->buf, s->len);
+   png_stream_write (s, crc, sizeof(crc));
+   s->len = 0;
+}
+
+/**
+ * png_stream_bits - Add bits to the deflate stream.
+ * @s:     Pointer to stream.
+ * @value: Bits, the first one in bit 0.
+ * @num:   Number of bits, at most 16.
+ *
+ * Returns:
+ * none.
+ */
+static void png_stream_bits (png_stream_t *s, uint32_t value, int num)
+{
+   s->bits |= value << s->num_bits;
+   s->num_bits += num;
+   while (s->num_bits >= 8)
+   {
+      s->buf[s->len++] = s->bits;
+      s->bits >>= 8;
+      s->num_bits -= 8;
+   }
+   if (s->len > PNG_STREAM_BUF - 8)
+      png_stream_flush (s);
+}
+
+/**
+ * png_stream_code - Add a Huffman code to the deflate stream.
+ * @s:    Pointer to stream.
+ * @code: Code.
+ * @num:  Number of bits of @code.
+ *
+ * Huffman codes are stored starting with their most significant bit.
+ *
+ * Returns:
+ * none.
+ */
+static void png_stream_code (png_stream_t *s, uint32_t code, int num)
+{
+   uint32_t rev = 0;
+   int i;
+
+   for (i = 0; i < num; i++)
+      rev |= ((code >> i) & 1) << (num - 1 - i);
+   png_stream_bits (s, rev, num);
+}
+
+/**
+ * png_stream_symbol - Add a literal/length symbol to the deflate stream.
+ * @s:   Pointer to stream.
+ * @sym: Symbol, 0-255 is a literal byte.
+ *
+ * The symbols are coded with the fixed Huffman codes of deflate.
+ *
+ * Returns:
+ * none.
+ */
+static void png_stream_symbol (png_stream_t *s, int sym)
+{
+   if (sym < 144)
+      png_stream_code (s, 0x30 + sym, 8);
+   else if (sym < 256)
+      png_stream_code (s, 0x190 + sym - 144, 9);
+   else if (sym < 280)
+      png_stream_code (s, sym - 256, 7);
+   else
+      png_stream_code (s, 0xc0 + sym - 280, 8);
+}
+
+/**
+ * png_stream_repeat - Add a copy of the previous pixel to the deflate stream.
+ * @s:   Pointer to stream.
+ * @len: Number of bytes to copy, 3 to 258.
+ *
+ * Returns:
+ * none.
+ */
+static void png_stream_repeat (png_stream_t *s, int len)
+{
+   static const uint16_t base[29] = {
+      3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+      35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+   };
+   static const uint8_t extra[29] = {
+      0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+      3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+   };
+   int i = 28;
+
+   while (base[i] > len)
+      i--;
+   png_stream_symbol (s, 257 + i);
+   if (extra[i])
+      png_stream_bits (s, len - base[i], extra[i]);
+
+   /* Distance 3, code 2 of the fixed distance codes */
+   png_stream_code (s, 2, 5);
+}
+
+/**
+ * png_stream_adler - Add a run of a pixel to an Adler-32.
+ * @adler: Adler-32 of preceding data.
+ * @rgb:   Pointer to pixel.
+ * @count: Number of pixels.
+ *
+ * Returns:
+ * Updated Adler-32, computed without going through the pixels.
+ */
+static uint32_t png_stream_adler (uint32_t adler, const uint8_t *rgb, uint64_t count)
+{
+   const uint64_t mod = 65521;
+   const uint64_t sum = rgb[0] + rgb[1] + rgb[2];
+   const uint64_t tri = 3 * rgb[0] + 2 * rgb[1] + rgb[2];
+   const uint64_t k   = count % mod;
+   uint64_t s1 = adler & 0xffff;
+   uint64_t s2 = adler >> 16;
+   uint64_t pairs;   /* count * (count - 1) / 2 */
+
+   pairs = count & 1 ? k * (((count - 1) / 2) % mod) % mod :
+                       ((count / 2) % mod) * ((count + mod - 1) % mod) % mod;
+
+   /* Each pixel adds the sum of its bytes to s1, and three times s1 before
+    * it plus 3r + 2g + b to s2 */
+   s2 = (s2 + 3 * k * s1 + 3 * sum % mod * pairs + k * tri) % mod;
+   s1 = (s1 + k * sum) % mod;
+
+   return (s2 << 16) | s1;
+}
+
+/**
+ * png_stream_begin - Start writing a PNG image to a file.
+ * @s:      Pointer to stream.
+ * @fp:     File to write to.
+ * @width:  Image width.
+ * @height: Image height.
+ *
+ * This function will write the header of the image, and then each row is
+ * written as runs of pixels by png_stream_run(), starting with the top row
+ * as in a PNG image. The image is finished by png_stream_end().
+ * Unlike png_encode(), the image data is compressed: each run is coded as
+ * a pixel followed by copies of the previous pixel, so the size of the
+ * image is proportional to the number of runs rather than of pixels.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int png_stream_begin (png_stream_t *s, FILE *fp, int width, int height)
+{
+   static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+   uint8_t ihdr[PNG_CHUNK_SZ + 13];
+   uint8_t *p;
+
+   if (width < 1 || height < 1)
+      return 1;
+
+   memset (s, 0, offsetof (png_stream_t, buf));
+   s->fp     = fp;
+   s->width  = width;
+   s->height = height;
+   s->adler  = 1;
+
+   png_stream_write (s, sig, sizeof(sig));
+
+   /* Header: size, 8 bits per sample, true color, no interlace */
+   memcpy (ihdr + 4, "IHDR", 4);
+   p = png_put32 (ihdr + 8, width);
+   p = png_put32 (p, height);
+   *p++ = 8;
+   *p++ = 2;
+   *p++ = 0;
+   *p++ = 0;
+   *p++ = 0;
+   png_chunk_end (ihdr, 13);
+   png_stream_write (s, ihdr, sizeof(ihdr));
+
+   /* zlib header, then a single deflate block with fixed codes */
+   s->buf[s->len++] = 0x78;
+   s->buf[s->len++] = 0x01;
+   png_stream_bits (s, 1, 1);
+   png_stream_bits (s, 1, 2);
+
+   return s->err;
+}
+
+/**
+ * png_stream_run - Write a run of a pixel.
+ * @s:     Pointer to stream.
+ * @rgb:   Pointer to the pixel, the red, green and blue component.
+ * @count: Number of pixels, the run must not go past the end of the row.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int png_stream_run (png_stream_t *s, const uint8_t *rgb, int count)
+{
+   int len;
+
+   if (count < 1 || s->y >= s->height || count > s->width - s->x)
+      return 1;
+
+   /* Each row starts with filter type 0 (none), the zero byte only adds
+    * s1 to s2 of the Adler-32 */
+   if (!s->x)
+   {
+      png_stream_symbol (s, 0);
+      s->adler = ((((s->adler >> 16) + (s->adler & 0xffff)) % 65521) << 16) |
+                 (s->adler & 0xffff);
+   }
+
+   /* The first pixel, unless it repeats the previous one */
+   if (!s->x || memcmp (rgb, s->prev, 3))
+   {
+      png_stream_symbol (s, rgb[0]);
+      png_stream_symbol (s, rgb[1]);
+      png_stream_symbol (s, rgb[2]);
+      memcpy (s->prev, rgb, 3);
+      len = (count - 1) * 3;
+   }
+   else
+      len = count * 3;
+
+   /* Copies, 258 bytes is the longest match and a multiple of 3 */
+   while (len > 0)
+   {
+      int n = len < 258 ? len : 258;
+
+      png_stream_repeat (s, n);
+      len -= n;
+   }
+
+   s->adler = png_stream_adler (s->adler, rgb, count);
+   s->x += count;
+   if (s->x == s->width)
+   {
+      s->x = 0;
+      s->y++;
+   }
+
+   return s->err;
+}
+
+/**
+ * png_stream_end - Finish writing a PNG image.
+ * @s: Pointer to stream.
+ *
+ * All rows must have been written. The file is not closed.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int png_stream_end (png_stream_t *s)
+{
+   uint8_t iend[PNG_CHUNK_SZ];
+
+   if (s->y != s->height)
+      return 1;
+
+   /* End of block, padded to a byte, then the checksum */
+   png_stream_symbol (s, 256);
+   if (s->num_bits)
+      png_stream_bits (s, 0, 8 - s->num_bits);
+   png_put32 (s->buf + s->len, s->adler);
+   s->len += 4;
+   png_stream_flush (s);
+
+   memcpy (iend + 4, "IEND", 4);
+   png_chunk_end (iend, 0);
+   png_stream_write (s, iend, sizeof(iend));
+
+   return s->err;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
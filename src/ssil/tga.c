@@ -22,6 +22,8 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <errno.h>
 #include <err.h>
@@ -111,6 +113,204 @@ int tga_write (const char *fname, int width, int height, uint8_t *image)
    return 0;
 }
 
+/**
+ * tga_rle_begin - Starts a run-length encoded TGA image file.
+ * @fp:     File to write to.
+ * @width:  Image width.
+ * @height: Image height.
+ *
+ * This function will write the header of a run-length encoded true-color
+ * TGA image. The pixels are then written as runs by tga_rle_run(), starting
+ * with the lower left pixel as for tga_write().
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int tga_rle_begin (FILE *fp, int width, int height)
+{
+   uint8_t hdr[18];
+
+   /* As tga_write(), but image type 10: run-length encoded, true-color */
+   memset (hdr, 0, sizeof(hdr));
+   hdr[2]  = 10;
+   hdr[12] = width % 256;
+   hdr[13] = width / 256;
+   hdr[14] = height % 256;
+   hdr[15] = height / 256;
+   hdr[16] = 24;
+
+   return fwrite (hdr, sizeof(hdr), 1, fp) != 1;
+}
+
+/**
+ * tga_rle_run - Writes a run of a pixel to a run-length encoded TGA image.
+ * @fp:    File to write to.
+ * @rgb:   Pointer to the pixel, the red, green and blue component.
+ * @count: Number of pixels.
+ *
+ * Runs are written as run-length packets of at most 128 pixels. A run
+ * should not go past the end of a row.
+ *
+ * Returns:
+ * Number of bytes written, or 0 on error.
+ */
+size_t tga_rle_run (FILE *fp, const uint8_t *rgb, int count)
+{
+   uint8_t packet[4];
+   size_t len = 0;
+
+   packet[1] = rgb[2];
+   packet[2] = rgb[1];
+   packet[3] = rgb[0];
+   while (count > 0)
+   {
+      int n = count < 128 ? count : 128;
+
+      packet[0] = 0x80 | (n - 1);
+      if (fwrite (packet, sizeof(packet), 1, fp) != 1)
+         return 0;
+      len   += sizeof(packet);
+      count -= n;
+   }
+
+   return len;
+}
+
+/**
+ * tga_read - Reads a TGA image file.
+ * @fname:  Filname of image file.
+ * @width:  Pointer where to return the image width.
+ * @height: Pointer where to return the image height.
+ * @image:  Pointer where to return the malloc'ed image buffer.
+ *
+ * This function will read a true-color TGA image file of 24 or 32 bits per
+ * pixel, uncompressed as created by tga_write() or run-length encoded as
+ * created by tga_rle_begin(). The image is returned in the layout
+ * tga_write() takes, i.e. starting with the lower left pixel, three bytes
+ * per pixel for the red, green and blue component. An alpha channel is
+ * dropped. The caller frees @image.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int tga_read (const char *fname, int *width, int *height, uint8_t **image)
+{
+   FILE *fp = NULL;
+   uint8_t hdr[18];
+   uint8_t px[4];
+   uint8_t *buf = NULL;
+   size_t i, num;
+   int w, h, depth, bpp, top, rle;
+   int y;
+   int rc = 1;
+
+   *image = NULL;
+
+   fp = fopen (fname, "r");
+   if (!fp)
+   {
+      warn ("%s", fname);
+      return 1;
+   }
+
+   if (fread (hdr, sizeof(hdr), 1, fp) != 1)
+   {
+      warnx ("%s: Not a TGA image", fname);
+      goto out;
+   }
+
+   w     = hdr[12] | hdr[13] << 8;
+   h     = hdr[14] | hdr[15] << 8;
+   depth = hdr[16];
+   top   = hdr[17] & 0x20;   /* Rows from the top instead of the bottom */
+   rle   = hdr[2] == 10;
+   bpp   = depth / 8;
+   if (hdr[1] != 0 || (hdr[2] != 2 && !rle) || (depth != 24 && depth != 32) || !w || !h)
+   {
+      warnx ("%s: Only true-color TGA images are supported", fname);
+      goto out;
+   }
+
+   /* Skip the image ID */
+   if (fseek (fp, hdr[0], SEEK_CUR))
+      goto out;
+
+   num = (size_t)w * h;
+   buf = malloc (num * 3);
+   if (!buf)
+   {
+      warnx ("%s: Unable to alloc memory for image", fname);
+      goto out;
+   }
+
+   /* Pixels in file order, BGR(A) to RGB. Packets may span rows. */
+   for (i = 0; i < num; )
+   {
+      size_t n = 1;
+      size_t k;
+      int run = 0;
+
+      if (rle)
+      {
+         int c = fgetc (fp);
+
+         if (c == EOF)
+            break;
+         n   = (c & 0x7f) + 1;
+         run = c & 0x80;
+         if (n > num - i)
+            break;
+      }
+
+      for (k = 0; k < n; k++, i++)
+      {
+         /* A run-length packet has a single pixel value */
+         if ((!run || !k) && fread (px, bpp, 1, fp) != 1)
+            break;
+         buf[i * 3]     = px[2];
+         buf[i * 3 + 1] = px[1];
+         buf[i * 3 + 2] = px[0];
+      }
+      if (k < n)
+         break;
+   }
+
+   if (i < num)
+   {
+      warnx ("%s: Truncated TGA image", fname);
+      goto out;
+   }
+
+   /* Rows from the bottom */
+   if (top)
+      for (y = 0; y < h / 2; y++)
+      {
+         uint8_t *a = buf + (size_t)y * w * 3;
+         uint8_t *b = buf + (size_t)(h - 1 - y) * w * 3;
+         size_t j;
+
+         for (j = 0; j < (size_t)w * 3; j++)
+         {
+            uint8_t t = a[j];
+
+            a[j] = b[j];
+            b[j] = t;
+         }
+      }
+
+   *width  = w;
+   *height = h;
+   *image  = buf;
+   buf     = NULL;
+   rc      = 0;
+
+out:
+   free (buf);
+   fclose (fp);
+
+   return rc;
+}
+
 /**
  * Local Variables:
  *  c-file-style: "ellemtel"
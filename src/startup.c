@@ -0,0 +1,132 @@
+/**
+ * startup.c - Startup class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines the startup profile, the time from the start of the
+ * process to the first rendered image, split by phase.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <time.h>
+
+#include "startup.h"
+
+/* A recorded phase */
+typedef struct {
+   const char *name;   /* Name of phase */
+   double      time;   /* Time spent in the phase, in seconds */
+} startup_phase_t;
+
+static int enabled = 0;
+static int reported = 0;
+static double start;       /* Time of startup_enable() */
+static double loader;      /* CPU time spent before main() */
+static double last;        /* Time of the last mark */
+static int num_phases = 0;
+static startup_phase_t phase[STARTUP_MAX_PHASES];
+
+/**
+ * startup_time - Get a clock in seconds.
+ * @clock: Clock ID.
+ *
+ * Returns:
+ * Clock value in seconds.
+ */
+static double startup_time (clockid_t clock)
+{
+   struct timespec ts;
+
+   clock_gettime (clock, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * startup_enable - Enable the startup profile.
+ *
+ * Call first thing in main(). The process CPU time used so far is recorded
+ * as the time spent by the dynamic loader, mapping and relocating the
+ * linked libraries, and running their constructors.
+ *
+ * Returns:
+ * none.
+ */
+void startup_enable (void)
+{
+   enabled = 1;
+   loader  = startup_time (CLOCK_PROCESS_CPUTIME_ID);
+   start   = startup_time (CLOCK_MONOTONIC);
+   last    = start;
+}
+
+/**
+ * startup_mark - End a startup phase.
+ * @name: Name of the phase, a string constant.
+ *
+ * The time since the previous mark, or since startup_enable(), is recorded
+ * for @name. Marks after the report are ignored.
+ *
+ * Returns:
+ * none.
+ */
+void startup_mark (const char *name)
+{
+   double now;
+
+   if (!enabled || reported || num_phases == STARTUP_MAX_PHASES)
+      return;
+
+   now = startup_time (CLOCK_MONOTONIC);
+   phase[num_phases].name = name;
+   phase[num_phases].time = now - last;
+   num_phases++;
+   last = now;
+}
+
+/**
+ * startup_report - Print the startup profile.
+ *
+ * Call when the first image is rendered. The profile is printed to stderr
+ * once, following calls do nothing.
+ *
+ * Returns:
+ * none.
+ */
+void startup_report (void)
+{
+   int i;
+
+   if (!enabled || reported)
+      return;
+   reported = 1;
+
+   fprintf (stderr, "Startup profile:\n");
+   fprintf (stderr, "  %-16s %8.3f ms (CPU)\n", "loader", loader * 1e3);
+   for (i = 0; i < num_phases; i++)
+      fprintf (stderr, "  %-16s %8.3f ms\n", phase[i].name, phase[i].time * 1e3);
+   fprintf (stderr, "  %-16s %8.3f ms\n", "total",
+            (loader + last - start) * 1e3);
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
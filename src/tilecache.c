@@ -0,0 +1,365 @@
+/**
+ * tilecache.c - Tile cache class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines a size bounded LRU cache of encoded images, shared by
+ * the server threads.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "tilecache.h"
+
+/* Number of hash buckets, must be a power of two */
+#define TILECACHE_BUCKETS 4096
+
+/* Cache state, protected by @lock */
+static pthread_mutex_t lock  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  ready = PTHREAD_COND_INITIALIZER;
+static tilecache_entry_t *bucket[TILECACHE_BUCKETS];
+static tilecache_entry_t *lru_head = NULL;   /* Most recently used */
+static tilecache_entry_t *lru_tail = NULL;   /* Least recently used */
+static tilecache_stats_t stats;
+
+/**
+ * tilecache_hash - Calculate hash of a key.
+ * @key: Key string.
+ *
+ * Returns:
+ * FNV-1a hash of @key.
+ */
+static uint32_t tilecache_hash (const char *key)
+{
+   uint32_t h = 2166136261u;
+
+   while (*key)
+   {
+      h ^= (uint8_t)*key++;
+      h *= 16777619u;
+   }
+
+   return h;
+}
+
+/**
+ * tilecache_lru_unlink - Remove an entry from the LRU list.
+ * @entry: Pointer to entry.
+ *
+ * Returns:
+ * none.
+ */
+static void tilecache_lru_unlink (tilecache_entry_t *entry)
+{
+   if (entry->prev)
+      entry->prev->next = entry->next;
+   else
+      lru_head = entry->next;
+   if (entry->next)
+      entry->next->prev = entry->prev;
+   else
+      lru_tail = entry->prev;
+
+   entry->prev = entry->next = NULL;
+}
+
+/**
+ * tilecache_lru_push - Put an entry first in the LRU list.
+ * @entry: Pointer to entry, not in the list.
+ *
+ * Returns:
+ * none.
+ */
+static void tilecache_lru_push (tilecache_entry_t *entry)
+{
+   entry->prev = NULL;
+   entry->next = lru_head;
+   if (lru_head)
+      lru_head->prev = entry;
+   lru_head = entry;
+   if (!lru_tail)
+      lru_tail = entry;
+}
+
+/**
+ * tilecache_unhash - Remove an entry from its hash bucket.
+ * @entry: Pointer to entry.
+ *
+ * Returns:
+ * none.
+ */
+static void tilecache_unhash (tilecache_entry_t *entry)
+{
+   tilecache_entry_t **p = &bucket[entry->hash & (TILECACHE_BUCKETS - 1)];
+
+   while (*p && *p != entry)
+      p = &(*p)->chain;
+   if (*p)
+      *p = entry->chain;
+   entry->chain = NULL;
+}
+
+/**
+ * tilecache_free - Free an entry.
+ * @entry: Pointer to entry.
+ *
+ * Returns:
+ * none.
+ */
+static void tilecache_free (tilecache_entry_t *entry)
+{
+   free (entry->data);
+   free (entry);
+}
+
+/**
+ * tilecache_drop - Drop an entry from the cache.
+ * @entry: Pointer to entry, not pending.
+ *
+ * The entry is freed at once if nobody uses it, else by the last
+ * tilecache_release().
+ *
+ * Returns:
+ * none.
+ */
+static void tilecache_drop (tilecache_entry_t *entry)
+{
+   tilecache_unhash (entry);
+   if (entry->cached)
+   {
+      tilecache_lru_unlink (entry);
+      stats.bytes -= entry->len;
+      stats.entries--;
+      entry->cached = 0;
+   }
+
+   if (!entry->refs)
+      tilecache_free (entry);
+}
+
+/**
+ * tilecache_init - Setup the cache.
+ * @max_bytes: Cache budget in bytes.
+ *
+ * All cached entries are dropped and the statistics are cleared.
+ *
+ * Returns:
+ * none.
+ */
+void tilecache_init (size_t max_bytes)
+{
+   tilecache_flush ();
+
+   pthread_mutex_lock (&lock);
+   memset (&stats, 0, sizeof(stats));
+   stats.max_bytes = max_bytes;
+   pthread_mutex_unlock (&lock);
+}
+
+/**
+ * tilecache_get - Look up an image.
+ * @key:   Key of the image.
+ * @owner: Pointer where to return non-zero if the caller must render.
+ *
+ * If the image is cached it is returned at once. If another caller is
+ * already rendering the image, this function waits for it to finish, i.e.
+ * duplicate concurrent requests are coalesced into one render. Otherwise a
+ * pending entry is created and *@owner is set; the caller must then render
+ * the image and hand it over with tilecache_fill().
+ * The returned entry must be released with tilecache_release().
+ *
+ * Returns:
+ * Pointer to entry, or NULL if the image couldn't be rendered.
+ */
+tilecache_entry_t* tilecache_get (const char *key, int *owner)
+{
+   const uint32_t hash = tilecache_hash (key);
+   tilecache_entry_t *entry;
+
+   *owner = 0;
+
+   pthread_mutex_lock (&lock);
+
+   for (entry = bucket[hash & (TILECACHE_BUCKETS - 1)]; entry; entry = entry->chain)
+      if (entry->hash == hash && !strcmp (entry->key, key))
+         break;
+
+   if (entry)
+   {
+      entry->refs++;
+      if (entry->pending)
+      {
+         stats.coalesced++;
+         while (entry->pending)
+            pthread_cond_wait (&ready, &lock);
+      }
+      else
+      {
+         stats.hits++;
+         tilecache_lru_unlink (entry);
+         tilecache_lru_push (entry);
+      }
+
+      if (!entry->data)
+      {
+         entry->refs--;
+         if (!entry->refs && !entry->cached)
+            tilecache_free (entry);
+         entry = NULL;
+      }
+   }
+   else
+   {
+      entry = calloc (1, sizeof(*entry));
+      if (entry)
+      {
+         snprintf (entry->key, sizeof(entry->key), "%s", key);
+         entry->hash    = hash;
+         entry->pending = 1;
+         entry->refs    = 1;
+         entry->chain   = bucket[hash & (TILECACHE_BUCKETS - 1)];
+         bucket[hash & (TILECACHE_BUCKETS - 1)] = entry;
+         stats.misses++;
+         *owner = 1;
+      }
+   }
+
+   pthread_mutex_unlock (&lock);
+
+   return entry;
+}
+
+/**
+ * tilecache_fill - Hand over a rendered image to the cache.
+ * @entry: Pointer to pending entry returned by tilecache_get().
+ * @data:  Pointer to malloc'ed encoded image, or NULL if rendering failed.
+ * @len:   Length of @data.
+ *
+ * The cache takes over @data. Waiting callers are woken up, and least
+ * recently used images are dropped until the cache is within its budget.
+ *
+ * Returns:
+ * none.
+ */
+void tilecache_fill (tilecache_entry_t *entry, uint8_t *data, size_t len)
+{
+   pthread_mutex_lock (&lock);
+
+   entry->data    = data;
+   entry->len     = data ? len : 0;
+   entry->pending = 0;
+
+   /* Keep the image if it wasn't flushed while rendering */
+   if (data && !entry->stale)
+   {
+      entry->cached = 1;
+      tilecache_lru_push (entry);
+      stats.bytes += len;
+      stats.entries++;
+   }
+   else
+   if (!entry->stale)
+   {
+      tilecache_unhash (entry);
+   }
+
+   while (stats.bytes > stats.max_bytes && lru_tail && lru_tail != entry)
+   {
+      stats.evictions++;
+      tilecache_drop (lru_tail);
+   }
+
+   pthread_cond_broadcast (&ready);
+   pthread_mutex_unlock (&lock);
+}
+
+/**
+ * tilecache_release - Release an entry.
+ * @entry: Pointer to entry returned by tilecache_get().
+ *
+ * Returns:
+ * none.
+ */
+void tilecache_release (tilecache_entry_t *entry)
+{
+   pthread_mutex_lock (&lock);
+
+   entry->refs--;
+   if (!entry->refs && !entry->cached && !entry->pending)
+      tilecache_free (entry);
+
+   pthread_mutex_unlock (&lock);
+}
+
+/**
+ * tilecache_flush - Drop all cached images.
+ *
+ * This function should be called when the scene has changed. Images being
+ * rendered are unlinked, i.e. they are handed to the requests already
+ * waiting for them but not cached.
+ *
+ * Returns:
+ * none.
+ */
+void tilecache_flush (void)
+{
+   int i;
+
+   pthread_mutex_lock (&lock);
+
+   for (i = 0; i < TILECACHE_BUCKETS; i++)
+   {
+      while (bucket[i])
+      {
+         tilecache_entry_t *entry = bucket[i];
+
+         if (entry->pending)
+         {
+            tilecache_unhash (entry);
+            entry->stale = 1;
+         }
+         else
+            tilecache_drop (entry);
+      }
+   }
+
+   pthread_mutex_unlock (&lock);
+}
+
+/**
+ * tilecache_get_stats - Get cache statistics.
+ * @s: Pointer where to return the statistics.
+ *
+ * Returns:
+ * none.
+ */
+void tilecache_get_stats (tilecache_stats_t *s)
+{
+   pthread_mutex_lock (&lock);
+   *s = stats;
+   pthread_mutex_unlock (&lock);
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
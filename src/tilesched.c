@@ -0,0 +1,314 @@
+/**
+ * tilesched.c - Tile scheduler class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines the tile scheduler, which records how long each part
+ * of the screen took to render and uses it to plan the tiles of the next
+ * frame.
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tilesched.h"
+
+/* Render time of each cost cell in the last recorded frame */
+static float *cell_cost = NULL;
+
+/* Frame size the cost cells were recorded for */
+static int cost_width  = 0;
+static int cost_height = 0;
+
+/* Non-zero when any cost has been recorded for the current frame size */
+static int have_history = 0;
+
+/**
+ * tilesched_time - Get monotonic time in seconds.
+ *
+ * Returns:
+ * Current time.
+ */
+double tilesched_time (void)
+{
+   struct timespec ts;
+
+   clock_gettime (CLOCK_MONOTONIC, &ts);
+
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * tilesched_begin - Start recording render times of a frame.
+ * @screen_width:  Width of rendered screen
+ * @screen_height: Height of rendered screen
+ *
+ * This function should be called before recording the render times of a
+ * frame with tilesched_record(). If the frame size differs from the last
+ * recorded frame, the old render times are thrown away.
+ *
+ * Returns:
+ * none.
+ */
+void tilesched_begin (int screen_width, int screen_height)
+{
+   const int cols = (screen_width  + TILESCHED_CELL - 1) / TILESCHED_CELL;
+   const int rows = (screen_height + TILESCHED_CELL - 1) / TILESCHED_CELL;
+   float *cost;
+
+   if (cell_cost && screen_width == cost_width && screen_height == cost_height)
+      return;
+
+   have_history = 0;
+   cost = realloc (cell_cost, (size_t)cols * rows * sizeof(float));
+   if (!cost)
+   {
+      free (cell_cost);
+      cell_cost   = NULL;
+      cost_width  = 0;
+      cost_height = 0;
+      return;
+   }
+
+   memset (cost, 0, (size_t)cols * rows * sizeof(float));
+   cell_cost   = cost;
+   cost_width  = screen_width;
+   cost_height = screen_height;
+}
+
+/**
+ * tilesched_record - Record the render time of a rectangle.
+ * @x0: First column of the rectangle
+ * @y0: First row of the rectangle
+ * @x1: Column after the last column of the rectangle
+ * @y1: Row after the last row of the rectangle
+ * @t:  Render time in seconds
+ *
+ * The time is spread evenly over the cost cells covered by the rectangle,
+ * replacing their previous value. Rectangles should be aligned to
+ * TILESCHED_CELL, except at the right and bottom screen edges.
+ *
+ * Returns:
+ * none.
+ */
+void tilesched_record (int x0, int y0, int x1, int y1, double t)
+{
+   const int cols = (cost_width + TILESCHED_CELL - 1) / TILESCHED_CELL;
+   int cx0, cy0, cx1, cy1;
+   int cx, cy;
+   float c;
+
+   if (!cell_cost || x0 >= x1 || y0 >= y1 || x1 > cost_width || y1 > cost_height)
+      return;
+
+   cx0 = x0 / TILESCHED_CELL;
+   cy0 = y0 / TILESCHED_CELL;
+   cx1 = (x1 + TILESCHED_CELL - 1) / TILESCHED_CELL;
+   cy1 = (y1 + TILESCHED_CELL - 1) / TILESCHED_CELL;
+   c   = t / ((cx1 - cx0) * (cy1 - cy0));
+
+   for (cy = cy0; cy < cy1; cy++)
+      for (cx = cx0; cx < cx1; cx++)
+         cell_cost[cy * cols + cx] = c;
+
+   have_history = 1;
+}
+
+/**
+ * tilesched_cost - Get predicted cost of a rectangle.
+ * @history: Non-zero to use recorded render times.
+ * @x0:      First column of the rectangle
+ * @y0:      First row of the rectangle
+ * @x1:      Column after the last column of the rectangle
+ * @y1:      Row after the last row of the rectangle
+ *
+ * Returns:
+ * Sum of the recorded render times of the cost cells covered by the
+ * rectangle, or the pixel count if @history is zero.
+ */
+static float tilesched_cost (int history, int x0, int y0, int x1, int y1)
+{
+   const int cols = (cost_width + TILESCHED_CELL - 1) / TILESCHED_CELL;
+   float c = 0;
+   int cx, cy;
+
+   if (!history)
+      return (float)(x1 - x0) * (y1 - y0);
+
+   for (cy = y0 / TILESCHED_CELL; cy < (y1 + TILESCHED_CELL - 1) / TILESCHED_CELL; cy++)
+      for (cx = x0 / TILESCHED_CELL; cx < (x1 + TILESCHED_CELL - 1) / TILESCHED_CELL; cx++)
+         c += cell_cost[cy * cols + cx];
+
+   return c;
+}
+
+/* Growing list of planned tiles */
+typedef struct {
+   tilesched_tile_t *tile;   /* Tiles */
+   int num;                  /* Number of tiles in @tile */
+   int max;                  /* Number of allocated tiles */
+   int history;              /* Non-zero to use recorded render times */
+   float target;             /* Tiles costing more than this are split */
+} tilesched_plan_t;
+
+/**
+ * tilesched_split - Add a rectangle to a plan, splitting it if expensive.
+ * @plan: Pointer to plan.
+ * @x0:   First column of the rectangle
+ * @y0:   First row of the rectangle
+ * @x1:   Column after the last column of the rectangle
+ * @y1:   Row after the last row of the rectangle
+ *
+ * The rectangle is split in four, at a cost cell boundary, as long as its
+ * predicted cost is above the plan target and it is larger than a cell.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+static int tilesched_split (tilesched_plan_t *plan, int x0, int y0, int x1, int y1)
+{
+   float c = tilesched_cost (plan->history, x0, y0, x1, y1);
+
+   if (c > plan->target && (x1 - x0 > TILESCHED_CELL || y1 - y0 > TILESCHED_CELL))
+   {
+      int mx = x0 + ((x1 - x0) / 2 + TILESCHED_CELL - 1) / TILESCHED_CELL * TILESCHED_CELL;
+      int my = y0 + ((y1 - y0) / 2 + TILESCHED_CELL - 1) / TILESCHED_CELL * TILESCHED_CELL;
+
+      if (mx > x1)
+         mx = x1;
+      if (my > y1)
+         my = y1;
+
+      if (tilesched_split (plan, x0, y0, mx, my))
+         return 1;
+      if (mx < x1 && tilesched_split (plan, mx, y0, x1, my))
+         return 1;
+      if (my < y1 && tilesched_split (plan, x0, my, mx, y1))
+         return 1;
+      if (mx < x1 && my < y1 && tilesched_split (plan, mx, my, x1, y1))
+         return 1;
+
+      return 0;
+   }
+
+   if (plan->num == plan->max)
+   {
+      tilesched_tile_t *tile;
+
+      plan->max = plan->max ? plan->max * 2 : 64;
+      tile = realloc (plan->tile, plan->max * sizeof(*tile));
+      if (!tile)
+         return 1;
+      plan->tile = tile;
+   }
+
+   plan->tile[plan->num].x0   = x0;
+   plan->tile[plan->num].y0   = y0;
+   plan->tile[plan->num].x1   = x1;
+   plan->tile[plan->num].y1   = y1;
+   plan->tile[plan->num].cost = c;
+   plan->num++;
+
+   return 0;
+}
+
+/**
+ * tilesched_cmp - Compare tiles by predicted cost, most expensive first.
+ * @a: Pointer to tile.
+ * @b: Pointer to tile.
+ *
+ * Returns:
+ * qsort() compare result.
+ */
+static int tilesched_cmp (const void *a, const void *b)
+{
+   const tilesched_tile_t *ta = a;
+   const tilesched_tile_t *tb = b;
+
+   if (ta->cost > tb->cost)
+      return -1;
+   if (ta->cost < tb->cost)
+      return 1;
+
+   return 0;
+}
+
+/**
+ * tilesched_plan - Plan the tiles of a frame.
+ * @screen_width:  Width of rendered screen
+ * @screen_height: Height of rendered screen
+ * @num_workers:   Number of workers that will render the tiles
+ * @tiles:         Pointer where to return a malloc'ed list of tiles
+ *
+ * This function will split the screen into tiles of TILESCHED_TILE_MAX
+ * pixels and then use the render times recorded for the last frame of the
+ * same size to split tiles predicted to be expensive, down to a single cost
+ * cell. The list is sorted with the most expensive tile first, so workers
+ * taking tiles in list order start with the long running tiles and finish
+ * the frame with cheap ones, which keeps the tail of the frame short. If
+ * there is no recorded history the pixel count is used as cost.
+ *
+ * Returns:
+ * Number of tiles in *@tiles, or -1 on error.
+ */
+int tilesched_plan (int screen_width,
+                    int screen_height,
+                    int num_workers,
+                    tilesched_tile_t **tiles)
+{
+   tilesched_plan_t plan;
+   int x, y;
+
+   memset (&plan, 0, sizeof(plan));
+   plan.history = have_history &&
+      screen_width == cost_width && screen_height == cost_height;
+   plan.target  = tilesched_cost (plan.history, 0, 0, screen_width, screen_height) /
+      ((num_workers > 0 ? num_workers : 1) * TILESCHED_TILES_PER_WORKER);
+
+   for (y = 0; y < screen_height; y += TILESCHED_TILE_MAX)
+   {
+      for (x = 0; x < screen_width; x += TILESCHED_TILE_MAX)
+      {
+         int x1 = x + TILESCHED_TILE_MAX;
+         int y1 = y + TILESCHED_TILE_MAX;
+
+         if (tilesched_split (&plan,
+                              x, y,
+                              x1 < screen_width  ? x1 : screen_width,
+                              y1 < screen_height ? y1 : screen_height))
+         {
+            fprintf (stderr, "error: Unable to alloc memory for tile plan\n");
+            free (plan.tile);
+            return -1;
+         }
+      }
+   }
+
+   qsort (plan.tile, plan.num, sizeof(*plan.tile), tilesched_cmp);
+   *tiles = plan.tile;
+
+   return plan.num;
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
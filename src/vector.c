@@ -87,6 +87,38 @@ void vector_normal (vector_t *v)
    v->z = v->z / len;
 }
 
+/**
+ * vector_normal_tier - Make unit vector at a given precision.
+ * @v: Pointer to vector.
+ * @p: Precision tier.
+ *
+ * This function works as vector_normal(), but the fast tiers scale @v by a
+ * reciprocal square root instead of dividing by its length.
+ *
+ * Returns:
+ * none.
+ */
+void vector_normal_tier (vector_t *v, precision_t p)
+{
+   float len2;
+   float r;
+
+   if (p == PRECISION_EXACT)
+   {
+      vector_normal (v);
+      return;
+   }
+
+   len2 = v->x * v->x + v->y * v->y + v->z * v->z;
+   if (len2 == 0.0f)
+      return;
+
+   r = precision_rsqrt (len2, p);
+   v->x = v->x * r;
+   v->y = v->y * r;
+   v->z = v->z * r;
+}
+
 /**
  * vector_dot - Calculate the dot product.
  * @v1: Pointer to vector 1.
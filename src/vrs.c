@@ -0,0 +1,150 @@
+/**
+ * vrs.c - Variable rate class.
+ *
+ * Copyright (c) 2013, Jonas Johansson <jonasj76@gmail.com>
+ *
+ * Description:
+ * This class defines the rate maps used for variable rate rendering, see
+ * render_vrs().
+ *
+ * License:
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "vrs.h"
+
+/**
+ * vrs_alloc - Allocate a rate map.
+ * @width:  Width of rendered screen.
+ * @height: Height of rendered screen.
+ *
+ * All cells are set to rate 1. The caller must free() the map.
+ *
+ * Returns:
+ * Pointer to rate map or NULL on error.
+ */
+uint8_t* vrs_alloc (int width, int height)
+{
+   size_t sz = (size_t)VRS_COLS (width) * VRS_ROWS (height);
+   uint8_t *rate = malloc (sz);
+
+   if (!rate)
+   {
+      fprintf (stderr, "error: Unable to alloc memory for rate map\n");
+      return NULL;
+   }
+   memset (rate, 1, sz);
+
+   return rate;
+}
+
+/**
+ * vrs_foveate - Setup a rate map around a foveation centre.
+ * @rate:   Pointer to rate map.
+ * @width:  Width of rendered screen.
+ * @height: Height of rendered screen.
+ * @cx:     Column of the foveation centre.
+ * @cy:     Row of the foveation centre.
+ *
+ * Cells are traced at full rate close to the centre and at lower rates
+ * further out, see VRS_FOVEA.
+ *
+ * Returns:
+ * none.
+ */
+void vrs_foveate (uint8_t* rate, int width, int height, int cx, int cy)
+{
+   const float r = VRS_FOVEA * sqrtf ((float)width * width + (float)height * height);
+   int x, y;
+
+   for (y = 0; y < VRS_ROWS (height); y++)
+   {
+      for (x = 0; x < VRS_COLS (width); x++)
+      {
+         float dx = x * VRS_CELL + VRS_CELL / 2 - cx;
+         float dy = y * VRS_CELL + VRS_CELL / 2 - cy;
+         float d  = sqrtf (dx * dx + dy * dy);
+
+         rate[y * VRS_COLS (width) + x] = d < r ? 1 : d < 2 * r ? 2 : 4;
+      }
+   }
+}
+
+/**
+ * vrs_edges - Setup a rate map from the edges of a previous frame.
+ * @rate:   Pointer to rate map.
+ * @image:  Pointer to previous rendered image.
+ * @width:  Width of rendered screen.
+ * @height: Height of rendered screen.
+ *
+ * Cells with an edge, i.e. a pixel differing from the pixel to the right or
+ * above it, are traced at full rate and cells next to them at rate 2, as
+ * edges may have moved a bit since the previous frame. Other cells are of a
+ * single color and are traced at rate 4. Each row of a cell is compared
+ * with memcmp() as a whole, and not at all once the cell has an edge.
+ *
+ * Returns:
+ * none.
+ */
+void vrs_edges (uint8_t* rate, const uint8_t* image, int width, int height)
+{
+   const int cols = VRS_COLS (width);
+   const int rows = VRS_ROWS (height);
+   int x, y, i, j;
+
+   memset (rate, 0, (size_t)cols * rows);
+
+   /* Find cells with edges */
+   for (y = 0; y < height; y++)
+   {
+      for (x = 0; x < cols; x++)
+      {
+         const int x0 = x * VRS_CELL;
+         const int x1 = x0 + VRS_CELL < width ? x0 + VRS_CELL : width;
+         const uint8_t *p = image + ((size_t)y * width + x0) * 3;
+         uint8_t *cell = &rate[(y / VRS_CELL) * cols + x];
+
+         /* Pixels to the right, including the first one of the next cell */
+         if (*cell || memcmp (p, p + 3, (size_t)(x1 < width ? x1 - x0 : x1 - x0 - 1) * 3) ||
+             (y + 1 < height && memcmp (p, p + (size_t)width * 3, (size_t)(x1 - x0) * 3)))
+            *cell = 1;
+      }
+   }
+
+   /* Lower the rate of all other cells, less next to an edge */
+   for (y = 0; y < rows; y++)
+   {
+      for (x = 0; x < cols; x++)
+      {
+         if (rate[y * cols + x] == 1)
+            continue;
+
+         rate[y * cols + x] = 4;
+         for (j = y - 1; j <= y + 1; j++)
+            for (i = x - 1; i <= x + 1; i++)
+               if (i >= 0 && j >= 0 && i < cols && j < rows && rate[j * cols + i] == 1)
+                  rate[y * cols + x] = 2;
+      }
+   }
+}
+
+/**
+ * Local Variables:
+ *  c-file-style: "ellemtel"
+ *  indent-tabs-mode: nil
+ * End:
+ */
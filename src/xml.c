@@ -20,6 +20,9 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <dlfcn.h>
 #include <libxml/xmlmemory.h>
 #include <libxml/parser.h>
 
@@ -44,51 +47,142 @@
 #define TAG_G      (const xmlChar*)"g"
 #define TAG_B      (const xmlChar*)"b"
 
+/* The functions used from libxml2, which is loaded by xml_load() */
+static struct {
+   void       *handle;
+   xmlDocPtr  (*xmlParseFile) (const char *filename);
+   xmlNodePtr (*xmlDocGetRootElement) (const xmlDoc *doc);
+   void       (*xmlFreeDoc) (xmlDocPtr cur);
+   xmlChar*   (*xmlGetProp) (const xmlNode *node, const xmlChar *name);
+   int        (*xmlStrcmp) (const xmlChar *str1, const xmlChar *str2);
+} libxml;
+
+/* Names of libxml2 to try, in order */
+static const char *libxml_names[] = {
+   "libxml2.so.2",
+   "libxml2.so",
+   NULL
+};
+
+/**
+ * xml_sym - Look up a libxml2 function.
+ * @fn:   Pointer where to return the function.
+ * @name: Name of the function.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if the function wasn't found.
+ */
+static int xml_sym (void *fn, const char *name)
+{
+   void *sym = dlsym (libxml.handle, name);
+
+   if (!sym)
+   {
+      fprintf (stderr, "error: %s not found in libxml2.\n", name);
+      return 1;
+   }
+   /* POSIX allows converting object pointers to function pointers */
+   *(void**)fn = sym;
+
+   return 0;
+}
+
+/**
+ * xml_load - Load libxml2.
+ *
+ * libxml2 isn't linked into srt, but loaded with dlopen() the first time
+ * it's needed, so runs which don't read XML, e.g. with a binary scene file,
+ * don't pay for loading it. Calling it again when loaded does nothing.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero if libxml2 couldn't be loaded.
+ */
+int xml_load (void)
+{
+   int i;
+
+   if (libxml.handle)
+      return 0;
+
+   for (i = 0; libxml_names[i] && !libxml.handle; i++)
+      libxml.handle = dlopen (libxml_names[i], RTLD_NOW | RTLD_LOCAL);
+   if (!libxml.handle)
+   {
+      fprintf (stderr, "error: Unable to load libxml2: %s\n", dlerror ());
+      return 1;
+   }
+
+   if (xml_sym (&libxml.xmlParseFile, "xmlParseFile") ||
+       xml_sym (&libxml.xmlDocGetRootElement, "xmlDocGetRootElement") ||
+       xml_sym (&libxml.xmlFreeDoc, "xmlFreeDoc") ||
+       xml_sym (&libxml.xmlGetProp, "xmlGetProp") ||
+       xml_sym (&libxml.xmlStrcmp, "xmlStrcmp"))
+   {
+      dlclose (libxml.handle);
+      libxml.handle = NULL;
+      return 1;
+   }
+
+   return 0;
+}
+
 /**
  * parse_sphere - Parse sphere object.
+ * @scene: Pointer to scene to setup
  * @cur: xml node
  * @id: Sphere id
  *
+ * The scene is grown to hold @id if needed.
+ *
  * Returns:
  * none.
  */
-void parse_sphere (xmlNodePtr cur, int id)
+void parse_sphere (scene_t* scene, xmlNodePtr cur, int id)
 {
-   sphere_t* sphere = scene_get_sphere (scene_get_scene ());
+   sphere_t* sphere;
    xmlChar *prop;
 
-   if (id<0 || id>scene_get_num_spheres ())
+   if (id<0)
    {
       printf("Invalid sphere ID (%d), skipping...", id);
       return;
    }
 
+   /* Make room for the sphere if the ID is beyond the current list */
+   if (id>=scene_get_num_spheres (scene) && scene_set_num_spheres (scene, id+1))
+      return;
+   sphere = scene_get_sphere (scene);
+
    while (cur)
    {
-      if (!xmlStrcmp (cur->name, TAG_DATA))
+      if (!libxml.xmlStrcmp (cur->name, TAG_DATA))
       {
+         dvector_t center;
+
          // Center
-         prop = xmlGetProp (cur, TAG_X);
+         scene_get_sphere_center (scene, id, &center);
+         prop = libxml.xmlGetProp (cur, TAG_X);
          if (prop)
-            sphere[id].center.x = atof((char*)prop);
-         prop = xmlGetProp (cur, TAG_Y);
+            center.x = atof((char*)prop);
+         prop = libxml.xmlGetProp (cur, TAG_Y);
          if (prop)
-            sphere[id].center.y = atof((char*)prop);
-         prop = xmlGetProp (cur, TAG_Z);
+            center.y = atof((char*)prop);
+         prop = libxml.xmlGetProp (cur, TAG_Z);
          if (prop)
-            sphere[id].center.z = atof((char*)prop);
+            center.z = atof((char*)prop);
+         scene_set_sphere_center (scene, id, center.x, center.y, center.z);
          // Radius
-         prop = xmlGetProp(cur, TAG_RADIUS);
+         prop = libxml.xmlGetProp(cur, TAG_RADIUS);
          if (prop)
             sphere[id].radius = atof((char*)prop);
          // Color
-         prop = xmlGetProp (cur, TAG_R);
+         prop = libxml.xmlGetProp (cur, TAG_R);
          if (prop)
             color_set (&sphere[id].color, atoi((char*)prop), -1, -1);
-         prop = xmlGetProp (cur, TAG_G);
+         prop = libxml.xmlGetProp (cur, TAG_G);
          if (prop)
             color_set (&sphere[id].color, -1, atoi((char*)prop), -1);
-         prop = xmlGetProp (cur, TAG_B);
+         prop = libxml.xmlGetProp (cur, TAG_B);
          if (prop)
             color_set (&sphere[id].color, -1, -1, atoi((char*)prop));
       }
@@ -98,32 +192,37 @@ void parse_sphere (xmlNodePtr cur, int id)
 
 /**
  * parse_camera - Parse camera object.
+ * @scene: Pointer to scene to setup
  * @cur: xml node
  *
  * Returns:
  * none.
  */
-void parse_camera (xmlNodePtr cur)
+void parse_camera (scene_t* scene, xmlNodePtr cur)
 {
-   camera_t* cam = scene_get_camera (scene_get_scene ());
+   camera_t* cam = scene_get_camera (scene);
    xmlChar *prop;
 
    while (cur)
    {
-      if (!xmlStrcmp (cur->name, TAG_DATA))
+      if (!libxml.xmlStrcmp (cur->name, TAG_DATA))
       {
+         dvector_t pos;
+
          // Position
-         prop = xmlGetProp (cur, TAG_X);
+         scene_get_camera_pos (scene, &pos);
+         prop = libxml.xmlGetProp (cur, TAG_X);
          if (prop)
-            cam->pos.x = atof((char*)prop);
-         prop = xmlGetProp (cur, TAG_Y);
+            pos.x = atof((char*)prop);
+         prop = libxml.xmlGetProp (cur, TAG_Y);
          if (prop)
-            cam->pos.y = atof((char*)prop);
-         prop = xmlGetProp (cur, TAG_Z);
+            pos.y = atof((char*)prop);
+         prop = libxml.xmlGetProp (cur, TAG_Z);
          if (prop)
-            cam->pos.z = atof((char*)prop);
+            pos.z = atof((char*)prop);
+         scene_set_camera_pos (scene, pos.x, pos.y, pos.z);
          // FOV
-         prop = xmlGetProp (cur, TAG_FOV);
+         prop = libxml.xmlGetProp (cur, TAG_FOV);
          if (prop)
             cam->fov=(atof((char*)prop) * 3.14) / 180.0;
       }
@@ -133,27 +232,28 @@ void parse_camera (xmlNodePtr cur)
 
 /**
  * parse_objects - Parse main objects.
+ * @scene: Pointer to scene to setup
  * @cur: xml node
  *
  * Returns:
  * none.
  */
-static void parse_objects (xmlNodePtr cur)
+static void parse_objects (scene_t* scene, xmlNodePtr cur)
 {
    cur = cur->xmlChildrenNode;
 
    while (cur)
    {
-      if (!xmlStrcmp(cur->name, TAG_CAMERA))
+      if (!libxml.xmlStrcmp(cur->name, TAG_CAMERA))
       {
-         parse_camera (cur->xmlChildrenNode);
+         parse_camera (scene, cur->xmlChildrenNode);
       }
-      if (!xmlStrcmp(cur->name, TAG_SPHERE))
+      if (!libxml.xmlStrcmp(cur->name, TAG_SPHERE))
       {
-         xmlChar *prop = xmlGetProp (cur, TAG_ID);
+         xmlChar *prop = libxml.xmlGetProp (cur, TAG_ID);
 
          if (prop)
-            parse_sphere (cur->xmlChildrenNode, atoi((char*)prop));
+            parse_sphere (scene, cur->xmlChildrenNode, atoi((char*)prop));
       }
       cur = cur->next;
    }
@@ -166,39 +266,59 @@ static void parse_objects (xmlNodePtr cur)
  *
  * This function will parse an xml file containg a scene.
  * The scene will be setup according to the information stored in the
- * xml file.
+ * xml file, see xml_parse_scene().
  *
  * Returns:
  * POSIX OK (zero) or non-zero on error.
  */
 int xml_parse(char *docname)
+{
+   return xml_parse_scene (scene_get_scene (), docname);
+}
+
+/**
+ * xml_parse_scene - Parse an xml file and setup a scene.
+ * @scene:   Pointer to scene to setup
+ * @docname: xml file
+ *
+ * This function will parse an xml file containg a scene into @scene.
+ * libxml2 is loaded first, if needed, see xml_load(). Only one file may
+ * be parsed at a time.
+ *
+ * Returns:
+ * POSIX OK (zero) or non-zero on error.
+ */
+int xml_parse_scene (scene_t *scene, char *docname)
 {
    xmlDocPtr doc;
    xmlNodePtr cur;
 
-   doc = xmlParseFile (docname);
+   if (xml_load ())
+      return 1;
+
+   doc = libxml.xmlParseFile (docname);
    if (!doc)
    {
       fprintf (stderr, "error: Unable to parse %s.\n", docname);
       return 1;
    }
 
-   cur = xmlDocGetRootElement (doc);
+   cur = libxml.xmlDocGetRootElement (doc);
    if (!cur)
    {
       fprintf (stderr, "error: %s is empty\n", docname);
-      xmlFreeDoc (doc);
+      libxml.xmlFreeDoc (doc);
       return 1;
    }
-   if (xmlStrcmp (cur->name, TAG_SCENE))
+   if (libxml.xmlStrcmp (cur->name, TAG_SCENE))
    {
       fprintf (stderr, "error: %s is of the wrong type, root node != %s\n", docname, TAG_SCENE);
-      xmlFreeDoc (doc);
+      libxml.xmlFreeDoc (doc);
       return 1;
    }
 
-   parse_objects (cur);
-   xmlFreeDoc (doc);
+   parse_objects (scene, cur);
+   libxml.xmlFreeDoc (doc);
 
    return 0;
 }
@@ -24,12 +24,23 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
 
 #include "output.h"
 #include "scene.h"
 #include "cli.h"
 #include "xml.h"
+#include "dist.h"
+#include "server.h"
+#include "render.h"
+#include "startup.h"
+#include "snapshot.h"
+#include "library.h"
+#include "loadgen.h"
+#include "quality.h"
 #include "version.h"
 
 #ifdef SSIL
@@ -150,8 +161,171 @@ int render_output_setup (void)
    return 1;
 }
 
-int main (void)
+static void usage (void)
 {
+   printf ("Usage: srt [-w <ADDRESS> | -s <ADDRESS> [-l <DIR>]] [-b <FILE>] [-r]\n"
+           "           [--library-size <MB>] [--startup-profile]\n"
+           "       srt -g <ADDRESS> [--connections <N>] [--rate <N>] [--duration <S>]\n"
+           "           [--mix <FILE>] [--hdr <FILE>]\n"
+           "       srt -c <REFERENCE> <IMAGE> [--map <FILE>]\n");
+   printf ("  -w <ADDRESS>  Run as a worker for a master rendering with\n"
+           "                'distribute <ADDRESS> <WORKERS>'.\n");
+   printf ("  -s <ADDRESS>  Run as a server, serving tiles over HTTP\n"
+           "                instead of entering the CLI. The scene is updated\n"
+           "                with deltas sent by the CLI command 'push'.\n");
+   printf ("  -l <DIR>      With -s, also serve the scenes <DIR>/<NAME>.xml,\n"
+           "                keeping the most recently used ones loaded.\n");
+   printf ("  --library-size <MB>\n"
+           "                Memory budget of the loaded scenes of -l, %d MB\n"
+           "                by default.\n", LIBRARY_SIZE >> 20);
+   printf ("  -b <FILE>     Load the scene from a binary scene file, written\n"
+           "                by the CLI command 'save', instead of %s.\n", SCENE_FILE);
+   printf ("  -r            Render the scene, output it and exit instead of\n"
+           "                entering the CLI.\n");
+   printf ("  --startup-profile\n"
+           "                Print the time to the first render by phase.\n");
+   printf ("  -g <ADDRESS>  Generate load on a server started with -s and report\n"
+           "                the latency, see README.\n");
+   printf ("  --connections <N>\n"
+           "                Number of client connections, %d by default.\n", LOADGEN_CONNECTIONS);
+   printf ("  --rate <N>    Requests per second, %.0f by default.\n", LOADGEN_RATE);
+   printf ("  --duration <S>\n"
+           "                Seconds to generate load, %.0f by default.\n", LOADGEN_DURATION);
+   printf ("  --mix <FILE>  Request mix, lines of\n"
+           "                <WEIGHT> <SCENE|-> <WIDTH>x<HEIGHT> <LEVEL>.\n");
+   printf ("  --hdr <FILE>  Dump the latency histogram to <FILE>.\n");
+   printf ("  -c <REFERENCE> <IMAGE>\n"
+           "                Compare two TGA images and print the PSNR and SSIM.\n");
+   printf ("  --map <FILE>  Write the per-pixel error of -c as a TGA image.\n");
+   printf ("<ADDRESS> is unix:<PATH> or <HOST>:<PORT>.\n");
+}
+
+int main (int argc, char *argv[])
+{
+   static const struct option options[] = {
+      { "startup-profile", no_argument,       NULL, 'P' },
+      { "library-size",    required_argument, NULL, 'L' },
+      { "connections",     required_argument, NULL, 'C' },
+      { "rate",            required_argument, NULL, 'R' },
+      { "duration",        required_argument, NULL, 'D' },
+      { "mix",             required_argument, NULL, 'M' },
+      { "hdr",             required_argument, NULL, 'H' },
+      { "map",             required_argument, NULL, 'm' },
+      { "help",            no_argument,       NULL, 'h' },
+      { NULL,              0,                 NULL, 0   }
+   };
+   char *worker = NULL;   /* Master address when running as a worker */
+   char *server = NULL;   /* Address to serve on when running as a server */
+   loadgen_conf_t load;   /* Load to generate when running as a client */
+   char *client = NULL;   /* Server address when generating load */
+   char *compare = NULL;  /* Reference image when comparing images */
+   char *map = NULL;      /* Error map of the comparison */
+   char *binary = NULL;   /* Binary scene file to load instead of XML */
+   char *library = NULL;  /* Directory of the scenes served besides it */
+   size_t library_size = LIBRARY_SIZE;
+   int render   = 0;      /* Render once instead of entering the CLI */
+   int opt;
+
+   loadgen_init (&load, NULL);
+   while ((opt = getopt_long (argc, argv, "w:s:l:g:c:b:rh", options, NULL)) != -1)
+   {
+      switch (opt)
+      {
+         case 'w':
+            worker = optarg;
+            break;
+
+         case 's':
+            server = optarg;
+            break;
+
+         case 'l':
+            library = optarg;
+            break;
+
+         case 'g':
+            client = optarg;
+            break;
+
+         case 'c':
+            compare = optarg;
+            break;
+
+         case 'm':
+            map = optarg;
+            break;
+
+         case 'C':
+            load.conns = atoi (optarg);
+            break;
+
+         case 'R':
+            load.rate = atof (optarg);
+            break;
+
+         case 'D':
+            load.duration = atof (optarg);
+            break;
+
+         case 'M':
+            load.mix = optarg;
+            break;
+
+         case 'H':
+            load.hdr = optarg;
+            break;
+
+         case 'L':
+            library_size = (size_t)atoi (optarg) << 20;
+            break;
+
+         case 'b':
+            binary = optarg;
+            break;
+
+         case 'r':
+            render = 1;
+            break;
+
+         case 'P':
+            startup_enable ();
+            break;
+
+         default:
+            usage ();
+            return opt == 'h' ? 0 : 1;
+      }
+   }
+
+   /* Worker mode, the scene is received from the master */
+   if (worker)
+      return dist_worker (worker);
+
+   /* Load generator mode, the scene is the server's */
+   if (client)
+   {
+      load.addr = client;
+      return loadgen_run (&load);
+   }
+
+   /* Compare mode, no scene is needed */
+   if (compare)
+   {
+      quality_t q;
+
+      if (optind != argc - 1)
+      {
+         usage ();
+         return 1;
+      }
+      if (quality_compare_files (compare, argv[optind], map, &q))
+         return 1;
+      printf ("PSNR: %.2f dB\nSSIM: %.4f\nMSE: %.4f\n"
+              "%ld pixels differ, max color error %d\n",
+              q.psnr, q.ssim, q.mse, q.num_diff, q.max_err);
+      return 0;
+   }
+
    /* Print version */
    printf ("srt %s\n", VERSION);
 
@@ -167,12 +341,64 @@ int main (void)
 
    /* Init scene */
    scene_init ();
+   startup_mark ("init");
    /* Load scene */
-   printf ("Loading scene (%s)...\n", SCENE_FILE);
-   if (xml_parse (SCENE_FILE))
+   if (binary)
+   {
+      printf ("Loading scene (%s)...\n", binary);
+      if (scene_load (scene_get_scene (), binary))
+      {
+         fprintf (stderr, "error: Scene could not be loaded.\n");
+         return 1;
+      }
+   }
+   else
    {
-      fprintf (stderr, "error: Scene could not be loaded.\n");
+      printf ("Loading scene (%s)...\n", SCENE_FILE);
+      if (xml_load ())
+      {
+         fprintf (stderr, "error: Scene could not be loaded.\n");
+         return 1;
+      }
+      startup_mark ("libxml2");
+      if (xml_parse (SCENE_FILE))
+      {
+         fprintf (stderr, "error: Scene could not be loaded.\n");
+         return 1;
+      }
+   }
+   startup_mark ("scene");
+
+   /* Publish the scene for the renders running in the background */
+   if (snapshot_publish (scene_get_scene (), NULL, 0))
       return 1;
+
+   /* Serve until killed */
+   if (server)
+   {
+      server_set_updates (1);
+      if (library && library_init (library, library_size))
+         return 1;
+      if (server_start (server, SERVER_CACHE_SIZE))
+         return 1;
+      return server_wait ();
+   }
+
+   /* Render once */
+   if (render)
+   {
+      if (render_scene (output_get_image (),
+                        output_get_image_size (),
+                        output_get_image_width (),
+                        output_get_image_height (),
+                        scene_get_scene ()))
+      {
+         fprintf (stderr, "error: Scene could not be rendered.\n");
+         return 1;
+      }
+      startup_mark ("render");
+      startup_report ();
+      return output_render ();
    }
 
    /* Enter CLI */